@@ -217,7 +217,13 @@ LOCAL_SRC_FILES := \
 		ePub3/ThirdParty/libzip/zip_unchange_archive.c \
 		ePub3/ThirdParty/libzip/zip_unchange_data.c \
 		ePub3/xml/utilities/io.cpp \
+		ePub3/xml/utilities/dictionary.cpp \
+		ePub3/xml/utilities/parser_pool.cpp \
+		ePub3/xml/utilities/entity_catalog.cpp \
+		ePub3/utilities/trace.cpp \
+		ePub3/xml/utilities/push_parser.cpp \
 		ePub3/xml/validation/schema.cpp \
+		ePub3/xml/validation/schema_pool.cpp \
 		ePub3/xml/tree/node.cpp \
 		ePub3/xml/tree/xpath.cpp \
 		ePub3/xml/validation/ns.cpp \
@@ -238,6 +244,8 @@ LOCAL_SRC_FILES := \
 		ePub3/ePub/nav_point.cpp \
 		ePub3/ePub/nav_table.cpp \
 		ePub3/ePub/glossary.cpp \
+		ePub3/ePub/document_cache.cpp \
+		ePub3/ePub/package_snapshot.cpp \
 		ePub3/ePub/library.cpp \
 		ePub3/ePub/font_obfuscation.cpp \
 		ePub3/ePub/encryption.cpp \
@@ -269,6 +277,7 @@ LOCAL_SRC_FILES := \
 		ePub3/ePub/media_support_info.cpp \
 		ePub3/utilities/byte_stream.cpp \
 		ePub3/utilities/ring_buffer.cpp \
+		ePub3/utilities/arena.cpp \
 		ePub3/utilities/run_loop_android.cpp \
 		Platform/Android/src/jni_cache_dir.c \
 		Platform/Android/src/backup_atomics.cpp
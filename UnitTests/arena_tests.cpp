@@ -0,0 +1,118 @@
+//
+//  arena_tests.cpp
+//  ePub3
+//
+//  Copyright (c) 2012-2013 The Readium Foundation and contributors.
+//
+//  The Readium SDK is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#include "../ePub3/utilities/arena.h"
+#include "catch.hpp"
+#include <algorithm>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+using namespace ePub3;
+
+namespace {
+
+struct Tracked
+{
+    Tracked(std::vector<int>& log, int n) : _log(log), _n(n), _name(std::string(64, 'x')) {}
+    ~Tracked() { _log.push_back(_n); }
+
+    std::vector<int>&   _log;
+    int                 _n;
+    std::string         _name;
+};
+
+struct alignas(32) Aligned
+{
+    char    bytes[3];
+};
+
+struct View
+{
+    virtual ~View() {}
+    void*   target;
+};
+
+}
+
+EPUB3_BEGIN_NAMESPACE
+template <>
+struct ArenaNeedsFinalizer<View> : std::false_type {};
+EPUB3_END_NAMESPACE
+
+TEST_CASE("Arena objects are destroyed with the arena, newest first", "")
+{
+    std::vector<int> log;
+    {
+        Arena arena(256);
+        for ( int i = 0; i < 100; i++ )
+        {
+            Tracked* t = arena.New<Tracked>(log, i);
+            REQUIRE(t->_n == i);
+        }
+        REQUIRE(log.empty());
+    }
+
+    REQUIRE(log.size() == 100);
+    for ( int i = 0; i < 100; i++ )
+    {
+        REQUIRE(log[i] == 99 - i);
+    }
+}
+
+TEST_CASE("Arena objects which own nothing need no finalizer", "")
+{
+    REQUIRE(ArenaNeedsFinalizer<Tracked>::value);
+    REQUIRE_FALSE(ArenaNeedsFinalizer<Aligned>::value);
+    REQUIRE_FALSE(ArenaNeedsFinalizer<View>::value);
+    
+    Arena arena(1024);
+    arena.New<View>();
+    size_t used = arena.BytesUsed();
+    for ( int i = 0; i < 10; i++ )
+    {
+        arena.New<View>();
+    }
+    REQUIRE(arena.BytesUsed() == used + 10 * sizeof(View));
+}
+
+TEST_CASE("Arena allocations honour alignment and size", "")
+{
+    Arena arena(1024);
+    REQUIRE(arena.BytesReserved() == 0);
+
+    for ( int i = 0; i < 50; i++ )
+    {
+        arena.Allocate(1, 1);
+        Aligned* a = arena.New<Aligned>();
+        REQUIRE((reinterpret_cast<uintptr_t>(a) % 32) == 0);
+    }
+
+    // an oversized allocation gets its own block without abandoning the current one
+    size_t used = arena.BytesUsed();
+    char* big = reinterpret_cast<char*>(arena.Allocate(4096));
+    std::fill(big, big+4096, 'a');
+    REQUIRE(arena.BytesUsed() >= used + 4096);
+    REQUIRE(arena.BytesReserved() >= arena.BytesUsed());
+
+    void* small = arena.Allocate(8);
+    REQUIRE(small != nullptr);
+    REQUIRE((reinterpret_cast<char*>(small) < big || reinterpret_cast<char*>(small) >= big + 4096));
+}
@@ -21,6 +21,9 @@
 
 #include "../ePub3/ePub/cfi.h"
 #include "catch.hpp"
+#include <chrono>
+#include <iostream>
+#include <sstream>
 
 using namespace ePub3;
 
@@ -89,3 +92,70 @@ TEST_CASE("Location and Range CFIs should be reassignable by CFI or string, even
     REQUIRE_NOTHROW(base = "/6/4!/4/3:5");
     REQUIRE_FALSE(base.IsRangeTriplet());
 }
+
+TEST_CASE("Long range CFIs should survive a round trip through parsing", "")
+{
+    static const char* kCFIs[] = {
+        "epubcfi(/6/14[chap05ref]!/4[body01]/10[para05]/2/1,/2[em02]/1:3[xx,y],/4[em03]/1:87)",
+        "epubcfi(/6/4[chap01ref]!/4[body01]/16[svgimg],/2~23.5@50.5:30,/2~24.5@60.5:40)",
+        u8"epubcfi(/6/16[夏目/漱石]!/4/2[第一章]/1:0[吾輩は猫],/3:2,/3:9)",
+        "epubcfi(/6/4!/4/2/3:5)",
+    };
+    
+    for ( const char* str : kCFIs )
+    {
+        CFI cfi(str);
+        REQUIRE(cfi.String() == str);
+        REQUIRE(CFI(cfi.String()) == cfi);
+    }
+    
+    REQUIRE(CFI(kCFIs[0]).IsRangeTriplet());
+    REQUIRE_FALSE(CFI(kCFIs[3]).IsRangeTriplet());
+    
+    // delimiters inside qualifiers don't split components or ranges
+    REQUIRE(CFI("/6/4[a/b,c]!/2") == CFI("epubcfi(/6/4[a/b,c]!/2)"));
+    REQUIRE_FALSE(CFI("/6/4[a/b,c]!/2") == CFI("/6/4[a]!/2"));
+    
+    REQUIRE_THROWS_AS(CFI("/6/4[chap01!/2"), CFI::InvalidCFI&);
+    REQUIRE_THROWS_AS(CFI("/6/x"), CFI::InvalidCFI&);
+    REQUIRE_THROWS_AS(CFI("/6/4:"), CFI::InvalidCFI&);
+    REQUIRE_THROWS_AS(CFI("/6/99999999999"), CFI::InvalidCFI&);
+    REQUIRE_THROWS_AS(CFI("/6/4,/2/1:3,/2/1~4"), CFI::InvalidCFI&);
+    REQUIRE_THROWS_AS(CFI("/6/4,/2/1,/2/1,/2/1"), CFI::InvalidCFI&);
+}
+
+TEST_CASE("Benchmark: parsing long range CFIs", "[hide][benchmark]")
+{
+    static const int kIterations = 20000;
+    
+    // what a reading system stores for a highlight: a deep path, with id assertions on most steps
+    std::stringstream deep;
+    deep << "epubcfi(/6/24[chapter12]!/4[body]";
+    for ( int i = 0; i < 24; i++ )
+        deep << "/" << (i*2+2) << "[section" << i << "]";
+    deep << "/3,/2[para18]/1:114,/6[para20]/3:42)";
+    
+    const std::vector<string> cfis = {
+        deep.str(),
+        "epubcfi(/6/14[chap05ref]!/4[body01]/10[para05]/2/1,/2[em02]/1:3,/4[em03]/1:87)",
+        u8"epubcfi(/6/16[夏目漱石]!/4/2[第一章]/10/4/2/6/1,/3:2,/7:9)",
+        "epubcfi(/6/4[chap01ref]!/4[body01]/16[svgimg]/2,/2~23.5@50.5:30,/2~24.5@60.5:40)",
+    };
+    
+    size_t ranges = 0, bytes = 0;
+    auto start = std::chrono::steady_clock::now();
+    for ( int i = 0; i < kIterations; i++ )
+    {
+        for ( auto& str : cfis )
+        {
+            CFI cfi(str);
+            if ( cfi.IsRangeTriplet() )
+                ranges++;
+            bytes += str.stl_str().size();
+        }
+    }
+    auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start);
+    
+    REQUIRE(ranges == cfis.size() * kIterations);
+    std::cout << "Parsed " << ranges << " range CFIs (" << (bytes >> 20) << "MB) in " << elapsed.count() << "ms" << std::endl;
+}
@@ -20,11 +20,17 @@
 //
 
 #include "../ePub3/ePub/container.h"
+#include "../ePub3/ePub/package.h"
+#include "../ePub3/utilities/byte_stream.h"
 #include "catch.hpp"
+#include "temporary_files.h"
+#include <thread>
+#include <vector>
 
 using namespace ePub3;
 
 #define EPUB_PATH "TestData/childrens-literature-20120722.epub"
+#define OBFUSCATED_EPUB_PATH "TestData/wasteland-otf-obf-20120118.epub"
 
 TEST_CASE("opening a container", "The container should open without problem")
 {
@@ -50,3 +56,180 @@ TEST_CASE("", "Version should be 1.0")
     Container container(EPUB_PATH);
     REQUIRE(container.Version() == "1.0");
 }
+
+TEST_CASE("Lazy containers should only load packages on demand", "")
+{
+    Container container(EPUB_PATH, true);
+    REQUIRE(container.LoadsPackagesLazily());
+    REQUIRE(container.PackageCount() == 1);
+    REQUIRE(container.PackageLocations().size() == 1);
+    
+    const Package* pkg = container.DefaultPackage();
+    REQUIRE(pkg != nullptr);
+    REQUIRE(container.PackageAt(0) == pkg);
+    REQUIRE(container.PackageAt(1) == nullptr);
+    REQUIRE(container.Packages().size() == 1);
+    REQUIRE(container.Packages()[0] == pkg);
+}
+
+static const char* gRootfilesXML = R"XML(<?xml version="1.0" encoding="utf-8"?>
+<container xmlns="urn:oasis:names:tc:opendocument:xmlns:container" version="1.0">
+  <rootfiles>
+    <rootfile media-type="application/oebps-package+xml" full-path="EPUB/package.opf"/>
+    <rootfile media-type="application/oebps-package+xml" full-path="EPUB/package.opf"/>
+    <rootfile media-type="application/oebps-package+xml" full-path="EPUB/package.opf"/>
+    <rootfile media-type="application/oebps-package+xml" full-path="EPUB/package.opf"/>
+  </rootfiles>
+</container>)XML";
+
+static const char* gBrokenRootfilesXML = R"XML(<?xml version="1.0" encoding="utf-8"?>
+<container xmlns="urn:oasis:names:tc:opendocument:xmlns:container" version="1.0">
+  <rootfiles>
+    <rootfile media-type="application/oebps-package+xml" full-path="EPUB/package.opf"/>
+    <rootfile media-type="application/oebps-package+xml" full-path="EPUB/missing-one.opf"/>
+    <rootfile media-type="application/oebps-package+xml" full-path="EPUB/missing-two.opf"/>
+  </rootfiles>
+</container>)XML";
+
+TEST_CASE("Multi-rendition containers should load all their packages concurrently", "")
+{
+    TemporaryArchive copy(EPUB_PATH, "META-INF/container.xml", [](std::string& xml) { xml = gRootfilesXML; });
+    std::string path = copy.Path();
+    REQUIRE(!path.empty());
+    
+    Container::SetLoaderThreadCount(4);
+    {
+        Container serialReference(EPUB_PATH);
+        const Package* reference = serialReference.DefaultPackage();
+        
+        Container container(path);
+        REQUIRE(container.PackageCount() == 4);
+        
+        auto& packages = container.Packages();
+        REQUIRE(packages.size() == 4);
+        for ( size_t i = 0; i < packages.size(); i++ )
+        {
+            REQUIRE(packages[i] != nullptr);
+            REQUIRE(container.PackageAt(i) == packages[i]);
+            REQUIRE(packages[i]->UniqueID() == reference->UniqueID());
+            REQUIRE(packages[i]->Manifest().size() == reference->Manifest().size());
+            REQUIRE(packages[i]->NavigationTables().size() == reference->NavigationTables().size());
+            for ( size_t j = 0; j < i; j++ )
+            {
+                REQUIRE(packages[i] != packages[j]);
+            }
+        }
+    }
+    Container::SetLoaderThreadCount(0);
+    REQUIRE(Container::LoaderThreadCount() >= 1);
+    REQUIRE(Container::LoaderThreadCount() <= 4);
+}
+
+static std::string ReadWholeStream(ByteStream* stream)
+{
+    std::string result;
+    char buf[1024];
+    ByteStream::size_type numRead = 0;
+    while ( (numRead = stream->ReadBytes(buf, sizeof(buf))) > 0 )
+        result.append(buf, numRead);
+    return result;
+}
+
+TEST_CASE("Byte streams from one archive should be readable concurrently", "")
+{
+    Container container(EPUB_PATH);
+    const Package* pkg = container.DefaultPackage();
+    REQUIRE(pkg != nullptr);
+    
+    std::vector<std::string> paths;
+    std::vector<std::string> expected;
+    for ( auto& pair : pkg->Manifest() )
+    {
+        std::string path(pair.second->AbsolutePath().stl_str());
+        auto stream = container.ReadStreamAtPath(path);
+        REQUIRE(stream->IsOpen());
+        paths.push_back(path);
+        expected.push_back(ReadWholeStream(stream.get()));
+    }
+    REQUIRE(paths.size() > 1);
+    
+    // every thread opens and reads every item, in a different order
+    const size_t numThreads = 4;
+    std::vector<std::vector<std::string>> results(numThreads, std::vector<std::string>(paths.size()));
+    std::vector<std::thread> threads;
+    for ( size_t t = 0; t < numThreads; t++ )
+    {
+        threads.emplace_back([&, t]() {
+            for ( size_t n = 0; n < paths.size(); n++ )
+            {
+                size_t i = (n + t * 3) % paths.size();
+                auto stream = container.ReadStreamAtPath(paths[i]);
+                results[t][i] = ReadWholeStream(stream.get());
+            }
+        });
+    }
+    for ( auto& thread : threads )
+    {
+        thread.join();
+    }
+    
+    for ( size_t t = 0; t < numThreads; t++ )
+    {
+        for ( size_t i = 0; i < paths.size(); i++ )
+        {
+            REQUIRE((results[t][i] == expected[i]));
+        }
+    }
+}
+
+TEST_CASE("Package load failures should be reported together", "")
+{
+    TemporaryArchive copy(EPUB_PATH, "META-INF/container.xml", [](std::string& xml) { xml = gBrokenRootfilesXML; });
+    std::string path = copy.Path();
+    REQUIRE(!path.empty());
+    
+    std::string message;
+    try
+    {
+        Container container(path);
+    }
+    catch (std::invalid_argument& e)
+    {
+        message = e.what();
+    }
+    
+    REQUIRE(message.find("2 of 3 packages") != std::string::npos);
+    REQUIRE(message.find("EPUB/missing-one.opf") != std::string::npos);
+    REQUIRE(message.find("EPUB/missing-two.opf") != std::string::npos);
+    
+    // lazy containers keep the packages which did load
+    Container lazy(path, true);
+    REQUIRE_THROWS(lazy.Packages());
+    REQUIRE(lazy.PackageAt(0) != nullptr);
+    REQUIRE_THROWS(lazy.PackageAt(1));
+}
+
+TEST_CASE("Obfuscated fonts should not need an encryption key", "")
+{
+    Container container(OBFUSCATED_EPUB_PATH);
+    REQUIRE(container.EncryptionData().size() == 3);
+    
+    const EncryptionInfo* info = container.EncryptionInfoForPath("EPUB/OldStandard-Regular.obf.otf");
+    REQUIRE(info != nullptr);
+    REQUIRE(info->Algorithm() == "http://www.idpf.org/2008/embedding");
+    REQUIRE(info->Path() == "EPUB/OldStandard-Regular.obf.otf");
+    REQUIRE(info->Retrieval_Method().empty());
+    REQUIRE(info->KeyIV().empty());
+    
+    // an entry which names a key can't be used without one
+    TemporaryArchive copy(OBFUSCATED_EPUB_PATH, "META-INF/encryption.xml", [](std::string& xml) {
+        std::string method("<EncryptionMethod Algorithm=\"http://www.idpf.org/2008/embedding\"/>");
+        xml.replace(xml.find(method), method.size(), std::string(method).append("<KeyInfo xmlns=\"http://www.w3.org/2000/09/xmldsig#\"><RetrievalMethod URI=\"#missing-key\"/></KeyInfo>"));
+    });
+    REQUIRE(!copy.Path().empty());
+    
+    Container keyed(copy.Path());
+    REQUIRE(keyed.EncryptionData().size() == 3);
+    REQUIRE(keyed.EncryptionInfoForPath("EPUB/OldStandard-Bold.obf.otf") == nullptr);
+    REQUIRE(keyed.EncryptionInfoForPath("EPUB/OldStandard-Regular.obf.otf") != nullptr);
+}
@@ -0,0 +1,157 @@
+//
+//  filter_pipeline_tests.cpp
+//  ePub3
+//
+//  Copyright (c) 2012-2013 The Readium Foundation and contributors.
+//
+//  The Readium SDK is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#include "../ePub3/ePub/container.h"
+#include "../ePub3/ePub/filter_pipeline.h"
+#include "../ePub3/ePub/package.h"
+#include "../ePub3/utilities/byte_stream.h"
+#include "catch.hpp"
+
+#define EPUB_PATH "TestData/wasteland-otf-obf-20120118.epub"
+#define FONT_SUBPATH "EPUB/OldStandard-Regular.obf.otf"
+#define FONT_MANIFEST_ID "font.OldStandard.regular"
+
+using namespace ePub3;
+
+class FailingFilter : public ContentFilter
+{
+public:
+    FailingFilter() : ContentFilter([](const ManifestItem*, const EncryptionInfo*) { return true; }) {}
+    FailingFilter(FailingFilter&& o) : ContentFilter(std::move(o)) {}
+    virtual void* FilterData(void* /*data*/, size_t /*len*/, size_t* outputLen) { *outputLen = 0; return nullptr; }
+};
+
+class CountingFilter : public ContentFilter
+{
+public:
+    CountingFilter(int* calls) : ContentFilter([](const ManifestItem*, const EncryptionInfo*) { return true; }), _calls(calls) {}
+    CountingFilter(CountingFilter&& o) : ContentFilter(std::move(o)), _calls(o._calls) {}
+    virtual void* FilterData(void* data, size_t len, size_t* outputLen) { (*_calls)++; *outputLen = len; return data; }
+    
+private:
+    int*    _calls;
+};
+
+TEST_CASE("Pipelines sniff using each stage's own sniffer", "")
+{
+    Container c(EPUB_PATH);
+    const Package* pkg = c.Packages()[0];
+    const ManifestItem* manifestItem = pkg->ManifestItemWithID(FONT_MANIFEST_ID);
+    const EncryptionInfo* encInfo = c.EncryptionInfoForPath(FONT_SUBPATH);
+    
+    StandardFilterPipeline pipeline{FontObfuscator(&c), SwitchPreprocessor(), ObjectPreprocessor(pkg)};
+    REQUIRE(pipeline.TypeSniffer()(manifestItem, encInfo));
+    REQUIRE_FALSE(pipeline.RequiresCompleteData());
+    
+    REQUIRE_FALSE(pipeline.TypeSniffer()(manifestItem, nullptr));
+}
+
+TEST_CASE("A pipeline's output matches that of its individual filters", "")
+{
+    Container c(EPUB_PATH);
+    const Package* pkg = c.Packages()[0];
+    const ManifestItem* manifestItem = pkg->ManifestItemWithID(FONT_MANIFEST_ID);
+    const EncryptionInfo* encInfo = c.EncryptionInfoForPath(FONT_SUBPATH);
+    
+    auto stream = c.ReadStreamAtPath(FONT_SUBPATH);
+    REQUIRE_FALSE(stream == nullptr);
+    
+    uint8_t bytes[1080], expected[1080];
+    ssize_t numRead = stream->ReadBytes(bytes, 1080);
+    REQUIRE(numRead == 1080);
+    memcpy(expected, bytes, sizeof(bytes));
+    
+    size_t outLen = 0;
+    FontObfuscator obfuscator(&c);
+    obfuscator.FilterData(expected, numRead, &outLen);
+    
+    // feed the pipeline in uneven chunks to exercise the stream offsets
+    FilterPipeline<FontObfuscator> pipeline{FontObfuscator(&c)};
+    REQUIRE(pipeline.Bind(manifestItem, encInfo));
+    
+    size_t chunks[] = { 7, 500, 533, 40 };
+    uint8_t* p = bytes;
+    for ( size_t chunk : chunks )
+    {
+        void* output = pipeline.FilterData(p, chunk, &outLen);
+        REQUIRE(output == p);
+        REQUIRE(outLen == chunk);
+        p += chunk;
+    }
+    
+    REQUIRE(memcmp(bytes, expected, sizeof(bytes)) == 0);
+}
+
+TEST_CASE("Adjacent byte transforms are fused", "")
+{
+    Container c(EPUB_PATH);
+    const Package* pkg = c.Packages()[0];
+    const ManifestItem* manifestItem = pkg->ManifestItemWithID(FONT_MANIFEST_ID);
+    const EncryptionInfo* encInfo = c.EncryptionInfoForPath(FONT_SUBPATH);
+    
+    auto stream = c.ReadStreamAtPath(FONT_SUBPATH);
+    REQUIRE_FALSE(stream == nullptr);
+    
+    uint8_t bytes[1080], original[1080];
+    ssize_t numRead = stream->ReadBytes(bytes, 1080);
+    REQUIRE(numRead == 1080);
+    memcpy(original, bytes, sizeof(bytes));
+    
+    // the algorithm is its own inverse, so two passes must leave the data untouched
+    FilterPipeline<FontObfuscator, FontObfuscator> pipeline{FontObfuscator(&c), FontObfuscator(&c)};
+    
+    size_t outLen = 0;
+    void* output = pipeline.FilterData(manifestItem, encInfo, bytes, numRead, &outLen);
+    REQUIRE(output == bytes);
+    REQUIRE(outLen == static_cast<size_t>(numRead));
+    REQUIRE(memcmp(bytes, original, sizeof(bytes)) == 0);
+}
+
+TEST_CASE("A pipeline stops at the first stage which fails", "")
+{
+    int calls = 0;
+    FilterPipeline<FailingFilter, CountingFilter> pipeline{FailingFilter(), CountingFilter(&calls)};
+    
+    char bytes[] = "data";
+    size_t outLen = 1;
+    REQUIRE(pipeline.FilterData(nullptr, nullptr, bytes, sizeof(bytes), &outLen) == nullptr);
+    REQUIRE(outLen == 0);
+    REQUIRE(calls == 0);
+}
+
+TEST_CASE("A pipeline's assigned type-sniffer restricts the items it applies to", "")
+{
+    int calls = 0;
+    FilterPipeline<CountingFilter> pipeline{CountingFilter(&calls)};
+    
+    pipeline.SetTypeSniffer([](const ManifestItem*, const EncryptionInfo*) { return false; });
+    REQUIRE_FALSE(pipeline.TypeSniffer()(nullptr, nullptr));
+    
+    char bytes[] = "data";
+    size_t outLen = 0;
+    REQUIRE(pipeline.FilterData(nullptr, nullptr, bytes, sizeof(bytes), &outLen) == bytes);
+    REQUIRE(outLen == sizeof(bytes));
+    REQUIRE(calls == 0);
+    
+    pipeline.SetTypeSniffer(nullptr);
+    REQUIRE(pipeline.TypeSniffer()(nullptr, nullptr));
+    REQUIRE(pipeline.FilterData(nullptr, nullptr, bytes, sizeof(bytes), &outLen) == bytes);
+    REQUIRE(calls == 1);
+}
@@ -24,6 +24,7 @@
 #include "../ePub3/ePub/metadata.h"
 #include "../ePub3/utilities/iri.h"
 #include "catch.hpp"
+#include "temporary_files.h"
 #include <type_traits>
 
 #define EPUB_PATH "TestData/childrens-literature-20120722.epub"
@@ -61,6 +62,120 @@ TEST_CASE("Metadata should be identified by property IRIs", "")
     }
 }
 
+TEST_CASE("Indexed metadata lookups should match a scan of all items", "")
+{
+    const Package* pkg = GetContainer()->Packages()[0];
+    const Package::MetadataMap& metadata = pkg->Metadata();
+    
+    auto scan = [&](const IRI& iri) {
+        Package::MetadataMap result;
+        for ( auto item : metadata )
+        {
+            bool match = (item->Property() == iri);
+            for ( auto extension : item->Extensions() )
+            {
+                if ( !extension->Property().IsEmpty() && extension->Property() == iri )
+                    match = true;
+            }
+            if ( match )
+                result.push_back(item);
+        }
+        return result;
+    };
+    
+    for ( auto item : metadata )
+    {
+        REQUIRE((pkg->MetadataItemsWithProperty(item->Property()) == scan(item->Property())));
+        for ( auto extension : item->Extensions() )
+        {
+            if ( !extension->Property().IsEmpty() )
+                REQUIRE((pkg->MetadataItemsWithProperty(extension->Property()) == scan(extension->Property())));
+        }
+    }
+    
+    for ( auto type : { Metadata::DCType::Identifier, Metadata::DCType::Title, Metadata::DCType::Creator, Metadata::DCType::Subject, Metadata::DCType::Coverage } )
+    {
+        REQUIRE((pkg->MetadataItemsWithDCType(type) == scan(Metadata::IRIForDCType(type))));
+    }
+    
+    // results come straight from the index
+    const Package::MetadataMap& titles = pkg->MetadataItemsWithDCType(Metadata::DCType::Title);
+    REQUIRE(!titles.empty());
+    REQUIRE(&titles == &pkg->MetadataItemsWithDCType(Metadata::DCType::Title));
+    REQUIRE(pkg->MetadataItemsWithProperty(IRI("http://example.com/no-such-property")).empty());
+    REQUIRE(pkg->MetadataItemsWithProperty(IRI()).empty());
+}
+
+TEST_CASE("DC type lookups should include items refined with that DC property", "")
+{
+    TemporaryArchive copy(EPUB_PATH, "EPUB/package.opf", [](std::string& opf) {
+        std::string pkg("<package ");
+        opf.replace(opf.find(pkg), pkg.size(), std::string(pkg).append("prefix=\"dcel: http://purl.org/dc/elements/1.1/\" "));
+        std::string fileAs("<meta property=\"file-as\" refines=\"#curry\">");
+        opf.replace(opf.find(fileAs), fileAs.size(), std::string("<meta property=\"dcel:contributor\" refines=\"#curry\">editor</meta>").append(fileAs));
+    });
+    REQUIRE(!copy.Path().empty());
+    
+    Container c(copy.Path());
+    const Package* pkg = c.Packages()[0];
+    
+    const Package::MetadataMap& contributors = pkg->MetadataItemsWithDCType(Metadata::DCType::Contributor);
+    REQUIRE(contributors.size() == 1);
+    REQUIRE(contributors[0]->Type() == Metadata::DCType::Creator);
+    REQUIRE(contributors[0]->Identifier() == "curry");
+    REQUIRE(pkg->MetadataItemsWithDCType(Metadata::DCType::Creator).size() == 2);
+}
+
+TEST_CASE("Property IRIs should be interned", "")
+{
+    IRI atom = IRI::Interned("http://Example.com/vocab#term");
+    IRI same = IRI::Interned("http://example.com/vocab#term");
+    IRI plain("http://example.com/vocab#term");
+    REQUIRE(atom.IsInterned());
+    REQUIRE_FALSE(plain.IsInterned());
+    
+    // spellings of the same URL share one atom
+    REQUIRE((atom == same));
+    REQUIRE((atom == plain));
+    REQUIRE((plain == atom));
+    REQUIRE_FALSE((atom < plain));
+    REQUIRE_FALSE((plain < atom));
+    REQUIRE((atom != IRI::Interned("http://example.com/vocab#other")));
+    REQUIRE(atom.URIString() == plain.URIString());
+    
+    // copies share the atom, and components are still available
+    IRI copy(atom);
+    REQUIRE(copy.IsInterned());
+    REQUIRE(copy.Host() == "example.com");
+    REQUIRE(copy.Fragment() == "term");
+    
+    // modifying a copy leaves the atom alone
+    copy.SetFragment("changed");
+    REQUIRE_FALSE(copy.IsInterned());
+    REQUIRE((copy != atom));
+    REQUIRE(copy.URIString() == "http://example.com/vocab#changed");
+    REQUIRE(atom.Fragment() == "term");
+    
+    // package properties from well-known vocabularies are interned
+    const Package* pkg = GetContainer()->Packages()[0];
+    for ( auto item : pkg->Metadata() )
+    {
+        REQUIRE(item->Property().IsInterned());
+        for ( auto extension : item->Extensions() )
+        {
+            REQUIRE(extension->Property().IsInterned());
+        }
+    }
+    REQUIRE(pkg->MetadataItemsWithProperty(IRI::Interned("http://purl.org/dc/terms/modified")).size() == 1);
+    
+    // but the open set of other properties is not, as interned IRIs are never released
+    IRI known = pkg->PropertyIRIFromAttributeValue("dcterms:modified");
+    IRI unknown = pkg->PropertyIRIFromAttributeValue("dcterms:not-a-real-term");
+    REQUIRE(known.IsInterned());
+    REQUIRE_FALSE(unknown.IsInterned());
+    REQUIRE((unknown == IRI("http://purl.org/dc/terms/not-a-real-term")));
+}
+
 TEST_CASE("Title(), Subtitle(), and FullTitle() should work as expected", "")
 {
     const Package* pkg = GetContainer()->Packages()[0];
@@ -95,6 +210,37 @@ TEST_CASE("Simple string metadata values should be correct", "")
     REQUIRE(pkg->ModificationDate() == "2010-02-17T04:39:13Z");
 }
 
+TEST_CASE("Memoized identity and display metadata should survive invalidation", "")
+{
+    Container c(EPUB_PATH);
+    Package* pkg = c.Packages()[0];
+    
+    string uniqueID = pkg->UniqueID();
+    string urlSafeID = pkg->URLSafeUniqueID();
+    string title = pkg->Title();
+    string fullTitle = pkg->FullTitle();
+    string authors = pkg->Authors();
+    Package::AttributionList attribution = pkg->AttributionNames();
+    
+    // stored values are handed back from here on
+    REQUIRE(pkg->UniqueID() == uniqueID);
+    REQUIRE(pkg->Title() == title);
+    REQUIRE(pkg->Authors() == authors);
+    
+    // localized and unlocalized values are kept apart
+    REQUIRE(pkg->Title(false) == title);
+    REQUIRE(pkg->Authors(false) == authors);
+    
+    pkg->InvalidateMetadataCache();
+    REQUIRE(pkg->UniqueID() == uniqueID);
+    REQUIRE(pkg->URLSafeUniqueID() == urlSafeID);
+    REQUIRE(pkg->URLSafeUniqueID() == "http://www.gutenberg.org/ebooks/25545_2010-02-17");
+    REQUIRE(pkg->PackageID() == "http://www.gutenberg.org/ebooks/25545");
+    REQUIRE(pkg->ModificationDate() == "2010-02-17T04:39:13Z");
+    REQUIRE(pkg->FullTitle() == fullTitle);
+    REQUIRE(pkg->AttributionNames() == attribution);
+}
+
 TEST_CASE("An appropriately localized value should be returned if available", "")
 {
     Container c(LOCALIZED_EPUB_PATH);
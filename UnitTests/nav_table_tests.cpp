@@ -0,0 +1,120 @@
+//
+//  nav_table_tests.cpp
+//  ePub3
+//
+//  Copyright (c) 2012-2013 The Readium Foundation and contributors.
+//
+//  The Readium SDK is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#include "../ePub3/ePub/nav_table.h"
+#include "catch.hpp"
+#include <libxml/parser.h>
+#include <chrono>
+#include <iostream>
+#include <sstream>
+
+using namespace ePub3;
+
+static const char* kNavDocument = R"X(<?xml version="1.0" encoding="UTF-8"?>
+<html xmlns="http://www.w3.org/1999/xhtml" xmlns:epub="http://www.idpf.org/2007/ops">
+<body>
+<nav epub:type="toc">
+  <h2>Contents</h2>
+  <ol>
+    <li><a href="one.xhtml">Chapter <b>One</b></a>
+      <ol>
+        <li><a href="one.xhtml#a">Part <i>A</i> &amp; more</a></li>
+        <li><span>Unlinked</span></li>
+      </ol>
+    </li>
+    <li><a href="two.xhtml">Chapter <em>Two</em></a></li>
+  </ol>
+</nav>
+</body>
+</html>)X";
+
+static xmlNodePtr FindNavNode(xmlNodePtr node)
+{
+    for ( ; node != nullptr; node = node->next )
+    {
+        if ( node->type != XML_ELEMENT_NODE )
+            continue;
+        if ( xmlStrEqual(node->name, BAD_CAST "nav") )
+            return node;
+
+        xmlNodePtr found = FindNavNode(node->children);
+        if ( found != nullptr )
+            return found;
+    }
+    return nullptr;
+}
+
+TEST_CASE("Navigation tables are built from nested ordered lists", "")
+{
+    xmlDocPtr doc = xmlReadMemory(kNavDocument, static_cast<int>(strlen(kNavDocument)), "nav.xhtml", nullptr, 0);
+    REQUIRE(doc != nullptr);
+
+    NavigationTable table(FindNavNode(xmlDocGetRootElement(doc)), "nav.xhtml");
+    REQUIRE(table.Type() == "toc");
+    REQUIRE(table.Title() == "Contents");
+    REQUIRE(table.Children().size() == 2);
+
+    const NavigationElement* one = table.Children()[0];
+    REQUIRE(one->Title() == "Chapter <b>One</b>");
+    REQUIRE(one->SourceHref() == "one.xhtml");
+    REQUIRE(one->Children().size() == 2);
+    REQUIRE(one->Children()[0]->Title() == "Part <i>A</i> & more");
+    REQUIRE(one->Children()[0]->SourceHref() == "one.xhtml#a");
+    REQUIRE(one->Children()[1]->Title() == "Unlinked");
+    REQUIRE(one->Children()[1]->SourceHref().empty());
+
+    // only bold and italic markup survives
+    REQUIRE(table.Children()[1]->Title() == "Chapter Two");
+
+    xmlFreeDoc(doc);
+}
+
+TEST_CASE("Benchmark: a synthetic 100,000 entry table of contents", "[hide][benchmark]")
+{
+    static const int kChapters = 1000, kSections = 99;
+
+    std::stringstream ss;
+    ss << R"X(<html xmlns="http://www.w3.org/1999/xhtml" xmlns:epub="http://www.idpf.org/2007/ops"><body><nav epub:type="toc"><ol>)X";
+    for ( int i = 0; i < kChapters; i++ )
+    {
+        ss << "<li><a href=\"c" << i << ".xhtml\">Chapter <b>" << i << "</b></a><ol>";
+        for ( int j = 0; j < kSections; j++ )
+        {
+            ss << "<li><a href=\"c" << i << ".xhtml#s" << j << "\">Section <i>" << j << "</i></a></li>";
+        }
+        ss << "</ol></li>";
+    }
+    ss << "</ol></nav></body></html>";
+
+    std::string xml(ss.str());
+    xmlDocPtr doc = xmlReadMemory(xml.data(), static_cast<int>(xml.size()), "nav.xhtml", nullptr, XML_PARSE_HUGE);
+    REQUIRE(doc != nullptr);
+
+    xmlNodePtr navNode = FindNavNode(xmlDocGetRootElement(doc));
+    auto start = std::chrono::steady_clock::now();
+    NavigationTable table(navNode, "nav.xhtml");
+    auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start);
+
+    REQUIRE(table.Children().size() == kChapters);
+    REQUIRE(table.Children().back()->Children().size() == kSections);
+    std::cout << "Built " << kChapters * (kSections + 1) << " navigation points in " << elapsed.count() << "ms" << std::endl;
+
+    xmlFreeDoc(doc);
+}
@@ -22,8 +22,26 @@
 #include "../ePub3/ePub/container.h"
 #include "../ePub3/ePub/package.h"
 #include "../ePub3/ePub/content_handler.h"
+#include "../ePub3/ePub/package_snapshot.h"
+#include "../ePub3/ePub/nav_table.h"
+#include "../ePub3/ePub/media_support_info.h"
+#include "../ePub3/utilities/trace.h"
+#include "../ePub3/xml/utilities/parser_pool.h"
+#include "../ePub3/xml/utilities/dictionary.h"
+#include "../ePub3/xml/utilities/entity_catalog.h"
+#include "../ePub3/xml/utilities/push_parser.h"
+#include "../ePub3/xml/validation/schema_pool.h"
 #include "catch.hpp"
+#include "temporary_files.h"
+#include <algorithm>
+#include <chrono>
 #include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <thread>
+#include <dirent.h>
 
 #define EPUB_PATH "TestData/childrens-literature-20120722.epub"
 #define BINDINGS_EPUB_PATH "TestData/widget-figure-gallery-20121022.epub"
@@ -93,6 +111,209 @@ TEST_CASE("Package should have multiple spine items", "")
     REQUIRE(pkg->SpineItemAt(idx) == (*pkg)[idx]);
 }
 
+TEST_CASE("Manifest items should be found by the paths of their resources", "")
+{
+    Container c(EPUB_PATH);
+    Package* pkg = c.Packages()[0];
+    
+    for ( auto& pair : pkg->Manifest() )
+    {
+        REQUIRE(pkg->ManifestItemWithID(pair.first) == pair.second);
+        REQUIRE(pkg->ManifestItemAtPath(pair.second->AbsolutePath()) == pair.second);
+    }
+    
+    const ManifestItem* s04 = pkg->ManifestItemWithID("s04");
+    REQUIRE(pkg->ManifestItemAtPath("EPUB/s04.xhtml") == s04);
+    REQUIRE(pkg->ManifestItemAtPath("/EPUB/s04.xhtml#section1") == s04);
+    REQUIRE(pkg->ManifestItemAtPath("EPUB/./css/../%73%304.xhtml") == s04);
+    REQUIRE(pkg->ManifestItemAtPath("EPUB//images/cover.png") == pkg->ManifestItemWithID("cover-img"));
+    REQUIRE(pkg->ManifestItemAtPath("s04.xhtml") == nullptr);
+    REQUIRE(pkg->ManifestItemAtPath("EPUB/missing.xhtml") == nullptr);
+}
+
+TEST_CASE("Spine lookups should take account of non-linear and repeated items", "")
+{
+    TemporaryArchive copy(EPUB_PATH, "EPUB/package.opf", [](std::string& opf) {
+        std::string nav("<itemref idref=\"nav\"/>");
+        opf.replace(opf.find(nav), nav.size(), "<itemref idref=\"nav\" linear=\"no\"/>");
+        std::string last("<itemref idref=\"s04\"/>");
+        opf.replace(opf.find(last), last.size(), std::string(last).append("<itemref idref=\"cover\" linear=\"no\"/>"));
+    });
+    std::string path = copy.Path();
+    REQUIRE(!path.empty());
+    
+    {
+        Container c(path);
+        Package* pkg = c.Packages()[0];
+        REQUIRE(pkg->SpineItemCount() == 4);
+        
+        const SpineItem* cover = pkg->SpineItemAt(0);
+        const SpineItem* nav = pkg->SpineItemAt(1);
+        const SpineItem* s04 = pkg->SpineItemAt(2);
+        const SpineItem* repeat = pkg->SpineItemAt(3);
+        REQUIRE(pkg->SpineItemAt(4) == nullptr);
+        
+        // positions agree with the linked list
+        size_t i = 0;
+        for ( const SpineItem* item = pkg->FirstSpineItem(); item != nullptr; item = item->Next(), i++ )
+        {
+            REQUIRE(item == pkg->SpineItemAt(i));
+            REQUIRE(item->Index() == i);
+            REQUIRE(item->Count() == 4 - i);
+        }
+        REQUIRE(repeat->Previous() == s04);
+        
+        // the first of several items with the same idref wins
+        REQUIRE(pkg->IndexOfSpineItemWithIDRef("cover") == 0);
+        REQUIRE(pkg->IndexOfSpineItemWithIDRef("s04") == 2);
+        REQUIRE(pkg->IndexOfSpineItemWithIDRef("missing") == size_t(-1));
+        REQUIRE(pkg->SpineItemWithIDRef("nav") == nav);
+        REQUIRE(pkg->SpineItemWithIDRef("missing") == nullptr);
+        
+        // stepping skips the non-linear items
+        REQUIRE(cover->NextStep() == s04);
+        REQUIRE(nav->NextStep() == s04);
+        REQUIRE(s04->NextStep() == nullptr);
+        REQUIRE(repeat->NextStep() == nullptr);
+        REQUIRE(cover->PriorStep() == nullptr);
+        REQUIRE(nav->PriorStep() == cover);
+        REQUIRE(s04->PriorStep() == cover);
+        REQUIRE(repeat->PriorStep() == s04);
+        
+        REQUIRE(s04->at(-2) == cover);
+        REQUIRE(s04->at(1) == repeat);
+        REQUIRE_THROWS_AS(s04->at(2), std::out_of_range&);
+        REQUIRE_THROWS_AS(s04->at(-3), std::out_of_range&);
+        
+        // a CFI with the wrong index is corrected using its qualifier
+        CFI cfi(_Str("epubcfi(/", pkg->SpineCFIIndex(), "/2[s04]!/4/2)"));
+        CFI remainder;
+        REQUIRE(pkg->ManifestItemForCFI(cfi, &remainder) == s04->ManifestItem());
+        REQUIRE((remainder == CFI("/4/2")));
+    }
+}
+
+TEST_CASE("Manifest items should be indexed by media type", "")
+{
+    Container c(EPUB_PATH);
+    Package* pkg = c.Packages()[0];
+    
+    const Package::ManifestItemList& xhtml = pkg->ManifestItemsWithMediaType("application/xhtml+xml");
+    REQUIRE(xhtml.size() == 3);
+    REQUIRE(xhtml[0] == pkg->ManifestItemWithID("cover"));
+    REQUIRE(xhtml[1] == pkg->ManifestItemWithID("s04"));
+    REQUIRE(xhtml[2] == pkg->ManifestItemWithID("nav"));
+    REQUIRE(pkg->ManifestItemsWithMediaType("image/png").size() == 1);
+    REQUIRE(pkg->ManifestItemsWithMediaType("image/gif").empty());
+    
+    Package::StringList types = { "application/xhtml+xml", "image/png", "text/css" };
+    REQUIRE(pkg->AllMediaTypes() == types);
+    REQUIRE(pkg->UnsupportedMediaTypes().empty());
+    REQUIRE(pkg->MediaSupport().size() == 3);
+    
+    MediaSupportInfo info("application/xhtml+xml");
+    MediaSupportInfo::ManifestItemList matches = info.MatchingManifestItems(pkg);
+    REQUIRE(matches.size() == 3);
+    REQUIRE(matches.front() == pkg->ManifestItemWithID("cover"));
+    REQUIRE(MediaSupportInfo("text/css").MatchingManifestItems(pkg).front() == pkg->ManifestItemWithID("css"));
+}
+
+TEST_CASE("Property lists and prefixes should be tokenized correctly", "")
+{
+    REQUIRE((ItemProperties("cover-image") == ItemProperties::CoverImage));
+    REQUIRE((ItemProperties("  SVG\tscripted, remote-resources ") == (ItemProperties::ContainsSVG|ItemProperties::HasScriptedContent|ItemProperties::HasRemoteResources)));
+    REQUIRE((ItemProperties("cover image navigation") == ItemProperties::None));
+    REQUIRE((ItemProperties("") == ItemProperties::None));
+    
+    REQUIRE(Package::IsCoreMediaType("application/xhtml+xml"));
+    REQUIRE(Package::IsCoreMediaType("text/javascript"));
+    REQUIRE_FALSE(Package::IsCoreMediaType("text/javascrip"));
+    REQUIRE_FALSE(Package::IsCoreMediaType("application/x-epub-figure-gallery"));
+    REQUIRE_FALSE(Package::IsCoreMediaType(""));
+    
+    TemporaryArchive copy(EPUB_PATH, "EPUB/package.opf", [](std::string& opf) {
+        std::string pkg("unique-identifier=\"id\"");
+        opf.replace(opf.find(pkg), pkg.size(), std::string(pkg).append(" prefix=\"ex: http://example.com/ns#   other:http://example.com/other/\""));
+        std::string cover("<itemref idref=\"cover\"/>");
+        opf.replace(opf.find(cover), cover.size(), "<itemref idref=\"cover\" properties=\" page-spread-right  ex:spread-note\"/>");
+    });
+    std::string path = copy.Path();
+    REQUIRE(!path.empty());
+    
+    {
+        Container c(path);
+        Package* pkg = c.Packages()[0];
+        
+        REQUIRE(pkg->ManifestItemWithID("cover-img")->HasProperty(ItemProperties::CoverImage));
+        REQUIRE(pkg->ManifestItemWithID("nav")->HasProperty(ItemProperties::Navigation));
+        
+        const SpineItem* cover = pkg->SpineItemAt(0);
+        REQUIRE(cover->Properties().size() == 2);
+        REQUIRE((cover->Spread() == SpineItem::PageSpread::Right));
+        REQUIRE((cover->Properties()[1] == IRI("http://example.com/ns#spread-note")));
+        
+        REQUIRE((pkg->PropertyIRIFromAttributeValue("other:a:b") == IRI("http://example.com/other/a:b")));
+        REQUIRE((pkg->PropertyIRIFromAttributeValue("dcterms:modified") == IRI("http://purl.org/dc/terms/modified")));
+        REQUIRE((pkg->PropertyIRIFromAttributeValue("title-type") == IRI("http://idpf.org/epub/vocab/package/#title-type")));
+        REQUIRE_THROWS_AS(pkg->PropertyIRIFromAttributeValue("nope:value"), Package::UnknownPrefix&);
+        REQUIRE_THROWS_AS(pkg->PropertyIRIFromAttributeValue(""), std::invalid_argument&);
+    }
+}
+
+TEST_CASE("Manifest items should be views onto the package's manifest store", "")
+{
+    TemporaryArchive copy(EPUB_PATH, "EPUB/package.opf", [](std::string& opf) {
+        std::string css("id=\"css\"");
+        opf.replace(opf.find(css), css.size(), std::string(css).append(" fallback=\"nav\""));
+        std::string cover("id=\"cover\"");
+        opf.replace(opf.find(cover), cover.size(), std::string(cover).append(" fallback=\"s04\" media-overlay=\"missing\""));
+        std::string png(" media-type=\"image/png\"");
+        opf.erase(opf.find(png), png.size());
+    });
+    std::string path = copy.Path();
+    REQUIRE(!path.empty());
+    
+    {
+        Container c(path);
+        Package* pkg = c.Packages()[0];
+        
+        // handles follow document order
+        const char* order[] = { "cover-img", "css", "cover", "s04", "nav" };
+        for ( ManifestStore::Handle h = 0; h < 5; h++ )
+        {
+            const ManifestItem* item = pkg->ManifestItemWithHandle(h);
+            REQUIRE(item != nullptr);
+            REQUIRE(item->Handle() == h);
+            REQUIRE(item->Identifier() == order[h]);
+            REQUIRE(pkg->ManifestItemWithID(order[h]) == item);
+        }
+        REQUIRE(pkg->ManifestItemWithHandle(5) == nullptr);
+        REQUIRE(pkg->ManifestItemWithHandle(ManifestStore::InvalidHandle) == nullptr);
+        
+        // shared strings are stored once
+        const ManifestItem* cover = pkg->ManifestItemWithID("cover");
+        const ManifestItem* s04 = pkg->ManifestItemWithID("s04");
+        REQUIRE(&cover->MediaType() == &s04->MediaType());
+        REQUIRE(cover->Href() == "cover.xhtml");
+        
+        // a missing media type is tolerated
+        REQUIRE(pkg->ManifestItemWithID("cover-img")->MediaType().empty());
+        
+        // cross-references, including those to later items, are resolved
+        REQUIRE(cover->Fallback() == s04);
+        REQUIRE(pkg->ManifestItemWithID("css")->Fallback() == pkg->ManifestItemWithID("nav"));
+        REQUIRE(s04->Fallback() == nullptr);
+        REQUIRE(cover->MediaOverlayID() == "missing");
+        REQUIRE(cover->MediaOverlay() == nullptr);
+        
+        for ( size_t i = 0; i < pkg->SpineItemCount(); i++ )
+        {
+            const SpineItem* item = pkg->SpineItemAt(i);
+            REQUIRE(item->ManifestItem() == pkg->ManifestItemWithID(item->Idref()));
+        }
+    }
+}
+
 TEST_CASE("Package should be able to create and resolve basic CFIs", "")
 {
     Container c(EPUB_PATH);
@@ -139,3 +360,583 @@ TEST_CASE("Package should parse bindings correctly.", "")
     IRI target = handler->Target("test.xml", ContentHandler::ParameterList());
     REQUIRE(target.URIString() == _Str("epub3://", pkg->PackageID(), "/EPUB/figure-gallery-widget/figure-gallery-impl.xhtml?src=test.xml"));
 }
+
+TEST_CASE("The streaming loader should produce the same package as the DOM loader", "")
+{
+    Container domContainer(EPUB_PATH);
+    const Package* expected = domContainer.Packages()[0];
+    
+    Package::SetUsesStreamingParser(true);
+    Container streamContainer(EPUB_PATH);
+    Container streamBindings(BINDINGS_EPUB_PATH);
+    Package::SetUsesStreamingParser(false);
+    
+    const Package* pkg = streamContainer.Packages()[0];
+    REQUIRE(pkg->UniqueID() == expected->UniqueID());
+    REQUIRE(pkg->Version() == expected->Version());
+    REQUIRE(pkg->Title() == expected->Title());
+    REQUIRE(pkg->SpineCFIIndex() == expected->SpineCFIIndex());
+    
+    REQUIRE(pkg->Manifest().size() == expected->Manifest().size());
+    for ( auto pos : expected->Manifest() )
+    {
+        const ManifestItem* item = pkg->ManifestItemWithID(pos.first);
+        REQUIRE(item != nullptr);
+        REQUIRE(item->Href() == pos.second->Href());
+        REQUIRE(item->MediaType() == pos.second->MediaType());
+    }
+    
+    const SpineItem* spineItem = pkg->FirstSpineItem();
+    for ( const SpineItem* expectedItem = expected->FirstSpineItem(); expectedItem != nullptr; expectedItem = expectedItem->Next() )
+    {
+        REQUIRE(spineItem != nullptr);
+        REQUIRE(spineItem->Idref() == expectedItem->Idref());
+        REQUIRE(spineItem->Linear() == expectedItem->Linear());
+        spineItem = spineItem->Next();
+    }
+    REQUIRE(spineItem == nullptr);
+    
+    REQUIRE(pkg->Metadata().size() == expected->Metadata().size());
+    for ( size_t i = 0; i < expected->Metadata().size(); i++ )
+    {
+        REQUIRE(pkg->Metadata()[i]->Property() == expected->Metadata()[i]->Property());
+        REQUIRE(pkg->Metadata()[i]->Value() == expected->Metadata()[i]->Value());
+        REQUIRE(pkg->Metadata()[i]->Extensions().size() == expected->Metadata()[i]->Extensions().size());
+    }
+    
+    REQUIRE(pkg->TableOfContents() != nullptr);
+    REQUIRE(pkg->PageList() != nullptr);
+    
+    const Package* bindingsPkg = streamBindings.Packages()[0];
+    REQUIRE(bindingsPkg->OPFHandlerForMediaType(kMediaType) != nullptr);
+}
+
+TEST_CASE("Package should share cached documents between lookups", "")
+{
+    Container c(EPUB_PATH);
+    Package* pkg = c.Packages()[0];
+    const SpineItem* first = pkg->SpineItemAt(0);
+    const SpineItem* second = pkg->SpineItemAt(1);
+    
+    CFI cfi(pkg->CFIForSpineItem(first));
+    Shared<const xmlDoc> doc = pkg->DocumentForCFI(cfi, nullptr);
+    REQUIRE(doc != nullptr);
+    REQUIRE(pkg->DocumentForCFI(cfi, nullptr) == doc);
+    REQUIRE(pkg->DocumentForManifestItem(first->ManifestItem()) == doc);
+    
+    // an evicted document stays alive while we hold it, but is reloaded next time
+    pkg->SetDocumentCacheCapacity(1);
+    Shared<const xmlDoc> other = pkg->DocumentForManifestItem(second->ManifestItem());
+    REQUIRE(other != nullptr);
+    REQUIRE(other != doc);
+    REQUIRE(xmlDocGetRootElement(doc.get()) != nullptr);
+    REQUIRE(pkg->DocumentForManifestItem(second->ManifestItem()) == other);
+    REQUIRE(pkg->DocumentForManifestItem(first->ManifestItem()) != doc);
+    
+    pkg->PurgeDocumentCache();
+    REQUIRE(pkg->DocumentForManifestItem(second->ManifestItem()) != other);
+}
+
+TEST_CASE("A package's documents should share one XML dictionary", "")
+{
+    Container c(EPUB_PATH);
+    Package* pkg = c.Packages()[0];
+    
+    Shared<const xmlDoc> first = pkg->DocumentForManifestItem(pkg->SpineItemAt(0)->ManifestItem());
+    Shared<const xmlDoc> second = pkg->DocumentForManifestItem(pkg->SpineItemAt(1)->ManifestItem());
+    REQUIRE(first != nullptr);
+    REQUIRE(second != nullptr);
+    REQUIRE(first->dict != nullptr);
+    REQUIRE(first->dict == second->dict);
+    
+    // shared trees and their dictionary are read-only to clients
+    static_assert(std::is_same<decltype(pkg->DocumentForManifestItem(nullptr)), Shared<const xmlDoc>>::value,
+                  "cached documents must be handed out read-only");
+    
+    // common names come from the process-wide vocabulary
+    xmlNodePtr root = xmlDocGetRootElement(first.get());
+    REQUIRE(xmlDictOwns(xml::Dictionary::Vocabulary(), root->name) == 1);
+    
+    // one-shot loads get a dictionary of their own
+    xmlDocPtr oneShot = pkg->SpineItemAt(0)->ManifestItem()->ReferencedDocument();
+    REQUIRE(oneShot != nullptr);
+    REQUIRE(oneShot->dict != first->dict);
+    REQUIRE(xmlDocGetRootElement(oneShot)->name == root->name);
+    xmlFreeDoc(oneShot);
+}
+
+TEST_CASE("Parser contexts should be reused between document loads", "")
+{
+    xml::ParserContextPool& pool = xml::ParserContextPool::XMLContexts();
+    pool.Drain();
+    
+    Container c(EPUB_PATH);
+    Package* pkg = c.Packages()[0];
+    REQUIRE(pool.IdleCount() == 1);
+    
+    xmlNodePtr firstRoot = nullptr;
+    for ( const SpineItem* item = pkg->FirstSpineItem(); item != nullptr; item = item->Next() )
+    {
+        xmlDocPtr doc = item->ManifestItem()->ReferencedDocument();
+        REQUIRE(doc != nullptr);
+        REQUIRE(xmlDocGetRootElement(doc) != nullptr);
+        if ( firstRoot == nullptr )
+            firstRoot = xmlCopyNode(xmlDocGetRootElement(doc), 1);
+        xmlFreeDoc(doc);
+        REQUIRE(pool.IdleCount() == 1);
+    }
+    
+    // a reused context parses the same document identically
+    xmlDocPtr again = pkg->SpineItemAt(0)->ManifestItem()->ReferencedDocument();
+    REQUIRE(again != nullptr);
+    REQUIRE(xmlStrEqual(xmlDocGetRootElement(again)->name, firstRoot->name) == 1);
+    REQUIRE(xmlChildElementCount(xmlDocGetRootElement(again)) == xmlChildElementCount(firstRoot));
+    xmlFreeDoc(again);
+    xmlFreeNode(firstRoot);
+    
+    // with no capacity, contexts are freed after use
+    pool.SetCapacity(0);
+    REQUIRE(pool.IdleCount() == 0);
+    xmlDocPtr unpooled = pkg->SpineItemAt(0)->ManifestItem()->ReferencedDocument();
+    REQUIRE(unpooled != nullptr);
+    xmlFreeDoc(unpooled);
+    REQUIRE(pool.IdleCount() == 0);
+    pool.SetCapacity(xml::ParserContextPool::DefaultCapacity);
+}
+
+TEST_CASE("Standard DTDs and entity sets should be resolved from the local catalog", "")
+{
+    REQUIRE(xml::EntityCatalog::Lookup("-//W3C//DTD XHTML 1.1//EN", nullptr) != nullptr);
+    REQUIRE(xml::EntityCatalog::Lookup(nullptr, "http://www.daisy.org/z3986/2005/ncx-2005-1.dtd") != nullptr);
+    REQUIRE(xml::EntityCatalog::Lookup("-//Example//DTD Unknown//EN", "http://example.com/unknown.dtd") == nullptr);
+    
+    std::istringstream input(R"XML(<?xml version="1.0" encoding="UTF-8"?>
+<!DOCTYPE html PUBLIC "-//W3C//DTD XHTML 1.1//EN" "http://www.w3.org/TR/xhtml11/DTD/xhtml11.dtd">
+<html><head><title>T</title></head><body><p>a&nbsp;b&eacute;&hellip;&euro;&amp;</p></body></html>)XML");
+    xml::StreamInputBuffer buffer(input);
+    xmlDocPtr doc = buffer.xmlReadDocument("chapter.xhtml", "utf-8", XML_PARSE_RECOVER|XML_PARSE_NOENT|XML_PARSE_DTDATTR);
+    REQUIRE(doc != nullptr);
+    
+    // the DTD's fixed xmlns attribute puts the document into the XHTML namespace
+    xmlNodePtr root = xmlDocGetRootElement(doc);
+    REQUIRE(root->ns != nullptr);
+    REQUIRE(xmlStrEqual(root->ns->href, BAD_CAST "http://www.w3.org/1999/xhtml") == 1);
+    
+    xmlChar* text = xmlNodeGetContent(root);
+    REQUIRE(std::string(reinterpret_cast<char*>(text)) == "Ta\u00A0b\u00E9\u2026\u20AC&");
+    xmlFree(text);
+    xmlFreeDoc(doc);
+}
+
+TEST_CASE("Push parsing should report top-level elements as they are completed", "")
+{
+    std::ostringstream chapter;
+    chapter << "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n<html xmlns=\"http://www.w3.org/1999/xhtml\"><head><title>T</title></head><body>";
+    for ( int i = 0; i < 200; i++ )
+        chapter << "<p id=\"p" << i << "\">Paragraph <em>" << i << "</em></p>\n";
+    chapter << "</body></html>";
+    std::string data(chapter.str());
+    
+    std::vector<size_t> reported;
+    size_t bytesFedAtFirstReport = 0, bytesFed = 0;
+    
+    xml::PushParser parser(false, "chapter.xhtml", "utf-8", XML_PARSE_RECOVER|XML_PARSE_NOENT);
+    parser.SetProgressHandler([&](xmlNodePtr container, size_t readyCount) {
+        REQUIRE(xmlStrEqual(container->name, BAD_CAST "body") == 1);
+        REQUIRE(xmlChildElementCount(container) >= readyCount);
+        if ( reported.empty() )
+            bytesFedAtFirstReport = bytesFed;
+        reported.push_back(readyCount);
+    });
+    
+    for ( size_t pos = 0; pos < data.size(); pos += 64 )
+    {
+        size_t len = std::min(size_t(64), data.size() - pos);
+        bytesFed += len;
+        REQUIRE(parser.Feed(data.data() + pos, len));
+    }
+    
+    xmlDocPtr doc = parser.Finish();
+    REQUIRE(doc != nullptr);
+    REQUIRE(parser.ReadyCount() == 200);
+    
+    // the first paragraphs were announced long before the end of the input
+    REQUIRE(reported.size() > 10);
+    REQUIRE(bytesFedAtFirstReport < data.size() / 10);
+    REQUIRE(std::is_sorted(reported.begin(), reported.end()));
+    REQUIRE(reported.back() == 200);
+    
+    xmlNodePtr body = xmlLastElementChild(xmlDocGetRootElement(doc));
+    REQUIRE(xmlChildElementCount(body) == 200);
+    xmlFreeDoc(doc);
+    
+    // reading on a worker thread gives the same result
+    size_t readPos = 0;
+    xml::PushParser concurrent(false, "chapter.xhtml", "utf-8", XML_PARSE_RECOVER|XML_PARSE_NOENT);
+    size_t lastReported = 0;
+    concurrent.SetProgressHandler([&](xmlNodePtr, size_t readyCount) { lastReported = readyCount; });
+    doc = concurrent.ParseConcurrently([&](void* buf, size_t len) -> ssize_t {
+        len = std::min(len, data.size() - readPos);
+        std::memcpy(buf, data.data() + readPos, len);
+        readPos += len;
+        return static_cast<ssize_t>(len);
+    }, 100);
+    REQUIRE(doc != nullptr);
+    REQUIRE(lastReported == 200);
+    REQUIRE(xmlChildElementCount(xmlLastElementChild(xmlDocGetRootElement(doc))) == 200);
+    xmlFreeDoc(doc);
+    
+    // a failed read produces no document
+    xml::PushParser failing(false, "chapter.xhtml", "utf-8", XML_PARSE_RECOVER);
+    REQUIRE(failing.ParseConcurrently([](void*, size_t) -> ssize_t { return -1; }) == nullptr);
+}
+
+TEST_CASE("Chapters should be parsed progressively from the archive", "")
+{
+    Container c(EPUB_PATH);
+    Package* pkg = c.Packages()[0];
+    const ManifestItem* item = pkg->SpineItemAt(0)->ManifestItem();
+    
+    size_t calls = 0, lastReported = 0;
+    xmlDocPtr progressive = item->ReferencedDocument([&](xmlNodePtr /*container*/, size_t readyCount) {
+        REQUIRE(readyCount > lastReported);
+        lastReported = readyCount;
+        calls++;
+    });
+    REQUIRE(progressive != nullptr);
+    REQUIRE(calls > 0);
+    
+    xmlDocPtr oneShot = item->ReferencedDocument();
+    REQUIRE(oneShot != nullptr);
+    
+    xmlNodePtr body = xmlLastElementChild(xmlDocGetRootElement(oneShot));
+    REQUIRE(lastReported == xmlChildElementCount(body));
+    
+    xmlChar* expected = xmlNodeGetContent(xmlDocGetRootElement(oneShot));
+    xmlChar* actual = xmlNodeGetContent(xmlDocGetRootElement(progressive));
+    REQUIRE(xmlStrEqual(expected, actual) == 1);
+    xmlFree(expected);
+    xmlFree(actual);
+    
+    xmlFreeDoc(oneShot);
+    xmlFreeDoc(progressive);
+    
+    // a shared dictionary's lock is held throughout the parse
+    xml::Dictionary dict;
+    bool checked = false, heldDuringParse = false;
+    xmlDocPtr shared = item->ReferencedDocument([&](xmlNodePtr, size_t) {
+        if ( checked )
+            return;
+        checked = true;
+        std::thread([&]() {
+            heldDuringParse = !dict.Lock().try_lock();
+            if ( !heldDuringParse )
+                dict.Lock().unlock();
+        }).join();
+    }, dict.xmlDict(), &dict.Lock());
+    REQUIRE(shared != nullptr);
+    REQUIRE(shared->dict == dict.xmlDict());
+    REQUIRE(checked);
+    REQUIRE(heldDuringParse);
+    REQUIRE(dict.Lock().try_lock());
+    dict.Lock().unlock();
+    xmlFreeDoc(shared);
+}
+
+static const char* gPermissiveOPFSchema = R"XSD(<?xml version="1.0"?>
+<xs:schema xmlns:xs="http://www.w3.org/2001/XMLSchema" targetNamespace="http://www.idpf.org/2007/opf" elementFormDefault="qualified">
+  <xs:element name="package">
+    <xs:complexType>
+      <xs:sequence>
+        <xs:any minOccurs="0" maxOccurs="unbounded" processContents="skip"/>
+      </xs:sequence>
+      <xs:anyAttribute processContents="skip"/>
+    </xs:complexType>
+  </xs:element>
+</xs:schema>)XSD";
+
+static const char* gStrictOPFSchema = R"XSD(<?xml version="1.0"?>
+<xs:schema xmlns:xs="http://www.w3.org/2001/XMLSchema" targetNamespace="http://www.idpf.org/2007/opf" elementFormDefault="qualified">
+  <xs:element name="package">
+    <xs:complexType>
+      <xs:sequence>
+        <xs:any minOccurs="0" maxOccurs="unbounded" processContents="skip"/>
+      </xs:sequence>
+      <xs:attribute name="not-in-any-package" type="xs:string" use="required"/>
+      <xs:anyAttribute processContents="skip"/>
+    </xs:complexType>
+  </xs:element>
+</xs:schema>)XSD";
+
+TEST_CASE("Package documents should be validated against registered schemas", "")
+{
+    const string opf("http://www.idpf.org/2007/opf");
+    REQUIRE(Package::ValidatesSchema());
+    REQUIRE_FALSE(xml::SchemaPool::HasSchemaForNamespace(opf));
+    
+    // compiled once, then shared
+    xml::SchemaPool::RegisterSchemaData(opf, gPermissiveOPFSchema);
+    xml::SchemaPool::CompiledSchema compiled = xml::SchemaPool::SchemaForNamespace(opf);
+    REQUIRE(compiled != nullptr);
+    REQUIRE(xml::SchemaPool::SchemaForNamespace(opf) == compiled);
+    
+    for ( bool streaming : {true, false} )
+    {
+        Package::SetUsesStreamingParser(streaming);
+        
+        xml::SchemaPool::RegisterSchemaData(opf, gPermissiveOPFSchema);
+        {
+            Container c(EPUB_PATH);
+            REQUIRE(c.DefaultPackage() != nullptr);
+        }
+        
+        xml::SchemaPool::RegisterSchemaData(opf, gStrictOPFSchema);
+        REQUIRE_THROWS_AS(Container(EPUB_PATH), std::invalid_argument&);
+        
+        Package::SetValidatesSchema(false);
+        {
+            Container c(EPUB_PATH);
+            REQUIRE(c.DefaultPackage() != nullptr);
+        }
+        Package::SetValidatesSchema(true);
+    }
+    
+    Package::SetUsesStreamingParser(false);
+    
+    // a broken schema is reported rather than silently ignored
+    xml::SchemaPool::RegisterSchemaData(opf, "<not-a-schema/>");
+    REQUIRE_THROWS_AS(xml::SchemaPool::SchemaForNamespace(opf), xml::ParserError&);
+    
+    xml::SchemaPool::UnregisterSchema(opf);
+    REQUIRE(xml::SchemaPool::SchemaForNamespace(opf) == nullptr);
+}
+
+static std::string RootElementSchema(const std::string& ns, const std::string& root, bool strict)
+{
+    std::string requiredAttr;
+    if ( strict )
+        requiredAttr = R"XSD(<xs:attribute name="not-in-any-document" type="xs:string" use="required"/>)XSD";
+    return std::string(R"XSD(<?xml version="1.0"?>
+<xs:schema xmlns:xs="http://www.w3.org/2001/XMLSchema" targetNamespace=")XSD") + ns + R"XSD(" elementFormDefault="qualified">
+  <xs:element name=")XSD" + root + R"XSD(">
+    <xs:complexType>
+      <xs:sequence>
+        <xs:any minOccurs="0" maxOccurs="unbounded" processContents="skip"/>
+      </xs:sequence>
+      )XSD" + requiredAttr + R"XSD(
+      <xs:anyAttribute processContents="skip"/>
+    </xs:complexType>
+  </xs:element>
+</xs:schema>)XSD";
+}
+
+TEST_CASE("Navigation documents and container.xml should be validated as they are parsed", "")
+{
+    const string xhtml("http://www.w3.org/1999/xhtml");
+    const string ocf("urn:oasis:names:tc:opendocument:xmlns:container");
+    REQUIRE(Package::ValidatesSchema());
+    
+    xml::SchemaPool::RegisterSchemaData(xhtml, RootElementSchema(xhtml.stl_str(), "html", false));
+    xml::SchemaPool::RegisterSchemaData(ocf, RootElementSchema(ocf.stl_str(), "container", false));
+    {
+        Container c(EPUB_PATH);
+        REQUIRE(c.DefaultPackage() != nullptr);
+        REQUIRE(c.DefaultPackage()->TableOfContents() != nullptr);
+    }
+    
+    xml::SchemaPool::RegisterSchemaData(xhtml, RootElementSchema(xhtml.stl_str(), "html", true));
+    REQUIRE_THROWS_AS(Container(EPUB_PATH), std::invalid_argument&);
+    xml::SchemaPool::UnregisterSchema(xhtml);
+    
+    xml::SchemaPool::RegisterSchemaData(ocf, RootElementSchema(ocf.stl_str(), "container", true));
+    REQUIRE_THROWS_AS(Container(EPUB_PATH), std::invalid_argument&);
+    xml::SchemaPool::UnregisterSchema(ocf);
+    
+    Container c(EPUB_PATH);
+    REQUIRE(c.DefaultPackage() != nullptr);
+}
+
+static std::vector<std::string> SnapshotFilesInDirectory(const char* dir)
+{
+    std::vector<std::string> result;
+    DIR* d = opendir(dir);
+    if ( d == nullptr )
+        return result;
+    
+    while ( struct dirent* entry = readdir(d) )
+    {
+        std::string name(entry->d_name);
+        if ( name.size() > 9 && name.substr(name.size()-9) == ".snapshot" )
+            result.push_back(std::string(dir) + std::string("/") + name);
+    }
+    
+    closedir(d);
+    return result;
+}
+
+TEST_CASE("Packages restored from a snapshot should match the original", "")
+{
+    TemporaryDirectory dir;
+    REQUIRE(!dir.Path().empty());
+    PackageSnapshot::SetDirectory(dir.Path());
+    
+    Container original(EPUB_PATH);
+    Container restored(EPUB_PATH);
+    Container originalBindings(BINDINGS_EPUB_PATH);
+    Container restoredBindings(BINDINGS_EPUB_PATH);
+    
+    const Package* expected = original.Packages()[0];
+    const Package* pkg = restored.Packages()[0];
+    std::vector<std::string> snapshots = SnapshotFilesInDirectory(dir.Path().c_str());
+    REQUIRE(snapshots.size() == 2);
+    
+    REQUIRE(pkg->UniqueID() == expected->UniqueID());
+    REQUIRE(pkg->Version() == expected->Version());
+    REQUIRE(pkg->Title() == expected->Title());
+    REQUIRE(pkg->SpineCFIIndex() == expected->SpineCFIIndex());
+    
+    REQUIRE(pkg->Manifest().size() == expected->Manifest().size());
+    for ( auto pos : expected->Manifest() )
+    {
+        const ManifestItem* item = pkg->ManifestItemWithID(pos.first);
+        REQUIRE(item != nullptr);
+        REQUIRE(item->Href() == pos.second->Href());
+        REQUIRE(item->MediaType() == pos.second->MediaType());
+        REQUIRE((item->Properties() == pos.second->Properties()));
+    }
+    
+    const SpineItem* spineItem = pkg->FirstSpineItem();
+    for ( const SpineItem* expectedItem = expected->FirstSpineItem(); expectedItem != nullptr; expectedItem = expectedItem->Next() )
+    {
+        REQUIRE(spineItem != nullptr);
+        REQUIRE(spineItem->Idref() == expectedItem->Idref());
+        REQUIRE(spineItem->Linear() == expectedItem->Linear());
+        REQUIRE(spineItem->Properties().size() == expectedItem->Properties().size());
+        spineItem = spineItem->Next();
+    }
+    REQUIRE(spineItem == nullptr);
+    
+    REQUIRE(pkg->Metadata().size() == expected->Metadata().size());
+    for ( size_t i = 0; i < expected->Metadata().size(); i++ )
+    {
+        REQUIRE(pkg->Metadata()[i]->Property() == expected->Metadata()[i]->Property());
+        REQUIRE(pkg->Metadata()[i]->Value() == expected->Metadata()[i]->Value());
+        REQUIRE(pkg->Metadata()[i]->Extensions().size() == expected->Metadata()[i]->Extensions().size());
+    }
+    
+    REQUIRE(pkg->TableOfContents() != nullptr);
+    REQUIRE(pkg->TableOfContents()->Title() == expected->TableOfContents()->Title());
+    REQUIRE(pkg->TableOfContents()->Children().size() == expected->TableOfContents()->Children().size());
+    REQUIRE(pkg->TableOfContents()->Children()[0]->SourceHref() == expected->TableOfContents()->Children()[0]->SourceHref());
+    REQUIRE(pkg->PageList() != nullptr);
+    
+    REQUIRE(restoredBindings.Packages()[0]->OPFHandlerForMediaType(kMediaType) != nullptr);
+    
+    // a damaged snapshot is ignored, and replaced
+    for ( auto& path : snapshots )
+    {
+        std::ofstream damaged(path, std::ios::binary|std::ios::trunc);
+        damaged << "EPB3SNAP garbage";
+    }
+    Container reloaded(EPUB_PATH);
+    REQUIRE(reloaded.Packages()[0]->Manifest().size() == expected->Manifest().size());
+    REQUIRE(reloaded.Packages()[0]->UniqueID() == expected->UniqueID());
+    
+    Container restoredAgain(EPUB_PATH);
+    REQUIRE(restoredAgain.Packages()[0]->Manifest().size() == expected->Manifest().size());
+    
+    PackageSnapshot::SetDirectory("");
+}
+
+TEST_CASE("Opening a container should report each phase to the trace observer", "")
+{
+    TraceRecorder recorder;
+    Trace::SetObserver(recorder.Observer());
+    REQUIRE(Trace::Enabled());
+    {
+        Container c(EPUB_PATH);
+        REQUIRE(c.Packages().size() == 1);
+    }
+    Trace::SetObserver(nullptr);
+    REQUIRE_FALSE(Trace::Enabled());
+    
+    std::vector<TracePhase> phases = recorder.Phases();
+    auto find = [&](const char* name) -> const TracePhase* {
+        for ( auto& phase : phases )
+        {
+            if ( std::strcmp(phase.name, name) == 0 )
+                return &phase;
+        }
+        return nullptr;
+    };
+    
+    const TracePhase* archive = find("Archive::Open");
+    const TracePhase* containerXML = find("Container::ParseContainerXML");
+    const TracePhase* open = find("Package::Open");
+    const TracePhase* readOPF = find(Package::UsesStreamingParser() ? "Package::StreamOPF" : "Package::ReadOPF");
+    const TracePhase* media = find("Package::InitMediaSupport");
+    REQUIRE(archive != nullptr);
+    REQUIRE(containerXML != nullptr);
+    REQUIRE(find("Container::LoadEncryption") != nullptr);
+    REQUIRE(open != nullptr);
+    REQUIRE(readOPF != nullptr);
+    REQUIRE(find("Package::NavigationTables") != nullptr);
+    REQUIRE(media != nullptr);
+    
+    REQUIRE(archive->detail == EPUB_PATH);
+    REQUIRE(containerXML->bytesRead > 0);
+    REQUIRE(open->detail == readOPF->detail);
+    
+    // the package's own phases nest inside Package::Open, and count towards it
+    REQUIRE(readOPF->thread == open->thread);
+    REQUIRE(readOPF->depth == open->depth + 1);
+    REQUIRE(readOPF->bytesRead > 0);
+    REQUIRE(readOPF->allocations > 0);
+    REQUIRE(open->bytesRead >= readOPF->bytesRead);
+    REQUIRE(open->allocations >= readOPF->allocations);
+    REQUIRE(media->start >= open->start);
+    uint64_t mediaEnd = media->start + media->duration, openEnd = open->start + open->duration;
+    REQUIRE(mediaEnd <= openEnd);
+    
+    std::stringstream json;
+    recorder.WriteChromeTrace(json);
+    std::string str = json.str();
+    REQUIRE(str.find("{\"traceEvents\":[") == 0);
+    REQUIRE(str.find("\"name\":\"Package::Open\"") != std::string::npos);
+    REQUIRE(str.find("\"ph\":\"X\"") != std::string::npos);
+    
+    // nothing is reported once the observer is gone
+    recorder.Clear();
+    Container quiet(EPUB_PATH);
+    REQUIRE(recorder.Phases().empty());
+}
+
+TEST_CASE("Benchmark: load events with memoized identity metadata", "[hide][benchmark]")
+{
+    static const int kEvents = 100000;
+    
+    Container c(EPUB_PATH);
+    Package* pkg = c.Packages()[0];
+    
+    size_t loaded = 0;
+    pkg->SetLoadHandler([&](const IRI& /*url*/) { loaded++; });
+    
+    // paths outside the package base are rewritten using the package's unique ID
+    IRI url("epub3://host/other/chapter.xhtml");
+    
+    auto start = std::chrono::steady_clock::now();
+    for ( int i = 0; i < kEvents; i++ )
+        pkg->FireLoadEvent(url);
+    auto cached = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start);
+    
+    start = std::chrono::steady_clock::now();
+    for ( int i = 0; i < kEvents; i++ )
+    {
+        pkg->InvalidateMetadataCache();
+        pkg->FireLoadEvent(url);
+    }
+    auto uncached = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start);
+    
+    REQUIRE(loaded == static_cast<size_t>(kEvents * 2));
+    std::cout << "Fired " << kEvents << " load events in " << cached.count() << "ms with memoized metadata, " << uncached.count() << "ms recomputing it" << std::endl;
+}
@@ -0,0 +1,154 @@
+//
+//  temporary_files.h
+//  ePub3
+//
+//  Copyright (c) 2012-2013 The Readium Foundation and contributors.
+//
+//  The Readium SDK is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#ifndef __ePub3__temporary_files__
+#define __ePub3__temporary_files__
+
+#include <libzip/zip.h>
+#include <dirent.h>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <functional>
+#include <string>
+#include <unistd.h>
+
+// `name` within the system's temporary directory
+inline std::string TemporaryPath(const char* name)
+{
+    const char* dir = std::getenv("TMPDIR");
+    if ( dir == nullptr || *dir == '\0' )
+        dir = P_tmpdir;
+    return std::string(dir) + std::string("/") + std::string(name);
+}
+
+/**
+ A copy of a test publication with one of its files edited, in the system's
+ temporary directory. The copy is deleted when this goes out of scope, so a failed
+ assertion doesn't leave it behind.
+ */
+class TemporaryArchive
+{
+public:
+    typedef std::function<void(std::string&)>   Editor;
+
+    /**
+     @param source The archive to copy.
+     @param member The path of the file within the archive to edit.
+     @param edit Receives the file's contents, and modifies them in place.
+     */
+    TemporaryArchive(const char* source, const char* member, const Editor& edit)
+    {
+        std::string path = TemporaryPath("epub3-test.XXXXXX.epub");
+        int fd = ::mkstemps(&path[0], 5);
+        if ( fd == -1 )
+            return;
+        ::close(fd);
+        _path = path;
+
+        {
+            std::ifstream in(source, std::ios::binary);
+            std::ofstream out(_path, std::ios::binary|std::ios::trunc);
+            out << in.rdbuf();
+        }
+
+        int zerr = 0;
+        struct zip* z = zip_open(_path.c_str(), 0, &zerr);
+        if ( z == nullptr )
+            return;
+
+        std::string contents;
+        struct zip_file* file = zip_fopen(z, member, 0);
+        char buf[4096];
+        ssize_t n;
+        while ( file != nullptr && (n = zip_fread(file, buf, sizeof(buf))) > 0 )
+            contents.append(buf, static_cast<size_t>(n));
+        if ( file != nullptr )
+            zip_fclose(file);
+
+        edit(contents);
+
+        // the buffer is only read by zip_close(), so `contents` must outlive it
+        struct zip_source* src = zip_source_buffer(z, contents.data(), contents.size(), 0);
+        bool replaced = (src != nullptr && zip_replace(z, zip_name_locate(z, member, 0), src) == 0);
+        if ( src != nullptr && !replaced )
+            zip_source_free(src);
+        if ( zip_close(z) == 0 && replaced )
+            _valid = true;
+    }
+    TemporaryArchive(const TemporaryArchive&)               = delete;
+    TemporaryArchive& operator=(const TemporaryArchive&)    = delete;
+    ~TemporaryArchive()
+    {
+        if ( !_path.empty() )
+            ::unlink(_path.c_str());
+    }
+
+    ///
+    /// The path of the copy, or an empty string if it could not be created.
+    std::string         Path()      const   { return (_valid ? _path : std::string()); }
+
+private:
+    std::string         _path;
+    bool                _valid = false;
+};
+
+/**
+ An empty directory in the system's temporary directory, which is deleted along
+ with its contents when this goes out of scope.
+ */
+class TemporaryDirectory
+{
+public:
+    TemporaryDirectory()
+    {
+        std::string path = TemporaryPath("epub3-test-XXXXXX");
+        if ( ::mkdtemp(&path[0]) != nullptr )
+            _path = path;
+    }
+    TemporaryDirectory(const TemporaryDirectory&)               = delete;
+    TemporaryDirectory& operator=(const TemporaryDirectory&)    = delete;
+    ~TemporaryDirectory()
+    {
+        if ( _path.empty() )
+            return;
+
+        if ( DIR* d = ::opendir(_path.c_str()) )
+        {
+            while ( struct dirent* entry = ::readdir(d) )
+            {
+                std::string name(entry->d_name);
+                if ( name != "." && name != ".." )
+                    ::unlink((_path + std::string("/") + name).c_str());
+            }
+            ::closedir(d);
+        }
+        ::rmdir(_path.c_str());
+    }
+
+    ///
+    /// The path of the directory, or an empty string if it could not be created.
+    const std::string&  Path()      const   { return _path; }
+
+private:
+    std::string         _path;
+};
+
+#endif /* defined(__ePub3__temporary_files__) */
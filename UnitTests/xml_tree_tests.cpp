@@ -0,0 +1,93 @@
+//
+//  xml_tree_tests.cpp
+//  ePub3
+//
+//  Copyright (c) 2012-2013 The Readium Foundation and contributors.
+//
+//  The Readium SDK is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+
+#include "../ePub3/xml/tree/document.h"
+#include "../ePub3/xml/tree/element.h"
+#include "catch.hpp"
+#include <libxml/parser.h>
+#include <cstring>
+#include <vector>
+
+using namespace ePub3;
+
+static const char* kChapterXML = "<html><body><p>one</p><!--c--><p>two</p><div/><p>three</p></body></html>";
+
+static xmlDocPtr ParseChapter()
+{
+    return xmlReadMemory(kChapterXML, static_cast<int>(std::strlen(kChapterXML)), "chapter.xhtml", nullptr, 0);
+}
+
+TEST_CASE("Parsing a document should not create any node wrappers", "")
+{
+    xmlDocPtr doc = ParseChapter();
+    REQUIRE(doc != nullptr);
+    
+    xmlNodePtr body = xmlDocGetRootElement(doc)->children;
+    REQUIRE(body->_private == nullptr);
+    for ( xmlNodePtr child = body->children; child != nullptr; child = child->next )
+    {
+        REQUIRE(child->_private == nullptr);
+    }
+    
+    xmlFreeDoc(doc);
+}
+
+TEST_CASE("Children should be iterated lazily and their wrappers reused", "")
+{
+    xml::Document doc(ParseChapter());
+    xml::Element* body = dynamic_cast<xml::Element*>(doc.Root()->FirstChild("body"));
+    REQUIRE(body != nullptr);
+    
+    // nothing below the body has been touched yet
+    REQUIRE(body->xml()->children->_private == nullptr);
+    
+    std::vector<xml::Node*> paragraphs;
+    for ( xml::Node* node : body->Children("p") )
+    {
+        REQUIRE(node->IsElementNode());
+        paragraphs.push_back(node);
+    }
+    REQUIRE(paragraphs.size() == 3);
+    REQUIRE(paragraphs[2]->StringValue() == "three");
+    
+    // the comment was skipped over without being wrapped
+    REQUIRE(paragraphs[0]->xml()->next->_private == nullptr);
+    
+    size_t count = 0;
+    for ( xml::Node* node : body->Children() )
+    {
+        if ( node->xml()->type == XML_ELEMENT_NODE && node->Name() == "p" )
+            REQUIRE(node == paragraphs[count++]);
+    }
+    REQUIRE(count == 3);
+    
+    REQUIRE(paragraphs[0]->NextSibling()->Type() == xml::NodeType::Comment);
+    REQUIRE(body->Children("table").empty());
+}
+
+TEST_CASE("Detached nodes should be freed along with their Document", "")
+{
+    xml::Document doc(ParseChapter());
+    xml::Node* div = doc.Root()->FirstChild("body")->FirstChild("div");
+    REQUIRE(div != nullptr);
+    div->Detach();
+    REQUIRE(doc.Root()->FirstChild("body")->FirstChild("div") == nullptr);
+}
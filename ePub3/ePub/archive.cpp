@@ -21,6 +21,7 @@
 
 #include "archive.h"
 #include "zip_archive.h"
+#include "trace.h"
 #include <map>
 
 EPUB3_BEGIN_NAMESPACE
@@ -33,6 +34,8 @@ void Archive::RegisterArchive(CreatorFn creator, SnifferFn sniffer)
 }
 void Archive::Initialize()
 {
+    Trace::Initialize();
+    
     RegisterArchive([](const std::string& path) { return new ZipArchive(path); },
                     [](const std::string& path) { return path.rfind(".zip") == path.size()-4; });
     RegisterArchive([](const std::string& path) { return new ZipArchive(path); },
@@ -21,9 +21,73 @@
 
 #include "cfi.h"
 #include <sstream>
+#include <algorithm>
+#include <cstring>
+#include <limits>
 
 EPUB3_BEGIN_NAMESPACE
 
+// Finds the first `delimiter` at or after `p` which isn't inside a `[...]` qualifier,
+// returning `end` if there is none, or nullptr if a qualifier is unterminated.
+static const char* SegmentEnd(const char* p, const char* end, char delimiter)
+{
+    for ( ; p != end && *p != delimiter; ++p )
+    {
+        if ( *p == '[' )
+        {
+            p = static_cast<const char*>(std::memchr(p, ']', end-p));
+            if ( p == nullptr )
+                return nullptr;
+        }
+    }
+    return p;
+}
+static inline bool IsDigit(char ch)
+{
+    return ch >= '0' && ch <= '9';
+}
+static bool ParseInteger(const char*& p, const char* end, uint32_t* result)
+{
+    if ( p == end || !IsDigit(*p) )
+        return false;
+    
+    uint64_t value = 0;
+    for ( ; p != end && IsDigit(*p); ++p )
+    {
+        value = (value * 10) + (*p - '0');
+        if ( value > std::numeric_limits<uint32_t>::max() )
+            return false;
+    }
+    
+    *result = static_cast<uint32_t>(value);
+    return true;
+}
+static bool ParseFloat(const char*& p, const char* end, float* result)
+{
+    bool negative = false;
+    if ( p != end && (*p == '-' || *p == '+') )
+        negative = (*p++ == '-');
+    
+    double value = 0.0, scale = 1.0;
+    bool haveDigits = false;
+    for ( ; p != end && IsDigit(*p); ++p, haveDigits = true )
+        value = (value * 10.0) + (*p - '0');
+    if ( p != end && *p == '.' )
+    {
+        for ( ++p; p != end && IsDigit(*p); ++p, haveDigits = true )
+        {
+            value = (value * 10.0) + (*p - '0');
+            scale *= 10.0;
+        }
+    }
+    
+    if ( !haveDigits )
+        return false;
+    
+    *result = static_cast<float>(negative ? -value/scale : value/scale);
+    return true;
+}
+
 CFI::CFI(const CFI& base, const CFI& start, const CFI& end) : _components(base._components), _rangeStart(start._components), _rangeEnd(end._components), _options(RangeTriplet)
 {
 }
@@ -212,84 +276,59 @@ void CFI::AppendComponents(std::stringstream& builder, ComponentList::const_iter
         ++pos;
     }
 }
-CFI::StringList CFI::CFIComponentStrings(const string &cfi, const string& delimiter)
-{
-    CFI::StringList components;
-    string breaks = delimiter + "[";
-    string tmp;
-    string::size_type pos = 0, loc = 0;
-    
-    while ( pos < cfi.size() )
-    {
-        loc = cfi.find_first_of(breaks, pos);
-        if ( loc > pos )
-        {
-            if ( loc == string::npos )
-            {
-                tmp.append(cfi, pos, cfi.size()-pos);
-                if ( !tmp.empty() )
-                    components.push_back(tmp);
-                break;
-            }
-            else
-            {
-                tmp.append(cfi, pos, loc-pos);
-            }
-            pos = loc;
-        }
-        
-        if ( cfi[loc] == '[' )
-        {
-            loc = cfi.find_first_of(']', loc);
-            if ( loc == string::npos )
-                throw std::range_error(_Str("CFI '", cfi, "' has an unterminated qualifier"));
-            
-            ++loc;
-            tmp.append(cfi, pos, loc-pos);
-        }
-        else if ( cfi.find(delimiter, loc) == loc )
-        {
-            // delimiter found, push the current string
-            if ( !tmp.empty() )
-                components.push_back(tmp);
-            tmp.clear();
-            
-            if ( loc == string::npos )
-                break;
-            loc++;
-        }
-        
-        pos = loc;
-    }
-    
-    return components;
-}
 bool CFI::CompileCFI(const string &str)
 {
+    // work on the UTF-8 bytes directly: every delimiter is ASCII, and ASCII bytes
+    // never occur within a multi-byte sequence
+    const std::string& utf8 = str.stl_str();
+    const char* begin = utf8.data();
+    const char* end = begin + utf8.size();
+    
     // strip the 'epubcfi(...)' wrapping
-    string cfi(str);
-    if ( str.find("epubcfi(") == 0 )
+    if ( utf8.compare(0, 8, "epubcfi(") == 0 )
     {
-        cfi = cfi.substr(8, (str.size()-1)-8);
+        begin += 8;
+        if ( end > begin )
+            --end;
     }
-    else if ( str.size() == 0 || str[0] != '/' )
+    else if ( begin == end || *begin != '/' )
     {
         // invalid CFI
         return false;
     }
     
-    StringList rangePieces = RangedCFIComponents(cfi);
-    if ( rangePieces.size() != 1 && rangePieces.size() != 3 )
+    // a location is a single path; a range is a common path, then start and end paths
+    const char* pieces[3][2];
+    size_t numPieces = 0;
+    for ( const char* p = begin; p != end; )
+    {
+        const char* next = SegmentEnd(p, end, ',');
+        if ( next == nullptr )
+            return false;
+        
+        if ( next != p )
+        {
+            if ( numPieces == 3 )
+                return false;
+            pieces[numPieces][0] = p;
+            pieces[numPieces][1] = next;
+            numPieces++;
+        }
+        
+        p = (next == end ? end : next + 1);
+    }
+    
+    if ( numPieces != 1 && numPieces != 3 )
         return false;
     
-    if ( CompileComponentsToList(CFIComponentStrings(rangePieces[0]), &_components) == false )
+    if ( CompileComponentsToList(pieces[0][0], pieces[0][1], &_components) == false )
         return false;
     
-    if ( rangePieces.size() == 3 )
+    if ( numPieces == 3 )
     {
-        if ( CompileComponentsToList(CFIComponentStrings(rangePieces[1]), &_rangeStart) == false )
+        if ( CompileComponentsToList(pieces[1][0], pieces[1][1], &_rangeStart) == false )
             return false;
-        if ( CompileComponentsToList(CFIComponentStrings(rangePieces[2]), &_rangeEnd) == false )
+        if ( CompileComponentsToList(pieces[2][0], pieces[2][1], &_rangeEnd) == false )
             return false;
         
         // now sanity-check the range delimiters:
@@ -303,9 +342,9 @@ bool CFI::CompileCFI(const string &str)
             return false;
         
         // where the delimiters' component ranges overlap, start must be <= end
-        auto maxsz = std::max(_rangeStart.size(), _rangeEnd.size());
+        auto minsz = std::min(_rangeStart.size(), _rangeEnd.size());
         bool inequalNodeIndexFound = false;
-        for ( decltype(maxsz) i = 0; i < maxsz; i++ )
+        for ( decltype(minsz) i = 0; i < minsz; i++ )
         {
             if ( _rangeStart[i].nodeIndex > _rangeEnd[i].nodeIndex )
                 return false;
@@ -335,18 +374,25 @@ bool CFI::CompileCFI(const string &str)
     
     return true;
 }
-bool CFI::CompileComponentsToList(const StringList &strings, ComponentList *list)
+bool CFI::CompileComponentsToList(const char* begin, const char* end, ComponentList* list)
 {
-    try
+    // a single allocation for the whole path; a '/' within a qualifier only over-reserves
+    list->reserve(list->size() + std::count(begin, end, '/') + 1);
+    
+    for ( const char* p = begin; p != end; )
     {
-        for ( auto str : strings )
+        const char* next = SegmentEnd(p, end, '/');
+        if ( next == nullptr )
+            return false;
+        
+        if ( next != p )
         {
-            list->emplace_back(str);
+            list->emplace_back();
+            if ( list->back().Parse(p, next) == false )
+                return false;
         }
-    }
-    catch (...)
-    {
-        return false;
+        
+        p = (next == end ? end : next + 1);
     }
     
     return true;
@@ -365,43 +411,40 @@ void CFI::Component::Parse(const string &str)
     if ( str.empty() )
         throw std::invalid_argument("Empty string supplied to CFI::Component");
     
-    std::string utf8 = str.stl_str();
-    std::istringstream iss(utf8);
-    
+    const std::string& utf8 = str.stl_str();
+    if ( Parse(utf8.data(), utf8.data() + utf8.size()) == false )
+        throw std::invalid_argument(_Str("Invalid string supplied to CFI::Component: ", str));
+}
+bool CFI::Component::Parse(const char* p, const char* end)
+{
     // read an integer
-    iss >> nodeIndex;
-    if ( nodeIndex == 0 && iss.fail() )
-        throw std::invalid_argument(_Str("No node value at start of CFI::Component string '", str, "'"));
+    if ( ParseInteger(p, end, &nodeIndex) == false )
+        return false;
     
-    while ( !iss.eof() )
+    while ( p != end )
     {
-        char next = 0;
-        iss >> next;
-        
-        switch ( next )
+        switch ( *p++ )
         {
             case '[':
             {
-                size_t pos = static_cast<size_t>(iss.tellg());
-                iss.ignore(std::numeric_limits<std::streamsize>::max(), ']');
-                size_t end = ((size_t)iss.tellg()) - 1;
-                
-                if ( iss.eof() )
-                    throw std::invalid_argument(_Str("Invalid string supplied to CFI::Component: ", str));
+                const char* close = static_cast<const char*>(std::memchr(p, ']', end-p));
+                if ( close == nullptr )
+                    return false;
                 
-                if ( characterOffset != 0 )
+                if ( HasCharacterOffset() )
                 {
                     // this is a text qualifier
-                    textQualifier = utf8.substr(pos, end-pos);
+                    textQualifier = string(p, close-p);
                     flags |= TextQualifier;
                 }
                 else
                 {
                     // it's a position qualifier
-                    qualifier = utf8.substr(pos, end-pos);
+                    qualifier = string(p, close-p);
                     flags |= Qualifier;
                 }
                 
+                p = close + 1;
                 break;
             }
                 
@@ -412,7 +455,8 @@ void CFI::Component::Parse(const string &str)
                     break;
                 
                 // read a numeral
-                iss >> temporalOffset;
+                if ( ParseFloat(p, end, &temporalOffset) == false )
+                    return false;
                 flags |= TemporalOffset;
                 break;
             }
@@ -427,15 +471,17 @@ void CFI::Component::Parse(const string &str)
                 float x, y;
                 
                 // read x
-                iss >> x;
+                if ( ParseFloat(p, end, &x) == false )
+                    return false;
                 
                 // check for and skip delimiter
-                if ( iss.peek() != ':' )
+                if ( p == end || *p != ':' )
                     break;
-                iss.ignore(1);
+                ++p;
                 
                 // read y
-                iss >> y;
+                if ( ParseFloat(p, end, &y) == false )
+                    return false;
                 
                 spatialOffset.x = x;
                 spatialOffset.y = y;
@@ -449,7 +495,8 @@ void CFI::Component::Parse(const string &str)
                 if ( HasSpatialTemporalOffset() )
                     break;
                 
-                iss >> characterOffset;
+                if ( ParseInteger(p, end, &characterOffset) == false )
+                    return false;
                 flags |= CharacterOffset;
                 break;
             }
@@ -457,7 +504,7 @@ void CFI::Component::Parse(const string &str)
             case '!':
             {
                 // must be the last character, and no offsets
-                if ( ((int)iss.peek()) != -1 || HasSpatialTemporalOffset() || HasCharacterOffset() )
+                if ( p != end || HasSpatialTemporalOffset() || HasCharacterOffset() )
                     break;
                 
                 flags |= Indirector;
@@ -468,6 +515,8 @@ void CFI::Component::Parse(const string &str)
                 break;
         }
     }
+    
+    return true;
 }
 bool CFI::Component::operator==(const ePub3::CFI::Component &o) const
 {
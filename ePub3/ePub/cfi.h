@@ -260,6 +260,12 @@ protected:
         
     private:
         void            Parse(const string& str);
+        ///
+        /// Parses a component from UTF-8 bytes, not including any leading `/`.
+        /// @result Returns `false` if the bytes don't describe a valid component.
+        bool            Parse(const char* begin, const char* end);
+        
+        friend class    CFI;
     };
     
     ///
@@ -296,17 +302,9 @@ protected:
     /// Appends components to a string stream. Used by Stringify().
     static void         AppendComponents(std::stringstream& stream, ComponentList::const_iterator start, ComponentList::const_iterator end);
     
-    typedef std::vector<string>    StringList;
-    
-    ///
-    /// Breaks a CFI string into its components.
-    static StringList   CFIComponentStrings(const string& cfi, const string& delimiter = "/");
-    ///
-    /// Breaks a ranged CFI string into base, start, and end CFI strings
-    static StringList   RangedCFIComponents(const string& cfi)          { return CFIComponentStrings(cfi, ","); }
     ///
-    /// Compiles CFI component strings into a component list.
-    static bool         CompileComponentsToList(const StringList& strings, ComponentList* list);
+    /// Compiles the `/`-delimited components in a span of UTF-8 bytes into a component list.
+    static bool         CompileComponentsToList(const char* begin, const char* end, ComponentList* list);
     ///
     /// Top-level CFI compilation method.
     bool                CompileCFI(const string& str);
@@ -25,29 +25,73 @@
 #include "archive_xml.h"
 #include "xpath_wrangler.h"
 #include "byte_stream.h"
+#include "trace.h"
+#include <ePub3/xml/schema_pool.h>
+#include <algorithm>
+#include <exception>
+#include <system_error>
+#include <thread>
 
 EPUB3_BEGIN_NAMESPACE
 
 static const char * gContainerFilePath = "META-INF/container.xml";
 static const char * gEncryptionFilePath = "META-INF/encryption.xml";
 static const char * gRootfilesXPath = "/ocf:container/ocf:rootfiles/ocf:rootfile";
-static const char * gRootfilePathsXPath = "/ocf:container/ocf:rootfiles/ocf:rootfile/@full-path";
 static const char * gVersionXPath = "/ocf:container/@version";
+static const char * gOCFNamespace = "urn:oasis:names:tc:opendocument:xmlns:container";
 
-Container::Container(const string& path) : _archive(Archive::Open(path.stl_str()))
+static std::atomic<size_t> gLoaderThreadCount(0);     // zero means 'one per hardware thread, up to the limit below'
+static const size_t gDefaultLoaderThreadLimit = 4;   // renditions rarely number more than this
+
+static Archive* OpenArchive(const string& path)
+{
+    Trace::Scope _("Archive::Open", path);
+    return Archive::Open(path.stl_str());
+}
+
+Container::Container(const string& path, bool lazy) : _archive(OpenArchive(path)), _key_info(nullptr), _lazy(lazy), _allPackagesLoaded(false)
 {
     if ( _archive == nullptr )
         throw std::invalid_argument(_Str("Path does not point to a recognised archive file: '", path, "'"));
     
-    // TODO: Initialize lazily? Doing so would make initialization faster, but require
-    // PackageLocations() to become non-const, like Packages().
+    ParseContainerDocument(path);
+    
+    // one slot for each package; in lazy mode they're filled in on demand
+    _packages.resize(_rootfiles.size(), nullptr);
+    if ( !_lazy )
+    {
+        LoadAllPackages();
+        _allPackagesLoaded = true;
+    }
+
+    LoadEncryption();
+}
+void Container::ParseContainerDocument(const string& path)
+{
+    Trace::Scope _("Container::ParseContainerXML", gContainerFilePath);
+    
     ArchiveXmlReader reader(_archive->ReaderAtPath(gContainerFilePath));
-    _ocf = reader.xmlReadDocument(gContainerFilePath, nullptr, XML_PARSE_RECOVER|XML_PARSE_NOENT|XML_PARSE_DTDATTR);
+    int flags = XML_PARSE_RECOVER|XML_PARSE_NOENT|XML_PARSE_DTDATTR;
+    
+    // any schema validation happens as the document is parsed, not in a second pass
+    xml::SchemaPool::CompiledSchema schema;
+    if ( Package::ValidatesSchema() )
+        schema = xml::SchemaPool::SchemaForNamespace(gOCFNamespace);
+    
+    string validationError;
+    bool valid = true;
+    if ( schema )
+        _ocf = reader.xmlReadValidatedDocument(gContainerFilePath, nullptr, flags, nullptr, schema, &valid, &validationError);
+    else
+        _ocf = reader.xmlReadDocument(gContainerFilePath, nullptr, flags);
     if ( _ocf == nullptr )
         throw std::invalid_argument(_Str(__PRETTY_FUNCTION__, ": No container.xml in ", path));
+    if ( !valid )
+        throw std::invalid_argument(_Str(__PRETTY_FUNCTION__, ": container.xml in ", path, " is not valid: ", validationError));
+    
     
-    XPathWrangler xpath(_ocf, {{"ocf", "urn:oasis:names:tc:opendocument:xmlns:container"}});
-    xmlNodeSetPtr nodes = xpath.Nodes(reinterpret_cast<const xmlChar*>(gRootfilesXPath));
+    _ocfXPath.reset(new XPathWrangler(_ocf, {{"ocf", gOCFNamespace}}));
+    xmlNodeSetPtr nodes = _ocfXPath->Nodes(reinterpret_cast<const xmlChar*>(gRootfilesXPath));
     
     if ( nodes == nullptr || nodes->nodeNr == 0 )
         throw std::invalid_argument(_Str(__PRETTY_FUNCTION__, ": No rootfiles in ", path));
@@ -56,22 +100,20 @@ Container::Container(const string& path) : _archive(Archive::Open(path.stl_str()
     {
         xmlNodePtr n = nodes->nodeTab[i];
         
-        const xmlChar * _type = xmlGetProp(n, reinterpret_cast<const xmlChar*>("media-type"));
-        std::string type((_type == nullptr ? "" : reinterpret_cast<const char*>(_type)));
-        
-        const xmlChar * _path = xmlGetProp(n, reinterpret_cast<const xmlChar*>("full-path"));
-        if ( _path == nullptr )
+        string fullPath = _getProp(n, "full-path");
+        if ( fullPath.empty() )
             continue;
         
-        _packages.push_back(new Package(_archive, _path, type));
+        _rootfiles.push_back({fullPath, _getProp(n, "media-type")});
     }
-
-    LoadEncryption();
+    
+    xmlXPathFreeNodeSet(nodes);
 }
-Container::Container(Container&& o) : _archive(o._archive), _ocf(o._ocf), _packages(std::move(o._packages))
+Container::Container(Container&& o) : _archive(o._archive), _ocf(o._ocf), _rootfiles(std::move(o._rootfiles)), _packages(std::move(o._packages)), _encryption(std::move(o._encryption)), _encryptionByPath(std::move(o._encryptionByPath)), _key_info(o._key_info), _lazy(o._lazy), _ocfXPath(std::move(o._ocfXPath)), _allPackagesLoaded(o._allPackagesLoaded.load())
 {
     o._archive = nullptr;
     o._ocf = nullptr;
+    o._key_info = nullptr;
     o._packages.clear();
 }
 Container::~Container()
@@ -83,27 +125,151 @@ Container::~Container()
 }
 Container::PathList Container::PackageLocations() const
 {
-    XPathWrangler xpath(_ocf, {{"ocf", "urn:oasis:names:tc:opendocument:xmlns:container"}});
-    
     PathList output;
-    for ( string& str : xpath.Strings(gRootfilePathsXPath) )
+    for ( auto& rootfile : _rootfiles )
     {
-        output.emplace_back(std::move(str));
+        output.push_back(rootfile.path);
     }
     
     return output;
 }
+const Container::PackageList& Container::Packages() const
+{
+    if ( _allPackagesLoaded )
+        return _packages;
+    
+    std::lock_guard<std::mutex> _(_packageLock);
+    LoadAllPackages();
+    _allPackagesLoaded = true;
+    
+    return _packages;
+}
 const Package* Container::DefaultPackage() const
 {
-    if ( _packages.empty() )
+    return PackageAt(0);
+}
+const Package* Container::PackageAt(size_t idx) const
+{
+    if ( idx >= _packages.size() )
         return nullptr;
-    return _packages[0];
+    if ( _allPackagesLoaded )
+        return _packages[idx];
+    
+    std::lock_guard<std::mutex> _(_packageLock);
+    return LoadPackageAt(idx);
 }
-string Container::Version() const
+Package* Container::LoadPackageAt(size_t idx) const
+{
+    if ( _packages[idx] == nullptr )
+    {
+        const Rootfile& rootfile = _rootfiles[idx];
+        _packages[idx] = new Package(_archive, rootfile.path, rootfile.mediaType);
+    }
+    
+    return _packages[idx];
+}
+void Container::LoadAllPackages() const
 {
-    XPathWrangler xpath(_ocf, {{"ocf", "urn:oasis:names:tc:opendocument:xmlns:container"}});
+    std::vector<size_t> pending;
+    for ( size_t i = 0; i < _packages.size(); i++ )
+    {
+        if ( _packages[i] == nullptr )
+            pending.push_back(i);
+    }
+    
+    if ( pending.empty() )
+        return;
+    
+    // each worker fills distinct slots of _packages and errors, so these need no lock
+    std::vector<std::exception_ptr> errors(_packages.size());
+    std::atomic<size_t> next(0);
+    auto worker = [&]() {
+        for ( size_t n = next++; n < pending.size(); n = next++ )
+        {
+            try
+            {
+                LoadPackageAt(pending[n]);
+            }
+            catch (...)
+            {
+                errors[pending[n]] = std::current_exception();
+            }
+        }
+    };
+    
+    std::vector<std::thread> threads;
+    size_t numThreads = std::min(pending.size(), LoaderThreadCount());
+    for ( size_t i = 1; i < numThreads; i++ )
+    {
+        try
+        {
+            threads.emplace_back(worker);
+        }
+        catch (std::system_error&)
+        {
+            break;      // make do with the threads we have
+        }
+    }
+    
+    // the calling thread does its share too
+    worker();
+    for ( auto& thread : threads )
+    {
+        thread.join();
+    }
+    
+    std::exception_ptr firstError;
+    std::vector<string> messages;
+    for ( size_t i : pending )
+    {
+        if ( !errors[i] )
+            continue;
+        
+        if ( !firstError )
+            firstError = errors[i];
+        
+        try
+        {
+            std::rethrow_exception(errors[i]);
+        }
+        catch (std::exception& e)
+        {
+            messages.push_back(_Str(_rootfiles[i].path, ": ", e.what()));
+        }
+        catch (...)
+        {
+            messages.push_back(_Str(_rootfiles[i].path, ": unknown error"));
+        }
+    }
+    
+    if ( messages.size() == 1 )
+        std::rethrow_exception(firstError);
     
-    std::vector<string> strings = xpath.Strings(gVersionXPath);
+    if ( !messages.empty() )
+    {
+        string description = _Str(messages.size(), " of ", _rootfiles.size(), " packages failed to load:");
+        for ( auto& message : messages )
+        {
+            description += _Str("\n    ", message);
+        }
+        throw std::invalid_argument(description.stl_str());
+    }
+}
+size_t Container::LoaderThreadCount()
+{
+    size_t count = gLoaderThreadCount;
+    if ( count == 0 )
+        count = std::min(static_cast<size_t>(std::max(std::thread::hardware_concurrency(), 1u)), gDefaultLoaderThreadLimit);
+    return count;
+}
+void Container::SetLoaderThreadCount(size_t count)
+{
+    gLoaderThreadCount = count;
+}
+string Container::Version() const
+{
+    std::lock_guard<std::mutex> _(_ocfXPathLock);
+    std::vector<string> strings = _ocfXPath->Strings(gVersionXPath);
     if ( strings.empty() )
         return "1.0";       // guess
     
@@ -111,6 +277,8 @@ string Container::Version() const
 }
 void Container::LoadEncryption()
 {
+    Trace::Scope _("Container::LoadEncryption");
+    
     ArchiveReader *pZipReader = _archive->ReaderAtPath(gEncryptionFilePath);
     if ( pZipReader == nullptr )
         return;
@@ -132,6 +300,7 @@ void Container::LoadEncryption()
     for ( size_t i = 0; i < nodes->nodeNr; i++ )
     {
         _encryption.emplace_back(new EncryptionInfo(nodes->nodeTab[i]));
+        _encryptionByPath.insert(_encryption.back()->Path().stl_str(), _encryption.back());
     }
     
     xmlNodeSetPtr keyNodes = xpath.Nodes("/ocf:encryption/enc:EncryptedKey");
@@ -153,42 +322,33 @@ bool Container::IsContainerEncrypted() const
 
 const EncryptionInfo* Container::EncryptionInfoForPath(const string &path) const
 {
-    for ( auto item : _encryption )
+    EncryptionInfo* const* found = _encryptionByPath.find(path.stl_str());
+    if ( found == nullptr )
+        return nullptr;
+    
+    const EncryptionInfo* item = *found;
+    if ( _key_info == nullptr )
     {
-        if ( item->Path() == path)
+        // without an EncryptedKey only items which don't name one (i.e. obfuscated fonts) are usable
+        if ( !item->Retrieval_Method().empty() )
         {
-            if (item->Retrieval_Method() != _key_info->Location())
-            {
-                fprintf(stderr, "Container::LoadEncryption(): RetrievalMethod URI %s for %s does not exist \n", item->Retrieval_Method().c_str(), item->Path().c_str());
-                return nullptr;
-            }
-            
-            return item;
+            fprintf(stderr, "Container::EncryptionInfoForPath(): no EncryptedKey for RetrievalMethod URI %s of %s\n", item->Retrieval_Method().c_str(), item->Path().c_str());
+            return nullptr;
         }
-        
+        return item;
+    }
+    if (item->Retrieval_Method() != _key_info->Location())
+    {
+        fprintf(stderr, "Container::LoadEncryption(): RetrievalMethod URI %s for %s does not exist \n", item->Retrieval_Method().c_str(), item->Path().c_str());
+        return nullptr;
     }
     
-    return nullptr;
+    return item;
 }
 
 bool Container::IsPathEncrypted(const ePub3::string &path) const
 {
-    for ( auto item : _encryption )
-    {
-        if ( item->Path() == path)
-        {
-            if (item->Retrieval_Method() != _key_info->Location())
-            {
-                fprintf(stderr, "Container::LoadEncryption(): RetrievalMethod URI %s for %s does not exist \n", item->Retrieval_Method().c_str(), item->Path().c_str());
-                return false;
-            }
-            
-            return true;
-        }
-        
-    }
-    
-    return false;
+    return (Container::EncryptionInfoForPath(path) != nullptr);
 }
 
 Auto<ByteStream> Container::ReadStreamAtPath(const string &path) const
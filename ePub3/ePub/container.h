@@ -26,10 +26,14 @@
 #include <ePub3/encryption.h>
 #include <ePub3/encryption_key.h>
 #include <ePub3/package.h>
+#include <ePub3/xpath_wrangler.h>
 #include <ePub3/utilities/utfstring.h>
+#include <ePub3/utilities/flat_hash_map.h>
 #include <libxml/tree.h>
 #include <libxml/xpath.h>
 #include <vector>
+#include <mutex>
+#include <atomic>
 
 EPUB3_BEGIN_NAMESPACE
 
@@ -49,6 +53,20 @@ class ByteStream;
  all Packages within the container, and all EncryptionInfo instances from
  META-INF/encryption.xml.
  
+ @remarks A Container may be created in *lazy* mode, in which case only the paths
+ of its rootfiles are read up front. Each Package is then constructed the first
+ time it is requested through PackageAt(), DefaultPackage() or Packages(); this is
+ thread-safe, and a package is never constructed more than once. Any exception
+ thrown while constructing a Package is passed on to the caller which requested
+ it, and a subsequent request will try again.
+ 
+ @remarks When a container has more than one rootfile (for example, fixed-layout
+ and reflowable renditions of the same publication), its packages are constructed
+ concurrently, using up to LoaderThreadCount() threads. This happens in the
+ constructor, or in lazy mode the first time Packages() is called. If exactly one
+ package fails to load, its own exception is passed on; if several fail, a single
+ `std::invalid_argument` describing each of the failures is thrown instead.
+ 
  @ingroup epub-model
  */
 class Container
@@ -68,8 +86,10 @@ public:
     /**
      Create a new Container.
      @param path The filesystem path to the container file (i.e. the .epub file).
+     @param lazy If `true`, no Package will be constructed until it is first
+     requested. The default is to construct all packages immediately.
      */
-                Container(const string& path);
+                Container(const string& path, bool lazy=false);
     ///
     /// There is no copy constructor.
                 Container(const Container&)                 = delete;
@@ -82,21 +102,52 @@ public:
     /// Retrieves the paths for all Package documents in the container.
     virtual PathList                PackageLocations()      const;
     
-    ///
-    /// Retrieves the list of all instantiated packages within the container.
-    virtual const PackageList&      Packages()              const   { return _packages; }
+    /**
+     Retrieves the list of all packages within the container.
+     
+     In lazy mode this will construct any packages which have not yet been loaded.
+     */
+    virtual const PackageList&      Packages()              const;
     
     /**
      Retrieves the default Package instance.
      
-     Equivalent to `this->Packages().at(0)`.
+     Equivalent to `this->PackageAt(0)`, and in lazy mode it will only construct
+     that one package.
      */
     virtual const Package*          DefaultPackage()        const;
     
+    ///
+    /// The number of rootfiles (and thus packages) in the container. Never loads a package.
+    size_t                          PackageCount()          const   { return _rootfiles.size(); }
+    
+    /**
+     Retrieves a single package, constructing it if necessary.
+     @param idx The index of the package's rootfile within container.xml.
+     @result The requested Package, or `nullptr` if `idx` is out of range.
+     */
+    virtual const Package*          PackageAt(size_t idx)   const;
+    
+    ///
+    /// Whether this container constructs its packages on demand.
+    bool                            LoadsPackagesLazily()   const   { return _lazy; }
+    
     ///
     /// The OCF version of the container document.
     virtual string                  Version()               const;
     
+    /**
+     The maximum number of threads used to construct a container's packages.
+     
+     Defaults to the number of hardware threads available, but no more than four. A
+     value of one means that packages are always constructed one after another, on
+     the calling thread.
+     */
+    static size_t                   LoaderThreadCount();
+    ///
+    /// Sets the maximum number of loader threads. Zero restores the default.
+    static void                     SetLoaderThreadCount(size_t count);
+    
     /// Returns true if container is encrypted, or false if not
     
     virtual bool                    IsContainerEncrypted()  const;
@@ -135,14 +186,40 @@ public:
     virtual Auto<ByteStream>        ReadStreamAtPath(const string& path)        const;
     
 protected:
+    ///
+    /// The location and media type of a package document, from an OCF `rootfile` element.
+    struct Rootfile
+    {
+        string          path;
+        string          mediaType;
+    };
+    
     Archive *           _archive;
     xmlDocPtr           _ocf;
-    PackageList         _packages;
+    std::vector<Rootfile> _rootfiles;       ///< All rootfiles, in document order.
+    mutable PackageList _packages;          ///< One slot per rootfile; in lazy mode, unloaded slots are `nullptr`.
     EncryptionList      _encryption;
+    FlatHashMap<EncryptionInfo*> _encryptionByPath;    ///< The entries from `_encryption`, hashed by path.
     EncryptionKeyInfo * _key_info;
+    bool                _lazy;
+    
+    Auto<XPathWrangler>         _ocfXPath;          ///< Reusable XPath context for `_ocf`.
+    mutable std::mutex          _ocfXPathLock;      ///< Serializes use of `_ocfXPath`.
+    mutable std::mutex          _packageLock;       ///< Serializes lazy package construction.
+    mutable std::atomic<bool>   _allPackagesLoaded; ///< Set once every slot in _packages is filled.
+    
+    ///
+    /// Reads and validates META-INF/container.xml, and collects its rootfiles.
+    void            ParseContainerDocument(const string& path);
     ///
     /// Parses the file META-INF/encryption.xml into an EncryptionList.
     void            LoadEncryption();
+    ///
+    /// Constructs the package at a given index, if needed. Caller must hold _packageLock.
+    Package*        LoadPackageAt(size_t idx)   const;
+    ///
+    /// Constructs all packages not yet loaded, concurrently. Caller must hold _packageLock.
+    void            LoadAllPackages()           const;
 };
 
 EPUB3_END_NAMESPACE
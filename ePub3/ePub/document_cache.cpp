@@ -0,0 +1,106 @@
+//
+//  document_cache.cpp
+//  ePub3
+//
+//  Copyright (c) 2012-2013 The Readium Foundation and contributors.
+//
+//  The Readium SDK is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#include "document_cache.h"
+
+EPUB3_BEGIN_NAMESPACE
+
+const size_t DocumentCache::DefaultCapacity;
+
+Shared<const xmlDoc> DocumentCache::Document(const string& path, const Loader& loader)
+{
+    {
+        std::lock_guard<std::mutex> _(_lock);
+        auto found = _index.find(path);
+        if ( found != _index.end() )
+        {
+            // move it to the front of the list
+            _entries.splice(_entries.begin(), _entries, found->second);
+            return found->second->second;
+        }
+    }
+
+    // parse without holding the lock
+    xmlDocPtr doc = loader();
+    if ( doc == nullptr )
+        return nullptr;
+
+    Shared<const xmlDoc> result(doc, _deleter);
+
+    std::lock_guard<std::mutex> _(_lock);
+    if ( _capacity == 0 )
+        return result;
+
+    auto found = _index.find(path);
+    if ( found != _index.end() )
+    {
+        // someone else beat us to it-- use theirs, and ours is freed on return
+        _entries.splice(_entries.begin(), _entries, found->second);
+        return found->second->second;
+    }
+
+    _entries.emplace_front(path, result);
+    _index[path] = _entries.begin();
+    Trim();
+
+    return result;
+}
+size_t DocumentCache::Capacity() const
+{
+    std::lock_guard<std::mutex> _(_lock);
+    return _capacity;
+}
+void DocumentCache::SetCapacity(size_t capacity)
+{
+    std::lock_guard<std::mutex> _(_lock);
+    _capacity = capacity;
+    Trim();
+}
+size_t DocumentCache::Size() const
+{
+    std::lock_guard<std::mutex> _(_lock);
+    return _entries.size();
+}
+void DocumentCache::Evict(const string& path)
+{
+    std::lock_guard<std::mutex> _(_lock);
+    auto found = _index.find(path);
+    if ( found == _index.end() )
+        return;
+
+    _entries.erase(found->second);
+    _index.erase(found);
+}
+void DocumentCache::Purge()
+{
+    std::lock_guard<std::mutex> _(_lock);
+    _index.clear();
+    _entries.clear();
+}
+void DocumentCache::Trim()
+{
+    while ( _entries.size() > _capacity )
+    {
+        _index.erase(_entries.back().first);
+        _entries.pop_back();
+    }
+}
+
+EPUB3_END_NAMESPACE
@@ -0,0 +1,125 @@
+//
+//  document_cache.h
+//  ePub3
+//
+//  Copyright (c) 2012-2013 The Readium Foundation and contributors.
+//
+//  The Readium SDK is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#ifndef __ePub3__document_cache__
+#define __ePub3__document_cache__
+
+#include <ePub3/epub3.h>
+#include <ePub3/utilities/utfstring.h>
+#include <libxml/tree.h>
+#include <functional>
+#include <list>
+#include <map>
+#include <mutex>
+
+EPUB3_BEGIN_NAMESPACE
+
+/**
+ A bounded cache of parsed XML documents, keyed by their path within a container.
+
+ Documents are handed out as reference-counted `Shared<const xmlDoc>` handles, which
+ free the underlying `xmlDoc` once the last handle is released. Since every client of
+ a path shares the same tree, documents are read-only once cached. The cache holds one such
+ handle for each of the most recently used documents, up to its capacity; when a new
+ document is added to a full cache, the least-recently used entry is dropped. Since
+ clients hold their own handles, a document evicted from the cache remains valid for
+ as long as anyone is still using it.
+
+ @remarks All methods are thread-safe. Documents are parsed outside the cache's lock,
+ so two threads requesting the same uncached document at once may both parse it; the
+ first to finish is cached and the other's copy is discarded.
+
+ @ingroup epub-model
+ */
+class DocumentCache
+{
+public:
+    ///
+    /// A function which parses and returns a new document, or `nullptr` on failure.
+    typedef std::function<xmlDocPtr()>      Loader;
+    ///
+    /// A function which frees a document once nobody is using it.
+    typedef std::function<void(xmlDocPtr)>  Deleter;
+
+    ///
+    /// The number of documents retained by default.
+    static const size_t                     DefaultCapacity = 8;
+
+public:
+    /**
+     Creates a new, empty cache.
+     @param capacity The maximum number of documents to retain. A capacity of zero
+     disables caching: each lookup will invoke its loader.
+     @param deleter The function used to free documents; the default is `xmlFreeDoc()`.
+     */
+                        DocumentCache(size_t capacity=DefaultCapacity, Deleter deleter=xmlFreeDoc) : _capacity(capacity), _deleter(deleter) {}
+                        DocumentCache(const DocumentCache&)         = delete;
+    virtual             ~DocumentCache() {}
+
+    /**
+     Returns the cached document for a path, loading it if necessary.
+     @param path The path of the document within its container.
+     @param loader A function to parse the document if it is not in the cache.
+     @result A shared handle to the document, or an empty handle if the document
+     could not be loaded.
+     */
+    Shared<const xmlDoc> Document(const string& path, const Loader& loader);
+
+    ///
+    /// The maximum number of documents retained by the cache.
+    size_t              Capacity()                  const;
+
+    /**
+     Changes the maximum number of documents retained by the cache, evicting the
+     least-recently used documents if it now holds too many.
+     */
+    void                SetCapacity(size_t capacity);
+
+    ///
+    /// The number of documents currently retained by the cache.
+    size_t              Size()                      const;
+
+    ///
+    /// Removes any document with the given path from the cache.
+    void                Evict(const string& path);
+
+    ///
+    /// Removes all documents from the cache.
+    void                Purge();
+
+protected:
+    typedef std::pair<string, Shared<const xmlDoc>> Entry;
+    typedef std::list<Entry>                    EntryList;
+
+    EntryList                                   _entries;   ///< Cached documents, most-recently used first.
+    std::map<string, EntryList::iterator>       _index;     ///< Lookup table for `_entries`, indexed by path.
+    size_t                                      _capacity;  ///< The maximum size of `_entries`.
+    Deleter                                     _deleter;   ///< Frees each document when its last handle is released.
+    mutable std::mutex                          _lock;      ///< Guards all the above.
+
+    ///
+    /// Drops least-recently used entries until the cache is within capacity. The caller must hold `_lock`.
+    void                Trim();
+
+};
+
+EPUB3_END_NAMESPACE
+
+#endif /* defined(__ePub3__document_cache__) */
@@ -33,33 +33,38 @@ EncryptionInfo::EncryptionInfo(xmlNodePtr node)
     {
         fprintf(stderr, "Container::LoadEncryption() error: Node does not contain /enc:EncryptionMethod/@Algorithm \n");
     }
-    if (strings[0] != EncryptedDataAlgorithmID)
+    else
     {
-        fprintf(stderr, "Container::LoadEncryption() error: EncryptionMethod Algorithm %s does not match AES-128 (http://www.w3.org/2001/04/xmlenc#kw-aes128) \n", strings[0].c_str());
+        if (strings[0] != EncryptedDataAlgorithmID)
+        {
+            fprintf(stderr, "Container::LoadEncryption() error: EncryptionMethod Algorithm %s does not match AES-128 (http://www.w3.org/2001/04/xmlenc#kw-aes128) \n", strings[0].c_str());
+        }
+        _algorithm = strings[0];
     }
-    _algorithm = strings[0];
     
+    // obfuscated fonts name no key, so these are optional
     strings = xpath.Strings("./dsig:KeyInfo/dsig:RetrievalMethod/@URI", node);
-    if (strings.empty())
+    if (!strings.empty())
     {
-        fprintf(stderr, "Container::LoadEncryption() error: Node does not contain /dsig:KeyInfo/dsig:RetrievalMethod/@URI \n");
+        strings[0].erase(0, 1);
+        _retrieval_method = strings[0];
     }
-    strings[0].erase(0, 1);
-    _retrieval_method = strings[0];
     
     strings = xpath.Strings("./dsig:KeyInfo/dsig:KeyIV", node);
-    if (strings.empty())
+    if (!strings.empty())
     {
-        fprintf(stderr, "Container::LoadEncryption() error: Node does not contain ./dsig:KeyInfo/dsig:KeyIV \n");
+        _keyIV = strings[0];
     }
-    _keyIV = strings[0];
     
     strings = xpath.Strings("./enc:CipherData/enc:CipherReference/@URI", node);
     if (strings.empty())
     {
         fprintf(stderr, "Container::LoadEncryption() error: Node does not contain /enc:CipherData/enc:CipherReference/@URI \n");
     }
-    _path = strings[0];
+    else
+    {
+        _path = strings[0];
+    }
     
 }
 
@@ -33,6 +33,8 @@ EPUB3_BEGIN_NAMESPACE
 class Package;
 class Container;
 
+template <class _Filter> struct FilterStageTraits;
+
 /**
  ContentFilter is an abstract base class from which all content filters must be
  derived.
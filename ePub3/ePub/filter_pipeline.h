@@ -0,0 +1,376 @@
+//
+//  filter_pipeline.h
+//  ePub3
+//
+//  Copyright (c) 2012-2013 The Readium Foundation and contributors.
+//
+//  The Readium SDK is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#ifndef __ePub3__filter_pipeline__
+#define __ePub3__filter_pipeline__
+
+#include <ePub3/filter.h>
+#include <ePub3/font_obfuscation.h>
+#include <ePub3/switch_preprocessor.h>
+#include <ePub3/object_preprocessor.h>
+#include <tuple>
+#include <type_traits>
+#include <algorithm>
+#include <cstdint>
+
+EPUB3_BEGIN_NAMESPACE
+
+/**
+ Describes how a FilterPipeline drives one of its stages.
+
+ The primary template simply defers to the stage's ContentFilter interface, so
+ any filter (including third-party ones) can be used as a pipeline stage. The
+ built-in filters are specialized below so that their type-sniffers are called
+ directly rather than through a std::function, and so that the font obfuscator
+ can take part in byte-transform fusion.
+
+ A specialization which sets `IsByteTransform` to `true` must also provide:
+
+ - `TransformLimit(const F&)`: the number of bytes, starting at the stage's current
+   stream offset, which it will still modify.
+ - `TransformByte(const F&, uint8_t b, size_t i)`: returns the transformed value of
+   the byte at index `i` relative to the stage's current offset, or `b` unchanged
+   if `i` lies beyond the stage's TransformLimit().
+ - `Advance(F&, size_t len)`: moves the stage's stream offset forward.
+
+ Byte transforms must be length-preserving, must work in-place, and must not require
+ complete data.
+ @ingroup filters
+ */
+template <class _Filter>
+struct FilterStageTraits
+{
+    static const bool IsByteTransform = false;
+
+    static bool Sniff(const _Filter& f, const ManifestItem* item, const EncryptionInfo* encInfo)
+        { return f.TypeSniffer()(item, encInfo); }
+    static bool RequiresCompleteData(const _Filter& f)
+        { return f.RequiresCompleteData(); }
+    static void* FilterData(_Filter& f, void* data, size_t len, size_t* outputLen)
+        { return f.FilterData(data, len, outputLen); }
+};
+
+template <>
+struct FilterStageTraits<FontObfuscator>
+{
+    static const bool IsByteTransform = true;
+
+    static bool Sniff(const FontObfuscator& f, const ManifestItem* item, const EncryptionInfo* encInfo)
+        { return FontObfuscator::FontTypeSniffer(item, encInfo); }
+    static bool RequiresCompleteData(const FontObfuscator& f)
+        { return false; }
+    static void* FilterData(FontObfuscator& f, void* data, size_t len, size_t* outputLen)
+        { return f.FontObfuscator::FilterData(data, len, outputLen); }
+
+    static size_t TransformLimit(const FontObfuscator& f)
+        { return (f._bytesFiltered < FontObfuscator::ObfuscatedLength ? FontObfuscator::ObfuscatedLength - f._bytesFiltered : 0); }
+    static uint8_t TransformByte(const FontObfuscator& f, uint8_t b, size_t i)
+        {
+            size_t off = i + f._bytesFiltered;
+            return (off < FontObfuscator::ObfuscatedLength ? b ^ f._key[off%FontObfuscator::KeySize] : b);
+        }
+    static void Advance(FontObfuscator& f, size_t len)
+        { f._bytesFiltered += len; }
+};
+
+template <>
+struct FilterStageTraits<SwitchPreprocessor>
+{
+    static const bool IsByteTransform = false;
+
+    static bool Sniff(const SwitchPreprocessor& f, const ManifestItem* item, const EncryptionInfo* encInfo)
+        { return SwitchPreprocessor::SniffSwitchableContent(item, encInfo); }
+    static bool RequiresCompleteData(const SwitchPreprocessor& f)
+        { return true; }
+    static void* FilterData(SwitchPreprocessor& f, void* data, size_t len, size_t* outputLen)
+        { return f.SwitchPreprocessor::FilterData(data, len, outputLen); }
+};
+
+template <>
+struct FilterStageTraits<ObjectPreprocessor>
+{
+    static const bool IsByteTransform = false;
+
+    // a preprocessor with no handlers disables itself (see its constructor)
+    static bool Sniff(const ObjectPreprocessor& f, const ManifestItem* item, const EncryptionInfo* encInfo)
+        { return !f._handlers.empty() && ObjectPreprocessor::ShouldApply(item, encInfo); }
+    static bool RequiresCompleteData(const ObjectPreprocessor& f)
+        { return true; }
+    static void* FilterData(ObjectPreprocessor& f, void* data, size_t len, size_t* outputLen)
+        { return f.ObjectPreprocessor::FilterData(data, len, outputLen); }
+};
+
+namespace __pipeline {
+
+    template <class _Tuple, size_t _Idx>
+    using StageType = typename std::tuple_element<_Idx, _Tuple>::type;
+
+    template <class _Tuple, size_t _Idx>
+    using StageTraits = FilterStageTraits<StageType<_Tuple, _Idx>>;
+
+    // Computes (at compile time) the end of the run of byte-transform stages which
+    // begins at _Idx. If stage _Idx isn't a byte transform, the run is empty.
+    template <class _Tuple, size_t _Idx, size_t _End = std::tuple_size<_Tuple>::value, bool = (_Idx < _End)>
+    struct ByteRunEnd
+    {
+        static const size_t value = (StageTraits<_Tuple, _Idx>::IsByteTransform ? ByteRunEnd<_Tuple, _Idx+1>::value : _Idx);
+    };
+    template <class _Tuple, size_t _Idx, size_t _End>
+    struct ByteRunEnd<_Tuple, _Idx, _End, false>
+    {
+        static const size_t value = _Idx;
+    };
+
+    // Per-stage helpers for each stage in [_Idx, _End), unrolled at compile time.
+    template <class _Tuple, size_t _Idx, size_t _End, bool = (_Idx < _End)>
+    struct ForRange
+    {
+        typedef StageTraits<_Tuple, _Idx>               Traits;
+        typedef ForRange<_Tuple, _Idx+1, _End>          Next;
+
+        static uint32_t Sniff(const _Tuple& t, const ManifestItem* item, const EncryptionInfo* encInfo)
+        {
+            uint32_t mask = (Traits::Sniff(std::get<_Idx>(t), item, encInfo) ? (1u << _Idx) : 0);
+            return mask | Next::Sniff(t, item, encInfo);
+        }
+        static bool RequiresCompleteData(const _Tuple& t, uint32_t active)
+        {
+            if ( (active & (1u << _Idx)) != 0 && Traits::RequiresCompleteData(std::get<_Idx>(t)) )
+                return true;
+            return Next::RequiresCompleteData(t, active);
+        }
+
+        // byte-transform runs only
+        static size_t TransformLimit(const _Tuple& t, uint32_t active)
+        {
+            size_t limit = ((active & (1u << _Idx)) != 0 ? Traits::TransformLimit(std::get<_Idx>(t)) : 0);
+            return std::max(limit, Next::TransformLimit(t, active));
+        }
+        static uint8_t TransformByte(const _Tuple& t, uint32_t active, uint8_t b, size_t i)
+        {
+            if ( (active & (1u << _Idx)) != 0 )
+                b = Traits::TransformByte(std::get<_Idx>(t), b, i);
+            return Next::TransformByte(t, active, b, i);
+        }
+        static void Advance(_Tuple& t, uint32_t active, size_t len)
+        {
+            if ( (active & (1u << _Idx)) != 0 )
+                Traits::Advance(std::get<_Idx>(t), len);
+            Next::Advance(t, active, len);
+        }
+    };
+    template <class _Tuple, size_t _Idx, size_t _End>
+    struct ForRange<_Tuple, _Idx, _End, false>
+    {
+        static uint32_t Sniff(const _Tuple&, const ManifestItem*, const EncryptionInfo*) { return 0; }
+        static bool RequiresCompleteData(const _Tuple&, uint32_t) { return false; }
+        static size_t TransformLimit(const _Tuple&, uint32_t) { return 0; }
+        static uint8_t TransformByte(const _Tuple&, uint32_t, uint8_t b, size_t) { return b; }
+        static void Advance(_Tuple&, uint32_t, size_t) {}
+    };
+
+    // Runs the stages starting at _Idx. Adjacent byte transforms are applied in a
+    // single pass over the buffer; everything else goes through its FilterData().
+    template <class _Tuple, size_t _Idx, size_t _Run = ByteRunEnd<_Tuple, _Idx>::value, bool = (_Idx < std::tuple_size<_Tuple>::value)>
+    struct Runner
+    {
+        // a run of fused byte transforms: [_Idx, _Run)
+        static void* Run(_Tuple& t, uint32_t active, void* data, size_t len, size_t* outputLen, void* input)
+        {
+            typedef ForRange<_Tuple, _Idx, _Run> Fused;
+
+            uint8_t* buf = reinterpret_cast<uint8_t*>(data);
+            size_t limit = std::min(len, Fused::TransformLimit(t, active));
+            for ( size_t i = 0; i < limit; i++ )
+                buf[i] = Fused::TransformByte(t, active, buf[i], i);
+            Fused::Advance(t, active, len);
+
+            return Runner<_Tuple, _Run>::Run(t, active, data, len, outputLen, input);
+        }
+    };
+    template <class _Tuple, size_t _Idx>
+    struct Runner<_Tuple, _Idx, _Idx, true>
+    {
+        // a single stage which isn't a byte transform
+        static void* Run(_Tuple& t, uint32_t active, void* data, size_t len, size_t* outputLen, void* input)
+        {
+            if ( (active & (1u << _Idx)) == 0 )
+                return Runner<_Tuple, _Idx+1>::Run(t, active, data, len, outputLen, input);
+
+            void* result = StageTraits<_Tuple, _Idx>::FilterData(std::get<_Idx>(t), data, len, &len);
+            if ( result != data && data != input )
+                delete [] reinterpret_cast<char*>(data);        // an intermediate buffer from an earlier stage
+            
+            if ( result == nullptr )
+            {
+                // the stage failed, so the chain stops here
+                *outputLen = 0;
+                return nullptr;
+            }
+            
+            return Runner<_Tuple, _Idx+1>::Run(t, active, result, len, outputLen, input);
+        }
+    };
+    template <class _Tuple, size_t _Idx, size_t _Run>
+    struct Runner<_Tuple, _Idx, _Run, false>
+    {
+        static void* Run(_Tuple&, uint32_t, void* data, size_t len, size_t* outputLen, void*)
+        {
+            *outputLen = len;
+            return data;
+        }
+    };
+
+}
+
+/**
+ A content filter composed at compile time from a fixed sequence of other filters.
+
+ Where a chain of ContentFilter instances is walked at runtime (with a virtual
+ FilterData() and a std::function type-sniffer call for each link), a
+ FilterPipeline knows the concrete type of each of its stages. Sniffers and filter
+ functions are therefore called directly and can be inlined, and any adjacent
+ stages which are simple byte transforms (see FilterStageTraits) are fused into a
+ single pass over each buffer.
+
+ The pipeline is itself a ContentFilter, so it can be installed at any point in a
+ dynamic filter chain alongside plug-in filters: its type-sniffer matches any item
+ that one of its stages would match, and its Next() filter is left untouched.
+
+ Stages run in the order in which they're listed; this is the opposite of the LIFO
+ order of a dynamic chain, so the typical production chain of de-obfuscation,
+ then `epub:switch` processing, then `object` replacement, is written as
+ `FilterPipeline<FontObfuscator, SwitchPreprocessor, ObjectPreprocessor>`.
+
+ Stages which return a new buffer must allocate it with `new char[]`, as the
+ built-in filters do, since the pipeline frees intermediate buffers itself. If any
+ stage returns `nullptr` the remaining stages are skipped and the pipeline returns
+ `nullptr`.
+
+ Like the individual filters, a pipeline holds per-resource state: the type-sniffer
+ records which stages apply to the item it was asked about, and FilterData() then
+ runs only those stages. Use FilterData(const ManifestItem*, const EncryptionInfo*,
+ void*, size_t, size_t*) to do both in one call.
+
+ @note Stages are dispatched statically, so a sniffer assigned to a stage via
+ SetTypeSniffer() is ignored unless that stage uses the default FilterStageTraits.
+ @ingroup filters
+ */
+template <class... _Stages>
+class FilterPipeline : public ContentFilter
+{
+public:
+    typedef std::tuple<_Stages...>          StageList;
+    static const size_t                     StageCount = sizeof...(_Stages);
+
+    static_assert(StageCount > 0, "A FilterPipeline needs at least one stage");
+    static_assert(StageCount <= 32, "A FilterPipeline can have at most 32 stages");
+
+public:
+    ///
+    /// Creates a pipeline from its stages, which are moved into place.
+    FilterPipeline(_Stages&&... stages)
+        : ContentFilter(nullptr), _stages(std::move(stages)...), _active(0), _gate()
+        {
+            ContentFilter::SetTypeSniffer([this](const ManifestItem* item, const EncryptionInfo* encInfo) {
+                return Bind(item, encInfo);
+            });
+        }
+    ///
+    /// No copy constructor: each stage may hold per-resource state.
+    FilterPipeline(const FilterPipeline&)   = delete;
+    virtual ~FilterPipeline() {}
+
+    ///
+    /// Accesses a stage directly.
+    template <size_t _Idx>
+    typename std::tuple_element<_Idx, StageList>::type& Stage()             { return std::get<_Idx>(_stages); }
+    template <size_t _Idx>
+    const typename std::tuple_element<_Idx, StageList>::type& Stage() const { return std::get<_Idx>(_stages); }
+
+    /**
+     Determines which stages apply to a given item, and remembers the result for
+     subsequent calls to FilterData().
+     @result `true` if any stage applies to the item.
+     */
+    bool Bind(const ManifestItem* item, const EncryptionInfo* encInfo)
+        {
+            if ( _gate && !_gate(item, encInfo) )
+                _active = 0;
+            else
+                _active = __pipeline::ForRange<StageList, 0, StageCount>::Sniff(_stages, item, encInfo);
+            return _active != 0;
+        }
+
+    /**
+     Restricts the items to which the pipeline applies.
+     
+     The pipeline's own type-sniffer, which consults each stage, stays in place; `fn`
+     is checked first, and an item it rejects binds no stages at all.
+     @param fn A sniffer which must accept an item before any stage is consulted, or
+     `nullptr` to remove a previous restriction.
+     */
+    virtual void SetTypeSniffer(TypeSnifferFn fn)   { _gate = fn; }
+
+    ///
+    /// Returns `true` if any of the stages bound to the current item need complete data.
+    virtual bool RequiresCompleteData() const
+        {
+            return __pipeline::ForRange<StageList, 0, StageCount>::RequiresCompleteData(_stages, _active);
+        }
+
+    /**
+     Runs each bound stage over the data in turn.
+
+     Any intermediate buffers allocated by one stage and replaced by a later one are
+     released here; as with any other filter, if the returned pointer differs from
+     `data` then the caller owns it.
+     */
+    virtual void* FilterData(void* data, size_t len, size_t* outputLen)
+        {
+            return __pipeline::Runner<StageList, 0>::Run(_stages, _active, data, len, outputLen, data);
+        }
+
+    ///
+    /// Binds to the given item and runs the applicable stages over the data.
+    void* FilterData(const ManifestItem* item, const EncryptionInfo* encInfo, void* data, size_t len, size_t* outputLen)
+        {
+            if ( !Bind(item, encInfo) )
+            {
+                *outputLen = len;
+                return data;
+            }
+            return FilterData(data, len, outputLen);
+        }
+
+protected:
+    StageList       _stages;
+    uint32_t        _active;        ///< Bitmask of stages bound to the current item.
+    TypeSnifferFn   _gate;          ///< An optional sniffer consulted ahead of the stages'.
+
+};
+
+///
+/// The standard reading pipeline: font de-obfuscation, `epub:switch` and `object` preprocessing.
+typedef FilterPipeline<FontObfuscator, SwitchPreprocessor, ObjectPreprocessor>  StandardFilterPipeline;
+
+EPUB3_END_NAMESPACE
+
+#endif /* defined(__ePub3__filter_pipeline__) */
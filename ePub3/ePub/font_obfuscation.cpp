@@ -22,6 +22,7 @@
 #include "font_obfuscation.h"
 #include "container.h"
 #include "package.h"
+#include <cctype>
 
 // OpenSSL APIs are deprecated on OS X and iOS
 #if defined(__MAC_OS_X_VERSION_MIN_REQUIRED) || defined(__IPHONE_OS_VERSION_MIN_REQUIRED)
@@ -33,15 +34,26 @@
 
 EPUB3_BEGIN_NAMESPACE
 
-const REGEX_NS::regex FontObfuscator::TypeCheck("(?:font/.*|application/(?:x-font-.*|vnd.ms-(?:opentype|fontobject)))");
+bool FontObfuscator::IsFontType(const string& mediaType)
+{
+    const std::string& type = mediaType.stl_str();
+    if ( type.compare(0, 5, "font/") == 0 )
+        return true;
+    if ( type.compare(0, 12, "application/") != 0 )
+        return false;
+    
+    return (type.compare(12, 7, "x-font-") == 0 ||
+            type.compare(12, std::string::npos, "vnd.ms-opentype") == 0 ||
+            type.compare(12, std::string::npos, "vnd.ms-fontobject") == 0);
+}
 
 void * FontObfuscator::FilterData(void *data, size_t len, size_t *outputLen)
 {
     uint8_t *buf = static_cast<uint8_t*>(data);
-    for ( int i = 0; i < len && (i + _bytesFiltered) < 1040; i++)
+    for ( int i = 0; i < len && (i + _bytesFiltered) < ObfuscatedLength; i++)
     {
         // XOR each of the first 1040 bytes of the font with the key, circling around the keybuf
-        buf[i] ^= _key[(i+_bytesFiltered)%20];
+        buf[i] ^= _key[(i+_bytesFiltered)%KeySize];
     }
     
     _bytesFiltered += len;
@@ -50,7 +62,6 @@ void * FontObfuscator::FilterData(void *data, size_t len, size_t *outputLen)
 }
 bool FontObfuscator::BuildKey(const Container* container)
 {
-    REGEX_NS::regex re(R"X(\s+)X");
     std::stringstream ss;
     
     for ( auto pkg : container->Packages() )
@@ -58,8 +69,13 @@ bool FontObfuscator::BuildKey(const Container* container)
         if ( ss.tellp() > 0 )
             ss << ' ';
         
-        // we use a C++11 regex to remove all whitespace in the value
-        ss << REGEX_NS::regex_replace(pkg->PackageID().stl_str(), re, "");
+        // remove all whitespace in the value
+        string packageID = pkg->PackageID();
+        for ( char ch : packageID.stl_str() )
+        {
+            if ( !isspace(static_cast<unsigned char>(ch)) )
+                ss << ch;
+        }
     }
     
     // hash the accumulated string (using OpenSSL syntax for portability)
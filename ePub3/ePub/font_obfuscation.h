@@ -24,7 +24,6 @@
 
 #include <ePub3/filter.h>
 #include <ePub3/encryption.h>
-#include REGEX_INCLUDE
 #include <cstring>
 
 EPUB3_BEGIN_NAMESPACE
@@ -42,7 +41,7 @@ class FontObfuscator : public ContentFilter
 {
 protected:
     static const size_t         KeySize = 20;       // SHA-1 key size = 20 bytes
-    static const REGEX_NS::regex     TypeCheck;
+    static const size_t         ObfuscatedLength = 1040;    // only the first 1040 bytes are obfuscated
     constexpr static const char * const   FontObfuscationAlgorithmID = "http://www.idpf.org/2008/embedding";
     
     /**
@@ -57,9 +56,13 @@ protected:
     static bool FontTypeSniffer(const ManifestItem* item, const EncryptionInfo* encInfo) {
         if ( encInfo == nullptr || encInfo->Algorithm() != FontObfuscationAlgorithmID )
             return false;
-        return REGEX_NS::regex_match(item->MediaType().stl_str(), TypeCheck);
+        return IsFontType(item->MediaType());
     }
     
+    ///
+    /// Matches `font/*`, `application/x-font-*`, and the two `application/vnd.ms-*` font types.
+    static bool IsFontType(const string& mediaType);
+    
 public:
     ///
     /// There is no default constructor.
@@ -109,6 +112,8 @@ protected:
      @see http://www.idpf.org/epub/30/spec/epub30-ocf.html#fobfus-keygen
      */
     bool BuildKey(const Container* container);
+    
+    friend struct FilterStageTraits<FontObfuscator>;
 };
 
 EPUB3_END_NAMESPACE
@@ -22,12 +22,14 @@
 #include "manifest.h"
 #include "package.h"
 #include "byte_stream.h"
-#include REGEX_INCLUDE
+#include "perfect_hash.h"
+#include <cctype>
 #include <sstream>
 
 EPUB3_BEGIN_NAMESPACE
 
-const ItemProperties::PropertyMap ItemProperties::PropertyLookupTable = {
+// the closed vocabulary of manifest item properties, hashed at compile time
+static constexpr VocabularyTerm<ItemProperties::value_type> gItemPropertyTerms[] = {
     { "cover-image", ItemProperties::CoverImage },
     { "mathml", ItemProperties::ContainsMathML },
     { "nav", ItemProperties::Navigation },
@@ -36,6 +38,11 @@ const ItemProperties::PropertyMap ItemProperties::PropertyLookupTable = {
     { "svg", ItemProperties::ContainsSVG },
     { "switch", ItemProperties::ContainsSwitch }
 };
+static constexpr PerfectHashTable<ItemProperties::value_type, 7, 12> gItemPropertyTable(gItemPropertyTerms);
+static_assert(gItemPropertyTable.IsPerfect(), "item property names must hash to distinct buckets");
+
+// used by all the ReferencedDocument() loaders
+static const int gDocumentParseOptions = XML_PARSE_RECOVER|XML_PARSE_NOENT|XML_PARSE_DTDATTR;
 
 ItemProperties::ItemProperties(const string& attrStr) : _p(None)
 {
@@ -53,26 +60,32 @@ ItemProperties::ItemProperties(const IRI& iri) : _p(None)
 }
 ItemProperties& ItemProperties::operator=(const string& attrStr)
 {
-    if ( attrStr.empty() )
-    {
-        _p = None;
-        return *this;
-    }
-    
-    // ensure the attributes string is lowercase
-    string lowAttrs = attrStr.tolower();
+    _p = None;
     
-    // NB: this is a C++11 raw-string literal. R"" means 'raw string', and the X(...)X bit are delimiters.
-    REGEX_NS::regex re(R"X(\w+)X", REGEX_NS::regex::icase);
-    auto pos = REGEX_NS::sregex_iterator(lowAttrs.stl_str().begin(), lowAttrs.stl_str().end(), re);
-    auto end = REGEX_NS::sregex_iterator();
-    
-    for ( ; pos != end; pos++ )
+    // the attribute is a whitespace-separated list, which we match case-insensitively
+    const std::string& attrs = attrStr.stl_str();
+    char lowered[32];
+    size_t pos = 0, len = attrs.size();
+    while ( pos < len )
     {
-        // using the entire matched range
-        auto found = PropertyLookupTable.find(pos->str());
-        if ( found != PropertyLookupTable.end() )
-            _p |= found->second;
+        while ( pos < len && (isspace(static_cast<unsigned char>(attrs[pos])) || attrs[pos] == ',') )
+            pos++;
+        
+        size_t start = pos;
+        while ( pos < len && !isspace(static_cast<unsigned char>(attrs[pos])) && attrs[pos] != ',' )
+            pos++;
+        
+        // anything longer than our buffer can't be one of ours
+        size_t tokenLen = pos - start;
+        if ( tokenLen == 0 || tokenLen > sizeof(lowered) )
+            continue;
+        
+        for ( size_t i = 0; i < tokenLen; i++ )
+            lowered[i] = static_cast<char>(tolower(static_cast<unsigned char>(attrs[start+i])));
+        
+        auto found = gItemPropertyTable.find(lowered, tokenLen);
+        if ( found != nullptr )
+            _p |= found->value;
     }
     
     return *this;
@@ -133,27 +146,108 @@ string ItemProperties::str() const
     return builder.str();
 }
 
-ManifestItem::ManifestItem(xmlNodePtr node, const class Package* package) : _owner(package)
+const ManifestStore::Handle ManifestStore::InvalidHandle;
+
+ManifestStore::ManifestStore()
+{
+    Intern(string());   // StringRef 0 is always the empty string
+}
+ManifestStore::ManifestStore(ManifestStore&& o) : _strings(std::move(o._strings)), _stringRefs(std::move(o._stringRefs)), _itemForString(std::move(o._itemForString)), _identifiers(std::move(o._identifiers)), _hrefs(std::move(o._hrefs)), _mediaTypes(std::move(o._mediaTypes)), _mediaOverlayIDs(std::move(o._mediaOverlayIDs)), _fallbackIDs(std::move(o._fallbackIDs)), _properties(std::move(o._properties)), _mediaOverlays(std::move(o._mediaOverlays)), _fallbacks(std::move(o._fallbacks))
+{
+    o.Clear();
+}
+ManifestStore::~ManifestStore()
+{
+}
+ManifestStore::StringRef ManifestStore::Intern(const string& str)
+{
+    StringRef next = static_cast<StringRef>(_strings.size());
+    if ( !_stringRefs.insert(str.stl_str(), next) )
+        return *_stringRefs.find(str.stl_str());
+    
+    _strings.push_back(str);
+    _itemForString.push_back(InvalidHandle);
+    return next;
+}
+ManifestStore::Handle ManifestStore::Add(xmlNodePtr node)
 {
-    _identifier = _getProp(node, "id");
-    if ( _identifier.empty() )
+    string ident = _getProp(node, "id");
+    if ( ident.empty() )
         throw std::invalid_argument("Manifest items must have an 'id' attribute");
     
-    _href = _getProp(node, "href");
-    if ( _href.empty() )
+    string href = _getProp(node, "href");
+    if ( href.empty() )
         throw std::invalid_argument("Manifest items must have a 'href' attribute");
     
-    _mediaType = _getProp(node, "media-type");
-    if ( _href.empty() )
-        throw std::invalid_argument("Manifest items must have a 'media-type' attribute");
+    // the media type is required too, but books which omit it have always loaded,
+    //  so such items are kept with an empty one
+    string mediaType = _getProp(node, "media-type");
+    
+    return Add(ident, href, mediaType, _getProp(node, "media-overlay"), _getProp(node, "fallback"), ItemProperties(_getProp(node, "properties")));
+}
+ManifestStore::Handle ManifestStore::Add(const string& ident, const string& href, const string& mediaType, const string& mediaOverlayID, const string& fallbackID, ItemProperties properties)
+{
+    StringRef identRef = Intern(ident);
+    if ( _itemForString[identRef] != InvalidHandle )
+        return InvalidHandle;
+    
+    Handle handle = static_cast<Handle>(_identifiers.size());
+    _itemForString[identRef] = handle;
+    
+    _identifiers.push_back(identRef);
+    _hrefs.push_back(Intern(href));
+    _mediaTypes.push_back(Intern(mediaType));
+    _mediaOverlayIDs.push_back(Intern(mediaOverlayID));
+    _fallbackIDs.push_back(Intern(fallbackID));
+    _properties.push_back(properties);
+    
+    // references may now point at this item, so they must be resolved again
+    _mediaOverlays.clear();
+    _fallbacks.clear();
+    return handle;
+}
+void ManifestStore::ResolveReferences()
+{
+    _mediaOverlays.resize(Count());
+    _fallbacks.resize(Count());
+    for ( Handle h = 0; h < Count(); h++ )
+    {
+        _mediaOverlays[h] = _itemForString[_mediaOverlayIDs[h]];
+        _fallbacks[h] = _itemForString[_fallbackIDs[h]];
+    }
+}
+void ManifestStore::Clear()
+{
+    _strings.clear();
+    _stringRefs.clear();
+    _itemForString.clear();
+    _identifiers.clear();
+    _hrefs.clear();
+    _mediaTypes.clear();
+    _mediaOverlayIDs.clear();
+    _fallbackIDs.clear();
+    _properties.clear();
+    _mediaOverlays.clear();
+    _fallbacks.clear();
     
-    _mediaOverlayID = _getProp(node, "media-overlay");
-    _fallbackID = _getProp(node, "fallback");
-    _properties = ItemProperties(_getProp(node, "properties"));
+    Intern(string());
+}
+ManifestStore::Handle ManifestStore::Find(const string& ident) const
+{
+    const StringRef* found = _stringRefs.find(ident.stl_str());
+    if ( found == nullptr )
+        return InvalidHandle;
+    return _itemForString[*found];
+}
+
+ManifestItem::ManifestItem(const class Package* owner, const ManifestStore* store, ManifestStore::Handle handle) : _owner(owner), _store(store), _handle(handle)
+{
 }
-ManifestItem::ManifestItem(ManifestItem&& o) : _owner(o._owner), _identifier(std::move(o._identifier)), _href(std::move(o._href)), _mediaType(std::move(o._mediaType)), _mediaOverlayID(std::move(o._mediaOverlayID)), _fallbackID(std::move(o._fallbackID)), _properties(o._properties)
+ManifestItem::ManifestItem(ManifestItem&& o) : _owner(o._owner), _store(o._store), _handle(o._handle)
 {
     o._owner = nullptr;
+    o._store = nullptr;
+    o._handle = ManifestStore::InvalidHandle;
 }
 ManifestItem::~ManifestItem()
 {
@@ -164,28 +258,32 @@ string ManifestItem::AbsolutePath() const
 }
 const ManifestItem* ManifestItem::MediaOverlay() const
 {
-    if ( _owner == nullptr || _mediaOverlayID.empty() )
+    if ( _owner == nullptr || MediaOverlayID().empty() )
         return nullptr;
     
-    return _owner->ManifestItemWithID(_mediaOverlayID);
+    ManifestStore::Handle h = _store->MediaOverlay(_handle);
+    if ( h == ManifestStore::InvalidHandle )
+        return _owner->ManifestItemWithID(MediaOverlayID());     // not resolved yet
+    return _owner->ManifestItemWithHandle(h);
 }
 const ManifestItem* ManifestItem::Fallback() const
 {
-    if ( _owner == nullptr || _fallbackID.empty() )
+    if ( _owner == nullptr || FallbackID().empty() )
         return nullptr;
     
-    return _owner->ManifestItemWithID(_fallbackID);
+    ManifestStore::Handle h = _store->Fallback(_handle);
+    if ( h == ManifestStore::InvalidHandle )
+        return _owner->ManifestItemWithID(FallbackID());         // not resolved yet
+    return _owner->ManifestItemWithHandle(h);
 }
 string ManifestItem::BaseHref() const
 {
     // get base part of href
-    string path;
-    size_t s = _href.find_first_of("#?");
+    const string& href = Href();
+    size_t s = href.find_first_of("#?");
     if ( s == string::npos )
-        path = _href;
-    else
-        path = path.substr(0, s);
-    return path;
+        return href;
+    return href.substr(0, s);
 }
 bool ManifestItem::HasProperty(const std::vector<IRI>& properties) const
 {
@@ -201,24 +299,84 @@ bool ManifestItem::HasProperty(const std::vector<IRI>& properties) const
     
     return false;
 }
-xmlDocPtr ManifestItem::ReferencedDocument() const
+Auto<ArchiveReader> ManifestItem::DocumentReader(string& path) const
 {
     // TODO: handle remote URLs
-    string path(BaseHref());
+    path = BaseHref();
+    return Auto<ArchiveReader>(_owner->ReaderForRelativePath(path));
+}
+xmlDocPtr ManifestItem::ReferencedDocument(xmlDictPtr dict) const
+{
+    string path;
+    Auto<ArchiveReader> reader(DocumentReader(path));
+    if ( reader == nullptr )
+        return nullptr;
     
-    ArchiveXmlReader * reader = _owner->XmlReaderForRelativePath(path);
+    ArchiveXmlReader input(reader.release());
+    if ( IsHTMLDocument() )
+        return input.htmlReadDocument(path.c_str(), "utf-8", gDocumentParseOptions, dict);
+    return input.xmlReadDocument(path.c_str(), "utf-8", gDocumentParseOptions, dict);
+}
+xmlDocPtr ManifestItem::ReferencedDocument(xmlDictPtr dict, std::mutex& dictLock, const xml::SchemaPool::CompiledSchema& schema, bool* valid, string* error) const
+{
+    string path;
+    Auto<ArchiveReader> reader(DocumentReader(path));
     if ( reader == nullptr )
         return nullptr;
     
+    std::string bytes;
+    char buf[4096];
+    ssize_t numRead = 0;
+    while ( (numRead = reader->read(buf, sizeof(buf))) > 0 )
+        bytes.append(buf, static_cast<size_t>(numRead));
+    reader.reset();
+    
+    xml::MemoryInputBuffer input(std::move(bytes));
+    
+    std::lock_guard<std::mutex> _(dictLock);
     xmlDocPtr result = nullptr;
-    int flags = XML_PARSE_RECOVER|XML_PARSE_NOENT|XML_PARSE_DTDATTR;
-    if ( _mediaType == "text/html" )
-        result = reader->htmlReadDocument(path.c_str(), "utf-8", flags);
+    if ( schema && !IsHTMLDocument() )
+    {
+        bool isValid = false;
+        string message;
+        result = input.xmlReadValidatedDocument(path.c_str(), "utf-8", gDocumentParseOptions, dict, schema, &isValid, &message);
+        if ( valid != nullptr )
+            *valid = isValid;
+        if ( error != nullptr )
+            *error = message;
+    }
     else
-        result = reader->xmlReadDocument(path.c_str(), "utf-8", flags);
+    {
+        if ( IsHTMLDocument() )
+            result = input.htmlReadDocument(path.c_str(), "utf-8", gDocumentParseOptions, dict);
+        else
+            result = input.xmlReadDocument(path.c_str(), "utf-8", gDocumentParseOptions, dict);
+        if ( valid != nullptr )
+            *valid = (result != nullptr);
+    }
     
     return result;
 }
+xmlDocPtr ManifestItem::ReferencedDocument(const xml::PushParser::ProgressFn& progress, xmlDictPtr dict, std::mutex* dictLock) const
+{
+    string path;
+    Auto<ArchiveReader> reader(DocumentReader(path));
+    if ( reader == nullptr )
+        return nullptr;
+    
+    // the parser interns names from construction until it's destroyed
+    std::unique_lock<std::mutex> lock;
+    if ( dictLock != nullptr )
+        lock = std::unique_lock<std::mutex>(*dictLock);
+    
+    xml::PushParser parser(IsHTMLDocument(), path.c_str(), "utf-8", gDocumentParseOptions, dict);
+    parser.SetProgressHandler(progress);
+    
+    ArchiveReader* source = reader.get();
+    return parser.ParseConcurrently([source](void* buf, size_t len) {
+        return source->read(buf, len);
+    });
+}
 Auto<ByteStream> ManifestItem::Reader() const
 {
     return _owner->ReadStreamForRelativePath(BaseHref());
@@ -25,7 +25,15 @@
 #include <ePub3/epub3.h>
 #include <ePub3/utilities/utfstring.h>
 #include <ePub3/utilities/iri.h>
+#include <ePub3/utilities/arena.h>
+#include <ePub3/xml/push_parser.h>
+#include <ePub3/xml/schema_pool.h>
+#include <ePub3/utilities/flat_hash_map.h>
+#include <cstdint>
+#include <deque>
 #include <map>
+#include <vector>
+#include <mutex>
 #include <libxml/tree.h>
 
 EPUB3_BEGIN_NAMESPACE
@@ -209,8 +217,115 @@ public:
 private:
     value_type _p;                                      ///< The property bitfield.
     
-    typedef std::map<string, value_type> PropertyMap;
-    static const PropertyMap PropertyLookupTable;       ///< A map of known property names to bitfield values.
+};
+
+/**
+ The ManifestStore class holds the details of every item in a package's manifest.
+ 
+ Rather than each ManifestItem carrying its own strings, the store keeps one array
+ per attribute, indexed by a Handle which is simply the item's position in the
+ manifest. Identifiers, hrefs, and media types are interned in a single string
+ table, so the handful of media types used by a publication are stored only once
+ however many items use them, while fallback and media-overlay references are
+ resolved once into handles rather than looked up by identifier on every use.
+ 
+ ManifestItem instances are lightweight views onto a store.
+ 
+ @remarks A store is filled while its package is being loaded, and is read-only
+ from then on, at which point any number of threads may use it.
+ 
+ @ingroup epub-model
+ */
+class ManifestStore
+{
+public:
+    ///
+    /// The position of an item within the store.
+    typedef uint32_t                Handle;
+    
+    ///
+    /// A Handle which refers to no item.
+    static const Handle             InvalidHandle = UINT32_MAX;
+    
+public:
+                        ManifestStore();
+                        ManifestStore(const ManifestStore&)                 = delete;
+                        ManifestStore(ManifestStore&&);
+                        ~ManifestStore();
+    
+    /**
+     Adds the item described by an OPF manifest `<item>` element.
+     @param node The `<item>` element.
+     @result The new item's handle, or InvalidHandle if an item with the same
+     identifier was already present.
+     @throws std::invalid_argument if the element lacks an `id` or `href` attribute.
+     An element without a `media-type` is added with an empty media type.
+     */
+    Handle              Add(xmlNodePtr node);
+    
+    /**
+     Adds an item.
+     @result The new item's handle, or InvalidHandle if an item with the same
+     identifier was already present.
+     */
+    Handle              Add(const string& ident, const string& href, const string& mediaType,
+                            const string& mediaOverlayID, const string& fallbackID, ItemProperties properties);
+    
+    ///
+    /// Resolves all fallback and media-overlay identifiers into handles. Call once all items are added.
+    void                ResolveReferences();
+    
+    ///
+    /// Removes all items.
+    void                Clear();
+    
+    ///
+    /// The number of items in the store.
+    size_t              Count()                             const   { return _identifiers.size(); }
+    
+    ///
+    /// Returns the handle of the item with a given identifier, or InvalidHandle.
+    Handle              Find(const string& ident)           const;
+    
+    /// @{
+    /// @name Item Attributes
+    
+    const string&       Identifier(Handle h)                const   { return _strings[_identifiers[h]]; }
+    const string&       Href(Handle h)                      const   { return _strings[_hrefs[h]]; }
+    const string&       MediaType(Handle h)                 const   { return _strings[_mediaTypes[h]]; }
+    const string&       MediaOverlayID(Handle h)            const   { return _strings[_mediaOverlayIDs[h]]; }
+    const string&       FallbackID(Handle h)                const   { return _strings[_fallbackIDs[h]]; }
+    const ItemProperties& Properties(Handle h)              const   { return _properties[h]; }
+    
+    ///
+    /// The media-overlay item's handle, or InvalidHandle if there is none or ResolveReferences() has not been called.
+    Handle              MediaOverlay(Handle h)              const   { return (_mediaOverlays.empty() ? InvalidHandle : _mediaOverlays[h]); }
+    ///
+    /// The fallback item's handle, or InvalidHandle if there is none or ResolveReferences() has not been called.
+    Handle              Fallback(Handle h)                  const   { return (_fallbacks.empty() ? InvalidHandle : _fallbacks[h]); }
+    
+    /// @}
+    
+protected:
+    typedef uint32_t                StringRef;      ///< A position in `_strings`.
+    
+    std::deque<string>              _strings;       ///< The string table; references to its contents stay valid as it grows.
+    FlatHashMap<StringRef>          _stringRefs;    ///< The position of each string in `_strings`.
+    std::vector<Handle>             _itemForString; ///< For each string, the item using it as an identifier, if any.
+    
+    std::vector<StringRef>          _identifiers;
+    std::vector<StringRef>          _hrefs;
+    std::vector<StringRef>          _mediaTypes;
+    std::vector<StringRef>          _mediaOverlayIDs;
+    std::vector<StringRef>          _fallbackIDs;
+    std::vector<ItemProperties>     _properties;
+    
+    std::vector<Handle>             _mediaOverlays; ///< Filled by ResolveReferences().
+    std::vector<Handle>             _fallbacks;     ///< Filled by ResolveReferences().
+    
+    ///
+    /// Interns a string, returning its position in the table.
+    StringRef           Intern(const string& str);
     
 };
 
@@ -237,8 +352,11 @@ private:
  
  @remarks A ManifestItem keeps a pointer to its owning Package, but does not assume
  any memory-management responsibility for that pointer. Each ManifestItem is owned by
- the Package from which it was loaded., and will be deleted when that Package is
- deallocated.
+ the Package from which it was loaded, which allocates it in its Arena, and will be
+ destroyed when that Package is deallocated.
+ 
+ The details themselves live in the Package's ManifestStore, of which each
+ ManifestItem is just a view.
  
  @ingroup epub-model
  */
@@ -249,47 +367,83 @@ public:
     
 public:
                         ManifestItem()                                      = delete;
-                        ManifestItem(xmlNodePtr node, const Package* owner);
+    /**
+     Creates a view onto an item in a package's manifest.
+     @param owner The package to which the item belongs.
+     @param store The store holding the item's details, which belongs to `owner`.
+     @param handle The item's handle within `store`.
+     */
+                        ManifestItem(const Package* owner, const ManifestStore* store, ManifestStore::Handle handle);
                         ManifestItem(const ManifestItem&)                   = delete;
                         ManifestItem(ManifestItem&&);
     virtual             ~ManifestItem();
     
     const Package*      Package()                           const   { return _owner; }
     
+    ///
+    /// This item's position in its package's ManifestStore.
+    ManifestStore::Handle Handle()                          const   { return _handle; }
+    
     string              AbsolutePath()                      const;
     
-    const string&       Identifier()                        const   { return _identifier; }
-    const string&       Href()                              const   { return _href; }
-    const MimeType&     MediaType()                         const   { return _mediaType; }
-    const string&       MediaOverlayID()                    const   { return _mediaOverlayID; }
+    const string&       Identifier()                        const   { return _store->Identifier(_handle); }
+    const string&       Href()                              const   { return _store->Href(_handle); }
+    const MimeType&     MediaType()                         const   { return _store->MediaType(_handle); }
+    const string&       MediaOverlayID()                    const   { return _store->MediaOverlayID(_handle); }
     const ManifestItem* MediaOverlay()                      const;
-    const string&       FallbackID()                        const   { return _fallbackID; }
+    const string&       FallbackID()                        const   { return _store->FallbackID(_handle); }
     const ManifestItem* Fallback()                          const;
     
     // strips any query/fragment from the href before returning
     string              BaseHref()                          const;
     
-    bool                HasProperty(const string& property) const   { return _properties.HasProperty(ItemProperties(property)); }
-    bool                HasProperty(ItemProperties::value_type prop)    const   { return _properties.HasProperty(prop); }
+    bool                HasProperty(const string& property) const   { return Properties().HasProperty(ItemProperties(property)); }
+    bool                HasProperty(ItemProperties::value_type prop)    const   { return Properties().HasProperty(prop); }
     bool                HasProperty(const std::vector<IRI>& properties)  const;
-    
-    // one-shot XML document loader
-    xmlDocPtr           ReferencedDocument()                const;
+    const ItemProperties& Properties()                      const   { return _store->Properties(_handle); }
+    
+    // one-shot XML document loader; the caller owns the result
+    // use Package::DocumentForManifestItem() to share a cached copy instead
+    // if `dict` belongs to an xml::Dictionary, the caller must hold its lock
+    xmlDocPtr           ReferencedDocument(xmlDictPtr dict=nullptr) const;
+    
+    // as above, but the whole resource is read and decompressed before `dictLock`
+    // is taken, so that only the parse itself holds up other users of `dict`
+    // if a `schema` is given, the document is validated against it as it is parsed,
+    // and `valid` and `error` receive the outcome
+    xmlDocPtr           ReferencedDocument(xmlDictPtr dict, std::mutex& dictLock,
+                                           const xml::SchemaPool::CompiledSchema& schema=nullptr,
+                                           bool* valid=nullptr, string* error=nullptr) const;
+    
+    // as above, but the resource is decompressed on a worker thread while this thread
+    // parses it, and `progress` is called here each time more of the document's
+    // top-level elements are complete; see xml::PushParser for details
+    // if `dict` belongs to an xml::Dictionary, pass its lock as `dictLock`: it is held
+    // for the whole parse, since names are interned as the input arrives
+    xmlDocPtr           ReferencedDocument(const xml::PushParser::ProgressFn& progress, xmlDictPtr dict=nullptr,
+                                           std::mutex* dictLock=nullptr) const;
     
     // stream the data
     Auto<ByteStream>    Reader()                            const;
     
 protected:
     const class Package*    _owner;
+    const ManifestStore*    _store;
+    ManifestStore::Handle   _handle;
+    
+    // opens the referenced resource for the ReferencedDocument() loaders, setting
+    // `path` to the URL to parse it with; `nullptr` if it can't be read
+    Auto<ArchiveReader> DocumentReader(string& path)        const;
     
-    string                  _identifier;
-    string                  _href;
-    MimeType                _mediaType;
-    string                  _mediaOverlayID;
-    string                  _fallbackID;
-    ItemProperties          _properties;
+    // whether the referenced resource is parsed as HTML rather than XML
+    bool                IsHTMLDocument()                    const   { return MediaType() == "text/html"; }
 };
 
+// a ManifestItem is only a view onto its Package's ManifestStore, and owns nothing
+//  which its (virtual, but empty) destructor would release; keep it that way
+template <>
+struct ArenaNeedsFinalizer<ManifestItem> : std::false_type {};
+
 EPUB3_END_NAMESPACE
 
 #endif /* defined(__ePub3__manifest__) */
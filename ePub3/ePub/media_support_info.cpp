@@ -74,13 +74,8 @@ void MediaSupportInfo::SetTypeAndSupport(const string& mediaType, SupportType su
 }
 const MediaSupportInfo::ManifestItemList MediaSupportInfo::MatchingManifestItems(const Package* pkg) const
 {
-    ManifestItemList items;
-    for ( auto pair : pkg->Manifest() )
-    {
-        if ( pair.first == _mediaType )
-            items.push_back(pair.second);
-    }
-    return items;
+    const Package::ManifestItemList& items = pkg->ManifestItemsWithMediaType(_mediaType);
+    return ManifestItemList(items.begin(), items.end());
 }
 
 EPUB3_END_NAMESPACE
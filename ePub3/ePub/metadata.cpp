@@ -101,22 +101,21 @@ Metadata::Metadata(Metadata&& o) : _node(o._node), _type(o._type), _extensions(s
 }
 Metadata::~Metadata()
 {
-    for ( auto item : _extensions )
-    {
-        delete item;
-    }
+    // extensions live in the owning package's arena
 }
 bool Metadata::Decode(const Package* owner)
 {
     xmlNsPtr ns = _node->ns;
     if ( ns != nullptr && xmlStrcasecmp(ns->href, DCMES_uri) == 0 )
     {
-        _type = NameToIDMap[_node->name];
-        if ( _type == DCType::Invalid )
+        // find() rather than [], as packages may be decoded on several threads at once
+        auto found = NameToIDMap.find(_node->name);
+        if ( found == NameToIDMap.end() || found->second == DCType::Invalid )
             return false;
+        _type = found->second;
         
         // special property IRI, not actually in the spec, but useful for comparisons and printouts
-        _property = IRI(string(DCMES_uri) + _node->name);
+        _property = IRIForDCType(_type);
     }
     else if ( xmlStrcasecmp(_node->name, MetaTagName) == 0 )
     {
@@ -182,7 +181,7 @@ string Metadata::Language() const
 }
 void Metadata::AddExtension(xmlNodePtr node, const Package* owner)
 {
-    try { _extensions.push_back(new Extension(node, owner)); }
+    try { _extensions.push_back(owner->ObjectArena().New<Extension>(node, owner)); }
     catch (std::exception& e) { fprintf(stderr, "ARGH: %s\n", e.what()); }
 }
 const Metadata::Extension* Metadata::ExtensionWithProperty(const IRI &property) const
@@ -206,10 +205,18 @@ const Metadata::ExtensionList Metadata::AllExtensionsWithProperty(const IRI& pro
 }
 const IRI Metadata::IRIForDCType(DCType type)
 {
-    auto found = IDToNameMap.find(type);
-    if ( found == IDToNameMap.end() )
+    // interned once, so that decoding metadata never touches the interning table's lock
+    static const std::map<DCType, IRI>* iris = []() {
+        std::map<DCType, IRI>* result = new std::map<DCType, IRI>;
+        for ( auto& pair : IDToNameMap )
+            result->emplace(pair.first, IRI::Interned(DCMES_uri + pair.second));
+        return result;
+    }();
+    
+    auto found = iris->find(type);
+    if ( found == iris->end() )
         return IRI();
-    return IRI(DCMES_uri + found->second);
+    return found->second;
 }
 const Metadata::ValueMap Metadata::DebugValues() const
 {
@@ -20,7 +20,6 @@
 //
 
 #include "nav_table.h"
-#include "xpath_wrangler.h"
 
 EPUB3_BEGIN_NAMESPACE
 
@@ -30,13 +29,32 @@ static std::map<string, bool> AllowedRootNodeNames = {
     { "nav", true }
 };
 
-NavigationTable::NavigationTable(xmlNodePtr node, const string& sourceHref)
-    : _sourceHref(sourceHref)
+NavigationTable::NavigationTable(xmlNodePtr node, const string& sourceHref, Arena* arena)
+    : _sourceHref(sourceHref), _arena(arena), _ownArena()
 {
+    // a table parsed on its own keeps its points in a private arena, released with it
+    if ( _arena == nullptr )
+    {
+        _ownArena.reset(new Arena(4096));
+        _arena = _ownArena.get();
+    }
+    
     if ( Parse(node) == false )
         throw std::invalid_argument("NavigationTable: supplied node does not appear to be a valid navigation document <nav> node");
 }
 
+// true if `node` is an element named `name` in the same namespace as `navNode`
+static inline bool IsHTMLElement(xmlNodePtr node, const xmlChar* name, xmlNodePtr navNode)
+{
+    if ( node->type != XML_ELEMENT_NODE || !xmlStrEqual(node->name, name) )
+        return false;
+    if ( node->ns == navNode->ns )
+        return true;
+    if ( node->ns == nullptr || navNode->ns == nullptr )
+        return false;
+    return xmlStrEqual(node->ns->href, navNode->ns->href) != 0;
+}
+
 bool NavigationTable::Parse(xmlNodePtr node)
 {
     if ( node == nullptr )
@@ -50,51 +68,57 @@ bool NavigationTable::Parse(xmlNodePtr node)
     if ( _type.empty() )
         return false;
     
-    XPathWrangler xpath(node->doc, {{"epub", ePub3NamespaceURI}}); // goddamn I love C++11 initializer list constructors
-    xpath.NameDefaultNamespace("html");
-    
-    // look for optional <h2> title
+    // a single walk over the <nav>'s children: look for the optional <h2> title and
+    //  load List Elements from a single Ordered List
     // Q: Should we fail on finding multiple <h2> tags here?
-    auto strings = xpath.Strings("./html:h2[1]/text()", node);
-    if ( !strings.empty() )
-        _title = std::move(strings[0]);
-
+    xmlNodePtr h2Node = nullptr, olNode = nullptr;
+    for ( xmlNodePtr child = node->children; child != nullptr; child = child->next )
+    {
+        if ( h2Node == nullptr && IsHTMLElement(child, BAD_CAST "h2", node) )
+        {
+            h2Node = child;
+        }
+        else if ( IsHTMLElement(child, BAD_CAST "ol", node) )
+        {
+            if ( olNode != nullptr )
+                return false;       // there must be only one list
+            olNode = child;
+        }
+    }
     
-    // load List Elements from a single Ordered List
-    // first: confirm there's a single list
-    xmlNodeSetPtr nodes = xpath.Nodes("./html:ol", node);
-    if ( nodes == nullptr )
+    if ( olNode == nullptr )
         return false;
-    if ( nodes->nodeNr != 1 )
+    
+    if ( h2Node != nullptr )
     {
-        xmlXPathFreeNodeSet(nodes);
-        return false;
+        for ( xmlNodePtr child = h2Node->children; child != nullptr; child = child->next )
+        {
+            if ( child->type == XML_TEXT_NODE )
+            {
+                _title = child->content;
+                break;
+            }
+        }
     }
 
-    LoadChildElements(this, nodes->nodeTab[0]);
-
-    xmlXPathFreeNodeSet(nodes);
+    LoadChildElements(this, olNode);
     
     return true;
 }
 
 void NavigationTable::LoadChildElements(NavigationElement *pElement, xmlNodePtr olNode)
 {
-    XPathWrangler xpath(olNode->doc, {{"epub", ePub3NamespaceURI}});
-    xpath.NameDefaultNamespace("html");
-
-    xmlNodeSetPtr liNodes = xpath.Nodes("./html:li", olNode);
-
-    for ( size_t i = 0; i < liNodes->nodeNr; i++ )
+    for ( xmlNodePtr liNode = olNode->children; liNode != nullptr; liNode = liNode->next )
     {
-        NavigationElement* childElement = BuildNavigationPoint(liNodes->nodeTab[i]);
+        if ( !IsHTMLElement(liNode, BAD_CAST "li", olNode) )
+            continue;
+        
+        NavigationElement* childElement = BuildNavigationPoint(liNode);
         if(childElement != nullptr)
         {
             pElement->AppendChild(childElement);
         }
     }
-
-    xmlXPathFreeNodeSet(liNodes);
 }
 
 NavigationElement*  NavigationTable::BuildNavigationPoint(xmlNodePtr liNode)
@@ -106,25 +130,25 @@ NavigationElement*  NavigationTable::BuildNavigationPoint(xmlNodePtr liNode)
         return nullptr;
     }
 
-    NavigationPoint* point = new NavigationPoint();
+    NavigationPoint* point = _arena->New<NavigationPoint>();
 
     for ( ; liChild != nullptr; liChild = liChild->next )
     {
         if ( liChild->type != XML_ELEMENT_NODE )
             continue;
 
-        std::string cName(reinterpret_cast<const char*>(liChild->name));
+        const xmlChar* cName = liChild->name;
 
-        if ( cName == "a" )
+        if ( xmlStrEqual(cName, BAD_CAST "a") )
         {
             point->SetTitle(TitleFromNode(liChild));
             point->SetSourceHref(_getProp(liChild, "href"));
         }
-        else if( cName == "span" )
+        else if( xmlStrEqual(cName, BAD_CAST "span") )
         {
             point->SetTitle(TitleFromNode(liChild));
         }
-        else if( cName == "ol" )
+        else if( xmlStrEqual(cName, BAD_CAST "ol") )
         {
             LoadChildElements(point, liChild);
             break;
@@ -136,61 +160,68 @@ NavigationElement*  NavigationTable::BuildNavigationPoint(xmlNodePtr liNode)
 
 string NavigationTable::TitleFromNode(xmlNodePtr node) const
 {
-    string title;
+    std::string title;
+    AppendTitleFromNode(node, title);
+    return string(std::move(title));
+}
+
+void NavigationTable::AppendTitleFromNode(xmlNodePtr node, std::string& title) const
+{
     for ( auto child = node->children; child != nullptr; child = child->next )
     {
         switch ( child->type )
         {
             case XML_ELEMENT_NODE:
             {
-                title += TagOpenNameForTitleFromNode(child) + TitleFromNode(child) + TagCloseNameForTitleFromNode(child);
+                const char* tagName = TagNameForTitleFromNode(child);
+                if ( tagName != nullptr )
+                    title.append("<").append(tagName).append(">");
+                AppendTitleFromNode(child, title);
+                if ( tagName != nullptr )
+                    title.append("</").append(tagName).append(">");
+                break;
+            }
+            
+            case XML_TEXT_NODE:
+            case XML_CDATA_SECTION_NODE:
+            {
+                if ( child->content != nullptr )
+                    title.append(reinterpret_cast<const char*>(child->content));
                 break;
             }
 
             default:
-                title += reinterpret_cast<const char*>(xmlNodeGetContent(child));
+            {
+                xmlChar* content = xmlNodeGetContent(child);
+                if ( content != nullptr )
+                {
+                    title.append(reinterpret_cast<const char*>(content));
+                    xmlFree(content);
+                }
                 break;
+            }
         }
     }
-    return title;
 }
 
-string NavigationTable::TagOpenNameForTitleFromNode(xmlNodePtr node) const
+const char* NavigationTable::TagNameForTitleFromNode(xmlNodePtr node) const
 {
-    string tagName = TagNameForTitleFromNode(node);
-    if (tagName.length() > 0)
-    {
-        return "<" + tagName + ">";
-    }
-    return "";
-}
-
-string NavigationTable::TagCloseNameForTitleFromNode(xmlNodePtr node) const
-{
-    string tagName = TagNameForTitleFromNode(node);
-    if (tagName.length() > 0)
-    {
-        return "</" + tagName + ">";
-    }
-    return "";
-}
-
-string NavigationTable::TagNameForTitleFromNode(xmlNodePtr node) const {
-    std::string tagName(reinterpret_cast<const char*>(node->name));
-
-    static const std::map<std::string, std::string> tagsMap = {
-            { "b", "b" },
-            { "B", "b" },
-            { "i", "i" },
-            { "I", "i" },
-    };
-    auto tagIter = tagsMap.find(tagName);
-    if ( tagIter != tagsMap.end() )
+    // only bold and italic markup is preserved in titles
+    const xmlChar* name = node->name;
+    if ( name == nullptr || name[0] == 0 || name[1] != 0 )
+        return nullptr;
+    
+    switch ( name[0] )
     {
-         return tagIter->second;
+        case 'b':
+        case 'B':
+            return "b";
+        case 'i':
+        case 'I':
+            return "i";
+        default:
+            return nullptr;
     }
-    return "";
 }
 
-
 EPUB3_END_NAMESPACE
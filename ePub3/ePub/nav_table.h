@@ -24,7 +24,8 @@
 
 #include <ePub3/epub3.h>
 #include <ePub3/nav_point.h>
-#include <libxml/xpath.h> // for xmlNodeSetPtr
+#include <ePub3/utilities/arena.h>
+#include <libxml/tree.h>
 
 EPUB3_BEGIN_NAMESPACE
 
@@ -36,11 +37,11 @@ class NavigationTable : public NavigationElement
 {
 public:
                             NavigationTable()                               = delete;
-                            NavigationTable(xmlNodePtr node, const string& sourceHref);   // requires a HTML <nav> node
-                            NavigationTable(const string& type) : NavigationElement(), _type(type), _title(), _sourceHref() {}
-                            NavigationTable(std::string&& type) : NavigationElement(), _type(type), _title(), _sourceHref() {}
+                            NavigationTable(xmlNodePtr node, const string& sourceHref, Arena* arena=nullptr);   // requires a HTML <nav> node; points are allocated from `arena` if given, else from one owned by the table
+                            NavigationTable(const string& type) : NavigationElement(), _type(type), _title(), _sourceHref(), _arena(nullptr) {}
+                            NavigationTable(std::string&& type) : NavigationElement(), _type(type), _title(), _sourceHref(), _arena(nullptr) {}
                             NavigationTable(const NavigationTable&)         = delete;
-                            NavigationTable(NavigationTable&& o) : NavigationElement(o), _type(std::move(o._type)), _title(std::move(o._title)), _sourceHref(std::move(o._sourceHref)) {}
+                            NavigationTable(NavigationTable&& o) : NavigationElement(o), _type(std::move(o._type)), _title(std::move(o._title)), _sourceHref(std::move(o._sourceHref)), _arena(o._arena), _ownArena(std::move(o._ownArena)) {}
                                                                                                                         
         
     virtual                 ~NavigationTable() {}
@@ -59,14 +60,15 @@ public:
 
 private:
     string                  TitleFromNode(xmlNodePtr node) const;
-    string                  TagOpenNameForTitleFromNode(xmlNodePtr node) const;
-    string                  TagCloseNameForTitleFromNode(xmlNodePtr node) const;
-    string                  TagNameForTitleFromNode(xmlNodePtr node) const;
+    void                    AppendTitleFromNode(xmlNodePtr node, std::string& title) const;
+    const char*             TagNameForTitleFromNode(xmlNodePtr node) const;
 
 protected:
     string      _type;
     string      _title;     // optional
     string      _sourceHref;      // heref to the nav item representing the table in the package
+    Arena*      _arena;           // where new NavigationPoints are allocated
+    std::unique_ptr<Arena>  _ownArena;  // holds the points of a table parsed without a package's arena
     
     bool                    Parse(xmlNodePtr node);
     NavigationElement*      BuildNavigationPoint(xmlNodePtr liNode);
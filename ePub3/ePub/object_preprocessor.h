@@ -133,6 +133,8 @@ protected:
     /// The object keeps its own list of handlers, used to create target URIs.
     std::map<string, MediaHandler>          _handlers;
     
+    friend struct FilterStageTraits<ObjectPreprocessor>;
+    
 };
 
 EPUB3_END_NAMESPACE
@@ -24,31 +24,116 @@
 #include "archive.h"
 #include "archive_xml.h"
 #include "xpath_wrangler.h"
+#include "package_snapshot.h"
 #include "nav_table.h"
 #include "glossary.h"
 #include "iri.h"
 #include "basic.h"
 #include "byte_stream.h"
+#include "perfect_hash.h"
+#include "trace.h"
+#include <ePub3/xml/schema_pool.h>
 #include <sstream>
 #include <list>
-#include REGEX_INCLUDE
+#include <cctype>
 #include <libxml/xpathInternals.h>
 
 EPUB3_BEGIN_NAMESPACE
 
 static const xmlChar * OPFNamespace = "http://www.idpf.org/2007/opf"_xml;
 static const xmlChar * DCNamespace = "http://purl.org/dc/elements/1.1/"_xml;
+static const xmlChar * XHTMLNamespace = "http://www.w3.org/1999/xhtml"_xml;
 static const xmlChar * MediaTypeElementName = "mediaType"_xml;
 
-const PackageBase::PropertyVocabularyMap PackageBase::gReservedVocabularies({
+// property IRIs used by the high-level metadata API; these are in reserved vocabularies,
+//  so they're the same for every package
+static const IRI gTitleTypeIRI(IRI::Interned("http://idpf.org/epub/vocab/package/#title-type"));
+static const IRI gDisplaySeqIRI(IRI::Interned("http://idpf.org/epub/vocab/package/#display-seq"));
+static const IRI gFileAsIRI(IRI::Interned("http://idpf.org/epub/vocab/package/#file-as"));
+static const IRI gIdentifierTypeIRI(IRI::Interned("http://idpf.org/epub/vocab/package/#identifier-type"));
+static const IRI gDCTermsCreatorIRI(IRI::Interned("http://purl.org/dc/terms/creator"));
+static const IRI gDCTermsContributorIRI(IRI::Interned("http://purl.org/dc/terms/contributor"));
+static const IRI gDCTermsModifiedIRI(IRI::Interned("http://purl.org/dc/terms/modified"));
+
+// the reserved vocabularies, which a package may use without declaring them
+static constexpr VocabularyTerm<const char*> gReservedVocabularyTerms[] = {
     { "", "http://idpf.org/epub/vocab/package/#" },
     { "dcterms", "http://purl.org/dc/terms/" },
     { "marc", "http://id.loc.gov/vocabulary/" },
     { "media", "http://www.idpf.org/epub/vocab/overlays/#" },
     { "onix", "http://www.editeur.org/ONIX/book/codelists/current.html#" },
     { "xsd", "http://www.w3.org/2001/XMLSchema#" }
-});
-const std::map<const string, bool> PackageBase::CoreMediaTypes({
+};
+static constexpr PerfectHashTable<const char*, 6, 15> gReservedVocabularies(gReservedVocabularyTerms);
+
+// the properties defined by the reserved and other well-known vocabularies
+static const char* gWellKnownPropertyIRIStrings[] = {
+    // EPUB 3 package metadata (the default vocabulary)
+    "http://idpf.org/epub/vocab/package/#alternate-script",
+    "http://idpf.org/epub/vocab/package/#belongs-to-collection",
+    "http://idpf.org/epub/vocab/package/#collection-type",
+    "http://idpf.org/epub/vocab/package/#display-seq",
+    "http://idpf.org/epub/vocab/package/#file-as",
+    "http://idpf.org/epub/vocab/package/#group-position",
+    "http://idpf.org/epub/vocab/package/#identifier-type",
+    "http://idpf.org/epub/vocab/package/#meta-auth",
+    "http://idpf.org/epub/vocab/package/#role",
+    "http://idpf.org/epub/vocab/package/#source-of",
+    "http://idpf.org/epub/vocab/package/#title-type",
+    // EPUB 3 spine itemref properties
+    "http://idpf.org/epub/vocab/package/#page-spread-left",
+    "http://idpf.org/epub/vocab/package/#page-spread-right",
+    // DCMI Metadata Terms
+    "http://purl.org/dc/terms/contributor",
+    "http://purl.org/dc/terms/coverage",
+    "http://purl.org/dc/terms/created",
+    "http://purl.org/dc/terms/creator",
+    "http://purl.org/dc/terms/date",
+    "http://purl.org/dc/terms/description",
+    "http://purl.org/dc/terms/format",
+    "http://purl.org/dc/terms/identifier",
+    "http://purl.org/dc/terms/issued",
+    "http://purl.org/dc/terms/language",
+    "http://purl.org/dc/terms/modified",
+    "http://purl.org/dc/terms/publisher",
+    "http://purl.org/dc/terms/relation",
+    "http://purl.org/dc/terms/rights",
+    "http://purl.org/dc/terms/source",
+    "http://purl.org/dc/terms/subject",
+    "http://purl.org/dc/terms/title",
+    "http://purl.org/dc/terms/type",
+    // Media Overlays
+    "http://www.idpf.org/epub/vocab/overlays/#active-class",
+    "http://www.idpf.org/epub/vocab/overlays/#duration",
+    "http://www.idpf.org/epub/vocab/overlays/#narrator",
+    "http://www.idpf.org/epub/vocab/overlays/#playback-active-class",
+    // Fixed-Layout rendition properties
+    "http://www.idpf.org/vocab/rendition/#layout",
+    "http://www.idpf.org/vocab/rendition/#orientation",
+    "http://www.idpf.org/vocab/rendition/#spread",
+    "http://www.idpf.org/vocab/rendition/#viewport",
+};
+
+// built once and never modified afterwards, so it's read without locking
+IRI PackageBase::KnownPropertyIRI(const string& iriStr)
+{
+    static const FlatHashMap<IRI>* known = []() {
+        FlatHashMap<IRI>* result = new FlatHashMap<IRI>;
+        result->reserve(sizeof(gWellKnownPropertyIRIStrings) / sizeof(gWellKnownPropertyIRIStrings[0]));
+        for ( const char* str : gWellKnownPropertyIRIStrings )
+            result->insert(str, IRI::Interned(str));
+        return result;
+    }();
+    
+    const IRI* found = known->find(iriStr.stl_str());
+    if ( found != nullptr )
+        return *found;
+    return IRI(iriStr);
+}
+static_assert(gReservedVocabularies.IsPerfect(), "reserved prefixes must hash to distinct buckets");
+
+// the Core Media Types from OPF 3.0 §5.1
+static constexpr VocabularyTerm<bool> gCoreMediaTypeTerms[] = {
     // Image Types
     {"image/gif", true},                            // GIF Images
     {"image/jpeg", true},                           // JPEG Images
@@ -70,24 +155,29 @@ const std::map<const string, bool> PackageBase::CoreMediaTypes({
     // Text Types
     {"text/css", true},                             // EPUB Style Sheets
     {"text/javascript", true}                       // Scripts
-});
+};
+static constexpr PerfectHashTable<bool, 14, 40> gCoreMediaTypes(gCoreMediaTypeTerms);
+static_assert(gCoreMediaTypes.IsPerfect(), "core media types must hash to distinct buckets");
 
 std::locale PackageBase::gCurrentLocale("");        // NB: std::locale() returns the C locale.
+bool PackageBase::gUseStreamingParser = false;
 
 bool Package::gValidateSchema = true;
 
-PackageBase::PackageBase(Archive* archive, const string& path, const string& type) : _archive(archive), _opf(nullptr), _type(type), _vocabularyLookup(gReservedVocabularies)
+// documents which share a package's dictionary must be freed while holding its lock
+static DocumentCache::Deleter DeleterForDictionary(Shared<xml::Dictionary> dict)
+{
+    return [dict](xmlDocPtr doc) {
+        std::lock_guard<std::mutex> _(dict->Lock());
+        xmlFreeDoc(doc);
+    };
+}
+
+PackageBase::PackageBase(Archive* archive, const string& path, const string& type) : _archive(archive), _opf(nullptr), _type(type), _vocabularyLookup(), _dictionary(new xml::Dictionary), _documentCache(DocumentCache::DefaultCapacity, DeleterForDictionary(_dictionary)), _arena(new Arena)
 {
     if ( _archive == nullptr )
         throw std::invalid_argument("Path does not point to a recognised archive file: " + path.stl_str());
     
-    // TODO: Initialize lazily? Doing so would make initialization faster, but require
-    // PackageLocations() to become non-const, like Packages().
-    ArchiveXmlReader reader(_archive->ReaderAtPath(path.stl_str()));
-    _opf = reader.xmlReadDocument(path.c_str(), nullptr, XML_PARSE_RECOVER|XML_PARSE_NOENT|XML_PARSE_DTDATTR);
-    if ( _opf == nullptr )
-        throw std::invalid_argument(std::string(__PRETTY_FUNCTION__) + ": No OPF file at " + path.stl_str());
-    
     size_t loc = path.rfind("/");
     if ( loc == std::string::npos )
     {
@@ -98,29 +188,17 @@ PackageBase::PackageBase(Archive* archive, const string& path, const string& typ
         _pathBase = path.substr(0, loc+1);
     }
 }
-PackageBase::PackageBase(PackageBase&& o) : _archive(o._archive), _opf(o._opf), _pathBase(std::move(o._pathBase)), _type(std::move(o._type)), _metadata(std::move(o._metadata)), _manifest(std::move(o._manifest)), _spine(std::move(o._spine)), _vocabularyLookup(std::move(o._vocabularyLookup))
-{
-    o._archive = nullptr;
-    o._opf = nullptr;
-}
 PackageBase::~PackageBase()
 {
-    for ( auto item : _metadata )
-    {
-        delete item;
-    }
-    for ( auto item : _manifest )
-    {
-        delete item.second;
-    }
-    for ( auto item : _navigation )
-    {
-        delete item.second;
-    }
+    // metadata, manifest, spine, and navigation objects all live in _arena, and
+    //  are destroyed along with it
     
     // our Container owns the archive
     if ( _opf != nullptr )
+    {
+        std::lock_guard<std::mutex> _(_dictionary->Lock());
         xmlFreeDoc(_opf);
+    }
 }
 std::locale& PackageBase::Locale()
 {
@@ -138,32 +216,119 @@ void PackageBase::SetLocale(const std::locale &locale)
 {
     gCurrentLocale = locale;
 }
-const SpineItem* PackageBase::SpineItemAt(size_t idx) const
+size_t PackageBase::IndexOfSpineItemWithIDRef(const string &idref) const
+{
+    auto found = _spineIndexByIDRef.find(idref.stl_str());
+    if ( found == _spineIndexByIDRef.end() )
+        return size_t(-1);
+    return found->second;
+}
+void PackageBase::AppendSpineItem(SpineItem *item)
 {
-    const SpineItem* item = _spine.get();
-    for ( size_t i = 0; i < idx && item != nullptr; i++ )
-    {
-        item = item->Next();
-    }
-    return item;
+    item->_index = _spine.size();
+    item->_linearIndex = _linearSpine.size();
+    item->_manifestHandle = _manifestStore.Find(item->Idref());
+    item->_prev = (_spine.empty() ? nullptr : _spine.back());
+    item->_next = nullptr;
+    if ( item->_prev != nullptr )
+        item->_prev->_next = item;
+    
+    _spine.push_back(item);
+    if ( item->Linear() )
+        _linearSpine.push_back(item);
+    
+    // the first item wins, as it would in a front-to-back search
+    _spineIndexByIDRef.emplace(item->Idref().stl_str(), item->_index);
 }
-size_t PackageBase::IndexOfSpineItemWithIDRef(const string &idref) const
+void PackageBase::ClearSpine()
+{
+    _spine.clear();
+    _linearSpine.clear();
+    _spineIndexByIDRef.clear();
+}
+void PackageBase::InstallManifestItem(ManifestStore::Handle handle)
+{
+    if ( handle == ManifestStore::InvalidHandle )
+        return;     // a duplicate identifier; the first one stays in every table
+    
+    ManifestItem* item = _arena->New<ManifestItem>(static_cast<const Package*>(this), &_manifestStore, handle);
+    _manifestItems.push_back(item);
+    _manifest.emplace(item->Identifier(), item);
+    _manifestByPath.insert(NormalizedPath(item->AbsolutePath()), item);
+    _manifestByMediaType[item->MediaType()].push_back(item);
+}
+void PackageBase::ClearManifest()
+{
+    _manifest.clear();
+    _manifestStore.Clear();
+    _manifestItems.clear();
+    _manifestByPath.clear();
+    _manifestByMediaType.clear();
+}
+std::string PackageBase::NormalizedPath(const string& path)
 {
-    const SpineItem* item = FirstSpineItem();
-    for ( size_t i = 0; item != nullptr; i++, item = item->Next() )
+    const std::string& in = path.stl_str();
+    size_t end = in.find_first_of("?#");
+    if ( end == std::string::npos )
+        end = in.size();
+    
+    std::string result;
+    result.reserve(end);
+    
+    size_t pos = 0;
+    while ( pos <= end )
     {
-        if ( item->Idref() == idref )
-            return i;
+        size_t next = in.find('/', pos);
+        if ( next == std::string::npos || next > end )
+            next = end;
+        
+        // percent-decode the step
+        std::string step;
+        for ( size_t i = pos; i < next; i++ )
+        {
+            if ( in[i] == '%' && i + 2 < next && isxdigit(in[i+1]) && isxdigit(in[i+2]) )
+            {
+                step.push_back(static_cast<char>(std::stoi(in.substr(i+1, 2), nullptr, 16)));
+                i += 2;
+            }
+            else
+            {
+                step.push_back(in[i]);
+            }
+        }
+        
+        if ( step == ".." )
+        {
+            size_t slash = result.rfind('/');
+            result.erase(slash == std::string::npos ? 0 : slash);
+        }
+        else if ( !step.empty() && step != "." )
+        {
+            if ( !result.empty() )
+                result.push_back('/');
+            result.append(step);
+        }
+        
+        pos = next + 1;
     }
     
-    return size_t(-1);
+    return result;
 }
 const ManifestItem* PackageBase::ManifestItemWithID(const string &ident) const
 {
-    auto found = _manifest.find(ident);
-    if ( found == _manifest.end() )
-        return nullptr;
-    
+    return ManifestItemWithHandle(_manifestStore.Find(ident));
+}
+const ManifestItem* PackageBase::ManifestItemAtPath(const string &path) const
+{
+    ManifestItem* const* found = _manifestByPath.find(NormalizedPath(path));
+    return (found == nullptr ? nullptr : *found);
+}
+const PackageBase::ManifestItemList& PackageBase::ManifestItemsWithMediaType(const string &mediaType) const
+{
+    static const ManifestItemList empty;
+    auto found = _manifestByMediaType.find(mediaType);
+    if ( found == _manifestByMediaType.end() )
+        return empty;
     return found->second;
 }
 string PackageBase::CFISubpathForManifestItemWithID(const string &ident) const
@@ -195,22 +360,59 @@ void PackageBase::RegisterPrefixIRIStem(const string &prefix, const string &iriS
 {
     _vocabularyLookup[prefix] = iriStem;
 }
+bool PackageBase::IsCoreMediaType(const string& mediaType)
+{
+    return gCoreMediaTypes.contains(mediaType.stl_str());
+}
 IRI PackageBase::MakePropertyIRI(const string &reference, const string& prefix) const
 {
     auto found = _vocabularyLookup.find(prefix);
-    if ( found == _vocabularyLookup.end() )
+    if ( found != _vocabularyLookup.end() )
+        return KnownPropertyIRI(found->second + reference);
+    
+    auto reserved = gReservedVocabularies.find(prefix.stl_str());
+    if ( reserved == nullptr )
         throw UnknownPrefix(_Str("Unknown prefix '", prefix, "'"));
-    return IRI(found->second + reference);
+    return KnownPropertyIRI(_Str(reserved->value, reference));
 }
 IRI PackageBase::PropertyIRIFromAttributeValue(const string &attrValue) const
 {
-    static REGEX_NS::regex re("^(?:(.+?):)?(.+)$");
-    REGEX_NS::smatch pieces;
-    if ( REGEX_NS::regex_match(attrValue.stl_str(), pieces, re) == false )
+    // 'prefix:reference' or just 'reference'; only the first colon separates a prefix
+    const std::string& value = attrValue.stl_str();
+    if ( value.empty() )
         throw std::invalid_argument(_Str("Attribute '", attrValue, "' doesn't look like a property name to me"));
     
-    // there are two captures, at indices 1 and 2
-    return MakePropertyIRI(pieces.str(2), pieces.str(1));
+    std::string::size_type colon = value.find(':');
+    if ( colon == 0 || colon == std::string::npos || colon == value.size() - 1 )
+        return MakePropertyIRI(attrValue);
+    
+    return MakePropertyIRI(value.substr(colon + 1), value.substr(0, colon));
+}
+Shared<const xmlDoc> PackageBase::DocumentForManifestItem(const ManifestItem* item) const
+{
+    return DocumentForManifestItem(item, nullptr);
+}
+Shared<const xmlDoc> PackageBase::DocumentForManifestItem(const ManifestItem* item, const xml::SchemaPool::CompiledSchema& schema) const
+{
+    if ( item == nullptr )
+        return nullptr;
+    
+    Shared<xml::Dictionary> dict(_dictionary);
+    return _documentCache.Document(item->AbsolutePath(), [item, dict, &schema]() {
+        bool valid = false;
+        string error;
+        xmlDocPtr doc = item->ReferencedDocument(dict->xmlDict(), dict->Lock(), schema, &valid, &error);
+        if ( doc != nullptr && !valid )
+        {
+            // never cached, so that it's rejected on every request
+            {
+                std::lock_guard<std::mutex> _(dict->Lock());
+                xmlFreeDoc(doc);
+            }
+            throw std::invalid_argument(_Str("Document ", item->AbsolutePath(), " is not valid: ", error));
+        }
+        return doc;
+    });
 }
 Auto<ByteStream> PackageBase::ReadStreamForItemAtPath(const string &path) const
 {
@@ -221,19 +423,36 @@ void PackageBase::InstallPrefixesFromAttributeValue(const ePub3::string &attrVal
     if ( attrValue.empty() )
         return;
     
-    static REGEX_NS::regex::flag_type reflags(REGEX_NS::regex::ECMAScript|REGEX_NS::regex::optimize);
-    static REGEX_NS::regex re(R"X((\w+):\s*(.+?)(?:\s+|$))X", reflags);
-    auto pos = REGEX_NS::sregex_iterator(attrValue.stl_str().begin(), attrValue.stl_str().end(), re);
-    auto end = REGEX_NS::sregex_iterator();
-    
-    while ( pos != end )
+    // a whitespace-separated list of 'prefix: stem' pairs
+    const std::string& value = attrValue.stl_str();
+    size_t pos = 0, len = value.size();
+    while ( pos < len )
     {
-        if ( pos->size() == 3 )     // entire match plus two captures
+        // prefixes are made of word characters, and are immediately followed by a colon
+        if ( !(isalnum(static_cast<unsigned char>(value[pos])) || value[pos] == '_') )
         {
-            RegisterPrefixIRIStem(pos->str(1), pos->str(2));
+            pos++;
+            continue;
         }
         
-        ++pos;
+        size_t start = pos;
+        while ( pos < len && (isalnum(static_cast<unsigned char>(value[pos])) || value[pos] == '_') )
+            pos++;
+        if ( pos == len || value[pos] != ':' )
+            continue;
+        
+        std::string prefix = value.substr(start, pos - start);
+        
+        pos++;
+        while ( pos < len && isspace(static_cast<unsigned char>(value[pos])) )
+            pos++;
+        
+        start = pos;
+        while ( pos < len && !isspace(static_cast<unsigned char>(value[pos])) )
+            pos++;
+        
+        if ( pos > start )
+            RegisterPrefixIRIStem(prefix, value.substr(start, pos - start));
     }
 }
 const SpineItem* PackageBase::ConfirmOrCorrectSpineItemQualifier(const SpineItem* pItem, CFI::Component *pComponent) const
@@ -241,20 +460,13 @@ const SpineItem* PackageBase::ConfirmOrCorrectSpineItemQualifier(const SpineItem
     if ( pComponent->HasQualifier() && pItem->Idref() != pComponent->qualifier )
     {
         // find the item with the qualifier
-        pItem = _spine.get();
-        uint32_t idx = 2;
+        size_t idx = IndexOfSpineItemWithIDRef(pComponent->qualifier);
+        if ( idx == size_t(-1) )
+            return nullptr;
         
-        while ( pItem != nullptr )
-        {
-            if ( pItem->Idref() == pComponent->qualifier )
-            {
-                // found it-- correct the CFI
-                pComponent->nodeIndex = idx;
-                break;
-            }
-            
-            pItem = pItem->Next();
-        }
+        // found it-- correct the CFI
+        pItem = _spine[idx];
+        pComponent->nodeIndex = static_cast<uint32_t>(idx*2);
     }
     
     return pItem;
@@ -264,27 +476,35 @@ NavigationList PackageBase::NavTablesFromManifestItem(const ManifestItem* pItem)
     if ( pItem == nullptr )
         return NavigationList();
     
-    xmlDocPtr doc = pItem->ReferencedDocument();
-    if ( doc == nullptr )
+    // any schema validation happens as the document is parsed, so a cached copy has
+    //  already been through it
+    xml::SchemaPool::CompiledSchema schema;
+    if ( Package::ValidatesSchema() )
+        schema = xml::SchemaPool::SchemaForNamespace(string(XHTMLNamespace));
+    
+    Shared<const xmlDoc> doc = pItem->Package()->DocumentForManifestItem(pItem, schema);
+    if ( !doc )
         return NavigationList();
     
-    // find each <nav> node
-    XPathWrangler xpath(doc, {{"epub", ePub3NamespaceURI}}); // goddamn I love C++11 initializer list constructors
+    // find each <nav> node-- XPath only reads the (shared) tree, but libxml wants it non-const
+    XPathWrangler xpath(const_cast<xmlDocPtr>(doc.get()), {{"epub", ePub3NamespaceURI}}); // goddamn I love C++11 initializer list constructors
     xpath.NameDefaultNamespace("html");
     
     xmlNodeSetPtr nodes = xpath.Nodes("//html:nav");
     
+    Arena& arena = pItem->Package()->ObjectArena();
     NavigationList tables;
     for ( size_t i = 0; i < nodes->nodeNr; i++ )
     {
         xmlNodePtr navNode = nodes->nodeTab[i];
-        tables.push_back(new class NavigationTable(navNode, pItem->Href()));
+        tables.push_back(arena.New<class NavigationTable>(navNode, pItem->Href(), &arena));
     }
     
     xmlXPathFreeNodeSet(nodes);
     
     // now look for any <dl> nodes with an epub:type of "glossary"
     nodes = xpath.Nodes("//html:dl[epub:type='glossary']");
+    xmlXPathFreeNodeSet(nodes);
     
     return tables;
 }
@@ -293,10 +513,63 @@ NavigationList PackageBase::NavTablesFromManifestItem(const ManifestItem* pItem)
 #pragma mark - Package High-Level API
 #endif
 
-Package::Package(Archive* archive, const string& path, const string& type) : PackageBase(archive, path, type)
+Package::Package(Archive* archive, const string& path, const string& type) : PackageBase(archive, path, type), _identity()
 {
-    if ( !Unpack() )
+    Trace::Scope trace("Package::Open", path);
+    
+    bool restored = false;
+    {
+        Trace::Scope _("Package::RestoreSnapshot", path);
+        restored = PackageSnapshot::Restore(this, path);
+    }
+    bool ok = restored;
+    
+    if ( !ok && gUseStreamingParser )
+    {
+        Trace::Scope _("Package::StreamOPF", path);
+        ok = UnpackStream(path);
+    }
+    else if ( !ok )
+    {
+        {
+            Trace::Scope _("Package::ReadOPF", path);
+            ArchiveXmlReader reader(_archive->ReaderAtPath(path.stl_str()));
+            int flags = XML_PARSE_RECOVER|XML_PARSE_NOENT|XML_PARSE_DTDATTR|XML_PARSE_COMPACT;
+            
+            // any schema validation happens as the document is parsed, not in a second pass
+            xml::SchemaPool::CompiledSchema schema;
+            if ( gValidateSchema )
+                schema = xml::SchemaPool::SchemaForNamespace(string(OPFNamespace));
+            
+            string error;
+            bool valid = true;
+            {
+                std::lock_guard<std::mutex> _(_dictionary->Lock());
+                if ( schema )
+                    _opf = reader.xmlReadValidatedDocument(path.c_str(), nullptr, flags, _dictionary->xmlDict(), schema, &valid, &error);
+                else
+                    _opf = reader.xmlReadDocument(path.c_str(), nullptr, flags, _dictionary->xmlDict());
+            }
+            if ( _opf == nullptr )
+                throw std::invalid_argument(std::string(__PRETTY_FUNCTION__) + ": No OPF file at " + path.stl_str());
+            if ( !valid )
+                throw std::invalid_argument(_Str(__PRETTY_FUNCTION__, ": OPF file at ", path, " is not valid: ", error));
+        }
+        
+        ok = Unpack();
+    }
+    
+    if ( !ok )
         throw std::invalid_argument(_Str(__PRETTY_FUNCTION__, ": Not a valid OPF file at ", path));
+    
+    _manifestStore.ResolveReferences();
+    
+    // a failure here just means the next load takes the slow path again
+    if ( !restored )
+    {
+        Trace::Scope _("Package::WriteSnapshot", path);
+        PackageSnapshot::Write(this, path);
+    }
 }
 bool Package::Unpack()
 {
@@ -329,7 +602,8 @@ bool Package::Unpack()
     if ( _spineCFIIndex == 0 )
         return false;       // spineless!
     
-    XPathWrangler xpath(_opf, {{"opf", OPFNamespace}, {"dc", DCNamespace}});
+    _opfXPath.reset(new XPathWrangler(_opf, {{"opf", OPFNamespace}, {"dc", DCNamespace}}));
+    XPathWrangler& xpath = *_opfXPath;
     
     // simple things: manifest and spine items
     xmlNodeSetPtr manifestNodes = nullptr;
@@ -343,30 +617,19 @@ bool Package::Unpack()
         if ( manifestNodes == nullptr || spineNodes == nullptr )
             throw false;   // looks invalid, or at least unusable, to me
         
-        for ( int i = 0; i < manifestNodes->nodeNr; i++ )
         {
-            ManifestItem *p = new ManifestItem(manifestNodes->nodeTab[i], this);
-#if EPUB_HAVE(CXX_MAP_EMPLACE)
-            _manifest.emplace(p->Identifier(), p);
-#else
-            _manifest[p->Identifier()] = p;
-#endif
+            Trace::Scope _("Package::Manifest");
+            for ( int i = 0; i < manifestNodes->nodeNr; i++ )
+            {
+                AddManifestItem(manifestNodes->nodeTab[i]);
+            }
         }
         
-        SpineItem* cur = nullptr;
+        Trace::Scope _("Package::Spine");
+        _spine.reserve(spineNodes->nodeNr);
         for ( int i = 0; i < spineNodes->nodeNr; i++ )
         {
-            SpineItem* next = new SpineItem(spineNodes->nodeTab[i], this);
-            if ( cur != nullptr )
-            {
-                cur->SetNextItem(next);
-            }
-            else
-            {
-                _spine.reset(next);
-            }
-            
-            cur = next;
+            AppendSpineItem(_arena->New<SpineItem>(spineNodes->nodeTab[i], this));
         }
     }
     catch (...)
@@ -383,78 +646,32 @@ bool Package::Unpack()
     
     // now the metadata, which is slightly more involved due to extensions
     xmlNodeSetPtr metadataNodes = nullptr;
-    xmlNodeSetPtr refineNodes = xmlXPathNodeSetCreate(nullptr);
     
     try
     {
+        Trace::Scope _("Package::Metadata");
         metadataNodes = xpath.Nodes("/opf:package/opf:metadata/*");
         if ( metadataNodes == nullptr )
             throw false;
         
         std::map<string, class Metadata*> metadataByID;
+        std::vector<xmlNodePtr> refineNodes;
         
         for ( int i = 0; i < metadataNodes->nodeNr; i++ )
         {
-            xmlNodePtr node = metadataNodes->nodeTab[i];
-            class Metadata* p = nullptr;
-            
-            if ( node->ns != nullptr && xmlStrcmp(node->ns->href, BAD_CAST DCNamespace) == 0 )
-            {
-                // definitely a main node
-                p = new class Metadata(node, this);
-            }
-            else if ( _getProp(node, "name").size() > 0 )
-            {
-                // it's an ePub2 item-- ignore it
-                continue;
-            }
-            else if ( _getProp(node, "refines").empty() )
-            {
-                // not refining anything, so it's a main node
-                p = new class Metadata(node, this);
-            }
-            else
-            {
-                // by elimination it's refining something-- we'll process it later when we know we've got all the main nodes in there
-                xmlXPathNodeSetAdd(refineNodes, node);
-            }
-            
-            if ( p != nullptr )
-            {
-                _metadata.push_back(p);
-                if ( !p->Identifier().empty() )
-                    metadataByID[p->Identifier()] = p;
-            }
+            UnpackMetadataNode(metadataNodes->nodeTab[i], metadataByID, refineNodes);
         }
         
-        for ( int i = 0; i < refineNodes->nodeNr; i++ )
-        {
-            xmlNodePtr node = refineNodes->nodeTab[i];
-            string ident = _getProp(node, "refines");
-            if ( ident.empty() )
-                continue;
-            
-            if ( ident[0] == '#' )
-                ident = ident.substr(1);
-            
-            auto found = metadataByID.find(ident);
-            if ( found == metadataByID.end() )
-                continue;
-            
-            found->second->AddExtension(node, this);
-        }
+        UnpackMetadataRefinements(metadataByID, refineNodes);
     }
     catch (...)
     {
         if ( metadataNodes != nullptr )
             xmlXPathFreeNodeSet(metadataNodes);
-        if ( refineNodes != nullptr )
-            xmlXPathFreeNodeSet(refineNodes);
         return false;
     }
     
     xmlXPathFreeNodeSet(metadataNodes);
-    xmlXPathFreeNodeSet(refineNodes);
     
     // now any content type bindings
     xmlNodeSetPtr bindingNodes = nullptr;
@@ -466,152 +683,456 @@ bool Package::Unpack()
         {
             for ( int i = 0; i < bindingNodes->nodeNr; i++ )
             {
-                xmlNodePtr node = bindingNodes->nodeTab[i];
-                if ( xmlStrcasecmp(node->name, MediaTypeElementName) != 0 )
-                    continue;
+                UnpackMediaTypeBinding(bindingNodes->nodeTab[i]);
+            }
+        }
+    }
+    catch (std::exception& exc)
+    {
+        std::cerr << "Exception processing OPF file: " << exc.what() << std::endl;
+        if ( bindingNodes != nullptr )
+            xmlXPathFreeNodeSet(bindingNodes);
+        return false;
+    }
+    catch (...)
+    {
+        if ( bindingNodes != nullptr )
+            xmlXPathFreeNodeSet(bindingNodes);
+        return false;
+    }
+    
+    xmlXPathFreeNodeSet(bindingNodes);
+    
+    FinishUnpacking();
+    return true;
+}
+bool Package::UnpackStream(const string& path)
+{
+    ArchiveXmlReader input(_archive->ReaderAtPath(path.stl_str()));
+    xmlTextReaderPtr reader = input.xmlReaderForDocument(path.c_str(), nullptr, XML_PARSE_RECOVER|XML_PARSE_NOENT|XML_PARSE_DTDATTR);
+    if ( reader == nullptr )
+        return false;
+    
+    // validation happens as we read, rather than as a second pass over a DOM
+    xml::SchemaPool::CompiledSchema schema;
+    xmlSchemaValidCtxtPtr validator = nullptr;
+    string validationError;
+    if ( gValidateSchema )
+    {
+        try
+        {
+            schema = xml::SchemaPool::SchemaForNamespace(string(OPFNamespace));
+        }
+        catch (...)
+        {
+            xmlFreeTextReader(reader);
+            throw;
+        }
+        
+        if ( schema && (validator = xml::SchemaPool::ValidateReader(reader, schema, &validationError)) == nullptr )
+        {
+            xmlFreeTextReader(reader);
+            return false;
+        }
+    }
+    
+    static const xmlChar* kPackageName = BAD_CAST "package";
+    static const xmlChar* kManifestName = BAD_CAST "manifest";
+    static const xmlChar* kItemName = BAD_CAST "item";
+    static const xmlChar* kSpineName = BAD_CAST "spine";
+    static const xmlChar* kItemRefName = BAD_CAST "itemref";
+    static const xmlChar* kMetadataName = BAD_CAST "metadata";
+    static const xmlChar* kBindingsName = BAD_CAST "bindings";
+    
+    // the skeleton document keeps only the root element, metadata, and bindings;
+    //  everything else is discarded by the reader as soon as we've passed it
+    xmlNodePtr root = nullptr;
+    std::vector<xmlNodePtr> bindings;
+    std::map<string, class Metadata*> metadataByID;
+    std::vector<xmlNodePtr> refineNodes;
+    
+    const xmlChar* section = nullptr;
+    bool seenSpine = false;
+    
+    _spineCFIIndex = 0;
+    
+    try
+    {
+        int status = xmlTextReaderRead(reader);
+        while ( status == 1 )
+        {
+            if ( xmlTextReaderNodeType(reader) != XML_READER_TYPE_ELEMENT )
+            {
+                status = xmlTextReaderRead(reader);
+                continue;
+            }
+            
+            int depth = xmlTextReaderDepth(reader);
+            if ( depth == 0 )
+            {
+                // very basic sanity check
+                xmlNodePtr node = xmlTextReaderCurrentNode(reader);
+                if ( node == nullptr || xmlStrcasecmp(node->name, kPackageName) != 0 )
+                    throw false;        // not an OPF file, innit?
                 
-                ////////////////////////////////////////////////////////////
-                // ePub Publications 3.0 §3.4.16: The `mediaType` Element
+                InstallPrefixesFromAttributeValue(_getProp(node, "prefix", ePub3NamespaceURI));
                 
-                // The media-type attribute is required.
-                string mediaType = _getProp(node, "media-type");
-                if ( mediaType.empty() )
+                _opf = xmlNewDoc(BAD_CAST "1.0");
+                root = xmlDocCopyNode(node, _opf, 2);       // attributes and namespaces only
+                xmlDocSetRootElement(_opf, root);
+                _opfXPath.reset(new XPathWrangler(_opf, {{"opf", OPFNamespace}, {"dc", DCNamespace}}));
+            }
+            else if ( depth == 1 )
+            {
+                const xmlChar* name = xmlTextReaderConstLocalName(reader);
+                const xmlChar* nsURI = xmlTextReaderConstNamespaceUri(reader);
+                
+                // count elements to determine the CFI index of the <spine> tag
+                if ( !seenSpine )
                 {
-                    throw std::invalid_argument("mediaType element has missing or empty media-type attribute.");
+                    _spineCFIIndex += 2;
+                    seenSpine = xmlStrEqual(name, kSpineName);
                 }
                 
-                // Each child mediaType of a bindings element must define a unique
-                // content type in its media-type attribute, and the media type
-                // specified must not be a Core Media Type.
-                if ( _contentHandlers[mediaType].empty() == false )
+                section = nullptr;
+                if ( !xmlStrEqual(nsURI, OPFNamespace) )
                 {
-                    // user shouldn't have added manual things yet, but for safety we'll look anyway
-                    for ( auto ptr : _contentHandlers[mediaType] )
-                    {
-                        if ( typeid(*ptr) == typeid(MediaHandler) )
-                        {
-                            throw std::invalid_argument(_Str("Duplicate media handler found for type '", mediaType, "'."));
-                        }
-                    }
+                    // not one of ours
                 }
-                if ( CoreMediaTypes.find(mediaType) != CoreMediaTypes.end() )
+                else if ( xmlStrEqual(name, kManifestName) )
                 {
-                    throw std::invalid_argument("mediaType element specifies an EPUB Core Media Type.");
+                    section = kManifestName;
                 }
-                
-                // The handler attribute is required
-                string handlerID = _getProp(node, "handler");
-                if ( handlerID.empty() )
+                else if ( xmlStrEqual(name, kSpineName) )
                 {
-                    throw std::invalid_argument("mediaType element has missing or empty handler attribute.");
+                    section = kSpineName;
                 }
-                
-                // The required handler attribute must reference the ID [XML] of an
-                // item in the manifest of the default implementation for this media
-                // type. The referenced item must be an XHTML Content Document.
-                const ManifestItem* handlerItem = ManifestItemWithID(handlerID);
-                if ( handlerItem == nullptr )
+                else if ( xmlStrEqual(name, kMetadataName) || xmlStrEqual(name, kBindingsName) )
                 {
-                    throw std::invalid_argument(_Str("mediaType element references non-existent handler with ID '", handlerID, "'."));
+                    // these are small, so we copy them wholesale into the skeleton
+                    xmlNodePtr node = xmlTextReaderExpand(reader);
+                    if ( node == nullptr )
+                        throw false;
+                    
+                    bool isMetadata = xmlStrEqual(name, kMetadataName);
+                    xmlNodePtr copy = xmlAddChild(root, xmlDocCopyNode(node, _opf, 1));
+                    for ( xmlNodePtr child = copy->children; child != nullptr; child = child->next )
+                    {
+                        if ( child->type != XML_ELEMENT_NODE )
+                            continue;
+                        
+                        if ( isMetadata )
+                            UnpackMetadataNode(child, metadataByID, refineNodes);
+                        else
+                            bindings.push_back(child);  // needs a complete manifest
+                    }
+                    
+                    status = xmlTextReaderNext(reader);
+                    continue;
                 }
-                if ( handlerItem->MediaType() != "application/xhtml+xml" )
+            }
+            else if ( depth == 2 && section != nullptr )
+            {
+                const xmlChar* name = xmlTextReaderConstLocalName(reader);
+                if ( !xmlStrEqual(xmlTextReaderConstNamespaceUri(reader), OPFNamespace) )
                 {
-                    throw std::invalid_argument(_Str("Media handlers must be XHTML content documents, but referenced item has type '", handlerItem->MediaType(), "'."));
+                    // not one of ours
                 }
-                
-                // All XHTML Content Documents designated as handlers must have the
-                // `scripted` property set in their manifest item's `properties`
-                // attribute.
-                if ( handlerItem->HasProperty(ItemProperties::HasScriptedContent) == false )
+                else if ( section == kManifestName && xmlStrEqual(name, kItemName) )
                 {
-                    throw std::invalid_argument("Media handlers must have the `scripted` property.");
+                    xmlNodePtr node = xmlTextReaderExpand(reader);
+                    if ( node == nullptr )
+                        throw false;
+                    AddManifestItem(node);
+                }
+                else if ( section == kSpineName && xmlStrEqual(name, kItemRefName) )
+                {
+                    xmlNodePtr node = xmlTextReaderExpand(reader);
+                    if ( node == nullptr )
+                        throw false;
+                    AppendSpineItem(_arena->New<SpineItem>(node, this));
                 }
-                
-                // all good-- install it now
-                _contentHandlers[mediaType].push_back(new MediaHandler(this, mediaType, handlerItem->AbsolutePath()));
             }
+            
+            status = xmlTextReaderRead(reader);
+        }
+        
+        if ( status != 0 || root == nullptr || !seenSpine )
+            throw false;        // unreadable, empty, or spineless!
+        if ( validator != nullptr && xmlTextReaderIsValid(reader) != 1 )
+            throw std::invalid_argument(_Str("OPF file is not valid: ", validationError));
+        
+        UnpackMetadataRefinements(metadataByID, refineNodes);
+        
+        for ( auto node : bindings )
+        {
+            UnpackMediaTypeBinding(node);
         }
     }
     catch (std::exception& exc)
     {
         std::cerr << "Exception processing OPF file: " << exc.what() << std::endl;
-        if ( bindingNodes != nullptr )
-            xmlXPathFreeNodeSet(bindingNodes);
+        xmlFreeTextReader(reader);
+        xmlSchemaFreeValidCtxt(validator);
         return false;
     }
     catch (...)
     {
-        if ( bindingNodes != nullptr )
-            xmlXPathFreeNodeSet(bindingNodes);
+        xmlFreeTextReader(reader);
+        xmlSchemaFreeValidCtxt(validator);
         return false;
     }
     
-    xmlXPathFreeNodeSet(bindingNodes);
+    xmlFreeTextReader(reader);
+    xmlSchemaFreeValidCtxt(validator);
     
-    // now the navigation tables
-    for ( auto item : _manifest )
+    FinishUnpacking();
+    return true;
+}
+void Package::UnpackMetadataNode(xmlNodePtr node, std::map<string, class Metadata*>& metadataByID, std::vector<xmlNodePtr>& refines)
+{
+    class Metadata* p = nullptr;
+    
+    if ( node->ns != nullptr && xmlStrcmp(node->ns->href, BAD_CAST DCNamespace) == 0 )
+    {
+        // definitely a main node
+        p = _arena->New<class Metadata>(node, this);
+    }
+    else if ( _getProp(node, "name").size() > 0 )
     {
-        if ( !item.second->HasProperty(ItemProperties::Navigation) )
+        // it's an ePub2 item-- ignore it
+        return;
+    }
+    else if ( _getProp(node, "refines").empty() )
+    {
+        // not refining anything, so it's a main node
+        p = _arena->New<class Metadata>(node, this);
+    }
+    else
+    {
+        // by elimination it's refining something-- we'll process it later when we know we've got all the main nodes in there
+        refines.push_back(node);
+    }
+    
+    if ( p != nullptr )
+    {
+        _metadata.push_back(p);
+        if ( !p->Identifier().empty() )
+            metadataByID[p->Identifier()] = p;
+    }
+}
+void Package::UnpackMetadataRefinements(const std::map<string, class Metadata*>& metadataByID, const std::vector<xmlNodePtr>& refines)
+{
+    for ( auto node : refines )
+    {
+        string ident = _getProp(node, "refines");
+        if ( ident.empty() )
+            continue;
+        
+        if ( ident[0] == '#' )
+            ident = ident.substr(1);
+        
+        auto found = metadataByID.find(ident);
+        if ( found == metadataByID.end() )
             continue;
         
-        NavigationList tables = NavTablesFromManifestItem(item.second);
-        for ( auto table : tables )
+        found->second->AddExtension(node, this);
+    }
+    
+    IndexMetadata();
+}
+void Package::UnpackMediaTypeBinding(xmlNodePtr node)
+{
+    if ( xmlStrcasecmp(node->name, MediaTypeElementName) != 0 )
+        return;
+    
+    ////////////////////////////////////////////////////////////
+    // ePub Publications 3.0 §3.4.16: The `mediaType` Element
+    
+    // The media-type attribute is required.
+    string mediaType = _getProp(node, "media-type");
+    if ( mediaType.empty() )
+    {
+        throw std::invalid_argument("mediaType element has missing or empty media-type attribute.");
+    }
+    
+    // Each child mediaType of a bindings element must define a unique
+    // content type in its media-type attribute, and the media type
+    // specified must not be a Core Media Type.
+    if ( _contentHandlers[mediaType].empty() == false )
+    {
+        // user shouldn't have added manual things yet, but for safety we'll look anyway
+        for ( auto ptr : _contentHandlers[mediaType] )
+        {
+            if ( typeid(*ptr) == typeid(MediaHandler) )
+            {
+                throw std::invalid_argument(_Str("Duplicate media handler found for type '", mediaType, "'."));
+            }
+        }
+    }
+    if ( IsCoreMediaType(mediaType) )
+    {
+        throw std::invalid_argument("mediaType element specifies an EPUB Core Media Type.");
+    }
+    
+    // The handler attribute is required
+    string handlerID = _getProp(node, "handler");
+    if ( handlerID.empty() )
+    {
+        throw std::invalid_argument("mediaType element has missing or empty handler attribute.");
+    }
+    
+    // The required handler attribute must reference the ID [XML] of an
+    // item in the manifest of the default implementation for this media
+    // type. The referenced item must be an XHTML Content Document.
+    const ManifestItem* handlerItem = ManifestItemWithID(handlerID);
+    if ( handlerItem == nullptr )
+    {
+        throw std::invalid_argument(_Str("mediaType element references non-existent handler with ID '", handlerID, "'."));
+    }
+    if ( handlerItem->MediaType() != "application/xhtml+xml" )
+    {
+        throw std::invalid_argument(_Str("Media handlers must be XHTML content documents, but referenced item has type '", handlerItem->MediaType(), "'."));
+    }
+    
+    // All XHTML Content Documents designated as handlers must have the
+    // `scripted` property set in their manifest item's `properties`
+    // attribute.
+    if ( handlerItem->HasProperty(ItemProperties::HasScriptedContent) == false )
+    {
+        throw std::invalid_argument("Media handlers must have the `scripted` property.");
+    }
+    
+    // all good-- install it now
+    _contentHandlers[mediaType].push_back(new MediaHandler(this, mediaType, handlerItem->AbsolutePath()));
+}
+void Package::FinishUnpacking()
+{
+    // now the navigation tables
+    {
+        Trace::Scope _("Package::NavigationTables");
+        for ( auto item : _manifest )
         {
-            // have to dynamic_cast these guys to get the right pointer type
-            class NavigationTable* navTable = dynamic_cast<class NavigationTable*>(table);
+            if ( !item.second->HasProperty(ItemProperties::Navigation) )
+                continue;
+            
+            NavigationList tables = NavTablesFromManifestItem(item.second);
+            for ( auto table : tables )
+            {
+                // have to dynamic_cast these guys to get the right pointer type
+                class NavigationTable* navTable = dynamic_cast<class NavigationTable*>(table);
 #if EPUB_HAVE(CXX_MAP_EMPLACE)
-            _navigation.emplace(navTable->Type(), navTable);
+                _navigation.emplace(navTable->Type(), navTable);
 #else
-            _navigation[navTable->Type()] = navTable;
+                _navigation[navTable->Type()] = navTable;
 #endif
+            }
         }
     }
     
     // lastly, let's set the media support information
+    Trace::Scope _("Package::InitMediaSupport");
     InitMediaSupport();
-    
-    return true;
 }
 
 string Package::UniqueID() const
 {
-    string packageID = PackageID();
-    if ( packageID.empty() )
-        return string::EmptyString;
-    
-    string modDate = ModificationDate();
-    if ( modDate.empty() )
-        return packageID;
-    
-    return _Str(packageID, "@", modDate);
+    std::lock_guard<std::mutex> _(_metadataCacheLock);
+    return IdentityLocked().uniqueID;
 }
 string Package::URLSafeUniqueID() const
 {
-    string packageID = PackageID();
-    if ( packageID.empty() )
-        return string::EmptyString;
+    std::lock_guard<std::mutex> _(_metadataCacheLock);
+    return IdentityLocked().urlSafeUniqueID;
+}
+string Package::PackageID() const
+{
+    std::lock_guard<std::mutex> _(_metadataCacheLock);
+    return IdentityLocked().packageID;
+}
+const Package::IdentityMetadata& Package::IdentityLocked() const
+{
+    if ( _identity.valid )
+        return _identity;
     
-    string modDate = ModificationDate();
-    if ( modDate.empty() )
-        return packageID;
+    _identity.packageID = ComputePackageID();
+    _identity.modificationDate = ComputeModificationDate();
     
-    // only include the first ten characters of the modification date (the date part)
-    modDate = modDate.substr(0, 10);
+    const string& packageID = _identity.packageID;
+    const string& modDate = _identity.modificationDate;
+    if ( packageID.empty() )
+    {
+        _identity.uniqueID = string::EmptyString;
+        _identity.urlSafeUniqueID = string::EmptyString;
+    }
+    else if ( modDate.empty() )
+    {
+        _identity.uniqueID = packageID;
+        _identity.urlSafeUniqueID = packageID;
+    }
+    else
+    {
+        _identity.uniqueID = _Str(packageID, "@", modDate);
+        
+        // only include the first ten characters of the modification date (the date part)
+        string shortDate = modDate.substr(0, 10);
+        
+        // trim the uniqueID if necessary to get the whole thing below 256 characters in length
+        string safeID = packageID;
+        string::size_type maxLen = 255, totalLen = safeID.size() + 1 + shortDate.size();
+        if ( totalLen > maxLen )
+        {
+            string::size_type diff = totalLen - maxLen;
+            safeID = safeID.substr(0, safeID.size() - diff);
+        }
+        
+        _identity.urlSafeUniqueID = _Str(safeID, '_', shortDate);
+    }
+    
+    _identity.valid = true;
+    return _identity;
+}
+const Package::DisplayMetadata& Package::DisplayLocked(bool localized) const
+{
+    std::string key;
+    if ( localized )
+    {
+        key = Locale().name();
+        if ( key.empty() || key == "*" )
+            key = "*";      // an unnamed locale: we can't tell one from another
+    }
     
-    // trim the uniqueID if necessary to get the whole thing below 256 characters in length
-    string::size_type maxLen = 255, totalLen = packageID.size() + 1 + modDate.size();
-    if ( totalLen > maxLen )
+    DisplayMetadata* display = nullptr;
+    if ( key == "*" )
+    {
+        display = &_uncachedDisplay;
+    }
+    else
     {
-        string::size_type diff = totalLen - maxLen;
-        packageID = packageID.substr(0, packageID.size() - diff);
+        auto found = _display.find(key);
+        if ( found != _display.end() )
+            return found->second;
+        display = &_display[key];
     }
     
-    return _Str(packageID, '_', modDate);
+    display->title = ComputeTitle(localized);
+    display->subtitle = ComputeSubtitle(localized);
+    display->fullTitle = ComputeFullTitle(localized);
+    display->authorNames = ComputeAuthorNames(localized);
+    display->attributionNames = ComputeAttributionNames(localized);
+    display->authors = CollateNames(display->authorNames);
+    return *display;
 }
-string Package::PackageID() const
+void Package::InvalidateMetadataCache()
 {
-    XPathWrangler xpath(_opf, {{"opf", OPFNamespace}, {"dc", DCNamespace}});
-    XPathWrangler::StringList strings = xpath.Strings("//*[@id=/opf:package/@unique-identifier]/text()");
+    std::lock_guard<std::mutex> _(_metadataCacheLock);
+    _identity = IdentityMetadata();
+    _display.clear();
+}
+string Package::ComputePackageID() const
+{
+    std::lock_guard<std::mutex> _(_opfXPathLock);
+    XPathWrangler::StringList strings = _opfXPath->Strings("//*[@id=/opf:package/@unique-identifier]/text()");
     if ( strings.empty() )
         return string::EmptyString;
     return strings[0];
@@ -638,46 +1159,48 @@ void Package::FireLoadEvent(const IRI &url) const
     
     _loadEventHandler(fixed);
 }
-const PackageBase::MetadataMap Package::MetadataItemsWithDCType(Metadata::DCType type) const
+const PackageBase::MetadataMap& Package::MetadataItemsWithDCType(Metadata::DCType type) const
 {
     return MetadataItemsWithProperty(IRIForDCType(type));
 }
-const PackageBase::MetadataMap Package::MetadataItemsWithProperty(const IRI &iri) const
+const PackageBase::MetadataMap& Package::MetadataItemsWithProperty(const IRI &iri) const
+{
+    static const MetadataMap empty;
+    if ( iri.IsEmpty() )
+        return empty;
+    
+    const MetadataMap* found = _metadataByProperty.find(iri.URIString().stl_str());
+    return (found == nullptr ? empty : *found);
+}
+void Package::IndexMetadata()
 {
-    MetadataMap result;
+    _metadataByProperty.clear();
+    
     for ( auto item : _metadata )
     {
         if ( item->Type() == Metadata::DCType::Invalid )
             continue;
         
-        if ( item->Property() == iri )
-        {
-            result.push_back(item);
-        }
-        else
+        // IRIs compare by their canonical URL, so that's what we key on
+        if ( !item->Property().IsEmpty() )
+            _metadataByProperty[item->Property().URIString().stl_str()].push_back(item);
+        
+        for ( auto extension : item->Extensions() )
         {
-            for ( auto extension : item->Extensions() )
-            {
-                if ( extension->Property() == iri )
-                {
-                    result.push_back(item);
-                    break;
-                }
-            }
+            if ( extension->Property().IsEmpty() )
+                continue;
+            
+            MetadataMap& bucket = _metadataByProperty[extension->Property().URIString().stl_str()];
+            if ( bucket.empty() || bucket.back() != item )
+                bucket.push_back(item);
         }
     }
     
-    return result;
+    InvalidateMetadataCache();
 }
 const SpineItem* Package::SpineItemWithIDRef(const string &idref) const
 {
-    for ( const SpineItem* item = FirstSpineItem(); item != nullptr; item = item->Next() )
-    {
-        if ( item->Idref() == idref )
-            return item;
-    }
-    
-    return nullptr;
+    return SpineItemAt(IndexOfSpineItemWithIDRef(idref));
 }
 const CFI Package::CFIForManifestItem(const ManifestItem *item) const
 {
@@ -717,7 +1240,10 @@ const ManifestItem* Package::ManifestItemForCFI(ePub3::CFI &cfi, CFI* pRemaining
     {
         if ( (component.nodeIndex % 2) == 1 )
             throw CFI::InvalidCFI("CFI spine item index is odd, which makes no sense for always-empty spine nodes.");
-        const SpineItem* item = _spine->at(component.nodeIndex/2);
+        const SpineItem* item = FirstSpineItem();
+        if ( item == nullptr )
+            throw std::out_of_range("The spine is empty");
+        item = item->at(component.nodeIndex/2);
         
         // check and correct any qualifiers
         item = ConfirmOrCorrectSpineItemQualifier(item, &component);
@@ -743,7 +1269,37 @@ Auto<ByteStream> Package::ReadStreamForRelativePath(const string &path) const
 }
 const string Package::Title(bool localized) const
 {
-    IRI titleTypeIRI(MakePropertyIRI("title-type"));      // http://idpf.org/epub/vocab/package/#title-type
+    std::lock_guard<std::mutex> _(_metadataCacheLock);
+    return DisplayLocked(localized).title;
+}
+const string Package::Subtitle(bool localized) const
+{
+    std::lock_guard<std::mutex> _(_metadataCacheLock);
+    return DisplayLocked(localized).subtitle;
+}
+const string Package::FullTitle(bool localized) const
+{
+    std::lock_guard<std::mutex> _(_metadataCacheLock);
+    return DisplayLocked(localized).fullTitle;
+}
+const Package::AttributionList Package::AuthorNames(bool localized) const
+{
+    std::lock_guard<std::mutex> _(_metadataCacheLock);
+    return DisplayLocked(localized).authorNames;
+}
+const Package::AttributionList Package::AttributionNames(bool localized) const
+{
+    std::lock_guard<std::mutex> _(_metadataCacheLock);
+    return DisplayLocked(localized).attributionNames;
+}
+const string Package::Authors(bool localized) const
+{
+    std::lock_guard<std::mutex> _(_metadataCacheLock);
+    return DisplayLocked(localized).authors;
+}
+string Package::ComputeTitle(bool localized) const
+{
+    const IRI& titleTypeIRI(gTitleTypeIRI);
     
     // find the main one
     for ( auto item : MetadataItemsWithProperty(titleTypeIRI) )
@@ -757,7 +1313,7 @@ const string Package::Title(bool localized) const
     }
     
     // no 'main title' found: just get the dc:title value
-    const MetadataMap items = MetadataItemsWithDCType(Metadata::DCType::Title);
+    const MetadataMap& items = MetadataItemsWithDCType(Metadata::DCType::Title);
     if ( items.empty() )
         return string::EmptyString;
     
@@ -766,9 +1322,9 @@ const string Package::Title(bool localized) const
     
     return items[0]->Value();
 }
-const string Package::Subtitle(bool localized) const
+string Package::ComputeSubtitle(bool localized) const
 {
-    IRI titleTypeIRI(MakePropertyIRI("title-type"));      // http://idpf.org/epub/vocab/package/#title-type
+    const IRI& titleTypeIRI(gTitleTypeIRI);
     
     // find the main one
     for ( auto item : MetadataItemsWithProperty(titleTypeIRI) )
@@ -788,16 +1344,16 @@ const string Package::Subtitle(bool localized) const
     // no 'subtitle' found, so no subtitle
     return string::EmptyString;
 }
-const string Package::FullTitle(bool localized) const
+string Package::ComputeFullTitle(bool localized) const
 {
-    MetadataMap items = MetadataItemsWithDCType(Metadata::DCType::Title);
+    const MetadataMap& items = MetadataItemsWithDCType(Metadata::DCType::Title);
     if ( items.size() == 1 )
         return items[0]->Value();
     
-    IRI displaySeqIRI(MakePropertyIRI("display-seq"));  // http://idpf.org/epub/vocab/package/#display-seq
+    const IRI& displaySeqIRI(gDisplaySeqIRI);
     std::vector<string> titles(items.size());
     
-    MetadataMap sequencedItems = MetadataItemsWithProperty(displaySeqIRI);
+    const MetadataMap& sequencedItems = MetadataItemsWithProperty(displaySeqIRI);
     if ( !sequencedItems.empty() )
     {
         // all these have a 1-based sequence number
@@ -832,7 +1388,7 @@ const string Package::FullTitle(bool localized) const
     
     return string(ss.str());
 }
-const Package::AttributionList Package::AuthorNames(bool localized) const
+Package::AttributionList Package::ComputeAuthorNames(bool localized) const
 {
     AttributionList result;
     for ( auto item : MetadataItemsWithDCType(Metadata::DCType::Creator) )
@@ -843,7 +1399,7 @@ const Package::AttributionList Package::AuthorNames(bool localized) const
     if ( result.empty() )
     {
         // maybe they're using dcterms:creator instead?
-        for ( auto item : MetadataItemsWithProperty(MakePropertyIRI("creator", "dcterms")) )
+        for ( auto item : MetadataItemsWithProperty(gDCTermsCreatorIRI) )
         {
             result.emplace_back((localized? item->LocalizedValue() : item->Value()));
         }
@@ -851,10 +1407,10 @@ const Package::AttributionList Package::AuthorNames(bool localized) const
     
     return result;
 }
-const Package::AttributionList Package::AttributionNames(bool localized) const
+Package::AttributionList Package::ComputeAttributionNames(bool localized) const
 {
     AttributionList result;
-    IRI fileAsIRI(MakePropertyIRI("file-as"));
+    const IRI& fileAsIRI(gFileAsIRI);
     for ( auto item : MetadataItemsWithDCType(Metadata::DCType::Creator) )
     {
         const Metadata::Extension* extension = item->ExtensionWithProperty(fileAsIRI);
@@ -865,10 +1421,9 @@ const Package::AttributionList Package::AttributionNames(bool localized) const
     }
     return result;
 }
-const string Package::Authors(bool localized) const
+string Package::CollateNames(const AttributionList& authors)
 {
     // TODO: handle localization of the word 'and'
-    AttributionList authors = AuthorNames(localized);
     if ( authors.empty() )
         return string::EmptyString;
     if ( authors.size() == 1 )
@@ -890,7 +1445,7 @@ const string Package::Authors(bool localized) const
 const Package::AttributionList Package::ContributorNames(bool localized) const
 {
     AttributionList result;
-    for ( auto item : MetadataItemsWithProperty(MakePropertyIRI("contributor", "dcterms")) )
+    for ( auto item : MetadataItemsWithProperty(gDCTermsContributorIRI) )
     {
         result.emplace_back((localized? item->LocalizedValue() : item->Value()));
     }
@@ -920,28 +1475,33 @@ const string Package::Contributors(bool localized) const
 }
 const string Package::Language() const
 {
-    MetadataMap items = MetadataItemsWithDCType(Metadata::DCType::Language);
+    const MetadataMap& items = MetadataItemsWithDCType(Metadata::DCType::Language);
     if ( items.empty() )
         return string::EmptyString;
     return items[0]->Value();
 }
 const string Package::Source(bool localized) const
 {
-    MetadataMap items = MetadataItemsWithDCType(Metadata::DCType::Source);
+    const MetadataMap& items = MetadataItemsWithDCType(Metadata::DCType::Source);
     if ( items.empty() )
         return string::EmptyString;
     return (localized? items[0]->LocalizedValue() : items[0]->Value());
 }
 const string Package::CopyrightOwner(bool localized) const
 {
-    MetadataMap items = MetadataItemsWithDCType(Metadata::DCType::Rights);
+    const MetadataMap& items = MetadataItemsWithDCType(Metadata::DCType::Rights);
     if ( items.empty() )
         return string::EmptyString;
     return (localized? items[0]->LocalizedValue() : items[0]->Value());
 }
 const string Package::ModificationDate() const
 {
-    MetadataMap items = MetadataItemsWithProperty(MakePropertyIRI("modified", "dcterms"));
+    std::lock_guard<std::mutex> _(_metadataCacheLock);
+    return IdentityLocked().modificationDate;
+}
+string Package::ComputeModificationDate() const
+{
+    const MetadataMap& items = MetadataItemsWithProperty(gDCTermsModifiedIRI);
     if ( items.empty() )
         return string::EmptyString;
     return items[0]->Value();
@@ -950,7 +1510,7 @@ const string Package::ISBN() const
 {
     for ( auto item : MetadataItemsWithDCType(Metadata::DCType::Identifier) )
     {
-        if ( item->ExtensionWithProperty(MakePropertyIRI("identifier-type")) == nullptr )
+        if ( item->ExtensionWithProperty(gIdentifierTypeIRI) == nullptr )
             continue;
         
         // this will be complicated...
@@ -1007,18 +1567,11 @@ const MediaHandler* Package::OPFHandlerForMediaType(const string &mediaType) con
 }
 const Package::StringList Package::AllMediaTypes() const
 {
-    std::map<string, bool>   set;
-    for ( auto pair : _manifest )
-    {
-        set[pair.second->MediaType()] = true;
-    }
-    
     StringList types;
-    for ( auto pair : set )
+    for ( auto& pair : _manifestByMediaType )
     {
         types.push_back(pair.first);
     }
-    
     return types;
 }
 const Package::StringList Package::UnsupportedMediaTypes() const
@@ -1043,9 +1596,10 @@ void Package::SetMediaSupport(MediaSupportList &&list)
 }
 void Package::InitMediaSupport()
 {
-    for ( auto& mediaType : AllMediaTypes() )
+    for ( auto& pair : _manifestByMediaType )
     {
-        if ( CoreMediaTypes.find(mediaType) != CoreMediaTypes.end() )
+        const string& mediaType = pair.first;
+        if ( IsCoreMediaType(mediaType) )
         {
             // support for core types is required
             _mediaSupport[mediaType] = MediaSupportInfo(mediaType);
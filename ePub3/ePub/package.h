@@ -27,6 +27,8 @@
 #include <vector>
 #include <map>
 #include <list>
+#include <mutex>
+#include <unordered_map>
 #include <libxml/tree.h>
 #include <ePub3/spine.h>
 #include <ePub3/manifest.h>
@@ -34,10 +36,14 @@
 #include <ePub3/cfi.h>
 #include <ePub3/nav_element.h>
 #include <ePub3/archive_xml.h>
+#include <ePub3/xml/dictionary.h>
 #include <ePub3/utilities/utfstring.h>
 #include <ePub3/utilities/iri.h>
 #include <ePub3/content_handler.h>
 #include <ePub3/media_support_info.h>
+#include <ePub3/document_cache.h>
+#include <ePub3/utilities/arena.h>
+#include <ePub3/utilities/flat_hash_map.h>
 
 EPUB3_BEGIN_NAMESPACE
 
@@ -45,17 +51,18 @@ class Archive;
 class Metadata;
 class NavigationTable;
 class ByteStream;
+class XPathWrangler;
 
 /**
  The PackageBase class implements the low-level components and all storage of an OPF
  package document.  It provides direct access to spine, manifest, and metadata tables,
  while the Package class provides a higher-level API on top of these.
  
- @remarks The PackageBase class holds owning references for all Metadata, ContentHandlers,
- top-level NavigationTables, and ManifestItems. It also holds an owning reference to
- the first SpineItem in its spine; each SpineItem holds an owning reference to the
- SpineItem that follows it. Lastly, it a reference to the XML document for its
- source OPF file.
+ @remarks The PackageBase class holds owning references for all ContentHandlers. All
+ Metadata, ManifestItems, SpineItems, and NavigationTables (along with their
+ NavigationPoints) are allocated in an Arena owned by the package, and are destroyed
+ together when the package is destroyed; none of these should ever be deleted
+ individually. Lastly, it a reference to the XML document for its source OPF file.
  
  @ingroup epub-model
  */
@@ -80,10 +87,16 @@ public:
     ///
     /// A map of media-type to content-handler lists.
     typedef std::map<string, ContentHandlerList>    ContentHandlerMap;
+    ///
+    /// An array of manifest items, in manifest order.
+    typedef std::vector<const ManifestItem*>        ManifestItemList;
+    ///
+    /// A map of media-type to the manifest items of that type.
+    typedef std::map<string, ManifestItemList>      MediaTypeIndex;
     
     ///
-    /// The list of Core Media Types from [OPF 3.0 §5.1](http://idpf.org/epub/30/spec/epub30-publications.html#sec-core-media-types).
-    static const std::map<const string, bool>       CoreMediaTypes;
+    /// Whether a media type is one of the Core Media Types from [OPF 3.0 §5.1](http://idpf.org/epub/30/spec/epub30-publications.html#sec-core-media-types).
+    static bool             IsCoreMediaType(const string& mediaType);
     
     /**
      This exception is thrown when a property vocabulary prefix is unknown to a
@@ -105,8 +118,10 @@ public:
     /** There is no default constructor for PackageBase. */
                             PackageBase() = delete;
     /**
-     Constructs a new PackageBase class by reading an XML document from a given
-     Archive using the supplied path.
+     Constructs a new, empty PackageBase for a document within a given Archive.
+     
+     The document itself is read by the Package constructor, which may restore it
+     from a PackageSnapshot rather than parsing it.
      
      The type, at present, is assumed to be `application/oebps-package+xml`; the
      parameter is here for future-proofing in case of alternative package types in
@@ -119,8 +134,12 @@ public:
                             PackageBase(Archive * archive, const string& path, const string& type);
     /** There is no copy constructor for PackageBase. */
                             PackageBase(const PackageBase&) = delete;
-    /** C++11 'move' constructor-- claims ownership of its argument's internals. */
-                            PackageBase(PackageBase&&);
+    /**
+     There is no move constructor either: manifest items, spine items, and navigation
+     objects live in the package's arena and refer back to the package and its
+     manifest store, so the package cannot change address.
+     */
+                            PackageBase(PackageBase&&) = delete;
     virtual                 ~PackageBase();
     
     /**
@@ -160,6 +179,30 @@ public:
     
     /// @}
     
+    /// @{
+    /// @name Loader Options
+    
+    /**
+     Whether new packages are read using the streaming OPF loader (default is `false`).
+     
+     The streaming loader reads the package document in a single pass using a
+     libxml2 pull parser, building ManifestItems and SpineItems as their elements
+     are encountered. Only the root `<package>` element and its `<metadata>` and
+     `<bindings>` subtrees are retained as a skeleton document, so the memory
+     required to open a package no longer grows with the size of its manifest or
+     spine.
+     */
+    static bool             UsesStreamingParser()               { return gUseStreamingParser; }
+    
+    /**
+     Enable or disable the streaming OPF loader for subsequently created packages.
+     @param streaming `true` to use the single-pass streaming loader, `false` to
+     parse the entire package document into a DOM first.
+     */
+    static void             SetUsesStreamingParser(bool streaming)  { gUseStreamingParser = streaming; }
+    
+    /// @}
+    
     /// @{
     /// @name Raw Table Accessors
     
@@ -173,6 +216,14 @@ public:
     /// Returns an immutable reference to the map of navigation tables.
     const NavigationMap&    NavigationTables()      const       { return _navigation; }
     
+    
+    /**
+     The arena from which this package's model objects are allocated.
+     
+     Anything allocated here lives exactly as long as the package itself.
+     */
+    Arena&                  ObjectArena()           const       { return *_arena; }
+    
     /// @}
     
     /**
@@ -195,16 +246,26 @@ public:
     /**
      Returns the first item in the Spine.
      */
-    const SpineItem *       FirstSpineItem()        const { return _spine.get(); }
+    const SpineItem *       FirstSpineItem()        const { return (_spine.empty() ? nullptr : _spine.front()); }
+    
+    ///
+    /// Returns the number of items in the Spine.
+    size_t                  SpineItemCount()        const { return _spine.size(); }
     
     /**
-     Locates a spine item by position.
+     Locates a spine item by position, in constant time.
      @param idx The zero-based position of the item to return.
      @result A pointer to the requested spine item, or `nullptr` if the index was
      out of bounds.
      */
-    const SpineItem *       SpineItemAt(size_t idx) const;
+    const SpineItem *       SpineItemAt(size_t idx) const { return (idx < _spine.size() ? _spine[idx] : nullptr); }
     
+    /**
+     Locates the first spine item referencing a given manifest item, in constant time.
+     @param idref The identifier of the manifest item.
+     @result The zero-based position of the spine item, or `size_t(-1)` if none
+     references that manifest item.
+     */
     size_t                  IndexOfSpineItemWithIDRef(const string& idref)  const;
     
     /// @}
@@ -219,6 +280,32 @@ public:
      */
     const ManifestItem *    ManifestItemWithID(const string& ident)         const;
     
+    /**
+     Returns the manifest item with a given handle, in constant time.
+     @param handle The item's position in the package's ManifestStore.
+     @result A pointer to the item, or `nullptr` if the handle is invalid.
+     */
+    const ManifestItem *    ManifestItemWithHandle(ManifestStore::Handle handle) const
+        { return (handle < _manifestItems.size() ? _manifestItems[handle] : nullptr); }
+    
+    /**
+     Looks up a manifest item by the location of its resource, in constant time.
+     @param path The container-relative path of the resource, as might be passed to
+     ReadStreamForItemAtPath(). It may be percent-encoded, begin with a `/`, and
+     contain `.` and `..` steps; any query or fragment is ignored.
+     @result A pointer to the item whose `href` refers to that resource, or `nullptr`
+     if the manifest does not list it.
+     */
+    const ManifestItem *    ManifestItemAtPath(const string& path)          const;
+    
+    /**
+     Returns every manifest item with a given media type.
+     @param mediaType The media type to match exactly.
+     @result The matching items in manifest order, which will be empty if there are
+     none.
+     */
+    const ManifestItemList& ManifestItemsWithMediaType(const string& mediaType) const;
+    
     /**
      Generates the subpath part of a CFI used to locate a given manifest item.
      
@@ -279,6 +366,18 @@ public:
      */
     IRI                     MakePropertyIRI(const string& reference, const string& prefix="")   const;
     
+    /**
+     Returns a property IRI, interned if it belongs to a well-known vocabulary.
+     
+     Only the properties of the reserved vocabularies (and a few other well-known
+     ones, such as rendition properties) are interned, since interned IRIs are never
+     released and the properties a package declares for itself form an open set.
+     Any other IRI is returned as a plain IRI, which compares equal to an interned
+     copy of itself.
+     @param iriStr The full IRI of a property.
+     */
+    static IRI              KnownPropertyIRI(const string& iriStr);
+    
     /**
      Creates a property IRI directly from a metadata element's `property` attribute
      value.
@@ -294,6 +393,49 @@ public:
     
     /// @}
     
+    /// @{
+    /// @name Parsed Document Cache
+    
+    /**
+     Returns the parsed XML document for a manifest item.
+     
+     Documents are parsed once and shared through a bounded cache owned by the
+     package, so repeated CFI lookups, navigation parsing, or searches over the same
+     item all use a single tree. The document will not be freed while any handle to
+     it remains, even if it is evicted from the cache in the meantime.
+     
+     The tree is shared with every other client, and its strings come from an XML
+     dictionary shared with the package's other documents, so it must not be
+     modified. To edit a document, load a private copy with
+     ManifestItem::ReferencedDocument() instead.
+     @param item The manifest item whose document to return.
+     @result A shared, read-only handle to the document, or an empty handle if the
+     item could not be read or parsed.
+     */
+    Shared<const xmlDoc>    DocumentForManifestItem(const ManifestItem* item)   const;
+    
+protected:
+    /**
+     As DocumentForManifestItem(const ManifestItem*), but a document which is not
+     already cached is validated against `schema` as it is parsed.
+     @throws std::invalid_argument if the document is not valid; it is not cached.
+     */
+    Shared<const xmlDoc>    DocumentForManifestItem(const ManifestItem* item, const xml::SchemaPool::CompiledSchema& schema) const;
+    
+public:
+    
+    ///
+    /// The maximum number of parsed documents retained by the package (default is 8).
+    size_t                  DocumentCacheCapacity()         const   { return _documentCache.Capacity(); }
+    ///
+    /// Changes the number of parsed documents retained by the package. Zero disables caching.
+    void                    SetDocumentCacheCapacity(size_t capacity)   { _documentCache.SetCapacity(capacity); }
+    ///
+    /// Releases the package's references to all cached documents.
+    void                    PurgeDocumentCache()                    { _documentCache.Purge(); }
+    
+    /// @}
+    
     /**
      Returns a ByteStream for reading from the specified file in the package's Archive.
      @param path The path of the item to read.
@@ -308,24 +450,36 @@ public:
     
 protected:
     Archive *               _archive;           ///< The archive from which the package was loaded.
-    xmlDocPtr               _opf;               ///< The XML document representing the package.
+    xmlDocPtr               _opf;               ///< The XML document representing the package (a skeleton when streamed).
     string                  _pathBase;          ///< The base path of the document within the archive.
     string                  _type;              ///< The MIME type of the package document.
     MetadataMap             _metadata;          ///< All metadata from the package, in document order.
     ManifestTable           _manifest;          ///< All manifest items, indexed by unique identifier.
+    ManifestStore           _manifestStore;     ///< The details of every manifest item, which are views onto this.
+    std::vector<ManifestItem*> _manifestItems;  ///< The same items, indexed by handle.
+    FlatHashMap<ManifestItem*> _manifestByPath; ///< The same items, hashed by NormalizedPath() of their absolute path.
+    MediaTypeIndex          _manifestByMediaType;   ///< The same items, grouped by media type.
     NavigationMap           _navigation;        ///< All navigation tables, indexed by type.
     ContentHandlerMap       _contentHandlers;   ///< All installed content handlers, indexed by media-type.
-    Auto<SpineItem>         _spine;             ///< The first item in the spine (SpineItems are a linked list).
+    std::vector<SpineItem*> _spine;             ///< The spine, in order. Items are also linked to their neighbours.
+    std::vector<SpineItem*> _linearSpine;       ///< The linear items from `_spine`, in order.
+    std::unordered_map<std::string, size_t> _spineIndexByIDRef;    ///< Position in `_spine` of the first item with each idref.
     
-    PropertyVocabularyMap   _vocabularyLookup;  ///< A lookup table for property prefix->IRI-stem mappings.
+    PropertyVocabularyMap   _vocabularyLookup;  ///< Prefix->IRI-stem mappings declared by the package; the reserved ones are looked up separately.
     
-    // used to initialize each package's vocabulary map
-    static const PropertyVocabularyMap gReservedVocabularies;           ///< The reserved/predefined metadata property vocabularies.
     static const std::map<Metadata::DCType, const IRI> gDCTypeIRIs;     ///< Our custom IRI mappings for DCMES metadata elements.
     
     // used to verify/correct CFIs
     uint32_t                _spineCFIIndex;     ///< The CFI index for the `<spine>` element in the package document.
     
+    Shared<xml::Dictionary> _dictionary;        ///< Names interned by the package document and all its content documents.
+    mutable DocumentCache   _documentCache;     ///< Parsed content documents, shared between clients.
+    
+    Auto<XPathWrangler>     _opfXPath;          ///< Reusable XPath context for `_opf`, with the OPF namespaces registered.
+    mutable std::mutex      _opfXPathLock;      ///< Serializes use of `_opfXPath` after construction.
+    
+    Auto<Arena>             _arena;             ///< Storage for all metadata, manifest, spine, and navigation objects.
+    
     ///
     /// Unpacks the _opf document. Implemented by the subclass, to make PackageBase pure-virtual.
     virtual bool            Unpack() = 0;
@@ -340,6 +494,34 @@ protected:
      */
     const SpineItem *       ConfirmOrCorrectSpineItemQualifier(const SpineItem * pItem, CFI::Component* pComponent) const;
     
+    ///
+    /// Adds an item described by an OPF `<item>` element to the manifest and its indices.
+    /// Where identifiers or paths repeat, the first item wins.
+    void                    AddManifestItem(xmlNodePtr node)    { InstallManifestItem(_manifestStore.Add(node)); }
+    ///
+    /// Adds an item to the manifest and its indices. Where identifiers or paths repeat, the first item wins.
+    void                    AddManifestItem(const string& ident, const string& href, const string& mediaType,
+                                            const string& mediaOverlayID, const string& fallbackID, ItemProperties properties)
+        { InstallManifestItem(_manifestStore.Add(ident, href, mediaType, mediaOverlayID, fallbackID, properties)); }
+    ///
+    /// Creates the view for a newly-stored manifest item and indexes it.
+    void                    InstallManifestItem(ManifestStore::Handle handle);
+    ///
+    /// Forgets all manifest items (they remain in the arena).
+    void                    ClearManifest();
+    ///
+    /// Percent-decodes a path, resolves its `.` and `..` steps, and strips any leading `/`, query, or fragment.
+    static std::string      NormalizedPath(const string& path);
+    
+    ///
+    /// Adds an item to the end of the spine, linking and indexing it.
+    void                    AppendSpineItem(SpineItem* item);
+    ///
+    /// Forgets all spine items (they remain in the arena).
+    void                    ClearSpine();
+    
+    friend class SpineItem;
+    
     ///
     /// Loads navigation tables from a given manifest item (which has the `"nav"` property).
     static NavigationList   NavTablesFromManifestItem(const ManifestItem * pItem);
@@ -347,6 +529,9 @@ protected:
     ///
     /// The current locale instance.  Defaults to the current user locale.
     static std::locale      gCurrentLocale;
+    
+    // default is `false`
+    static bool             gUseStreamingParser;
 };
 
 /**
@@ -382,9 +567,20 @@ public:
     
 public:
                             Package()                                   = delete;
+    /**
+     Loads a package document from an Archive.
+     
+     If PackageSnapshot::Directory() is set, the package is restored from a current
+     snapshot when one exists; otherwise the document is parsed and a new snapshot
+     is written for next time.
+     @param archive The Archive from which to read the package document.
+     @param path The path of the document within the archive.
+     @param type The MIME type of the document, as read from the OCF `root-file`
+     element.
+     */
                             Package(Archive * archive, const string& path, const string& type);
                             Package(const Package&)                     = delete;
-                            Package(Package&& o) : PackageBase(std::move(o)) {}
+                            Package(Package&&)                          = delete;
     virtual                 ~Package() {}
     
     ///
@@ -403,6 +599,17 @@ public:
     /// OPF version of this package document.
     virtual string          Version()               const;
     
+    /**
+     Discards the memoized identity and display metadata.
+     
+     UniqueID(), PackageID(), ModificationDate(), and the title and author accessors
+     compute their results on first use and return stored copies from then on, with
+     localized values kept separately for each locale. This is called whenever the
+     package's metadata is re-indexed; call it yourself after altering the metadata
+     by any other means.
+     */
+    void                    InvalidateMetadataCache();
+    
     /// @{
     /// @name Event/Content Handlers
     
@@ -470,7 +677,7 @@ public:
     const ManifestItem *    ManifestItemForCFI(CFI& cfi, CFI* pRemainingCFI) const;
     
     /**
-     A convenience method used to obtain a libxml2 `xmlDocPtr` from a CFI.
+     A convenience method used to obtain a parsed libxml2 document from a CFI.
      
      This method calls ManifestItemForCFI() internally, so will fix the input
      CFI based on any qualifiers.
@@ -481,10 +688,13 @@ public:
      the returned ManifestItem, i.e. a document-relative locator. If no fragment
      remains (`cfi` referred only to the top-level document) then it will be set
      to the empty CFI.
-     @result An `xmlDocPtr` for the selected document, or `nullptr` upon failure.
+     @result A shared handle to the selected document, or an empty handle upon
+     failure. The document is shared through the package's document cache, and must
+     not be freed or modified by the caller.
+     @see DocumentForManifestItem(const ManifestItem*)
      */
-    xmlDocPtr               DocumentForCFI(CFI& cfi, CFI* pRemainingCFI) const {
-        return ManifestItemForCFI(cfi, pRemainingCFI)->ReferencedDocument();
+    Shared<const xmlDoc>    DocumentForCFI(CFI& cfi, CFI* pRemainingCFI) const {
+        return DocumentForManifestItem(ManifestItemForCFI(cfi, pRemainingCFI));
     }
     
     /**
@@ -544,17 +754,25 @@ public:
     
     /**
      Fetches a map of all metadata items with a given DCType.
+     
+     This is equivalent to `MetadataItemsWithProperty(IRIForDCType(type))`, so it
+     includes items which carry the DC property in an extension as well as the DC
+     elements themselves.
      @param type The type of the attribute to fetch.
-     @result A MetadataMap containing all the metadata items with this DC type.
+     @result A MetadataMap containing all the metadata items with this DC type, in
+     document order.
      */
-    const MetadataMap       MetadataItemsWithDCType(Metadata::DCType type) const;
+    const MetadataMap&      MetadataItemsWithDCType(Metadata::DCType type) const;
     
     /**
      Fetches a map of all metadata items with a given IRI.
+     
+     The items are looked up in an index built when the package is loaded.
      @param iri The IRI identifying the type of metadata item to fetch.
-     @result A MetadataMap containing all the metadata items with this type.
+     @result A MetadataMap containing all the metadata items with this type, or with
+     an extension of this type, in document order.
      */
-    const MetadataMap       MetadataItemsWithProperty(const IRI& iri) const;
+    const MetadataMap&      MetadataItemsWithProperty(const IRI& iri) const;
     
     /**
      Retrieves the title of the publication.
@@ -707,7 +925,7 @@ public:
     const MediaHandler*         OPFHandlerForMediaType(const string& mediaType) const;
     
     ///
-    /// Returns a list of all media types seen in the manifest.
+    /// Returns a list of all media types seen in the manifest, in sorted order.
     const StringList        AllMediaTypes()                 const;
     ///
     /// Returns a list of all unsupported media types.
@@ -754,22 +972,108 @@ protected:
     /// Extracts information from the OPF XML document.
     virtual bool            Unpack();
     
+    /**
+     Reads and unpacks the OPF document in a single streaming pass.
+     
+     Used in place of Unpack() when UsesStreamingParser() is `true`. On return, the
+     `_opf` member contains a skeleton document holding only the root element and
+     its `<metadata>` and `<bindings>` children.
+     @param path The path of the package document within the archive.
+     @result `true` if the document was a valid OPF package, `false` otherwise.
+     */
+    virtual bool            UnpackStream(const string& path);
+    
+    /// Creates the Metadata item for a child of `<metadata>`, or defers it to
+    /// `refines` if it refines another item.
+    void                    UnpackMetadataNode(xmlNodePtr node, std::map<string, class Metadata*>& metadataByID, std::vector<xmlNodePtr>& refines);
+    
+    /// Attaches deferred refinements to the Metadata items they refine, then indexes all metadata.
+    void                    UnpackMetadataRefinements(const std::map<string, class Metadata*>& metadataByID, const std::vector<xmlNodePtr>& refines);
+    
+    /// Rebuilds `_metadataByProperty` from `_metadata`, and invalidates the metadata cache.
+    void                    IndexMetadata();
+    
+    /// Validates and installs the MediaHandler described by a `<mediaType>` element.
+    /// @throws std::invalid_argument if the binding is invalid.
+    void                    UnpackMediaTypeBinding(xmlNodePtr node);
+    
+    /// Loads navigation tables and media support info once the manifest is complete.
+    void                    FinishUnpacking();
+    
     // default is `true`
     static bool             gValidateSchema;
     
 public:
-    ///
-    /// Whether the XML parser will validate an OPF file against its schema (default is `true`).
+    /**
+     Whether documents are validated against their schemas (default is `true`).
+     
+     This covers the OPF file, `META-INF/container.xml`, and navigation documents,
+     each of which is validated against the schema registered with xml::SchemaPool
+     for the namespace of its root element; documents with no registered schema are
+     not validated. The streaming OPF loader validates as it reads, so it costs no
+     extra pass over the document.
+     
+     A package whose OPF file or container fails validation will not load, while an
+     invalid navigation document is simply ignored.
+     */
     static bool             ValidatesSchema()                   { return gValidateSchema; }
     ///
-    /// Enable or disable OPF schema validation.
+    /// Enable or disable schema validation.
     static void             SetValidatesSchema(bool validate)   { gValidateSchema = validate; }
     
 protected:
     LoadEventHandler        _loadEventHandler;      ///< The current handler for load events.
     MediaSupportList        _mediaSupport;          ///< A list of media types with their support details.
     
+    FlatHashMap<MetadataMap> _metadataByProperty;   ///< Metadata items keyed by the canonical IRI of their own or their extensions' properties.
+    
+    ///
+    /// Identity values derived from the metadata.
+    struct IdentityMetadata
+    {
+        bool                valid;
+        string              packageID;
+        string              modificationDate;
+        string              uniqueID;
+        string              urlSafeUniqueID;
+    };
+    ///
+    /// Display values derived from the metadata, for one locale.
+    struct DisplayMetadata
+    {
+        string              title;
+        string              subtitle;
+        string              fullTitle;
+        string              authors;
+        AttributionList     authorNames;
+        AttributionList     attributionNames;
+    };
+    
+    mutable std::mutex      _metadataCacheLock;     ///< Serializes use of the members below.
+    mutable IdentityMetadata _identity;             ///< Computed on first use.
+    mutable std::map<std::string, DisplayMetadata> _display;    ///< Computed on first use, keyed by locale name, or `""` for unlocalized values.
+    mutable DisplayMetadata _uncachedDisplay;       ///< For locales which have no name, and so can't be cached.
+    
+    ///
+    /// Returns the identity values, computing them if necessary. Caller must hold _metadataCacheLock.
+    const IdentityMetadata& IdentityLocked()                    const;
+    ///
+    /// Returns the display values for the current locale, computing them if necessary. Caller must hold _metadataCacheLock.
+    const DisplayMetadata&  DisplayLocked(bool localized)       const;
+    
+    // the uncached implementations
+    string                  ComputePackageID()                  const;
+    string                  ComputeModificationDate()           const;
+    string                  ComputeTitle(bool localized)        const;
+    string                  ComputeSubtitle(bool localized)     const;
+    string                  ComputeFullTitle(bool localized)    const;
+    AttributionList         ComputeAuthorNames(bool localized)  const;
+    AttributionList         ComputeAttributionNames(bool localized) const;
+    static string           CollateNames(const AttributionList& names);
+    
     void                    InitMediaSupport();
+    
+    friend class PackageSnapshot;
 };
 
 EPUB3_END_NAMESPACE
@@ -0,0 +1,622 @@
+//
+//  package_snapshot.cpp
+//  ePub3
+//
+//  Copyright (c) 2012-2013 The Readium Foundation and contributors.
+//
+//  The Readium SDK is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#include "package_snapshot.h"
+#include "package.h"
+#include "archive.h"
+#include "nav_table.h"
+#include "nav_point.h"
+#include "xpath_wrangler.h"
+#include <libxml/parser.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <cstdio>
+#include <cstring>
+#include <functional>
+#include <mutex>
+#include <sstream>
+#include <iomanip>
+
+EPUB3_BEGIN_NAMESPACE
+
+static const xmlChar * OPFNamespace = "http://www.idpf.org/2007/opf"_xml;
+static const xmlChar * DCNamespace = "http://purl.org/dc/elements/1.1/"_xml;
+
+static const char       kSnapshotMagic[8] = { 'E', 'P', 'B', '3', 'S', 'N', 'A', 'P' };
+static const uint32_t   kByteOrderMark = 0x01020304;
+
+static string           gSnapshotDirectory;
+static std::mutex       gSnapshotDirectoryLock;
+
+const uint32_t PackageSnapshot::FormatVersion;
+
+namespace {
+
+// the values which tell us whether a snapshot is still current
+struct Fingerprint
+{
+    uint64_t    archiveSize;
+    uint64_t    archiveModDate;
+    uint64_t    opfSize;
+    uint32_t    opfCRC;
+};
+
+// a string within the mapped snapshot
+struct StringSpan
+{
+    const char*     data;
+    size_t          len;
+
+    string          Str()                       const   { return string(data, len); }
+};
+
+// a manifest item read back from a snapshot, before it is installed; its strings
+//  refer into the mapping, so each is copied just once, into the manifest store
+struct ManifestRecord
+{
+    StringSpan      ident;
+    StringSpan      href;
+    StringSpan      mediaType;
+    StringSpan      overlay;
+    StringSpan      fallback;
+    ItemProperties  properties;
+};
+
+bool FingerprintForPackage(const Archive* archive, const string& opfPath, Fingerprint& fp)
+{
+    struct stat sb;
+    if ( ::stat(archive->Path().c_str(), &sb) != 0 )
+        return false;
+
+    fp.archiveSize = static_cast<uint64_t>(sb.st_size);
+    fp.archiveModDate = static_cast<uint64_t>(sb.st_mtime);
+
+    try
+    {
+        ArchiveItemInfo info = archive->InfoAtPath(opfPath.stl_str());
+        fp.opfSize = static_cast<uint64_t>(info.UncompressedSize());
+        fp.opfCRC = info.CRC32();
+    }
+    catch (std::exception&)
+    {
+        return false;
+    }
+
+    return true;
+}
+
+// appends host-order values and length-prefixed strings to a memory buffer
+class SnapshotWriter
+{
+public:
+    void                U8(uint8_t v)                       { _buf.push_back(static_cast<char>(v)); }
+    void                U32(uint32_t v)                     { _buf.append(reinterpret_cast<const char*>(&v), sizeof(v)); }
+    void                U64(uint64_t v)                     { _buf.append(reinterpret_cast<const char*>(&v), sizeof(v)); }
+    void                Raw(const void* p, size_t len)      { _buf.append(reinterpret_cast<const char*>(p), len); }
+    void                Bytes(const void* p, size_t len)    { U32(static_cast<uint32_t>(len)); Raw(p, len); }
+    void                Str(const string& s)                { Bytes(s.stl_str().data(), s.stl_str().size()); }
+
+    const std::string&  Buffer()                    const   { return _buf; }
+
+private:
+    std::string         _buf;
+};
+
+// reads the values written by SnapshotWriter from mapped memory; any attempt to read
+//  past the end of the data marks the whole read as failed, and returns empty values
+class SnapshotReader
+{
+public:
+                        SnapshotReader(const uint8_t* p, size_t len) : _p(p), _end(p + len), _ok(true) {}
+
+    bool                Ok()                        const   { return _ok; }
+    bool                AtEnd()                     const   { return _p == _end; }
+
+    uint8_t             U8()                                { return Value<uint8_t>(); }
+    uint32_t            U32()                               { return Value<uint32_t>(); }
+    uint64_t            U64()                               { return Value<uint64_t>(); }
+
+    const uint8_t*      Raw(size_t len)
+        {
+            if ( !Check(len) )
+                return nullptr;
+            const uint8_t* result = _p;
+            _p += len;
+            return result;
+        }
+    const uint8_t*      Bytes(size_t& len)
+        {
+            len = U32();
+            const uint8_t* result = Raw(len);
+            if ( result == nullptr )
+                len = 0;
+            return result;
+        }
+    string              Str()
+        {
+            size_t len = 0;
+            const uint8_t* p = Bytes(len);
+            if ( p == nullptr )
+                return string::EmptyString;
+            return string(reinterpret_cast<const char*>(p), len);
+        }
+    StringSpan          Span()
+        {
+            size_t len = 0;
+            const uint8_t* p = Bytes(len);
+            return StringSpan{reinterpret_cast<const char*>(p), (p == nullptr ? 0 : len)};
+        }
+
+    // an item count can never exceed the number of bytes left, which stops a corrupt
+    //  count from sending us off allocating millions of empty items
+    uint32_t            Count()
+        {
+            uint32_t n = U32();
+            if ( !_ok || n > static_cast<size_t>(_end - _p) )
+            {
+                _ok = false;
+                return 0;
+            }
+            return n;
+        }
+
+private:
+    const uint8_t*      _p;
+    const uint8_t*      _end;
+    bool                _ok;
+
+    bool                Check(size_t len)
+        {
+            if ( _ok && static_cast<size_t>(_end - _p) < len )
+                _ok = false;
+            return _ok;
+        }
+    template <typename _Tp>
+    _Tp                 Value()
+        {
+            _Tp v = 0;
+            const uint8_t* p = Raw(sizeof(_Tp));
+            if ( p != nullptr )
+                std::memcpy(&v, p, sizeof(_Tp));
+            return v;
+        }
+};
+
+// a read-only mapping of an entire file
+class MappedFile
+{
+public:
+                        MappedFile(const std::string& path) : _addr(MAP_FAILED), _len(0)
+        {
+            int fd = ::open(path.c_str(), O_RDONLY);
+            if ( fd < 0 )
+                return;
+
+            struct stat sb;
+            if ( ::fstat(fd, &sb) == 0 && sb.st_size > 0 )
+            {
+                _len = static_cast<size_t>(sb.st_size);
+                _addr = ::mmap(nullptr, _len, PROT_READ, MAP_PRIVATE, fd, 0);
+            }
+
+            ::close(fd);
+        }
+                        MappedFile(const MappedFile&)   = delete;
+                        ~MappedFile()                   { if ( _addr != MAP_FAILED ) ::munmap(_addr, _len); }
+
+    bool                IsMapped()                  const   { return _addr != MAP_FAILED; }
+    const uint8_t*      Bytes()                     const   { return reinterpret_cast<const uint8_t*>(_addr); }
+    size_t              Length()                    const   { return _len; }
+
+private:
+    void*               _addr;
+    size_t              _len;
+};
+
+// builds a document holding only the package root element and its metadata and bindings,
+//  which is all that Package keeps once the manifest and spine have been unpacked
+xmlDocPtr CopySkeletonDocument(xmlDocPtr opf)
+{
+    static const xmlChar* kMetadataName = BAD_CAST "metadata";
+    static const xmlChar* kBindingsName = BAD_CAST "bindings";
+
+    xmlNodePtr root = xmlDocGetRootElement(opf);
+    if ( root == nullptr )
+        return nullptr;
+
+    xmlDocPtr doc = xmlNewDoc(BAD_CAST "1.0");
+    xmlNodePtr copy = xmlDocCopyNode(root, doc, 2);       // attributes and namespaces only
+    xmlDocSetRootElement(doc, copy);
+
+    for ( xmlNodePtr child = root->children; child != nullptr; child = child->next )
+    {
+        if ( child->type != XML_ELEMENT_NODE || child->ns == nullptr || !xmlStrEqual(child->ns->href, OPFNamespace) )
+            continue;
+        if ( xmlStrEqual(child->name, kMetadataName) || xmlStrEqual(child->name, kBindingsName) )
+            xmlAddChild(copy, xmlDocCopyNode(child, doc, 1));
+    }
+
+    return doc;
+}
+
+void WriteNavigationChildren(SnapshotWriter& out, const NavigationElement* element)
+{
+    out.U32(static_cast<uint32_t>(element->Children().size()));
+    for ( auto child : element->Children() )
+    {
+        out.Str(child->Title());
+        out.Str(child->SourceHref());
+        WriteNavigationChildren(out, child);
+    }
+}
+
+bool ReadNavigationChildren(SnapshotReader& in, Arena& arena, NavigationElement* element, int depth)
+{
+    // nothing real nests this deeply; a corrupt file might
+    if ( depth > 256 )
+        return false;
+
+    uint32_t count = in.Count();
+    for ( uint32_t i = 0; i < count && in.Ok(); i++ )
+    {
+        NavigationPoint* point = arena.New<NavigationPoint>();
+        element->AppendChild(point);
+        point->SetTitle(in.Str());
+        point->SetSourceHref(in.Str());
+        if ( !ReadNavigationChildren(in, arena, point, depth+1) )
+            return false;
+    }
+
+    return in.Ok();
+}
+
+}   // anonymous namespace
+
+string PackageSnapshot::Directory()
+{
+    std::lock_guard<std::mutex> _(gSnapshotDirectoryLock);
+    return gSnapshotDirectory;
+}
+void PackageSnapshot::SetDirectory(const string& path)
+{
+    std::lock_guard<std::mutex> _(gSnapshotDirectoryLock);
+    gSnapshotDirectory = path;
+}
+string PackageSnapshot::PathForPackage(const Archive* archive, const string& opfPath)
+{
+    string dir = Directory();
+    if ( dir.empty() || archive == nullptr )
+        return string::EmptyString;
+
+    // the full paths are stored inside the snapshot, so a collision just looks stale
+    std::hash<std::string> hasher;
+    std::stringstream ss;
+    ss << std::hex << std::setfill('0') << std::setw(16) << static_cast<uint64_t>(hasher(archive->Path() + '\0' + opfPath.stl_str()));
+
+    if ( dir.stl_str().back() != '/' )
+        dir += '/';
+    return _Str(dir, ss.str(), ".snapshot");
+}
+bool PackageSnapshot::Write(const Package* package, const string& opfPath)
+{
+    string path = PathForPackage(package->_archive, opfPath);
+    if ( path.empty() || package->_opf == nullptr )
+        return false;
+
+    Fingerprint fp;
+    if ( !FingerprintForPackage(package->_archive, opfPath, fp) )
+        return false;
+
+    xmlDocPtr skeleton = CopySkeletonDocument(package->_opf);
+    if ( skeleton == nullptr )
+        return false;
+
+    xmlChar* skeletonXML = nullptr;
+    int skeletonLen = 0;
+    xmlDocDumpMemory(skeleton, &skeletonXML, &skeletonLen);
+    xmlFreeDoc(skeleton);
+    if ( skeletonXML == nullptr )
+        return false;
+
+    SnapshotWriter out;
+
+    // header
+    out.Raw(kSnapshotMagic, sizeof(kSnapshotMagic));
+    out.U32(FormatVersion);
+    out.U32(kByteOrderMark);
+    out.Str(package->_archive->Path());
+    out.Str(opfPath);
+    out.U64(fp.archiveSize);
+    out.U64(fp.archiveModDate);
+    out.U64(fp.opfSize);
+    out.U32(fp.opfCRC);
+
+    // package-level values
+    out.U32(package->_spineCFIIndex);
+    out.U32(static_cast<uint32_t>(package->_vocabularyLookup.size()));
+    for ( auto& pair : package->_vocabularyLookup )
+    {
+        out.Str(pair.first);
+        out.Str(pair.second);
+    }
+
+    // manifest
+    // in handle order, so restored items get the same handles
+    out.U32(static_cast<uint32_t>(package->_manifestItems.size()));
+    for ( const ManifestItem* item : package->_manifestItems )
+    {
+        out.Str(item->Identifier());
+        out.Str(item->Href());
+        out.Str(item->MediaType());
+        out.Str(item->MediaOverlayID());
+        out.Str(item->FallbackID());
+        out.U32(static_cast<uint32_t>(item->Properties()));
+    }
+
+    // spine
+    out.U32(static_cast<uint32_t>(package->_spine.size()));
+    for ( const SpineItem* item : package->_spine )
+    {
+        out.Str(item->Identifier());
+        out.Str(item->Idref());
+        out.U8(item->Linear() ? 1 : 0);
+        out.U32(static_cast<uint32_t>(item->Properties().size()));
+        for ( auto& iri : item->Properties() )
+        {
+            out.Str(iri.IRIString());
+        }
+    }
+
+    // navigation tables
+    out.U32(static_cast<uint32_t>(package->_navigation.size()));
+    for ( auto& pair : package->_navigation )
+    {
+        const NavigationTable* table = pair.second;
+        out.Str(table->Type());
+        out.Str(table->Title());
+        out.Str(table->SourceHref());
+        WriteNavigationChildren(out, table);
+    }
+
+    // skeleton document: root, metadata, and bindings
+    out.Bytes(skeletonXML, static_cast<size_t>(skeletonLen));
+    xmlFree(skeletonXML);
+
+    // write to a temporary file, then move it into place
+    ::mkdir(Directory().c_str(), 0755);
+
+    std::string tmpPath = path.stl_str() + ".XXXXXX";
+    int fd = ::mkstemp(&tmpPath[0]);
+    if ( fd < 0 )
+        return false;
+
+    const std::string& buf = out.Buffer();
+    size_t written = 0;
+    while ( written < buf.size() )
+    {
+        ssize_t n = ::write(fd, buf.data() + written, buf.size() - written);
+        if ( n <= 0 )
+            break;
+        written += static_cast<size_t>(n);
+    }
+
+    ::close(fd);
+    if ( written != buf.size() || ::rename(tmpPath.c_str(), path.c_str()) != 0 )
+    {
+        ::unlink(tmpPath.c_str());
+        return false;
+    }
+
+    return true;
+}
+bool PackageSnapshot::Restore(Package* package, const string& opfPath)
+{
+    string path = PathForPackage(package->_archive, opfPath);
+    if ( path.empty() )
+        return false;
+
+    MappedFile file(path.stl_str());
+    if ( !file.IsMapped() )
+        return false;
+
+    Fingerprint fp;
+    if ( !FingerprintForPackage(package->_archive, opfPath, fp) )
+        return false;
+
+    SnapshotReader in(file.Bytes(), file.Length());
+
+    // header
+    const uint8_t* magic = in.Raw(sizeof(kSnapshotMagic));
+    if ( magic == nullptr || std::memcmp(magic, kSnapshotMagic, sizeof(kSnapshotMagic)) != 0 )
+        return false;
+    if ( in.U32() != FormatVersion || in.U32() != kByteOrderMark )
+        return false;
+    if ( in.Str() != package->_archive->Path() || in.Str() != opfPath )
+        return false;
+    if ( in.U64() != fp.archiveSize || in.U64() != fp.archiveModDate || in.U64() != fp.opfSize || in.U32() != fp.opfCRC )
+        return false;
+
+    // read everything before touching the package, so a corrupt snapshot leaves it untouched;
+    //  anything already built in its arena is simply left there until the package goes away
+    Arena& arena = *package->_arena;
+    uint32_t spineCFIIndex = in.U32();
+
+    PackageBase::PropertyVocabularyMap vocabulary;
+    uint32_t count = in.Count();
+    for ( uint32_t i = 0; i < count && in.Ok(); i++ )
+    {
+        string prefix = in.Str();
+        vocabulary[prefix] = in.Str();
+    }
+
+    std::vector<ManifestRecord> manifest;
+    count = in.Count();
+    manifest.reserve(count);
+    for ( uint32_t i = 0; i < count && in.Ok(); i++ )
+    {
+        ManifestRecord record;
+        record.ident = in.Span();
+        record.href = in.Span();
+        record.mediaType = in.Span();
+        record.overlay = in.Span();
+        record.fallback = in.Span();
+        record.properties = static_cast<ItemProperties::value_type>(in.U32());
+        manifest.push_back(record);
+    }
+
+    std::vector<SpineItem*> spine;
+    count = in.Count();
+    spine.reserve(count);
+    for ( uint32_t i = 0; i < count && in.Ok(); i++ )
+    {
+        string ident = in.Str();
+        string idref = in.Str();
+        bool linear = (in.U8() != 0);
+
+        SpineItem::PropertyList properties;
+        uint32_t numProperties = in.Count();
+        for ( uint32_t j = 0; j < numProperties && in.Ok(); j++ )
+        {
+            properties.push_back(Package::KnownPropertyIRI(in.Str()));
+        }
+
+        spine.push_back(arena.New<SpineItem>(package, ident, idref, linear, std::move(properties)));
+    }
+
+    std::vector<NavigationTable*> navigation;
+    count = in.Count();
+    for ( uint32_t i = 0; i < count && in.Ok(); i++ )
+    {
+        NavigationTable* table = arena.New<NavigationTable>(in.Str());
+        navigation.push_back(table);
+        table->SetTitle(in.Str());
+        table->SetSourceHref(in.Str());
+        if ( !ReadNavigationChildren(in, arena, table, 0) )
+            break;
+    }
+
+    size_t skeletonLen = 0;
+    const uint8_t* skeletonXML = in.Bytes(skeletonLen);
+
+    xmlDocPtr skeleton = nullptr;
+    if ( in.Ok() && in.AtEnd() && skeletonXML != nullptr )
+        skeleton = xmlReadMemory(reinterpret_cast<const char*>(skeletonXML), static_cast<int>(skeletonLen), opfPath.c_str(), nullptr, XML_PARSE_NONET|XML_PARSE_COMPACT);
+
+    if ( skeleton == nullptr || xmlDocGetRootElement(skeleton) == nullptr || spine.empty() )
+    {
+        if ( skeleton != nullptr )
+            xmlFreeDoc(skeleton);
+        return false;
+    }
+
+    // now install it all
+    package->_opf = skeleton;
+    package->_opfXPath.reset(new XPathWrangler(skeleton, {{"opf", OPFNamespace}, {"dc", DCNamespace}}));
+    package->_spineCFIIndex = spineCFIIndex;
+    package->_vocabularyLookup = std::move(vocabulary);
+
+    for ( auto& r : manifest )
+    {
+        package->AddManifestItem(r.ident.Str(), r.href.Str(), r.mediaType.Str(), r.overlay.Str(), r.fallback.Str(), r.properties);
+    }
+
+    package->_spine.reserve(spine.size());
+    for ( auto item : spine )
+    {
+        package->AppendSpineItem(item);
+    }
+
+    for ( auto table : navigation )
+    {
+#if EPUB_HAVE(CXX_MAP_EMPLACE)
+        package->_navigation.emplace(table->Type(), table);
+#else
+        package->_navigation[table->Type()] = table;
+#endif
+    }
+
+    // metadata and bindings are unpacked from the skeleton exactly as they were originally
+    try
+    {
+        static const xmlChar* kMetadataName = BAD_CAST "metadata";
+        static const xmlChar* kBindingsName = BAD_CAST "bindings";
+
+        std::map<string, class Metadata*> metadataByID;
+        std::vector<xmlNodePtr> refineNodes;
+        std::vector<xmlNodePtr> bindings;
+
+        for ( xmlNodePtr section = xmlDocGetRootElement(skeleton)->children; section != nullptr; section = section->next )
+        {
+            if ( section->type != XML_ELEMENT_NODE || section->ns == nullptr || !xmlStrEqual(section->ns->href, OPFNamespace) )
+                continue;
+
+            bool isMetadata = xmlStrEqual(section->name, kMetadataName);
+            if ( !isMetadata && !xmlStrEqual(section->name, kBindingsName) )
+                continue;
+
+            for ( xmlNodePtr child = section->children; child != nullptr; child = child->next )
+            {
+                if ( child->type != XML_ELEMENT_NODE )
+                    continue;
+
+                if ( isMetadata )
+                    package->UnpackMetadataNode(child, metadataByID, refineNodes);
+                else
+                    bindings.push_back(child);
+            }
+        }
+
+        package->UnpackMetadataRefinements(metadataByID, refineNodes);
+
+        for ( auto node : bindings )
+        {
+            package->UnpackMediaTypeBinding(node);
+        }
+    }
+    catch (...)
+    {
+        // put everything back the way we found it; the objects themselves stay in the arena
+        package->_metadata.clear();
+        package->IndexMetadata();
+        package->ClearManifest();
+        package->_navigation.clear();
+        package->ClearSpine();
+        for ( auto& pair : package->_contentHandlers )
+        {
+            for ( auto handler : pair.second )
+                delete handler;
+        }
+        package->_contentHandlers.clear();
+        package->_opfXPath.reset();
+        xmlFreeDoc(package->_opf);
+        package->_opf = nullptr;
+        package->_vocabularyLookup.clear();
+        return false;
+    }
+
+    // media support depends on the currently-installed handlers, so it's never stored
+    package->InitMediaSupport();
+    return true;
+}
+
+EPUB3_END_NAMESPACE
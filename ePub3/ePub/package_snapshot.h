@@ -0,0 +1,123 @@
+//
+//  package_snapshot.h
+//  ePub3
+//
+//  Copyright (c) 2012-2013 The Readium Foundation and contributors.
+//
+//  The Readium SDK is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#ifndef __ePub3__package_snapshot__
+#define __ePub3__package_snapshot__
+
+#include <ePub3/epub3.h>
+#include <ePub3/utilities/utfstring.h>
+
+EPUB3_BEGIN_NAMESPACE
+
+class Archive;
+class Package;
+
+/**
+ Reads and writes binary snapshots of fully-unpacked packages.
+
+ Opening a package normally means parsing its OPF document and then building the
+ manifest, spine, metadata, and navigation tables from it. When a snapshot directory
+ has been set, each Package writes the result of that work to a single file in that
+ directory, and the next time the same package is opened it is restored by mapping
+ that file into memory instead.
+
+ A snapshot is only used if its format version and byte order match the running
+ library, and if the archive's size and modification date and the package document's
+ size and CRC-32 checksum all match the values recorded when it was written. Any
+ snapshot which is stale, truncated, or otherwise unreadable is ignored, and the
+ package is loaded from its OPF document and a new snapshot written in its place.
+
+ Only the package's own data is stored: the list of supported media types is always
+ rebuilt from the current set of media handlers on restore.
+
+ A restore avoids re-parsing the OPF and re-building the manifest, spine, and
+ navigation tables from the DOM, but it is not a zero-copy load: the mapping is
+ released once the package is restored, so each string is copied once into the
+ package's own storage, and the metadata and bindings are re-parsed from a small
+ XML skeleton, since Metadata objects refer to the nodes of the package document.
+
+ @ingroup epub-model
+ */
+class PackageSnapshot
+{
+public:
+    ///
+    /// The snapshot format written by this version of the library.
+    ///
+    /// This must be incremented whenever what is stored, or how it is interpreted,
+    /// changes; snapshots of any other version are ignored and rewritten.
+    ///  - 1: initial format.
+    ///  - 2: spine items store their `linear` flag as a boolean.
+    ///  - 3: manifest items are stored in document order, which defines their handles.
+    ///  - 4: item properties are a 32-bit mask, including `cover-image` and `remote-resources`.
+    static const uint32_t   FormatVersion = 4;
+
+public:
+    /**
+     The directory in which snapshots are stored.
+
+     The default is an empty string, which disables snapshots entirely. Applications
+     will typically place this alongside their library database, within a cache
+     directory they own.
+     */
+    static string           Directory();
+
+    /**
+     Sets the snapshot directory for subsequently created packages.
+     @param path The path of a directory, which will be created if necessary, or an
+     empty string to disable snapshots.
+     */
+    static void             SetDirectory(const string& path);
+
+    /**
+     Returns the path of the snapshot file for a given package.
+     @param archive The archive containing the package.
+     @param opfPath The path of the package document within the archive.
+     @result A path within Directory(), or an empty string if snapshots are disabled.
+     */
+    static string           PathForPackage(const Archive* archive, const string& opfPath);
+
+    /**
+     Writes a snapshot of a fully-unpacked package.
+
+     The file is written to a temporary location and then renamed into place, so
+     a concurrent reader will never see a partially-written snapshot.
+     @param package The package to save.
+     @param opfPath The path of the package's OPF document within its archive.
+     @result `true` if the snapshot was written, `false` otherwise.
+     */
+    static bool             Write(const Package* package, const string& opfPath);
+
+    /**
+     Restores a package from its snapshot, if there is a valid one.
+
+     On failure the package is left in the same (empty) state it was in before the
+     call, ready to be loaded from its OPF document.
+     @param package A newly-constructed package which has not been unpacked.
+     @param opfPath The path of the package's OPF document within its archive.
+     @result `true` if the package was restored, `false` otherwise.
+     */
+    static bool             Restore(Package* package, const string& opfPath);
+
+};
+
+EPUB3_END_NAMESPACE
+
+#endif /* defined(__ePub3__package_snapshot__) */
@@ -21,32 +21,44 @@
 
 #include "spine.h"
 #include "package.h"
-#include REGEX_INCLUDE
+#include <cctype>
 
 EPUB3_BEGIN_NAMESPACE
 
-const IRI SpineItem::PageSpreadRightPropertyIRI("http://idpf.org/epub/vocab/package/#page-spread-right");
-const IRI SpineItem::PageSpreadLeftPropertyIRI("http://idpf.org/epub/vocab/package/#page-spread-left");
+const IRI SpineItem::PageSpreadRightPropertyIRI(IRI::Interned("http://idpf.org/epub/vocab/package/#page-spread-right"));
+const IRI SpineItem::PageSpreadLeftPropertyIRI(IRI::Interned("http://idpf.org/epub/vocab/package/#page-spread-left"));
 
-SpineItem::SpineItem(xmlNodePtr node, Package * owner) : _ident(), _idref(), _owner(owner), _linear(true), _next(nullptr), _prev(nullptr)
+SpineItem::SpineItem(xmlNodePtr node, Package * owner) : _ident(), _idref(), _owner(owner), _linear(true), _next(nullptr), _prev(nullptr), _index(0), _linearIndex(0), _manifestHandle(UINT32_MAX)
 {
     _prev = nullptr;
     _next = nullptr;
     _ident = _getProp(node, "id");
     _idref = _getProp(node, "idref");
-    if ( _getProp(node, "linear").tolower() == U"false" )
+    string linear = _getProp(node, "linear").tolower();
+    if ( linear.stl_str() == "no" || linear.stl_str() == "false" )
         _linear = false;
     
+    // a whitespace-separated list, although we'll accept commas too
     string properties = _getProp(node, "properties");
-    if ( !properties.empty() )
+    const std::string& props = properties.stl_str();
+    size_t pos = 0, len = props.size();
+    while ( pos < len )
     {
-        for ( auto& property : properties.split(REGEX_NS::regex(",\\s*")) )
-        {
-            _properties.push_back(owner->PropertyIRIFromAttributeValue(property));
-        }
+        while ( pos < len && (isspace(static_cast<unsigned char>(props[pos])) || props[pos] == ',') )
+            pos++;
+        
+        size_t start = pos;
+        while ( pos < len && !isspace(static_cast<unsigned char>(props[pos])) && props[pos] != ',' )
+            pos++;
+        
+        if ( pos > start )
+            _properties.push_back(owner->PropertyIRIFromAttributeValue(props.substr(start, pos - start)));
     }
 }
-SpineItem::SpineItem(SpineItem&& o) : _ident(std::move(o._ident)), _idref(std::move(o._idref)), _owner(o._owner), _linear(o._linear), _properties(std::move(o._properties)), _prev(o._prev), _next(std::move(o._next))
+SpineItem::SpineItem(Package* owner, const string& ident, const string& idref, bool linear, PropertyList&& properties) : _ident(ident), _idref(idref), _owner(owner), _linear(linear), _properties(std::move(properties)), _prev(nullptr), _next(nullptr), _index(0), _linearIndex(0), _manifestHandle(UINT32_MAX)
+{
+}
+SpineItem::SpineItem(SpineItem&& o) : _ident(std::move(o._ident)), _idref(std::move(o._idref)), _owner(o._owner), _linear(o._linear), _properties(std::move(o._properties)), _prev(o._prev), _next(std::move(o._next)), _index(o._index), _linearIndex(o._linearIndex), _manifestHandle(o._manifestHandle)
 {
     o._owner = nullptr;
     o._prev = nullptr;
@@ -54,9 +66,16 @@ SpineItem::SpineItem(SpineItem&& o) : _ident(std::move(o._ident)), _idref(std::m
 SpineItem::~SpineItem()
 {
 }
+size_t SpineItem::Count() const
+{
+    return _owner->SpineItemCount() - _index;
+}
 const ManifestItem* SpineItem::ManifestItem() const
 {
-    return _owner->ManifestItemWithID(Idref());
+    const class ManifestItem* item = _owner->ManifestItemWithHandle(_manifestHandle);
+    if ( item == nullptr )
+        item = _owner->ManifestItemWithID(Idref());     // added to the spine before the manifest
+    return item;
 }
 SpineItem::PageSpread SpineItem::Spread() const
 {
@@ -86,10 +105,11 @@ SpineItem::PageSpread SpineItem::Spread() const
 }
 SpineItem* SpineItem::NextStep()
 {
-    SpineItem* n = Next();
-    while ( n != nullptr && n->Linear() == false )
-        n = n->Next();
-    return n;
+    // the first linear item after this one
+    size_t next = _linearIndex + (_linear ? 1 : 0);
+    if ( next >= _owner->_linearSpine.size() )
+        return nullptr;
+    return _owner->_linearSpine[next];
 }
 const SpineItem* SpineItem::NextStep() const
 {
@@ -97,10 +117,9 @@ const SpineItem* SpineItem::NextStep() const
 }
 SpineItem* SpineItem::PriorStep()
 {
-    SpineItem* p = Previous();
-    while ( p != nullptr && p->Linear() == false )
-        p = p->Previous();
-    return p;
+    if ( _linearIndex == 0 )
+        return nullptr;
+    return _owner->_linearSpine[_linearIndex-1];
 }
 const SpineItem* SpineItem::PriorStep() const
 {
@@ -108,31 +127,13 @@ const SpineItem* SpineItem::PriorStep() const
 }
 SpineItem* SpineItem::at(ssize_t idx) throw (std::out_of_range)
 {
-    SpineItem* result(this);
-    ssize_t i = idx;
-    
-    if ( i > 0 )
-    {
-        while ( result != nullptr && i > 0 )
-        {
-            result = result->Next();
-            i--;
-        }
-    }
-    else if ( idx < 0 )
-    {
-        while ( result != nullptr && i < 0 )
-        {
-            result = result->Previous();
-            i++;
-        }
-    }
+    ssize_t i = static_cast<ssize_t>(_index) + idx;
     
     // Q: maybe just return nullptr?
-    if ( result == nullptr )
-        throw std::out_of_range(_Str("Index ", i, " is out of range"));
+    if ( i < 0 || static_cast<size_t>(i) >= _owner->SpineItemCount() )
+        throw std::out_of_range(_Str("Index ", idx, " is out of range"));
     
-    return result;
+    return _owner->_spine[i];
 }
 const SpineItem* SpineItem::at(ssize_t idx) const throw (std::out_of_range)
 {
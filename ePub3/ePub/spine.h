@@ -25,6 +25,7 @@
 #include <ePub3/epub3.h>
 #include <ePub3/utilities/utfstring.h>
 #include <vector>
+#include <cstdint>
 #include <libxml/tree.h>
 
 EPUB3_BEGIN_NAMESPACE
@@ -62,16 +63,17 @@ class IRI;
  they would not be encountered; placing them in the spine, however, allows a CFI or
  hyperlink to still reference them directly.
  
- SpineItems in Readium are implemented as a doubly-linked list. Each SpineItem has a
- pointer to the items preceeding and succeeding it in the spine. These can be
- accessed directly using the Next() and Previous() methods. When stepping between
- spine items, however, the NextStep() and PriorStep() methods can be used to
- implicitly skip any non-linear items.
+ A Package keeps its SpineItems in an array, along with a second array holding only
+ the linear items and a table mapping each idref to its position, so positional and
+ idref lookups take constant time. Each SpineItem also has a pointer to the items
+ preceeding and succeeding it in the spine. These can be accessed directly using the
+ Next() and Previous() methods. When stepping between spine items, however, the
+ NextStep() and PriorStep() methods can be used to implicitly skip any non-linear
+ items; these also take constant time.
  
- @remarks As a linked-list structure, each SpineItem holds an *owning reference* to the
- following item, and a *non-owning reference* to the preceding item. When a
- SpineItem is destroyed, it will delete the next SpineItem in the chain, and will
- set its prior item's pointer-to-next to be `nullptr`.
+ @remarks Each SpineItem holds *non-owning references* to the items which precede and
+ follow it. All the items in a spine are allocated in their Package's Arena, and are
+ destroyed along with the Package.
  
  @ingroup epub-model
  */
@@ -93,6 +95,15 @@ public:
      @param owner The package contaning this spine item.
      */
                         SpineItem(xmlNodePtr node, Package * owner);
+    /**
+     Constructs a new SpineItem directly from its attribute values.
+     @param owner The package contaning this spine item.
+     @param ident The item's `id` attribute, if any.
+     @param idref The `idref` of the manifest item this spine item references.
+     @param linear Whether the item is part of the linear reading order.
+     @param properties The item's property IRIs.
+     */
+                        SpineItem(Package * owner, const string& ident, const string& idref, bool linear, PropertyList&& properties);
     ///
     /// There is no copy constructor.
                         SpineItem(const SpineItem&)                     = delete;
@@ -100,19 +111,18 @@ public:
     /// C++11 move constructor.
                         SpineItem(SpineItem&&);
     
-    // NB: deleting a spine item will delete its next, etc.
-    // It will also reach back into _prev and nullify its _next
+    // NB: spine items belong to their package's arena; never delete one directly
     virtual             ~SpineItem();
     
     /// @{
     /// @name Metadata
     
     ///
-    /// Returns an O(n) count of items in the spine (starting with this item).
-    inline size_t       Count()             const       { return (_next == nullptr ? 1 : 1 + _next->Count()); }
+    /// Returns a count of items in the spine (starting with this item).
+    size_t              Count()             const;
     ///
-    /// Returns the index of the current item in the overall spine. O(n).
-    inline size_t       Index()             const       { return (_prev == nullptr ? 0 : _prev->Index() + 1); }
+    /// Returns the index of the current item in the overall spine.
+    size_t              Index()             const       { return _index; }
     
     ///
     /// Returns this item's identifier (if any).
@@ -231,12 +241,13 @@ protected:
     SpineItem* _prev;               ///< The SpineItem preceding this one in the spine.
     SpineItem* _next;               ///< The SpineItem following this one in the spine.
     
+    size_t     _index;              ///< This item's position in the spine.
+    size_t     _linearIndex;        ///< The number of linear items preceding this one.
+    uint32_t   _manifestHandle;     ///< The ManifestStore handle of the item named by `_idref`, found when added to the spine.
+    
+    friend class PackageBase;
     friend class Package;
-    void SetNextItem(SpineItem* next) {
-        next->_next = _next;
-        next->_prev = this;
-        _next = next;
-    }
+    friend class PackageSnapshot;
 };
 
 EPUB3_END_NAMESPACE
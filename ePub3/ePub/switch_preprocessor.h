@@ -140,6 +140,8 @@ private:
      */
     static REGEX_NS::regex   DefaultContentExtractor;
     
+    friend struct FilterStageTraits<SwitchPreprocessor>;
+    
 };
 
 EPUB3_END_NAMESPACE
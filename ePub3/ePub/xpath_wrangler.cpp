@@ -21,6 +21,9 @@
 
 #include "xpath_wrangler.h"
 #include <libxml/xpathInternals.h>
+#include <mutex>
+#include <cctype>
+#include <cstring>
 
 #define XMLCHAR(utfstr) utfstr.xml_str()
 
@@ -31,16 +34,141 @@ static void * _nsHashCopier(void * data, xmlChar * name)
 
 EPUB3_BEGIN_NAMESPACE
 
+// Returns `true` if an expression calls a function. Evaluating a function-call step
+//  writes the resolved function into the compiled step (libxml2's `op->cache`), so
+//  such expressions can't be shared between threads. Node-type tests such as `text()`
+//  aren't function calls and don't do this.
+static bool CallsFunction(const std::string& xpath)
+{
+    static const char* const kNodeTypes[] = { "text", "node", "comment", "processing-instruction" };
+    
+    for ( size_t i = 0; i < xpath.size(); i++ )
+    {
+        char ch = xpath[i];
+        if ( ch == '"' || ch == '\'' )
+        {
+            // skip string literals
+            i = xpath.find(ch, i+1);
+            if ( i == std::string::npos )
+                return false;
+            continue;
+        }
+        if ( ch != '(' )
+            continue;
+        
+        // find the name (if any) ahead of the parenthesis
+        size_t end = i;
+        while ( end > 0 && isspace(static_cast<unsigned char>(xpath[end-1])) )
+            end--;
+        size_t start = end;
+        while ( start > 0 && (isalnum(static_cast<unsigned char>(xpath[start-1])) || strchr("-_.:", xpath[start-1]) != nullptr) )
+            start--;
+        if ( start == end )
+            continue;       // just a parenthesized expression
+        
+        bool nodeType = false;
+        for ( const char* name : kNodeTypes )
+        {
+            if ( xpath.compare(start, end-start, name) == 0 )
+                nodeType = true;
+        }
+        if ( !nodeType )
+            return true;
+    }
+    
+    return false;
+}
+
+// Compiled expressions don't bind namespace prefixes (those are resolved against the
+//  evaluation context), so a single compiled copy of each expression can be shared
+//  by every context in the process-- unless it calls a function (see CallsFunction()),
+//  in which case it's compiled afresh for each evaluation.
+class CompiledXPathCache
+{
+public:
+    // the number of distinct expressions retained; beyond this they're compiled per-use
+    static const size_t MaxEntries = 128;
+    
+    CompiledXPathCache() = default;
+    ~CompiledXPathCache()
+    {
+        for ( auto item : _cache )
+        {
+            xmlXPathFreeCompExpr(item.second);
+        }
+    }
+    
+    // returns `true` if the caller must free the result
+    xmlXPathCompExprPtr Lookup(const string& xpath, bool* pMustFree)
+    {
+        *pMustFree = false;
+        
+        {
+            std::lock_guard<std::mutex> _(_lock);
+            auto found = _cache.find(xpath);
+            if ( found != _cache.end() )
+                return found->second;
+        }
+        
+        xmlXPathCompExprPtr comp = xmlXPathCompile(xpath.xml_str());
+        if ( comp == nullptr )
+            return nullptr;
+        
+        if ( CallsFunction(xpath.stl_str()) )
+        {
+            *pMustFree = true;
+            return comp;
+        }
+        
+        std::lock_guard<std::mutex> _(_lock);
+        auto found = _cache.find(xpath);
+        if ( found != _cache.end() )
+        {
+            // compiled on another thread while we were busy
+            xmlXPathFreeCompExpr(comp);
+            return found->second;
+        }
+        
+        if ( _cache.size() >= MaxEntries )
+        {
+            *pMustFree = true;
+            return comp;
+        }
+        
+        _cache[xpath] = comp;
+        return comp;
+    }
+    
+private:
+    std::map<string, xmlXPathCompExprPtr>   _cache;
+    std::mutex                              _lock;
+};
+
+static CompiledXPathCache gCompiledXPaths;
+
+// holds a compiled expression for the duration of an evaluation
+class CompiledXPath
+{
+public:
+    CompiledXPath(const string& xpath) : _mustFree(false) { _comp = gCompiledXPaths.Lookup(xpath, &_mustFree); }
+    ~CompiledXPath() { if ( _mustFree ) xmlXPathFreeCompExpr(_comp); }
+    
+    operator xmlXPathCompExprPtr () const { return _comp; }
+    
+private:
+    xmlXPathCompExprPtr _comp;
+    bool                _mustFree;
+};
+
 XPathWrangler::XPathWrangler(xmlDocPtr doc, const NamespaceList& namespaces)
 {
+    // NB: xmlXPathNewContext() registers all the standard functions itself
     _ctx = xmlXPathNewContext(doc);
-    xmlXPathRegisterAllFunctions(_ctx);
     RegisterNamespaces(namespaces);
 }
 XPathWrangler::XPathWrangler(const XPathWrangler& o)
 {
     _ctx = xmlXPathNewContext(o._ctx->doc);
-    xmlXPathRegisterAllFunctions(_ctx);
     
     // copy across the namespaces
     if ( _ctx->nsHash != nullptr )
@@ -65,7 +193,11 @@ XPathWrangler::StringList XPathWrangler::Strings(const string& xpath, xmlNodePtr
     StringList strings;
     _ctx->node = (node == nullptr ? xmlDocGetRootElement(_ctx->doc) : node);
     
-    xmlXPathObjectPtr result = xmlXPathEvalExpression(xpath.xml_str(), _ctx);
+    CompiledXPath comp(xpath);
+    if ( comp == nullptr )
+        return strings;
+    
+    xmlXPathObjectPtr result = xmlXPathCompiledEval(comp, _ctx);
     if ( result != nullptr )
     {
         switch ( result->type )
@@ -94,12 +226,27 @@ XPathWrangler::StringList XPathWrangler::Strings(const string& xpath, xmlNodePtr
     
     return std::move(strings);
 }
+bool XPathWrangler::Matches(const string& xpath, xmlNodePtr node)
+{
+    _ctx->node = (node == nullptr ? xmlDocGetRootElement(_ctx->doc) : node);
+    
+    CompiledXPath comp(xpath);
+    if ( comp == nullptr )
+        return false;
+    
+    // stops at the first matching node rather than building a complete node-set
+    return xmlXPathCompiledEvalToBoolean(comp, _ctx) == 1;
+}
 xmlNodeSetPtr XPathWrangler::Nodes(const string& xpath, xmlNodePtr node)
 {
     _ctx->node = (node == nullptr ? xmlDocGetRootElement(_ctx->doc) : node);
     
+    CompiledXPath comp(xpath);
+    if ( comp == nullptr )
+        return nullptr;
+    
     xmlNodeSetPtr nodes = nullptr;
-    xmlXPathObjectPtr result = xmlXPathEvalExpression(xpath.xml_str(), _ctx);
+    xmlXPathObjectPtr result = xmlXPathCompiledEval(comp, _ctx);
     if ( result != nullptr )
     {
         if ( result->type == XPATH_NODESET && result->nodesetval != nullptr )
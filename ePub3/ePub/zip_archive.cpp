@@ -22,6 +22,7 @@
 #include "zip_archive.h"
 #include <libzip/zipint.h>
 #include "byte_stream.h"
+#include "trace.h"
 #include <sstream>
 #include <fstream>
 #include <iostream>
@@ -62,16 +63,24 @@ static std::string GetTempFilePath(const std::string& ext)
 class ZipReader : public ArchiveReader
 {
 public:
-    ZipReader(struct zip_file* file) : _file(file) {}
-    ZipReader(ZipReader&& o) : _file(o._file) { o._file = nullptr; }
-    virtual ~ZipReader() { if (_file != nullptr) zip_fclose(_file); }
+    ZipReader(struct zip_file* file, std::mutex& lock) : _file(file), _lock(lock) {}
+    ZipReader(ZipReader&& o) : _file(o._file), _lock(o._lock) { o._file = nullptr; }
+    virtual ~ZipReader() { if (_file != nullptr) { std::lock_guard<std::mutex> _(_lock); zip_fclose(_file); } }
     
     virtual bool operator !() const { return _file == nullptr || _file->bytes_left == 0; }
-    virtual ssize_t read(void* p, size_t len) const { return zip_fread(_file, p, len); }
+    virtual ssize_t read(void* p, size_t len) const
+    {
+        std::lock_guard<std::mutex> _(_lock);
+        ssize_t numRead = zip_fread(_file, p, len);
+        if ( numRead > 0 )
+            Trace::CountBytesRead(static_cast<size_t>(numRead));
+        return numRead;
+    }
     
     virtual ssize_t bytesLeft() const { return _file->bytes_left; }
 private:
     struct zip_file * _file;
+    std::mutex &      _lock;    ///< The owning archive's read lock.
 };
 
 class ZipWriter : public ArchiveWriter
@@ -123,6 +132,7 @@ ZipArchive::ZipItemInfo::ZipItemInfo(struct zip_stat & info)
     SetIsCompressed(info.comp_method == ZIP_CM_STORE);
     SetCompressedSize(static_cast<size_t>(info.comp_size));
     SetUncompressedSize(static_cast<size_t>(info.size));
+    SetCRC32(static_cast<uint32_t>(info.crc));
 }
 
 std::string ZipArchive::TempFilePath()
@@ -152,6 +162,7 @@ Archive & ZipArchive::operator = (ZipArchive &&o)
 }
 bool ZipArchive::ContainsItem(const std::string & path) const
 {
+    std::lock_guard<std::mutex> _(_readLock);
     return (zip_name_locate(_zip, Sanitized(path).c_str(), 0) >= 0);
 }
 bool ZipArchive::DeleteItem(const std::string & path)
@@ -167,18 +178,22 @@ bool ZipArchive::CreateFolder(const std::string & path)
 }
 Auto<ByteStream> ZipArchive::ByteStreamAtPath(const std::string &path) const
 {
-    return Auto<ByteStream>(new ZipFileByteStream(_zip, path));
+    return Auto<ByteStream>(new ZipFileByteStream(_zip, path, _readLock));
 }
 ArchiveReader* ZipArchive::ReaderAtPath(const std::string & path) const
 {
     if (_zip == nullptr)
         return nullptr;
     
-    struct zip_file* file = zip_fopen(_zip, Sanitized(path).c_str(), 0);
+    struct zip_file* file = nullptr;
+    {
+        std::lock_guard<std::mutex> _(_readLock);
+        file = zip_fopen(_zip, Sanitized(path).c_str(), 0);
+    }
     if (file == nullptr)
         return nullptr;
     
-    return new ZipReader(file);
+    return new ZipReader(file, _readLock);
 }
 ArchiveWriter* ZipArchive::WriterAtPath(const std::string & path, bool compressed, bool create)
 {
@@ -200,6 +215,7 @@ ArchiveWriter* ZipArchive::WriterAtPath(const std::string & path, bool compresse
 }
 ArchiveItemInfo ZipArchive::InfoAtPath(const std::string & path) const
 {
+    std::lock_guard<std::mutex> _(_readLock);
     struct zip_stat sbuf;
     if ( zip_stat(_zip, Sanitized(path).c_str(), 0, &sbuf) < 0 )
         throw std::runtime_error(std::string("zip_stat("+path+") - " + zip_strerror(_zip)));
@@ -25,6 +25,7 @@
 #include <ePub3/archive.h>
 #include <libzip/zip.h>
 #include <list>
+#include <mutex>
 
 EPUB3_BEGIN_NAMESPACE
 
@@ -35,6 +36,9 @@ EPUB3_BEGIN_NAMESPACE
  @note The underlying implementation, `libzip`, writes data only when the archive
  is closed. Any data written to a zip file will therefore be kept in temporary
  storage until the archive object is closed.
+ @note `libzip` reads every item through one shared file handle, so reads from a
+ single archive are serialized by an internal lock. Readers may be used from several
+ threads at once, but only one will be fetching data from the file at any time.
  @see http://www.idpf.org/epub/30/spec/epub30-ocf.html#physical-container-zip
  @ingroup archives
  */
@@ -58,7 +62,7 @@ public:
     ZipArchive(const std::string & path);
     ///
     /// move constructos.
-    ZipArchive(ZipArchive &&o) : _zip(o._zip) { o._zip = nullptr; }
+    ZipArchive(ZipArchive &&o) : _zip(o._zip), _readLock() { o._zip = nullptr; }
     ///
     /// Initialize directly from a `libzip` internal structure.
     explicit ZipArchive(struct zip * aZip) : _zip(aZip) {}
@@ -82,6 +86,7 @@ public:
     
 protected:
     struct zip *    _zip;           ///< Pointer to the underlying `libzip` data type.
+    mutable std::mutex  _readLock;  ///< Serializes access to `_zip` by readers.
     
     typedef std::list<zip_source*>  ZipSourceList;
     ZipSourceList   _liveSources;   ///< A list of live zip sources, which must be cleaned up upon closing.
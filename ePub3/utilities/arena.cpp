@@ -0,0 +1,125 @@
+//
+//  arena.cpp
+//  ePub3
+//
+//  Copyright (c) 2012-2013 The Readium Foundation and contributors.
+//
+//  The Readium SDK is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#include "arena.h"
+#include "trace.h"
+#include <cstdlib>
+#include <cstdint>
+
+EPUB3_BEGIN_NAMESPACE
+
+const size_t Arena::DefaultBlockSize;
+
+Arena::Arena(size_t blockSize) : _blocks(nullptr), _finalizers(nullptr), _blockSize(blockSize), _reserved(0), _used(0)
+{
+}
+Arena::~Arena()
+{
+    // objects first, newest to oldest, as they may refer to things created before them
+    for ( Finalizer* f = _finalizers; f != nullptr; f = f->prev )
+    {
+        f->destroy(f->object);
+    }
+
+    Block* block = _blocks;
+    while ( block != nullptr )
+    {
+        Block* next = block->next;
+        std::free(block);
+        block = next;
+    }
+}
+void* Arena::Allocate(size_t size, size_t align)
+{
+    std::lock_guard<std::mutex> _(_lock);
+    return AllocateLocked(size, align);
+}
+size_t Arena::BytesReserved() const
+{
+    std::lock_guard<std::mutex> _(_lock);
+    return _reserved;
+}
+size_t Arena::BytesUsed() const
+{
+    std::lock_guard<std::mutex> _(_lock);
+    return _used;
+}
+void Arena::AddFinalizer(void (*destroy)(void*), void* object)
+{
+    std::lock_guard<std::mutex> _(_lock);
+    Finalizer* f = reinterpret_cast<Finalizer*>(AllocateLocked(sizeof(Finalizer), alignof(Finalizer)));
+    f->prev = _finalizers;
+    f->destroy = destroy;
+    f->object = object;
+    _finalizers = f;
+}
+void* Arena::AllocateLocked(size_t size, size_t align)
+{
+    // keeps the usable space in each block maximally aligned
+    static const size_t kBlockHeaderSize = (sizeof(Block) + alignof(std::max_align_t) - 1) & ~(alignof(std::max_align_t) - 1);
+
+    if ( size == 0 )
+        size = 1;
+
+    if ( _blocks != nullptr )
+    {
+        uintptr_t base = reinterpret_cast<uintptr_t>(_blocks) + kBlockHeaderSize;
+        uintptr_t start = (base + _blocks->used + align - 1) & ~(uintptr_t(align) - 1);
+        size_t end = static_cast<size_t>(start - base) + size;
+        if ( end <= _blocks->size )
+        {
+            _used += end - _blocks->used;
+            _blocks->used = end;
+            return reinterpret_cast<void*>(start);
+        }
+    }
+
+    // large allocations get a block to themselves, placed behind the current block so
+    //  that the remainder of the current block isn't wasted
+    bool oversized = (size > _blockSize / 4);
+    size_t blockSize = (oversized ? size + align : _blockSize);
+
+    Block* block = reinterpret_cast<Block*>(std::malloc(kBlockHeaderSize + blockSize));
+    if ( block == nullptr )
+        throw std::bad_alloc();
+    Trace::CountAllocation(kBlockHeaderSize + blockSize);
+
+    block->size = blockSize;
+    _reserved += kBlockHeaderSize + blockSize;
+
+    if ( oversized && _blocks != nullptr )
+    {
+        block->next = _blocks->next;
+        _blocks->next = block;
+    }
+    else
+    {
+        block->next = _blocks;
+        _blocks = block;
+    }
+
+    uintptr_t base = reinterpret_cast<uintptr_t>(block) + kBlockHeaderSize;
+    uintptr_t start = (base + align - 1) & ~(uintptr_t(align) - 1);
+    block->used = static_cast<size_t>(start - base) + size;
+    _used += block->used;
+    return reinterpret_cast<void*>(start);
+}
+
+EPUB3_END_NAMESPACE
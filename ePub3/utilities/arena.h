@@ -0,0 +1,168 @@
+//
+//  arena.h
+//  ePub3
+//
+//  Copyright (c) 2012-2013 The Readium Foundation and contributors.
+//
+//  The Readium SDK is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#ifndef __ePub3__arena__
+#define __ePub3__arena__
+
+#include <ePub3/epub3.h>
+#include <ePub3/utilities/basic.h>
+#include <cstddef>
+#include <mutex>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+EPUB3_BEGIN_NAMESPACE
+
+/**
+ Whether an Arena must run the destructor of objects of a given type at teardown.
+ 
+ This is true of any type with a non-trivial destructor. Specialize it as false for
+ a type whose destructor is only non-trivial because it is declared (for instance,
+ because it is virtual) and which owns nothing, so that an Arena need not record or
+ run a finalizer for each such object.
+ @ingroup utilities
+ */
+template <class _Tp>
+struct ArenaNeedsFinalizer : std::integral_constant<bool, !std::is_trivially_destructible<_Tp>::value> {};
+
+/**
+ A monotonic allocator for objects which all share a single owner's lifetime.
+
+ Memory is carved sequentially out of large blocks, and is never returned until the
+ arena itself is destroyed, at which point all its blocks are released together.
+ Objects created through New() are destroyed at that time too, in the reverse order
+ of their creation; objects with trivial destructors, or for which ArenaNeedsFinalizer
+ is false, cost nothing to tear down.
+ 
+ Teardown is therefore not free for everything: each object which owns heap memory
+ of its own-- such as a string too long to be stored inline, or a vector-- still has
+ its destructor run, and that memory is released piecemeal.
+
+ Objects created in an arena must never be passed to `delete`.
+
+ A Package uses an arena for its manifest, spine, metadata, and navigation objects,
+ so that opening and closing many packages leaves the heap with a handful of large,
+ same-sized holes rather than many thousands of small ones.
+ 
+ libxml2's own allocations cannot come from an arena: `xmlMemSetup()` replaces its
+ allocator for the whole process rather than per document, and libxml2 releases
+ each block individually through `xmlFree()`, which an arena cannot honour. (Trace
+ only wraps libxml2's existing allocator and keeps its `free()`, which is why it can
+ install its counters at any time.)
+
+ @remarks All methods are thread-safe.
+
+ @ingroup utilities
+ */
+class Arena
+{
+public:
+    ///
+    /// The default size of each block obtained from the system.
+    static const size_t     DefaultBlockSize = 16 * 1024;
+
+public:
+    /**
+     Creates a new, empty arena. No memory is allocated until it is first used.
+     @param blockSize The size of each block to request from the system. Single
+     allocations larger than a quarter of this are given a block of their own.
+     */
+                            Arena(size_t blockSize=DefaultBlockSize);
+                            Arena(const Arena&)     = delete;
+                            Arena(Arena&&)          = delete;
+    ///
+    /// Destroys all objects created through New(), then releases all memory.
+                            ~Arena();
+
+    /**
+     Allocates raw, uninitialized memory.
+     @param size The number of bytes required.
+     @param align The required alignment, which must be a power of two.
+     @result A pointer to the allocated memory, which remains valid until the arena
+     is destroyed.
+     @throws std::bad_alloc if memory could not be obtained from the system.
+     */
+    void*                   Allocate(size_t size, size_t align=alignof(std::max_align_t));
+
+    /**
+     Creates a new object in the arena.
+
+     The object's destructor will be run when the arena is destroyed, unless
+     ArenaNeedsFinalizer says it needn't be. If the object's constructor throws, its
+     memory is simply abandoned.
+     */
+    template <class _Tp, typename... _Args>
+    _Tp*                    New(_Args&&... __args)
+        {
+            _Tp* result = new (Allocate(sizeof(_Tp), alignof(_Tp))) _Tp(std::forward<_Args>(__args)...);
+            if ( ArenaNeedsFinalizer<_Tp>::value )
+                AddFinalizer(&Arena::Destroy<_Tp>, result);
+            return result;
+        }
+
+    ///
+    /// The total number of bytes obtained from the system.
+    size_t                  BytesReserved()         const;
+    ///
+    /// The total number of bytes handed out, including alignment padding and bookkeeping.
+    size_t                  BytesUsed()             const;
+
+protected:
+    ///
+    /// A block of memory obtained from the system; its usable space follows the header.
+    struct Block
+    {
+        Block*      next;
+        size_t      size;
+        size_t      used;
+    };
+    ///
+    /// A destructor to run at teardown; these are themselves allocated in the arena.
+    struct Finalizer
+    {
+        Finalizer*  prev;
+        void        (*destroy)(void*);
+        void*       object;
+    };
+
+    Block*                  _blocks;        ///< The block currently being filled, linked to all earlier blocks.
+    Finalizer*              _finalizers;    ///< The most recently registered finalizer.
+    size_t                  _blockSize;     ///< The standard size of a new block.
+    size_t                  _reserved;      ///< Total block bytes obtained from the system.
+    size_t                  _used;          ///< Total bytes handed out.
+    mutable std::mutex      _lock;          ///< Guards all of the above.
+
+    ///
+    /// Registers a function to be called with `object` at teardown.
+    void                    AddFinalizer(void (*destroy)(void*), void* object);
+
+    ///
+    /// Allocates from the current block, or a new one. The caller must hold `_lock`.
+    void*                   AllocateLocked(size_t size, size_t align);
+
+    template <class _Tp>
+    static void             Destroy(void* p)    { reinterpret_cast<_Tp*>(p)->~_Tp(); }
+
+};
+
+EPUB3_END_NAMESPACE
+
+#endif /* defined(__ePub3__arena__) */
@@ -20,6 +20,7 @@
 //
 
 #include "byte_stream.h"
+#include "trace.h"
 #include <cstdio>
 #include <libzip/zip.h>
 #include <libzip/zipint.h>          // for internals of zip_file
@@ -359,6 +360,11 @@ ZipFileByteStream::ZipFileByteStream(struct zip* archive, const string& path, in
 {
     Open(archive, path, flags);
 }
+ZipFileByteStream::ZipFileByteStream(struct zip* archive, const string& path, std::mutex& archiveLock, int flags) : ZipFileByteStream()
+{
+    _lock = &archiveLock;
+    Open(archive, path, flags);
+}
 ZipFileByteStream::~ZipFileByteStream()
 {
     Close();
@@ -383,6 +389,7 @@ bool ZipFileByteStream::Open(struct zip *archive, const string &path, int flags)
     if ( _file != nullptr )
         Close();
     
+    auto _ = LockArchive();
     _file = zip_fopen(archive, path.c_str(), flags);
     return ( _file != nullptr );
 }
@@ -391,6 +398,7 @@ void ZipFileByteStream::Close()
     if ( _file == nullptr )
         return;
 
+    auto _ = LockArchive();
     zip_fclose(_file);
     _file = nullptr;
 }
@@ -399,13 +407,18 @@ ByteStream::size_type ZipFileByteStream::ReadBytes(void *buf, size_type len)
     if ( _file == nullptr )
         return 0;
     
-    ssize_t numRead = zip_fread(_file, buf, len);
+    ssize_t numRead = 0;
+    {
+        auto _ = LockArchive();
+        numRead = zip_fread(_file, buf, len);
+    }
     if ( numRead < 0 )
     {
         Close();
         return 0;
     }
     
+    Trace::CountBytesRead(static_cast<size_t>(numRead));
     return numRead;
 }
 ByteStream::size_type ZipFileByteStream::WriteBytes(const void *buf, size_type len)
@@ -413,6 +426,12 @@ ByteStream::size_type ZipFileByteStream::WriteBytes(const void *buf, size_type l
     // no write support at this moment
     return 0;
 }
+std::unique_lock<std::mutex> ZipFileByteStream::LockArchive() const
+{
+    if ( _lock == nullptr )
+        return std::unique_lock<std::mutex>();
+    return std::unique_lock<std::mutex>(*_lock);
+}
 
 #if 0
 #pragma mark -
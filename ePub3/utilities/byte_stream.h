@@ -26,6 +26,7 @@
 #include <ePub3/utilities/ring_buffer.h>
 #include <functional>
 #include <ios>
+#include <mutex>
 #include <thread>
 #include <ePub3/utilities/run_loop.h>
 
@@ -354,7 +355,7 @@ class ZipFileByteStream : public ByteStream
 public:
     ///
     /// Create a new unattached stream.
-                            ZipFileByteStream() : ByteStream(), _file(nullptr) {}
+                            ZipFileByteStream() : ByteStream(), _file(nullptr), _lock(nullptr) {}
     /**
      Create a new stream to a file within a zip archive.
      @param archive The Zip arrchive containing the target file.
@@ -362,6 +363,19 @@ public:
      @param zipFlags Flags such as whether to read the raw compressed data.
      */
                             ZipFileByteStream(struct zip* archive, const string& pathToOpen, int zipFlags=0);
+    /**
+     Create a new stream to a file within a zip archive which is shared with other
+     readers.
+     
+     libzip reads every file through the archive's single file handle, so all
+     opening, reading, and closing of the file is done while holding `archiveLock`.
+     @param archive The Zip arrchive containing the target file.
+     @param pathToOpen The path within the archive of the resource to open.
+     @param archiveLock The lock serializing access to `archive`; it must outlive
+     the stream.
+     @param zipFlags Flags such as whether to read the raw compressed data.
+     */
+                            ZipFileByteStream(struct zip* archive, const string& pathToOpen, std::mutex& archiveLock, int zipFlags=0);
     virtual                 ~ZipFileByteStream();
     
 private:
@@ -402,6 +416,11 @@ public:
     
 protected:
     struct zip_file*        _file;      ///< The underlying Zip file stream.
+    std::mutex*             _lock;      ///< The archive's read lock, if it is shared.
+    
+    ///
+    /// Returns a lock on the archive's read lock, or an empty lock if there is none.
+    std::unique_lock<std::mutex> LockArchive()                    const;
 };
 
 /**
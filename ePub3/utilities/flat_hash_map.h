@@ -0,0 +1,209 @@
+//
+//  flat_hash_map.h
+//  ePub3
+//
+//  Copyright (c) 2012-2013 The Readium Foundation and contributors.
+//
+//  The Readium SDK is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#ifndef __ePub3__flat_hash_map__
+#define __ePub3__flat_hash_map__
+
+#include <ePub3/epub3.h>
+#include <cstddef>
+#include <functional>
+#include <string>
+#include <utility>
+#include <vector>
+
+EPUB3_BEGIN_NAMESPACE
+
+/**
+ A string-keyed hash table stored in a single contiguous array.
+
+ Entries are placed using open addressing with linear probing, so a lookup touches
+ one run of adjacent slots rather than following a chain of separately-allocated
+ nodes as `std::map` and `std::unordered_map` do. Each slot keeps the full hash of
+ its key, so keys are only compared when the hashes already match.
+
+ The table is meant for indices which are built once and then read many times, so
+ it does not support removing single entries; use clear() and rebuild instead.
+
+ @remarks Not thread-safe for writes; any number of threads may read concurrently.
+
+ @ingroup utilities
+ */
+template <typename _Tp>
+class FlatHashMap
+{
+public:
+    typedef std::string     key_type;
+    typedef _Tp             mapped_type;
+
+private:
+    struct Slot
+    {
+        size_t          hash;       ///< Zero marks an empty slot.
+        key_type        key;
+        mapped_type     value;
+
+        Slot() : hash(0), key(), value() {}
+    };
+
+public:
+                        FlatHashMap() : _slots(), _size(0) {}
+                        FlatHashMap(const FlatHashMap&)             = default;
+                        FlatHashMap(FlatHashMap&& o) : _slots(std::move(o._slots)), _size(o._size) { o._size = 0; }
+                        ~FlatHashMap() {}
+
+    FlatHashMap&        operator=(const FlatHashMap&)               = default;
+    FlatHashMap&        operator=(FlatHashMap&& o)
+        {
+            _slots = std::move(o._slots);
+            _size = o._size;
+            o._size = 0;
+            return *this;
+        }
+
+    size_t              size()                              const   { return _size; }
+    bool                empty()                             const   { return _size == 0; }
+
+    ///
+    /// Removes every entry, keeping the allocated slots for reuse.
+    void                clear()
+        {
+            for ( Slot& slot : _slots )
+                slot = Slot();
+            _size = 0;
+        }
+
+    ///
+    /// Makes room for at least `count` entries without further rehashing.
+    void                reserve(size_t count)
+        {
+            size_t capacity = 8;
+            while ( capacity - (capacity / 4) < count )
+                capacity *= 2;
+            if ( capacity > _slots.size() )
+                Rehash(capacity);
+        }
+
+    /**
+     Adds an entry, unless one already exists for the given key.
+     @result `true` if the entry was added, `false` if the key was already present,
+     in which case the existing value is left unchanged.
+     */
+    bool                insert(const key_type& key, const mapped_type& value)
+        {
+            if ( (_size + 1) > _slots.size() - (_slots.size() / 4) )
+                Rehash(_slots.empty() ? 8 : _slots.size() * 2);
+
+            size_t hash = Hash(key);
+            size_t idx = Probe(key, hash);
+            if ( _slots[idx].hash != 0 )
+                return false;
+
+            _slots[idx].hash = hash;
+            _slots[idx].key = key;
+            _slots[idx].value = value;
+            ++_size;
+            return true;
+        }
+
+    ///
+    /// Returns the value stored for a key, first adding a default-constructed one if there is none.
+    mapped_type&        operator[](const key_type& key)
+        {
+            if ( (_size + 1) > _slots.size() - (_slots.size() / 4) )
+                Rehash(_slots.empty() ? 8 : _slots.size() * 2);
+
+            size_t hash = Hash(key);
+            size_t idx = Probe(key, hash);
+            if ( _slots[idx].hash == 0 )
+            {
+                _slots[idx].hash = hash;
+                _slots[idx].key = key;
+                ++_size;
+            }
+            return _slots[idx].value;
+        }
+
+    ///
+    /// Returns the value stored for a key, or `nullptr` if there is none.
+    const mapped_type*  find(const key_type& key)           const
+        {
+            if ( _size == 0 )
+                return nullptr;
+
+            const Slot& slot = _slots[Probe(key, Hash(key))];
+            return (slot.hash == 0 ? nullptr : &slot.value);
+        }
+    mapped_type*        find(const key_type& key)
+        {
+            return const_cast<mapped_type*>(const_cast<const FlatHashMap*>(this)->find(key));
+        }
+
+    ///
+    /// Calls `fn(key, value)` for every entry, in no particular order.
+    template <typename _Fn>
+    void                for_each(_Fn fn)                    const
+        {
+            for ( const Slot& slot : _slots )
+            {
+                if ( slot.hash != 0 )
+                    fn(slot.key, slot.value);
+            }
+        }
+
+private:
+    std::vector<Slot>   _slots;     ///< Always empty or a power of two in size.
+    size_t              _size;
+
+    static size_t       Hash(const key_type& key)
+        {
+            size_t hash = std::hash<key_type>()(key);
+            return (hash == 0 ? 1 : hash);
+        }
+
+    ///
+    /// The index of the slot holding `key`, or of the empty slot where it belongs.
+    size_t              Probe(const key_type& key, size_t hash) const
+        {
+            size_t mask = _slots.size() - 1;
+            size_t idx = hash & mask;
+            while ( _slots[idx].hash != 0 && (_slots[idx].hash != hash || _slots[idx].key != key) )
+                idx = (idx + 1) & mask;
+            return idx;
+        }
+
+    void                Rehash(size_t capacity)
+        {
+            std::vector<Slot> old(capacity);
+            old.swap(_slots);
+            for ( Slot& slot : old )
+            {
+                if ( slot.hash == 0 )
+                    continue;
+
+                size_t idx = Probe(slot.key, slot.hash);
+                _slots[idx] = std::move(slot);
+            }
+        }
+
+};
+
+EPUB3_END_NAMESPACE
+
+#endif /* defined(__ePub3__flat_hash_map__) */
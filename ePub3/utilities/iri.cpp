@@ -22,7 +22,11 @@
 #include "iri.h"
 #include <google-url/url_util.h>
 #include "cfi.h"
+#include "flat_hash_map.h"
 #include REGEX_INCLUDE
+#include <deque>
+#include <memory>
+#include <mutex>
 
 EPUB3_BEGIN_NAMESPACE
 
@@ -39,13 +43,38 @@ inline const url_parse::Component ComponentForString(const string& str)
     return url_parse::Component(0, str.empty() ? -1 : static_cast<int>(str.utf8_size()));
 }
 
-IRI::IRI(const string& iriStr) : _url(new GURL(iriStr.stl_str())), _pureIRI(iriStr)
+/**
+ An entry in the process-wide table of interned IRIs.
+ 
+ Only the canonical URL string is kept up front; the GURL itself is parsed again
+ the first time anyone asks for one of its components.
+ */
+struct IRI::Atom
+{
+    std::string             spec;       ///< The canonical URL, unique among atoms.
+    string                  iri;        ///< The Unicode IRI string first interned with this spec.
+    bool                    valid;      ///< Whether the URL parsed successfully.
+    
+    mutable std::once_flag  urlOnce;
+    mutable std::unique_ptr<GURL> url;
+    
+    Atom(const std::string& s, const string& i, bool v) : spec(s), iri(i), valid(v), urlOnce(), url() {}
+    
+    const GURL& URL() const
+    {
+        std::call_once(urlOnce, [this]() { url.reset(new GURL(spec)); });
+        return *url;
+    }
+};
+
+IRI::IRI(const string& iriStr) : _url(new GURL(iriStr.stl_str())), _atom(nullptr), _pureIRI(iriStr)
 {
 }
-IRI::IRI(const string& nameID, const string& namespacedString) : _urnComponents{gURNScheme, nameID, namespacedString}, _pureIRI(_Str("urn:", nameID, ":", namespacedString)), _url(new GURL(_pureIRI.stl_str()))
+IRI::IRI(const string& nameID, const string& namespacedString) : _urnComponents{gURNScheme, nameID, namespacedString}, _url(nullptr), _atom(nullptr), _pureIRI(_Str("urn:", nameID, ":", namespacedString))
 {
+    _url = new GURL(_pureIRI.stl_str());
 }
-IRI::IRI(const string& scheme, const string& host, const string& path, const string& query, const string& fragment) : _urnComponents(), _url(nullptr)
+IRI::IRI(const string& scheme, const string& host, const string& path, const string& query, const string& fragment) : _urnComponents(), _url(nullptr), _atom(nullptr)
 {
     _pureIRI = _Str(scheme, "://", host);
     if ( path.empty() )
@@ -67,59 +96,144 @@ IRI::~IRI()
     if ( _url != nullptr )
         delete _url;
 }
+IRI IRI::Interned(const string& iriStr)
+{
+    // never destroyed, so that static IRIs may be interned and released in any order
+    static std::mutex* lock = new std::mutex;
+    static std::deque<Atom>* atoms = new std::deque<Atom>;
+    static FlatHashMap<const Atom*>* byString = new FlatHashMap<const Atom*>;
+    static FlatHashMap<const Atom*>* bySpec = new FlatHashMap<const Atom*>;
+    
+    IRI result;
+    std::lock_guard<std::mutex> _(*lock);
+    
+    const Atom** found = byString->find(iriStr.stl_str());
+    if ( found != nullptr )
+    {
+        result._atom = *found;
+        return result;
+    }
+    
+    // different spellings of the same URL share an atom, so identity is equality
+    GURL url(iriStr.stl_str());
+    const std::string& spec = url.possibly_invalid_spec();
+    found = bySpec->find(spec);
+    if ( found != nullptr )
+    {
+        result._atom = *found;
+    }
+    else
+    {
+        atoms->emplace_back(spec, iriStr, url.is_valid());
+        result._atom = &atoms->back();
+        bySpec->insert(spec, result._atom);
+    }
+    
+    byString->insert(iriStr.stl_str(), result._atom);
+    return result;
+}
 IRI& IRI::operator=(const IRI& o)
 {
     _urnComponents = o._urnComponents;
     _pureIRI = o._pureIRI;
-    if ( _url != nullptr )
+    _atom = o._atom;
+    if ( o._url == nullptr )
+    {
+        delete _url;
+        _url = nullptr;
+    }
+    else if ( _url != nullptr )
+    {
         *_url = *o._url;
+    }
     else
+    {
         _url = new GURL(*o._url);
+    }
     return *this;
 }
 IRI& IRI::operator=(IRI &&o)
 {
     _urnComponents = std::move(o._urnComponents);
     _pureIRI = std::move(o._pureIRI);
+    delete _url;
     _url = o._url;
     o._url = nullptr;
+    _atom = o._atom;
+    o._atom = nullptr;
     return *this;
 }
 bool IRI::operator==(const IRI &o) const
 {
     if ( IsURN() )
         return _urnComponents == o._urnComponents;
-    return *_url == *o._url;
+    if ( _atom != nullptr && o._atom != nullptr )
+        return _atom == o._atom;
+    return Spec() == o.Spec();
 }
 bool IRI::operator!=(const IRI& o) const
 {
-    if ( IsURN() )
-        return _urnComponents != o._urnComponents;
-    return *_url != *o._url;
+    return !(*this == o);
 }
 bool IRI::operator<(const IRI& o) const
 {
     if ( IsURN() )
         return _urnComponents < o._urnComponents;
-    return *_url < *o._url;
+    if ( _atom != nullptr && _atom == o._atom )
+        return false;
+    return Spec() < o.Spec();
+}
+const GURL& IRI::URL() const
+{
+    static const GURL empty;
+    if ( _url != nullptr )
+        return *_url;
+    if ( _atom != nullptr )
+        return _atom->URL();
+    return empty;
+}
+const std::string& IRI::Spec() const
+{
+    if ( _url == nullptr && _atom != nullptr )
+        return _atom->spec;
+    return URL().possibly_invalid_spec();
+}
+GURL* IRI::MutableURL()
+{
+    if ( _url == nullptr )
+    {
+        if ( _atom != nullptr )
+        {
+            // no longer the interned value once it changes
+            _url = new GURL(_atom->URL());
+            _pureIRI = _atom->iri;
+            _atom = nullptr;
+        }
+        else
+        {
+            _url = new GURL();
+        }
+    }
+    return _url;
 }
 IRI::IRICredentials IRI::Credentials() const
 {
+    const GURL& url = URL();
     string u, p;
-    if ( _url->has_username() )
+    if ( url.has_username() )
     {
-        u = _url->username();
+        u = url.username();
     }
-    if ( _url->has_password() )
+    if ( url.has_password() )
     {
-        p = _url->password();
+        p = url.password();
     }
     
     return IRICredentials(u, p);
 }
 const string IRI::Path(bool urlEncoded) const
 {
-    std::string encodedPath(_url->path());
+    std::string encodedPath(URL().path());
     if ( urlEncoded )
         return encodedPath;
     
@@ -129,7 +243,7 @@ const string IRI::Path(bool urlEncoded) const
 }
 const CFI IRI::ContentFragmentIdentifier() const
 {
-    if ( !_url->has_ref() )
+    if ( !URL().has_ref() )
         return CFI();
     
     string ref = Fragment();
@@ -142,7 +256,7 @@ void IRI::SetScheme(const string& scheme)
 {
     url_canon::Replacements<char> rep;
     rep.SetScheme(scheme.c_str(), ComponentForString(scheme));
-    _url->ReplaceComponentsInline(rep);
+    MutableURL()->ReplaceComponentsInline(rep);
     
     // can't keep the IRI up to date
     _pureIRI.clear();
@@ -151,7 +265,7 @@ void IRI::SetHost(const string& host)
 {
     url_canon::Replacements<char> rep;
     rep.SetHost(host.c_str(), ComponentForString(host));
-    _url->ReplaceComponentsInline(rep);
+    MutableURL()->ReplaceComponentsInline(rep);
     
     // can't keep the IRI up to date
     _pureIRI.clear();
@@ -162,23 +276,24 @@ void IRI::SetCredentials(const string& user, const string& pass)
     url_parse::Component invalid(0, -1);
     rep.SetUsername(user.c_str(), ComponentForString(user));
     rep.SetPassword(pass.c_str(), ComponentForString(pass));
-    _url->ReplaceComponentsInline(rep);
+    MutableURL()->ReplaceComponentsInline(rep);
     
     // can't keep the IRI up to date
     _pureIRI.clear();
 }
 void IRI::AddPathComponent(const string& component)
 {
-    std::string path(_url->path());
+    GURL* url = MutableURL();
+    std::string path(url->path());
     if ( path[path.size()-1] != '/' )
         path += '/';
     path += component.stl_str();
     
     url_canon::Replacements<char> rep;
     rep.SetPath(path.c_str(), url_parse::Component(0, static_cast<int>(path.size())));
-    _url->ReplaceComponentsInline(rep);
+    url->ReplaceComponentsInline(rep);
     
-    if ( !_pureIRI.empty() && !_url->has_query() && !_url->has_ref() )
+    if ( !_pureIRI.empty() && !url->has_query() && !url->has_ref() )
     {
         if ( _pureIRI[_pureIRI.size()-1] != U'/' )
             _pureIRI += '/';
@@ -194,7 +309,7 @@ void IRI::SetQuery(const string& query)
 {
     url_canon::Replacements<char> rep;
     rep.SetQuery(query.c_str(), ComponentForString(query));
-    _url->ReplaceComponentsInline(rep);
+    MutableURL()->ReplaceComponentsInline(rep);
     
     if ( _pureIRI.empty() )
         return;
@@ -224,7 +339,7 @@ void IRI::SetFragment(const string& fragment)
 {
     url_canon::Replacements<char> rep;
     rep.SetRef(fragment.c_str(), ComponentForString(fragment));
-    _url->ReplaceComponentsInline(rep);
+    MutableURL()->ReplaceComponentsInline(rep);
     
     string::size_type pos = _pureIRI.rfind('#');
     if ( pos != string::npos )
@@ -286,10 +401,12 @@ string IRI::IRIString() const
 {
     if ( !_pureIRI.empty() )
         return _pureIRI;
+    if ( _url == nullptr && _atom != nullptr )
+        return _atom->iri;
     
     // we'll have to reverse-engineer it, grr
     string uri(URIString());
-    std::string plainHost(_url->host());
+    std::string plainHost(URL().host());
     
     url_canon::RawCanonOutputW<256> idnDecoded;
     const string16 idnSrc = string(plainHost).utf16string();
@@ -308,7 +425,9 @@ string IRI::IRIString() const
 }
 string IRI::URIString() const
 {
-    return _url->spec();
+    if ( _url == nullptr && _atom != nullptr )
+        return (_atom->valid ? _atom->spec : std::string());
+    return URL().spec();
 }
 
 EPUB3_END_NAMESPACE
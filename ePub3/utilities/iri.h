@@ -62,7 +62,7 @@ public:
 public:
     ///
     /// Initializes an empty (and thus invalid) IRI.
-    IRI() : _urnComponents(), _url(nullptr), _pureIRI() {}
+    IRI() : _urnComponents(), _url(nullptr), _atom(nullptr), _pureIRI() {}
     
     /**
      Create a new IRI.
@@ -99,14 +99,30 @@ public:
     
     ///
     /// Create a copy of an existing IRI.
-    IRI(const IRI& o) : _urnComponents(o._urnComponents), _url(new GURL(*o._url)), _pureIRI(o._pureIRI) {}
+    IRI(const IRI& o) : _urnComponents(o._urnComponents), _url(o._url == nullptr ? nullptr : new GURL(*o._url)), _atom(o._atom), _pureIRI(o._pureIRI) {}
     
     ///
     /// C++11 move-constructor.
-    IRI(IRI&& o) : _urnComponents(std::move(o._urnComponents)), _url(o._url), _pureIRI(std::move(o._pureIRI)) { o._url = nullptr; }
+    IRI(IRI&& o) : _urnComponents(std::move(o._urnComponents)), _url(o._url), _atom(o._atom), _pureIRI(std::move(o._pureIRI)) { o._url = nullptr; o._atom = nullptr; }
     
     virtual ~IRI();
     
+    /**
+     Obtains the process-wide interned copy of an IRI.
+     
+     Each distinct IRI is parsed once, the first time it is interned, and every IRI
+     interned from a string with the same canonical form then shares that one entry.
+     Interned IRIs are cheap to copy, compare equal to one another by identity alone,
+     and only build a full URL object if one of their components is requested.
+     
+     This is meant only for the closed sets of IRIs named by the library itself, such
+     as the properties of the reserved vocabularies: interned entries are never
+     released, and each call takes a process-wide lock. Intern such IRIs once and keep
+     them, rather than interning on every use.
+     @param iriStr A valid URL or IRI string.
+     */
+    static IRI      Interned(const string& iriStr);
+    
     /// @{
     /// @name Assignment
     
@@ -123,6 +139,14 @@ public:
     /// @{
     /// @name Comparators
     
+    ///
+    /// Returns `true` for an empty IRI, as created by the default constructor.
+    bool            IsEmpty()                               const   { return _url == nullptr && _atom == nullptr; }
+    
+    ///
+    /// Returns `true` for an IRI obtained from Interned() which hasn't since been modified.
+    bool            IsInterned()                            const   { return _atom != nullptr; }
+    
     /**
      Compares two IRIs for equality.
      @param o An IRI to compare.
@@ -154,14 +178,14 @@ public:
     
     ///
     /// Returns `true` if the IRI is a URL referencing a relative location.
-    bool            IsRelative() const { return !_url->has_host(); }
+    bool            IsRelative() const { return !URL().has_host(); }
     
     /// @{
     /// @name Component Introspection
     
     ///
     /// Obtains the IRI's scheme component.
-    const string    Scheme() const { return (IsURN() ? _urnComponents[0] : _url->scheme()); }    // simple, because it must ALWAYS be present (even if empty, as for pure fragment IRIs)
+    const string    Scheme() const { return (IsURN() ? _urnComponents[0] : URL().scheme()); }    // simple, because it must ALWAYS be present (even if empty, as for pure fragment IRIs)
     
     ///
     /// Obtains the name-id component of a URN IRI.
@@ -169,7 +193,7 @@ public:
     
     ///
     /// Retrieves the nost component of a URL IRI.
-    const string    Host() const { return _url->host(); }
+    const string    Host() const { return URL().host(); }
     
     ///
     /// Retrieves any credentials attached to an IRI.
@@ -181,7 +205,7 @@ public:
     
     ///
     /// Obtains the port number associated with a URL IRI.
-    int             Port() const { return _url->EffectiveIntPort(); }
+    int             Port() const { return URL().EffectiveIntPort(); }
     
     /**
      Obtains the path component of a URL IRI.
@@ -192,15 +216,15 @@ public:
     
     ///
     /// Retrieves the query portion of a URL IRI, if any.
-    const string    Query() const { return _url->query(); }
+    const string    Query() const { return URL().query(); }
     
     ///
     /// Retrieves any fragment part of a URL IRI.
-    const string    Fragment() const { return _url->ref(); }
+    const string    Fragment() const { return URL().ref(); }
     
     ///
     /// Obtains the last path component of a URL IRI.
-    const string    LastPathComponent() const { return _url->ExtractFileName(); }
+    const string    LastPathComponent() const { return URL().ExtractFileName(); }
     
     /**
      Returns any CFI present in a URL IRI.
@@ -299,10 +323,23 @@ public:
     string          URIString() const;
     
 protected:
+    struct Atom;
+    
     ComponentList   _urnComponents;     ///< The components of a URN.
-    GURL*           _url;               ///< The underlying URL object.
+    GURL*           _url;               ///< The underlying URL object. `nullptr` for interned IRIs, which use their atom's.
+    const Atom*     _atom;              ///< The interned entry for this IRI, if any.
     string          _pureIRI;           ///< A cache of the Unicode IRI string. May be empty.
     
+    ///
+    /// The underlying URL object, which for interned IRIs is built on first use.
+    const GURL&     URL()                                   const;
+    ///
+    /// The canonical URL string, which is what IRIs are compared by.
+    const std::string& Spec()                               const;
+    ///
+    /// Gives this IRI its own URL object, which may then be modified.
+    GURL*           MutableURL();
+    
 };
 
 template <class _CharT, class _Traits>
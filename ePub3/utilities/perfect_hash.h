@@ -0,0 +1,157 @@
+//
+//  perfect_hash.h
+//  ePub3
+//
+//  Copyright (c) 2012-2013 The Readium Foundation and contributors.
+//
+//  The Readium SDK is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#ifndef __ePub3__perfect_hash__
+#define __ePub3__perfect_hash__
+
+#include <ePub3/epub3.h>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string>
+
+EPUB3_BEGIN_NAMESPACE
+
+///
+/// A single term in a PerfectHashTable.
+template <typename _Tp>
+struct VocabularyTerm
+{
+    const char*     name;
+    _Tp             value;
+};
+
+namespace __perfect_hash
+{
+    ///
+    /// 32-bit FNV-1a, usable at compile time.
+    constexpr uint32_t Hash(const char* s, uint32_t h = 2166136261u)
+    {
+        return (*s == '\0' ? h : Hash(s + 1, (h ^ static_cast<uint8_t>(*s)) * 16777619u));
+    }
+
+    ///
+    /// 32-bit FNV-1a, for use at runtime on strings which aren't nul-terminated.
+    inline uint32_t Hash(const char* s, size_t len)
+    {
+        uint32_t h = 2166136261u;
+        for ( size_t i = 0; i < len; i++ )
+            h = (h ^ static_cast<uint8_t>(s[i])) * 16777619u;
+        return h;
+    }
+
+    template <size_t... _I> struct IndexList {};
+    template <size_t _N, size_t... _I> struct MakeIndexList : MakeIndexList<_N-1, _N-1, _I...> {};
+    template <size_t... _I> struct MakeIndexList<0, _I...> { typedef IndexList<_I...> type; };
+}
+
+/**
+ A lookup table for a small, closed set of string keys, built at compile time.
+
+ Every term hashes to its own bucket, so a lookup costs one hash of the candidate
+ string and at most one string comparison. The bucket count is chosen by hand for
+ each vocabulary; IsPerfect() lets a `static_assert` confirm that the chosen count
+ places no two terms in the same bucket.
+
+ @code
+ constexpr VocabularyTerm<int> gTerms[] = { {"one", 1}, {"two", 2} };
+ constexpr PerfectHashTable<int, 2, 3> gTable(gTerms);
+ static_assert(gTable.IsPerfect(), "gTable needs a different bucket count");
+ @endcode
+
+ @remarks The terms array must have static storage duration, as the table refers to
+ it rather than copying it.
+
+ @ingroup utilities
+ */
+template <typename _Tp, size_t _Count, size_t _Buckets>
+class PerfectHashTable
+{
+public:
+    typedef VocabularyTerm<_Tp>     term_type;
+    typedef _Tp                     value_type;
+
+public:
+    constexpr                   PerfectHashTable(const term_type (&terms)[_Count])
+        : PerfectHashTable(terms, typename __perfect_hash::MakeIndexList<_Buckets>::type())
+        {}
+
+    ///
+    /// Returns `true` if no two terms share a bucket.
+    constexpr bool              IsPerfect()                                     const
+        {
+            return Unique(0, 1);
+        }
+
+    ///
+    /// Returns the term matching the given characters, or `nullptr` if there is none.
+    const term_type*            find(const char* s, size_t len)                 const
+        {
+            size_t idx = _slots[__perfect_hash::Hash(s, len) % _Buckets];
+            if ( idx == _Count )
+                return nullptr;
+
+            const term_type& term = _terms[idx];
+            if ( std::strncmp(term.name, s, len) != 0 || term.name[len] != '\0' )
+                return nullptr;
+            return &term;
+        }
+    const term_type*            find(const std::string& s)                      const
+        {
+            return find(s.data(), s.size());
+        }
+
+    bool                        contains(const std::string& s)                  const
+        {
+            return find(s) != nullptr;
+        }
+
+    const term_type*            begin()                                         const   { return _terms; }
+    const term_type*            end()                                           const   { return _terms + _Count; }
+
+private:
+    const term_type             (&_terms)[_Count];
+    size_t                      _slots[_Buckets];   ///< Index of the term in each bucket, or `_Count` if empty.
+
+    template <size_t... _I>
+    constexpr                   PerfectHashTable(const term_type (&terms)[_Count], __perfect_hash::IndexList<_I...>)
+        : _terms(terms), _slots{ TermInBucket(terms, _I, 0)... }
+        {}
+
+    static constexpr size_t     BucketOf(const term_type& term)
+        {
+            return __perfect_hash::Hash(term.name) % _Buckets;
+        }
+    static constexpr size_t     TermInBucket(const term_type (&terms)[_Count], size_t bucket, size_t i)
+        {
+            return (i == _Count ? _Count : (BucketOf(terms[i]) == bucket ? i : TermInBucket(terms, bucket, i + 1)));
+        }
+    constexpr bool              Unique(size_t i, size_t j)                      const
+        {
+            return (i + 1 >= _Count ? true :
+                    (j == _Count ? Unique(i + 1, i + 2) :
+                     (BucketOf(_terms[i]) == BucketOf(_terms[j]) ? false : Unique(i, j + 1))));
+        }
+
+};
+
+EPUB3_END_NAMESPACE
+
+#endif /* defined(__ePub3__perfect_hash__) */
@@ -0,0 +1,238 @@
+//
+//  trace.cpp
+//  ePub3
+//
+//  Copyright (c) 2012-2013 The Readium Foundation and contributors.
+//
+//  The Readium SDK is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#include "trace.h"
+#include <libxml/xmlmemory.h>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+
+EPUB3_BEGIN_NAMESPACE
+
+#if EPUB_COMPILER(MSVC)
+# define TRACE_THREAD_LOCAL __declspec(thread)
+#else
+# define TRACE_THREAD_LOCAL __thread
+#endif
+
+// running totals for each thread; a phase's counts are the change over its lifetime
+static TRACE_THREAD_LOCAL uint64_t tAllocations = 0;
+static TRACE_THREAD_LOCAL uint64_t tAllocatedBytes = 0;
+static TRACE_THREAD_LOCAL uint64_t tBytesRead = 0;
+static TRACE_THREAD_LOCAL uint32_t tDepth = 0;
+static TRACE_THREAD_LOCAL uint32_t tThread = 0;         // assigned when the thread first reports a phase
+
+static std::atomic<bool> gEnabled(false);
+static std::atomic<uint32_t> gNextThread(1);
+static std::mutex gObserverLock;
+static std::shared_ptr<Trace::Observer> gObserver;
+static const std::chrono::steady_clock::time_point gEpoch(std::chrono::steady_clock::now());
+
+// libxml2's own allocator, which ours forward to
+static xmlFreeFunc gXmlFree = nullptr;
+static xmlMallocFunc gXmlMalloc = nullptr;
+static xmlReallocFunc gXmlRealloc = nullptr;
+static xmlStrdupFunc gXmlStrdup = nullptr;
+
+static void* CountingMalloc(size_t size)
+{
+    Trace::CountAllocation(size);
+    return gXmlMalloc(size);
+}
+static void* CountingRealloc(void* ptr, size_t size)
+{
+    Trace::CountAllocation(size);
+    return gXmlRealloc(ptr, size);
+}
+static char* CountingStrdup(const char* str)
+{
+    Trace::CountAllocation(std::strlen(str) + 1);
+    return gXmlStrdup(str);
+}
+
+// done once, at library initialization, and never undone: memory may be freed long
+//  after tracing stops, and swapping allocators while another thread is parsing would
+//  race with it
+void Trace::Initialize()
+{
+    static std::once_flag once;
+    std::call_once(once, []() {
+        if ( xmlMemGet(&gXmlFree, &gXmlMalloc, &gXmlRealloc, &gXmlStrdup) == 0 )
+            xmlMemSetup(gXmlFree, CountingMalloc, CountingRealloc, CountingStrdup);
+    });
+}
+
+static uint64_t Now()
+{
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - gEpoch).count());
+}
+
+Trace::Scope::Scope(const char* name) : _name(name), _detail(), _active(false)
+{
+    Begin();
+}
+Trace::Scope::Scope(const char* name, const string& detail) : _name(name), _detail(), _active(false)
+{
+    Begin();
+    if ( _active )
+        _detail = detail.stl_str();
+}
+Trace::Scope::~Scope()
+{
+    if ( !_active )
+        return;
+
+    uint64_t end = Now();
+    tDepth--;
+
+    std::shared_ptr<Observer> observer;
+    {
+        std::lock_guard<std::mutex> _(gObserverLock);
+        observer = gObserver;
+    }
+    if ( !observer )
+        return;
+
+    if ( tThread == 0 )
+        tThread = gNextThread++;
+
+    TracePhase phase = {
+        _name, std::move(_detail), _start, end - _start,
+        tAllocations - _allocations, tAllocatedBytes - _allocatedBytes, tBytesRead - _bytesRead,
+        tThread, tDepth
+    };
+
+    try
+    {
+        (*observer)(phase);
+    }
+    catch (...)
+    {
+        // we're in a destructor; an observer's failure mustn't take the load down with it
+    }
+}
+void Trace::Scope::Begin()
+{
+    if ( !gEnabled.load(std::memory_order_acquire) )
+        return;
+
+    _active = true;
+    _allocations = tAllocations;
+    _allocatedBytes = tAllocatedBytes;
+    _bytesRead = tBytesRead;
+    tDepth++;
+    _start = Now();
+}
+
+void Trace::SetObserver(Observer observer)
+{
+    std::lock_guard<std::mutex> _(gObserverLock);
+    if ( observer )
+        gObserver = std::make_shared<Observer>(std::move(observer));
+    else
+        gObserver.reset();
+    gEnabled.store(bool(gObserver), std::memory_order_release);
+}
+bool Trace::Enabled()
+{
+    return gEnabled.load(std::memory_order_relaxed);
+}
+void Trace::CountBytesRead(size_t count)
+{
+    if ( gEnabled.load(std::memory_order_relaxed) )
+        tBytesRead += count;
+}
+void Trace::CountAllocation(size_t size)
+{
+    if ( gEnabled.load(std::memory_order_relaxed) )
+    {
+        tAllocations++;
+        tAllocatedBytes += size;
+    }
+}
+
+Trace::Observer TraceRecorder::Observer()
+{
+    return [this](const TracePhase& phase) {
+        Record(phase);
+    };
+}
+void TraceRecorder::Record(const TracePhase& phase)
+{
+    std::lock_guard<std::mutex> _(_lock);
+    _phases.push_back(phase);
+}
+std::vector<TracePhase> TraceRecorder::Phases() const
+{
+    std::lock_guard<std::mutex> _(_lock);
+    return _phases;
+}
+void TraceRecorder::Clear()
+{
+    std::lock_guard<std::mutex> _(_lock);
+    _phases.clear();
+}
+
+static void WriteJSONString(std::ostream& out, const char* str, size_t len)
+{
+    out << '"';
+    for ( size_t i = 0; i < len; i++ )
+    {
+        unsigned char ch = static_cast<unsigned char>(str[i]);
+        if ( ch == '"' || ch == '\\' )
+        {
+            out << '\\' << static_cast<char>(ch);
+        }
+        else if ( ch < 0x20 )
+        {
+            char buf[8];
+            snprintf(buf, sizeof(buf), "\\u%04x", ch);
+            out << buf;
+        }
+        else
+        {
+            out << static_cast<char>(ch);
+        }
+    }
+    out << '"';
+}
+void TraceRecorder::WriteChromeTrace(std::ostream& out) const
+{
+    std::lock_guard<std::mutex> _(_lock);
+
+    // complete ('X') events; the viewer nests them on each thread by their times
+    out << "{\"traceEvents\":[";
+    for ( size_t i = 0; i < _phases.size(); i++ )
+    {
+        const TracePhase& phase = _phases[i];
+        out << (i == 0 ? "\n" : ",\n") << "{\"name\":";
+        WriteJSONString(out, phase.name, std::strlen(phase.name));
+        out << ",\"cat\":\"epub3\",\"ph\":\"X\",\"ts\":" << phase.start << ",\"dur\":" << phase.duration;
+        out << ",\"pid\":1,\"tid\":" << phase.thread << ",\"args\":{\"detail\":";
+        WriteJSONString(out, phase.detail.data(), phase.detail.size());
+        out << ",\"allocations\":" << phase.allocations << ",\"allocatedBytes\":" << phase.allocatedBytes;
+        out << ",\"bytesRead\":" << phase.bytesRead << "}}";
+    }
+    out << "\n],\"displayTimeUnit\":\"ms\"}\n";
+}
+
+EPUB3_END_NAMESPACE
@@ -0,0 +1,209 @@
+//
+//  trace.h
+//  ePub3
+//
+//  Copyright (c) 2012-2013 The Readium Foundation and contributors.
+//
+//  The Readium SDK is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#ifndef __ePub3__trace__
+#define __ePub3__trace__
+
+#include <ePub3/epub3.h>
+#include <ePub3/utilities/utfstring.h>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <vector>
+
+EPUB3_BEGIN_NAMESPACE
+
+/**
+ The cost of a single phase of work, such as parsing a package's manifest.
+
+ Counts include the work of any phases nested within this one on the same thread.
+
+ @ingroup utilities
+ */
+struct TracePhase
+{
+    const char*     name;           ///< The phase, such as `"Package::Manifest"`.
+    std::string     detail;         ///< What the phase worked on, such as a file path. May be empty.
+    uint64_t        start;          ///< When the phase began, in microseconds since the library was loaded.
+    uint64_t        duration;       ///< Wall time, in microseconds.
+    uint64_t        allocations;    ///< Allocations made by libxml2 and by package arenas.
+    uint64_t        allocatedBytes; ///< The bytes requested by those allocations.
+    uint64_t        bytesRead;      ///< Uncompressed bytes read from archives.
+    uint32_t        thread;         ///< A small number identifying the thread which did the work.
+    uint32_t        depth;          ///< The number of phases enclosing this one on its thread.
+};
+
+/**
+ Instrumentation for the phases of opening a Container and its Packages.
+
+ Tracing is off until an observer is installed, and costs a single test per phase
+ and per archive read while it remains off. Once on, each phase listed below is
+ timed, and the allocations and archive reads made on its thread are counted, and
+ the result is passed to the observer when the phase ends.
+
+ - `Archive::Open`
+ - `Container::ParseContainerXML`
+ - `Container::LoadEncryption`
+ - `Package::Open`, which encloses all of the following:
+ - `Package::RestoreSnapshot`
+ - `Package::ReadOPF`, which includes schema validation
+ - `Package::StreamOPF`, which takes the place of ReadOPF and the manifest, spine,
+   and metadata phases when the streaming parser is in use
+ - `Package::Manifest`
+ - `Package::Spine`
+ - `Package::Metadata`
+ - `Package::NavigationTables`
+ - `Package::InitMediaSupport`
+ - `Package::WriteSnapshot`
+
+ Packages are loaded in parallel, so the observer may be called from several
+ threads at once.
+
+ @remarks Allocations are counted by wrapping libxml2's allocator, which is done
+ once by Archive::Initialize(), before anything has been parsed. If the library has
+ not been initialized, libxml2's allocations are not counted.
+
+ @ingroup utilities
+ */
+class Trace
+{
+public:
+    ///
+    /// The type of the function which receives each phase as it ends.
+    typedef std::function<void(const TracePhase&)>  Observer;
+
+    /**
+     Records the duration and resource use of a phase, from its construction to its
+     destruction.
+     */
+    class Scope
+    {
+    public:
+        ///
+        /// Begins a phase. `name` must be a string literal.
+                    Scope(const char* name);
+        ///
+        /// Begins a phase, noting what it is working on.
+                    Scope(const char* name, const string& detail);
+                    Scope(const Scope&)         = delete;
+                    Scope(Scope&&)              = delete;
+        ///
+        /// Ends the phase and reports it to the observer.
+                    ~Scope();
+
+    private:
+        const char* _name;
+        std::string _detail;
+        bool        _active;
+        uint64_t    _start;
+        uint64_t    _allocations;
+        uint64_t    _allocatedBytes;
+        uint64_t    _bytesRead;
+
+        void        Begin();
+    };
+
+public:
+    /**
+     Wraps libxml2's allocator so that allocations can be counted.
+     
+     This is called by Archive::Initialize(), and must run before any other thread
+     uses libxml2. Later calls do nothing.
+     */
+    static void     Initialize();
+
+    /**
+     Installs the observer which receives every phase, replacing any existing one.
+     @param observer The new observer, or `nullptr` to turn tracing off.
+     */
+    static void     SetObserver(Observer observer);
+
+    ///
+    /// Returns `true` while an observer is installed.
+    static bool     Enabled();
+
+    ///
+    /// Notes that an archive reader produced `count` bytes on the current thread.
+    static void     CountBytesRead(size_t count);
+
+    ///
+    /// Notes an allocation of `size` bytes on the current thread.
+    static void     CountAllocation(size_t size);
+
+};
+
+/**
+ An observer which keeps every phase it is given, and can write them out in the
+ Chrome trace-event format.
+
+ @code
+ TraceRecorder recorder;
+ Trace::SetObserver(recorder.Observer());
+ Container container(path);
+ Trace::SetObserver(nullptr);
+ recorder.WriteChromeTrace(std::cout);
+ @endcode
+
+ The recorder must outlive its installation as the observer.
+
+ @ingroup utilities
+ */
+class TraceRecorder
+{
+public:
+                            TraceRecorder() : _lock(), _phases() {}
+                            TraceRecorder(const TraceRecorder&)     = delete;
+                            TraceRecorder(TraceRecorder&&)          = delete;
+                            ~TraceRecorder() {}
+
+    ///
+    /// Returns an observer which adds phases to this recorder.
+    Trace::Observer         Observer();
+
+    ///
+    /// Adds a phase.
+    void                    Record(const TracePhase& phase);
+
+    ///
+    /// Returns a copy of every phase recorded so far, in the order they ended.
+    std::vector<TracePhase> Phases()                                const;
+
+    ///
+    /// Discards every phase recorded so far.
+    void                    Clear();
+
+    /**
+     Writes every phase recorded so far as a JSON document which may be loaded
+     into `chrome://tracing`.
+     @see https://docs.google.com/document/d/1CvAClvFfyA5R-PhYUmn5OOQtYMH4h6I0nSsKchNAySU
+     */
+    void                    WriteChromeTrace(std::ostream& out)     const;
+
+private:
+    mutable std::mutex      _lock;
+    std::vector<TracePhase> _phases;
+
+};
+
+EPUB3_END_NAMESPACE
+
+#endif /* defined(__ePub3__trace__) */
@@ -113,7 +113,7 @@ public:
     
     // From std::string
     string(const __base &o) : _base(o) {}
-    string(__base &&o) : _base(o) {}
+    string(__base &&o) : _base(std::move(o)) {}
     string(const __base &s, size_type i, size_type n=npos);
     
     // From char
@@ -107,7 +107,7 @@ EPUB3_XML_BEGIN_NAMESPACE
 Document::Document(const string & version) : Document(xmlNewDoc(version.utf8()))
 {
 }
-Document::Document(xmlDocPtr doc) : Node(reinterpret_cast<xmlNodePtr>(doc))
+Document::Document(xmlDocPtr doc) : Node(reinterpret_cast<xmlNodePtr>(doc)), _wrappers(new Arena(4096))
 {
     if ( _xml == nullptr )
         throw InternalError("Failed to create new document");
@@ -121,8 +121,12 @@ Document::Document(Element * rootElement) : Document("1.0")
 }
 Document::~Document()
 {
+    // this detaches the pooled wrappers from their nodes, and frees any detached nodes
+    //  while the document they came from still exists
+    _wrappers.reset();
+    
     xmlDocPtr doc = xml();
-    Unwrap(_xml);
+    doc->_private = nullptr;
     _xml = nullptr;
     xmlFreeDoc(doc);
 }
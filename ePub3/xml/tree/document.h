@@ -26,6 +26,8 @@
 #include <ePub3/xml/element.h>
 #include <ePub3/xml/io.h>
 #include <ePub3/xml/c14n.h>
+#include <ePub3/utilities/arena.h>
+#include <memory>
 
 EPUB3_XML_BEGIN_NAMESPACE
 
@@ -98,6 +100,33 @@ public:
     
     string XMLString() const { string __s; WriteXML(__s); return std::move(__s); }
     
+protected:
+    ///
+    /// Wrappers for this document's nodes, all destroyed before the document is freed.
+    std::unique_ptr<Arena>  _wrappers;
+    
+    /**
+     Creates a wrapper for a node, in its Document's pool if it belongs to one.
+     
+     Nodes in a document with no Document object get an individually-allocated
+     wrapper, which is deleted when the node is freed.
+     */
+    template <class _Tp>
+    static _Tp * NewWrapper(_xmlNode * aNode)
+        {
+            class Document * owner = nullptr;
+            if ( aNode->doc != nullptr && reinterpret_cast<_xmlNode*>(aNode->doc) != aNode )
+                owner = reinterpret_cast<class Document*>(aNode->doc->_private);
+            if ( owner == nullptr || !owner->_wrappers )
+                return new _Tp(aNode);
+            
+            _Tp * result = owner->_wrappers->New<_Tp>(aNode);
+            static_cast<Node*>(result)->_pooled = true;
+            return result;
+        }
+    
+    friend class Node;
+    
 };
 
 EPUB3_XML_END_NAMESPACE
@@ -46,6 +46,13 @@ public:
     virtual ~Element() {}
 };
 
+// element wrappers are created by Node::Wrap(), so they come from the Document's pool
+template <>
+inline Element * Wrapped<Element, _xmlNode>(xmlNode * n)
+{
+    return dynamic_cast<Element*>(Wrapped<Node, _xmlNode>(n));
+}
+
 EPUB3_XML_END_NAMESPACE
 
 #endif /* defined(__ePub3__element__) */
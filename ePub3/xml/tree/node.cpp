@@ -66,11 +66,11 @@ std::string TypeString(NodeType type)
     return r;
 }
 
-Node::Node(_xmlNode *xml) : _xml(xml)
+Node::Node(_xmlNode *xml) : _xml(xml), _pooled(false)
 {
     _xml->_private = this;
 }
-Node::Node(const string & name, NodeType type, const string & content, const class Namespace & ns)
+Node::Node(const string & name, NodeType type, const string & content, const class Namespace & ns) : _pooled(false)
 {
     _xmlNode * newNode = nullptr;
     
@@ -118,18 +118,20 @@ Node::Node(const string & name, NodeType type, const string & content, const cla
     _xml = newNode;
     _xml->_private = this;
 }
-Node::Node(Node && o) : _xml(o._xml) {
+Node::Node(Node && o) : _xml(o._xml), _pooled(false) {
     _xml->_private = this;
     o._xml = NULL;
 }
 Node::~Node()
 {
-    if ( _xml->_private != this )
+    if ( _xml == nullptr || _xml->_private != this )
         return;
     
     // free the underlying node if *and only if* it is detached
     if ( _xml->parent == nullptr && _xml->prev == nullptr && _xml->next == nullptr )
         xmlFreeNode(_xml);
+    else
+        _xml->_private = nullptr;
 }
 
 #pragma mark - Properties
@@ -255,10 +257,12 @@ string Node::XMLString() const
 }
 string Node::StringValue() const
 {
-    const xmlChar * content = xmlNodeGetContent(_xml);
+    xmlChar * content = xmlNodeGetContent(_xml);
     if ( content == nullptr )
         return string();
-    return content;
+    string r(content);
+    xmlFree(content);
+    return r;
 }
 int Node::IntValue() const
 {
@@ -293,7 +297,7 @@ Node * Node::NextSibling()
 {
     if ( _xml->next == nullptr )
         return nullptr;
-    return Wrapped<Node, _xmlNode>(_xml);
+    return Wrapped<Node, _xmlNode>(_xml->next);
 }
 const Node * Node::NextSibling() const
 {
@@ -331,17 +335,11 @@ const Node * Node::FirstChild(const string & filterByName) const
 {
     return const_cast<Node*>(this)->FirstChild(filterByName);
 }
-Node::NodeList Node::Children(const string & filterByName)
+Node::ChildRange Node::Children(const string & filterByName)
 {
-    NodeList list;
-    for ( xmlNodePtr child = _xml->children; child != nullptr; child = child->next )
-    {
-        if ( filterByName.empty() || filterByName == child->name )
-            list.push_back(Wrapped<Node, _xmlNode>(child));
-    }
-    return list;
+    return ChildRange(_xml, filterByName);
 }
-const Node::NodeList Node::Children(const string & filterByName) const
+const Node::ChildRange Node::Children(const string & filterByName) const
 {
     return const_cast<Node*>(this)->Children(filterByName);
 }
@@ -477,14 +475,15 @@ WrapperBase * Node::Wrap(_xmlNode *aNode)
             
         case XML_ATTRIBUTE_NODE:
             //wrapper = new Attribute(reinterpret_cast<xmlAttrPtr>(aNode));
+            wrapper = xml::Document::NewWrapper<Node>(aNode);
             break;
             
         case XML_ELEMENT_NODE:
-            //wrapper = new Element(aNode);
+            wrapper = xml::Document::NewWrapper<Element>(aNode);
             break;
             
         default:
-            wrapper = new Node(aNode);
+            wrapper = xml::Document::NewWrapper<Node>(aNode);
             break;
     }
     
@@ -504,6 +503,15 @@ void Node::Unwrap(_xmlNode *aNode)
     
     WrapperBase * obj = reinterpret_cast<WrapperBase*>(aNode->_private);
     aNode->_private = nullptr;
+    
+    // pooled wrappers live until their Document goes away
+    Node * node = (aNode->type == XML_NAMESPACE_DECL ? nullptr : dynamic_cast<Node*>(obj));
+    if ( node != nullptr && node->_pooled )
+    {
+        node->_xml = nullptr;
+        return;
+    }
+    
     delete obj;
 }
 xmlNodePtr Node::createChild(const string &name, const string &prefix) const
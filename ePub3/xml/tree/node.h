@@ -26,8 +26,8 @@
 #include <ePub3/xml/ns.h>
 #include <ePub3/utilities/utfstring.h>
 #include <libxml/xpath.h>
+#include <iterator>
 #include <string>
-#include <list>
 #include <map>
 #include <vector>
 
@@ -81,7 +81,7 @@ std::string TypeString(NodeType type);
 class Node : public WrapperBase
 {
 public:
-    typedef std::list<Node*>                    NodeList;
+    class ChildRange;
     
     class InvalidNodeType : public exception
     {
@@ -157,13 +157,13 @@ public:
     Node * NextSibling();
     Node * PreviousSibling();
     Node * FirstChild(const string & filterByName = string());
-    NodeList Children(const string & filterByName = string());
+    ChildRange Children(const string & filterByName = string());
     
     const Element * Parent() const;
     const Node * NextSibling() const;
     const Node * PreviousSibling() const;
     const Node * FirstChild(const string & filterByName = string()) const;
-    const NodeList Children(const string & filterByName = string()) const;
+    const ChildRange Children(const string & filterByName = string()) const;
     
     Element * AddChild(const string & name, const string & prefix = string());
     void AddChild(Node * child);
@@ -190,11 +190,15 @@ public:
     ///////////////////////////////////////////////////////
     // Wrapper Factory
     
+    // Wrappers are created on first use. Those for nodes in a document owned by a
+    // Document object are allocated from that Document's pool and are destroyed
+    // along with it; they must never be deleted directly.
     static WrapperBase * Wrap(_xmlNode * xml);
     static void Unwrap(_xmlNode * xml);
     
 protected:
     _xmlNode *  _xml;
+    bool        _pooled;    ///< Allocated from a Document's wrapper pool.
     
     xmlNodePtr createChild(const string & name, const string & prefix) const;
     void rebind(_xmlNode * newNode);
@@ -210,12 +214,63 @@ template <>
 inline Node * Wrapped<Node, _xmlNode>(xmlNode * n)
 {
     if ( n == nullptr ) return nullptr;
-    if ( n->_private == nullptr ) return reinterpret_cast<Node*>(n->_private);
+    if ( n->_private != nullptr ) return dynamic_cast<Node*>(reinterpret_cast<WrapperBase*>(n->_private));
     
     // Node::Wrap() instantiates the correct WrapperBase subclass
     return dynamic_cast<Node*>(Node::Wrap(n));
 }
 
+/**
+ A lazily-evaluated view of a node's children, optionally only those with a given name.
+ 
+ Iterating it allocates nothing beyond the children's wrappers, which are created (or
+ reused) one at a time as the iteration reaches them. The iterators refer to the range
+ itself, so the range must outlive them; this is always the case in a range-based `for`.
+ @ingroup tree
+ */
+class Node::ChildRange
+{
+public:
+    class iterator : public std::iterator<std::forward_iterator_tag, Node*>
+    {
+    public:
+        iterator() : _cur(nullptr), _filter(nullptr) {}
+        iterator(_xmlNode * first, const string * filter) : _cur(first), _filter(filter) { skip(); }
+        
+        Node * operator*() const { return Wrapped<Node, _xmlNode>(_cur); }
+        iterator & operator++() { _cur = _cur->next; skip(); return *this; }
+        iterator operator++(int) { iterator __r(*this); ++(*this); return __r; }
+        
+        bool operator==(const iterator & o) const { return _cur == o._cur; }
+        bool operator!=(const iterator & o) const { return _cur != o._cur; }
+        
+        _xmlNode * xml() const { return _cur; }
+        
+    private:
+        _xmlNode *      _cur;
+        const string *  _filter;
+        
+        void skip() {
+            if ( _filter == nullptr || _filter->empty() )
+                return;
+            while ( _cur != nullptr && !(*_filter == _cur->name) )
+                _cur = _cur->next;
+        }
+    };
+    typedef iterator const_iterator;
+    
+    ChildRange(_xmlNode * parent, const string & filterByName) : _parent(parent), _filter(filterByName) {}
+    
+    iterator begin() const { return iterator(_parent->children, &_filter); }
+    iterator end() const { return iterator(); }
+    bool empty() const { return begin() == end(); }
+    
+private:
+    _xmlNode *  _parent;
+    string      _filter;
+    
+};
+
 EPUB3_XML_END_NAMESPACE
 
 #endif /* defined(__ePub3_xml_node__) */
@@ -267,19 +267,8 @@ ePub3::xml::NodeSet XPathEvaluator::NodeSetResult() const throw(ePub3::xml::Inte
     
     for ( int i = 0; i < xmlXPathNodeSetGetLength(ns); i++ )
     {
-        xmlNodePtr xml = xmlXPathNodeSetItem(ns, i);
-        if ( xml->_private != nullptr )
-        {
-            Node * node = reinterpret_cast<Node*>(xml->_private);
-            if ( typeid(*node) == typeid(Node) )
-            {
-                nodes.push_back(node);
-                continue;
-            }
-        }
-        
-        // need to build a wrapper
-        nodes.push_back(new Node(xml));
+        // reuses the node's existing wrapper, if any
+        nodes.push_back(Wrapped<Node, _xmlNode>(xmlXPathNodeSetItem(ns, i)));
     }
     
     return nodes;
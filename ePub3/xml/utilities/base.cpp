@@ -30,16 +30,11 @@
 
 EPUB3_XML_BEGIN_NAMESPACE
 
-static xmlRegisterNodeFunc defNodeRegister = nullptr;
-static xmlRegisterNodeFunc defThrNodeRegister = nullptr;
 static xmlDeregisterNodeFunc defNodeDeregister = nullptr;
 static xmlDeregisterNodeFunc defThrNodeDeregister = nullptr;
 
-static void __registerNode(xmlNodePtr aNode)
-{
-    Node::Wrap(aNode);
-}
-
+// Wrappers are created lazily by Wrapped<>(), so there's nothing to do as nodes are
+//  created; they only need to be cleaned up when the nodes go away.
 static void __deregisterNode(xmlNodePtr aNode)
 {
     Node::Unwrap(aNode);
@@ -49,8 +44,6 @@ __attribute__((constructor))
 static void __setupLibXML(void)
 {
     xmlInitGlobals();
-    defNodeRegister = xmlRegisterNodeDefault(&__registerNode);
-    defThrNodeDeregister = xmlThrDefRegisterNodeDefault(&__registerNode);
     defNodeDeregister = xmlDeregisterNodeDefault(&__deregisterNode);
     defThrNodeDeregister = xmlThrDefDeregisterNodeDefault(&__deregisterNode);
     
@@ -61,8 +54,6 @@ static void __setupLibXML(void)
 __attribute__((destructor))
 static void __resetLibXMLOverrides(void)
 {
-    xmlRegisterNodeDefault(defNodeRegister);
-    xmlThrDefRegisterNodeDefault(defThrNodeRegister);
     xmlDeregisterNodeDefault(defNodeDeregister);
     xmlThrDefDeregisterNodeDefault(defThrNodeDeregister);
     
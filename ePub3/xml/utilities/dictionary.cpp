@@ -0,0 +1,127 @@
+//
+//  dictionary.cpp
+//  ePub3
+//
+//  Copyright (c) 2012-2013 The Readium Foundation and contributors.
+//
+//  The Readium SDK is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#include "dictionary.h"
+
+EPUB3_XML_BEGIN_NAMESPACE
+
+// names which turn up in almost every document we parse
+static const char* const gVocabularyNames[] = {
+    // parser-internal
+    "xml", "xmlns", "http://www.w3.org/XML/1998/namespace", "lang", "space", "base",
+
+    // OCF
+    "container", "rootfiles", "rootfile", "full-path", "media-type", "version",
+    "encryption", "EncryptedData", "EncryptionMethod", "Algorithm", "KeyInfo",
+    "CipherData", "CipherReference", "URI",
+
+    // OPF
+    "package", "unique-identifier", "prefix", "metadata", "meta", "link", "property",
+    "refines", "scheme", "rel", "manifest", "item", "id", "href", "properties",
+    "fallback", "media-overlay", "spine", "itemref", "idref", "linear", "toc",
+    "page-progression-direction", "guide", "reference", "bindings", "mediaType",
+    "handler", "collection", "content", "name",
+
+    // Dublin Core
+    "identifier", "title", "language", "contributor", "coverage", "creator", "date",
+    "description", "format", "publisher", "relation", "rights", "source", "subject",
+    "type",
+
+    // NCX
+    "ncx", "head", "docTitle", "docAuthor", "navMap", "navPoint", "navLabel", "text",
+    "playOrder", "pageList", "pageTarget", "navList", "navTarget", "value", "src",
+
+    // XHTML
+    "html", "body", "style", "script", "nav", "section", "article", "aside",
+    "header", "footer", "main", "div", "span", "p", "a", "img", "br", "hr", "h1", "h2",
+    "h3", "h4", "h5", "h6", "ol", "ul", "li", "dl", "dt", "dd", "table", "thead",
+    "tbody", "tfoot", "tr", "th", "td", "caption", "col", "colgroup", "em", "strong",
+    "b", "i", "u", "s", "small", "sub", "sup", "cite", "code", "pre", "blockquote",
+    "q", "abbr", "figure", "figcaption", "object", "param", "embed", "iframe", "audio",
+    "video", "track", "switch", "case", "default", "trigger",
+    "class", "alt", "width", "height", "dir", "charset", "http-equiv", "required-namespace",
+    "epub", "xlink", "svg", "g", "path", "rect", "image", "use", "viewBox",
+    "preserveAspectRatio",
+};
+
+static xmlDictPtr gVocabulary = nullptr;
+static std::once_flag gVocabularyOnce;
+
+Dictionary::Dictionary() : _dict(xmlDictCreateSub(Vocabulary()))
+{
+    if ( _dict == nullptr )
+        throw InternalError("Failed to create xml dictionary");
+}
+Dictionary::~Dictionary()
+{
+    // documents hold their own references, so this may not actually free it yet
+    xmlDictFree(_dict);
+}
+xmlDictPtr Dictionary::Vocabulary()
+{
+    std::call_once(gVocabularyOnce, []() {
+        xmlDictPtr dict = xmlDictCreate();
+        for ( const char* name : gVocabularyNames )
+        {
+            xmlDictLookup(dict, BAD_CAST name, -1);
+        }
+        gVocabulary = dict;     // lives for the rest of the process
+    });
+    return gVocabulary;
+}
+void Dictionary::AttachToContext(xmlParserCtxtPtr ctxt, xmlDictPtr dict)
+{
+    if ( ctxt->dict == dict )
+        return;
+
+    if ( ctxt->dict != nullptr )
+        xmlDictFree(ctxt->dict);
+
+    xmlDictReference(dict);
+    ctxt->dict = dict;
+
+    // the parser compares these by address, so they must come from the new dictionary
+    ctxt->str_xml = xmlDictLookup(dict, BAD_CAST "xml", 3);
+    ctxt->str_xmlns = xmlDictLookup(dict, BAD_CAST "xmlns", 5);
+    ctxt->str_xml_ns = xmlDictLookup(dict, XML_XML_NAMESPACE, 36);
+}
+void Dictionary::UseWithContext(xmlParserCtxtPtr ctxt, xmlDictPtr dict)
+{
+    if ( dict != nullptr )
+    {
+        AttachToContext(ctxt, dict);
+        return;
+    }
+    
+    // a private dictionary, which the document will own
+    xmlDictPtr sub = xmlDictCreateSub(Vocabulary());
+    if ( sub == nullptr )
+        return;     // stick with the context's own
+    
+    AttachToContext(ctxt, sub);
+    xmlDictFree(sub);
+}
+size_t Dictionary::Size() const
+{
+    std::lock_guard<std::mutex> _(_lock);
+    return static_cast<size_t>(xmlDictSize(_dict)) - static_cast<size_t>(xmlDictSize(Vocabulary()));
+}
+
+EPUB3_XML_END_NAMESPACE
@@ -0,0 +1,103 @@
+//
+//  dictionary.h
+//  ePub3
+//
+//  Copyright (c) 2012-2013 The Readium Foundation and contributors.
+//
+//  The Readium SDK is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#ifndef __ePub3_xml_dictionary__
+#define __ePub3_xml_dictionary__
+
+#include <ePub3/xml/base.h>
+#include <libxml/dict.h>
+#include <libxml/parser.h>
+#include <mutex>
+
+EPUB3_XML_BEGIN_NAMESPACE
+
+/**
+ A libxml2 string dictionary shared between several documents.
+
+ Every libxml2 parse interns its element and attribute names in a dictionary, which
+ by default is created afresh for each document. A Dictionary lets a group of
+ documents-- such as all those belonging to one Package-- share a single one, so
+ that names common to all of them are stored only once.
+
+ Each Dictionary is backed by the process-wide Vocabulary(), which is filled with
+ the names used by OPF, NCX, OCF, and XHTML documents when it is first used and is
+ never modified afterwards. Since it is read-only, it is safe to share between any
+ number of threads and documents; each Dictionary only stores the names which are
+ not already found there.
+
+ @remarks libxml2 dictionaries are not thread-safe. All parsing with, and freeing of,
+ documents which use a Dictionary must be done while holding its Lock().
+
+ @ingroup xml-utils
+ */
+class Dictionary
+{
+public:
+                        Dictionary();
+                        Dictionary(const Dictionary&)   = delete;
+                        Dictionary(Dictionary&&)        = delete;
+    virtual             ~Dictionary();
+
+    /**
+     The process-wide dictionary of common names.
+
+     The result must not be used directly for parsing, since libxml2 would add to it;
+     create a child using `xmlDictCreateSub()` instead.
+     */
+    static xmlDictPtr   Vocabulary();
+
+    /**
+     Makes a parser context intern its names in a given dictionary.
+
+     This must be called before anything is parsed using the context.
+     @param ctxt The parser context.
+     @param dict The dictionary to use. The context takes its own reference.
+     */
+    static void         AttachToContext(xmlParserCtxtPtr ctxt, xmlDictPtr dict);
+    
+    /**
+     Makes a parser context intern its names in a given dictionary, or in a new
+     child of the Vocabulary() which the resulting document will own.
+     @param ctxt The parser context, which has not yet parsed anything.
+     @param dict The dictionary to use, or `nullptr` for a private one.
+     */
+    static void         UseWithContext(xmlParserCtxtPtr ctxt, xmlDictPtr dict);
+
+    ///
+    /// The underlying libxml2 dictionary.
+    xmlDictPtr          xmlDict()               const   { return _dict; }
+
+    ///
+    /// The lock which must be held while parsing or freeing a document using this dictionary.
+    std::mutex&         Lock()                  const   { return _lock; }
+
+    ///
+    /// The number of names stored in this dictionary, excluding those in the Vocabulary().
+    size_t              Size()                  const;
+
+protected:
+    xmlDictPtr          _dict;
+    mutable std::mutex  _lock;
+
+};
+
+EPUB3_XML_END_NAMESPACE
+
+#endif /* defined(__ePub3_xml_dictionary__) */
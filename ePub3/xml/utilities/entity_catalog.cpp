@@ -0,0 +1,193 @@
+//
+//  entity_catalog.cpp
+//  ePub3
+//
+//  Copyright (c) 2012-2013 The Readium Foundation and contributors.
+//
+//  The Readium SDK is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+
+#include "entity_catalog.h"
+#include <libxml/HTMLparser.h>
+#include <libxml/parserInternals.h>
+#include <cstring>
+#include <mutex>
+#include <sstream>
+
+EPUB3_XML_BEGIN_NAMESPACE
+
+// the three XHTML entity sets, which between them hold all the HTML 4 entities
+enum EntitySet : unsigned
+{
+    NoEntities      = 0,
+    Latin1          = 1 << 0,
+    Symbols         = 1 << 1,
+    Special         = 1 << 2,
+    AllEntities     = Latin1|Symbols|Special
+};
+
+struct CatalogEntry
+{
+    const char*     publicID;
+    const char*     systemID;
+    unsigned        entitySets;
+    const char*     rootElement;        ///< Given a fixed `xmlns` attribute, if non-null.
+    const char*     rootNamespace;
+};
+
+static const CatalogEntry gCatalog[] = {
+    { "-//W3C//DTD XHTML 1.0 Strict//EN", "http://www.w3.org/TR/xhtml1/DTD/xhtml1-strict.dtd", AllEntities, "html", "http://www.w3.org/1999/xhtml" },
+    { "-//W3C//DTD XHTML 1.0 Transitional//EN", "http://www.w3.org/TR/xhtml1/DTD/xhtml1-transitional.dtd", AllEntities, "html", "http://www.w3.org/1999/xhtml" },
+    { "-//W3C//DTD XHTML 1.0 Frameset//EN", "http://www.w3.org/TR/xhtml1/DTD/xhtml1-frameset.dtd", AllEntities, "html", "http://www.w3.org/1999/xhtml" },
+    { "-//W3C//DTD XHTML 1.1//EN", "http://www.w3.org/TR/xhtml11/DTD/xhtml11.dtd", AllEntities, "html", "http://www.w3.org/1999/xhtml" },
+    { "-//W3C//DTD XHTML Basic 1.0//EN", "http://www.w3.org/TR/xhtml-basic/xhtml-basic10.dtd", AllEntities, "html", "http://www.w3.org/1999/xhtml" },
+    { "-//W3C//DTD XHTML Basic 1.1//EN", "http://www.w3.org/TR/xhtml-basic/xhtml-basic11.dtd", AllEntities, "html", "http://www.w3.org/1999/xhtml" },
+    { "-//W3C//DTD XHTML 1.1 plus MathML 2.0//EN", "http://www.w3.org/Math/DTD/mathml2/xhtml-math11-f.dtd", AllEntities, "html", "http://www.w3.org/1999/xhtml" },
+    { "-//W3C//DTD XHTML 1.1 plus MathML 2.0 plus SVG 1.1//EN", "http://www.w3.org/2002/04/xhtml-math-svg/xhtml-math-svg.dtd", AllEntities, "html", "http://www.w3.org/1999/xhtml" },
+    { "-//W3C//ENTITIES Latin 1 for XHTML//EN", "http://www.w3.org/TR/xhtml1/DTD/xhtml-lat1.ent", Latin1, nullptr, nullptr },
+    { "-//W3C//ENTITIES Symbols for XHTML//EN", "http://www.w3.org/TR/xhtml1/DTD/xhtml-symbol.ent", Symbols, nullptr, nullptr },
+    { "-//W3C//ENTITIES Special for XHTML//EN", "http://www.w3.org/TR/xhtml1/DTD/xhtml-special.ent", Special, nullptr, nullptr },
+    { "-//NISO//DTD dtbook 2005-1//EN", "http://www.daisy.org/z3986/2005/dtbook-2005-1.dtd", NoEntities, "dtbook", "http://www.daisy.org/z3986/2005/dtbook/" },
+    { "-//NISO//DTD dtbook 2005-2//EN", "http://www.daisy.org/z3986/2005/dtbook-2005-2.dtd", NoEntities, "dtbook", "http://www.daisy.org/z3986/2005/dtbook/" },
+    { "-//NISO//DTD dtbook 2005-3//EN", "http://www.daisy.org/z3986/2005/dtbook-2005-3.dtd", NoEntities, "dtbook", "http://www.daisy.org/z3986/2005/dtbook/" },
+    { "-//NISO//DTD ncx 2005-1//EN", "http://www.daisy.org/z3986/2005/ncx-2005-1.dtd", NoEntities, "ncx", "http://www.daisy.org/z3986/2005/ncx/" },
+    { "+//ISBN 0-9673008-1-9//DTD OEB 1.2 Package//EN", "http://openebook.org/dtds/oeb-1.2/oebpkg12.dtd", NoEntities, nullptr, nullptr },
+    { "+//ISBN 0-9673008-1-9//DTD OEB 1.2 Document//EN", "http://openebook.org/dtds/oeb-1.2/oebdoc12.dtd", AllEntities, nullptr, nullptr },
+    { "-//W3C//DTD SVG 1.1//EN", "http://www.w3.org/Graphics/SVG/1.1/DTD/svg11.dtd", NoEntities, "svg", "http://www.w3.org/2000/svg" },
+};
+
+static const size_t gCatalogSize = sizeof(gCatalog) / sizeof(gCatalog[0]);
+
+// xhtml-special.ent; xhtml-lat1.ent is U+00A0 to U+00FF, and xhtml-symbol.ent the rest
+static const unsigned gSpecialCodePoints[] = {
+    34, 38, 60, 62, 338, 339, 352, 353, 376, 710, 732, 8194, 8195, 8201, 8204, 8205,
+    8206, 8207, 8211, 8212, 8216, 8217, 8218, 8220, 8221, 8222, 8224, 8225, 8240, 8249,
+    8250, 8364
+};
+
+static std::string gEntryContent[gCatalogSize];
+static std::once_flag gContentOnce;
+static std::once_flag gInstallOnce;
+
+xmlExternalEntityLoader EntityCatalog::gNextLoader = nullptr;
+
+static unsigned EntitySetForCodePoint(unsigned value)
+{
+    if ( value >= 0xA0 && value <= 0xFF )
+        return Latin1;
+    for ( unsigned special : gSpecialCodePoints )
+    {
+        if ( special == value )
+            return Special;
+    }
+    return Symbols;
+}
+static void BuildContent()
+{
+    // libxml2's table is sorted by code point, and ends at U+2666 (&diams;)
+    std::stringstream entities[3];
+    for ( unsigned value = 1; value < 0x3000; value++ )
+    {
+        const htmlEntityDesc* desc = htmlEntityValueLookup(value);
+        if ( desc == nullptr || desc->value != value )
+            continue;
+        
+        // the five predefined XML entities need no declaration
+        if ( value == 34 || value == 38 || value == 39 || value == 60 || value == 62 )
+            continue;
+        
+        unsigned set = EntitySetForCodePoint(value);
+        int idx = (set == Latin1 ? 0 : (set == Symbols ? 1 : 2));
+        entities[idx] << "<!ENTITY " << desc->name << " \"&#" << value << ";\">\n";
+    }
+    
+    std::string sets[3] = { entities[0].str(), entities[1].str(), entities[2].str() };
+    for ( size_t i = 0; i < gCatalogSize; i++ )
+    {
+        const CatalogEntry& entry = gCatalog[i];
+        std::string& content = gEntryContent[i];
+        
+        if ( entry.rootElement != nullptr )
+        {
+            content += "<!ATTLIST ";
+            content += entry.rootElement;
+            content += " xmlns CDATA #FIXED \"";
+            content += entry.rootNamespace;
+            content += "\">\n";
+        }
+        
+        if ( (entry.entitySets & Latin1) != 0 )
+            content += sets[0];
+        if ( (entry.entitySets & Symbols) != 0 )
+            content += sets[1];
+        if ( (entry.entitySets & Special) != 0 )
+            content += sets[2];
+    }
+}
+
+void EntityCatalog::Install()
+{
+    std::call_once(gInstallOnce, []() {
+        gNextLoader = xmlGetExternalEntityLoader();
+        xmlSetExternalEntityLoader(&EntityCatalog::LoadEntity);
+    });
+}
+const std::string* EntityCatalog::Lookup(const char *publicID, const char *systemID)
+{
+    std::call_once(gContentOnce, BuildContent);
+    
+    // the public identifier is the more reliable, but isn't always present
+    if ( publicID != nullptr )
+    {
+        for ( size_t i = 0; i < gCatalogSize; i++ )
+        {
+            if ( std::strcmp(gCatalog[i].publicID, publicID) == 0 )
+                return &gEntryContent[i];
+        }
+    }
+    if ( systemID != nullptr )
+    {
+        for ( size_t i = 0; i < gCatalogSize; i++ )
+        {
+            if ( std::strcmp(gCatalog[i].systemID, systemID) == 0 )
+                return &gEntryContent[i];
+        }
+    }
+    
+    return nullptr;
+}
+xmlParserInputPtr EntityCatalog::LoadEntity(const char *URL, const char *ID, xmlParserCtxtPtr ctxt)
+{
+    const std::string* content = Lookup(ID, URL);
+    if ( content == nullptr )
+        return (gNextLoader != nullptr ? gNextLoader(URL, ID, ctxt) : nullptr);
+    
+    xmlParserInputBufferPtr buf = xmlParserInputBufferCreateMem(content->data(), static_cast<int>(content->size()), XML_CHAR_ENCODING_UTF8);
+    if ( buf == nullptr )
+        return nullptr;
+    
+    xmlParserInputPtr input = xmlNewIOInputStream(ctxt, buf, XML_CHAR_ENCODING_UTF8);
+    if ( input == nullptr )
+    {
+        xmlFreeParserInputBuffer(buf);
+        return nullptr;
+    }
+    
+    if ( URL != nullptr )
+        input->filename = reinterpret_cast<char*>(xmlStrdup(BAD_CAST URL));
+    return input;
+}
+
+EPUB3_XML_END_NAMESPACE
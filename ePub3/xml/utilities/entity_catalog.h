@@ -0,0 +1,77 @@
+//
+//  entity_catalog.h
+//  ePub3
+//
+//  Copyright (c) 2012-2013 The Readium Foundation and contributors.
+//
+//  The Readium SDK is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+
+#ifndef __ePub3_xml_entity_catalog__
+#define __ePub3_xml_entity_catalog__
+
+#include <ePub3/xml/base.h>
+#include <libxml/parser.h>
+#include <string>
+
+EPUB3_XML_BEGIN_NAMESPACE
+
+/**
+ An in-memory catalog of the DTDs and entity sets referenced by EPUB content.
+
+ Documents are parsed with `XML_PARSE_NOENT` and `XML_PARSE_DTDATTR`, so a
+ chapter whose DOCTYPE names (for example) the XHTML 1.1 or DTBook DTD makes
+ libxml2 load that DTD from its system URL. That is slow at best, and without a
+ network it fails only after a timeout.
+
+ Once installed, the catalog answers libxml2's requests for the XHTML 1.0, 1.1 and
+ Basic DTDs, the XHTML entity sets, and the DTBook, NCX, OEB 1.2 and SVG 1.1 DTDs
+ from memory. It provides the named character entities (built from libxml2's own
+ HTML 4 entity table) and the fixed namespace declaration of each DTD's root
+ element; other declarations are omitted, as nothing we parse is validated against
+ a DTD. Each DTD's text is generated once and reused for every parse. Requests for
+ anything else are passed on to the previously installed entity loader.
+
+ @ingroup xml-utils
+ */
+class EntityCatalog
+{
+public:
+    /**
+     Installs the catalog as libxml2's external entity loader.
+
+     This is done automatically by InputBuffer before it parses anything, and is
+     only done once per process; subsequent calls do nothing.
+     */
+    static void                 Install();
+
+    /**
+     Looks up the content served for a DTD or entity set.
+     @param publicID The public identifier, or `nullptr`.
+     @param systemID The system identifier (URL), or `nullptr`.
+     @result The DTD text, or `nullptr` if neither identifier is in the catalog.
+     */
+    static const std::string*   Lookup(const char* publicID, const char* systemID);
+
+protected:
+    static xmlExternalEntityLoader  gNextLoader;
+
+    static xmlParserInputPtr    LoadEntity(const char* URL, const char* ID, xmlParserCtxtPtr ctxt);
+
+};
+
+EPUB3_XML_END_NAMESPACE
+
+#endif /* defined(__ePub3_xml_entity_catalog__) */
@@ -20,11 +20,18 @@
 //
 
 #include "io.h"
+#include "parser_pool.h"
+#include "entity_catalog.h"
+#include <algorithm>
+#include <cstring>
 
 EPUB3_XML_BEGIN_NAMESPACE
 
 InputBuffer::InputBuffer()
 {
+    // keeps DTD lookups off the network
+    EntityCatalog::Install();
+    
     _buf = xmlParserInputBufferCreateIO(InputBuffer::read_cb, InputBuffer::close_cb, this, XML_CHAR_ENCODING_NONE);
     if ( _buf == NULL )
         throw InternalError("Failed to create xml input buffer");
@@ -44,13 +51,51 @@ int InputBuffer::close_cb(void *context)
     InputBuffer * p = static_cast<InputBuffer*>(context);
     return (p->close() ? 0 : -1);
 }
-xmlDocPtr InputBuffer::xmlReadDocument(const char * url, const char * encoding, int options)
+xmlDocPtr InputBuffer::xmlReadDocument(const char * url, const char * encoding, int options, xmlDictPtr dict)
 {
-    return xmlReadIO(_buf->readcallback, _buf->closecallback, _buf->context, url, encoding, options);
+    ParserContextPool::Lease ctxt(ParserContextPool::XMLContexts());
+    if ( ctxt == nullptr )
+        return nullptr;
+    
+    Dictionary::UseWithContext(ctxt, dict);
+    return xmlCtxtReadIO(ctxt, _buf->readcallback, _buf->closecallback, _buf->context, url, encoding, options);
+}
+xmlDocPtr InputBuffer::xmlReadValidatedDocument(const char * url, const char * encoding, int options, xmlDictPtr dict,
+                                                const SchemaPool::CompiledSchema& schema, bool * valid, string * error)
+{
+    *valid = false;
+    
+    ParserContextPool::Lease ctxt(ParserContextPool::XMLContexts());
+    if ( ctxt == nullptr )
+        return nullptr;
+    
+    Dictionary::UseWithContext(ctxt, dict);
+    
+    xmlSchemaSAXPlugPtr plug = nullptr;
+    xmlSchemaValidCtxtPtr vctxt = SchemaPool::ValidateParse(ctxt, schema, error, &plug);
+    if ( vctxt == nullptr )
+        throw InternalError("Failed to create schema validation context");
+    
+    xmlDocPtr doc = xmlCtxtReadIO(ctxt, _buf->readcallback, _buf->closecallback, _buf->context, url, encoding, options);
+    *valid = (doc != nullptr && xmlSchemaIsValid(vctxt) == 1);
+    
+    // the context goes back to the pool with its own SAX handler restored
+    xmlSchemaSAXUnplug(plug);
+    xmlSchemaFreeValidCtxt(vctxt);
+    return doc;
 }
-xmlDocPtr InputBuffer::htmlReadDocument(const char *url, const char *encoding, int options)
+xmlDocPtr InputBuffer::htmlReadDocument(const char *url, const char *encoding, int options, xmlDictPtr dict)
 {
-    return htmlReadIO(_buf->readcallback, _buf->closecallback, _buf->context, url, encoding, options);
+    ParserContextPool::Lease ctxt(ParserContextPool::HTMLContexts());
+    if ( ctxt == nullptr )
+        return nullptr;
+    
+    Dictionary::UseWithContext(ctxt, dict);
+    return htmlCtxtReadIO(ctxt, _buf->readcallback, _buf->closecallback, _buf->context, url, encoding, options);
+}
+xmlTextReaderPtr InputBuffer::xmlReaderForDocument(const char *url, const char *encoding, int options)
+{
+    return xmlReaderForIO(_buf->readcallback, _buf->closecallback, _buf->context, url, encoding, options);
 }
 
 OutputBuffer::OutputBuffer(const std::string & encoding)
@@ -116,4 +161,16 @@ bool StreamOutputBuffer::close()
     return true;
 }
 
+size_t MemoryInputBuffer::read(uint8_t *buf, size_t len)
+{
+    size_t num = std::min(len, _bytes.size() - _pos);
+    ::memcpy(buf, _bytes.data() + _pos, num);
+    _pos += num;
+    return num;
+}
+bool MemoryInputBuffer::close()
+{
+    return true;
+}
+
 EPUB3_XML_END_NAMESPACE
@@ -23,9 +23,13 @@
 #define __ePub3_xml_io__
 
 #include <ePub3/xml/base.h>
+#include <ePub3/xml/dictionary.h>
+#include <ePub3/xml/schema_pool.h>
 #include <iostream>
 #include <libxml/xmlIO.h>
 #include <libxml/HTMLtree.h>
+#include <libxml/HTMLparser.h>
+#include <libxml/xmlreader.h>
 
 EPUB3_XML_BEGIN_NAMESPACE
 
@@ -44,8 +48,37 @@ public:
     operator xmlParserInputBuffer * () { return xmlBuffer(); }
     operator const xmlParserInputBuffer * () const { return xmlBuffer(); }
     
-    xmlDocPtr xmlReadDocument(const char * url, const char * encoding, int options);
-    xmlDocPtr htmlReadDocument(const char * url, const char * encoding, int options);
+    /**
+     Parses the buffer's content as an XML or HTML document.
+     
+     Element and attribute names are interned in `dict` if one is supplied, and
+     otherwise in a new dictionary backed by Dictionary::Vocabulary().
+     The parser context is borrowed from ParserContextPool, and returned before this
+     method returns.
+     @param dict A dictionary shared with other documents. The caller must hold its
+     Lock() for the duration of the call, if it belongs to a Dictionary.
+     */
+    xmlDocPtr xmlReadDocument(const char * url, const char * encoding, int options, xmlDictPtr dict=nullptr);
+    xmlDocPtr htmlReadDocument(const char * url, const char * encoding, int options, xmlDictPtr dict=nullptr);
+    
+    /**
+     Parses the buffer's content as an XML document, validating it against `schema`
+     in the same pass.
+     @param valid Receives `true` if the document was parsed and is valid.
+     @param error Receives a description of the first validation error found.
+     @throws InternalError if validation could not be set up.
+     @see xmlReadDocument()
+     */
+    xmlDocPtr xmlReadValidatedDocument(const char * url, const char * encoding, int options, xmlDictPtr dict,
+                                       const SchemaPool::CompiledSchema& schema, bool * valid, string * error);
+    
+    /**
+     Creates a streaming (pull) reader over the buffer's content.
+     
+     The caller owns the result and must release it using `xmlFreeTextReader()`
+     before this buffer is destroyed.
+     */
+    xmlTextReaderPtr xmlReaderForDocument(const char * url, const char * encoding, int options);
     
 protected:
     xmlParserInputBufferPtr _buf;
@@ -122,6 +155,27 @@ protected:
     
 };
 
+/**
+ An InputBuffer over bytes which have already been read into memory, so that parsing
+ them involves no further I/O.
+ @ingroup xml-utils
+ */
+class MemoryInputBuffer : public InputBuffer
+{
+public:
+    MemoryInputBuffer(std::string && bytes) : InputBuffer(), _bytes(std::move(bytes)), _pos(0) {}
+    MemoryInputBuffer(MemoryInputBuffer && o) : InputBuffer(std::move(o)), _bytes(std::move(o._bytes)), _pos(o._pos) {}
+    virtual ~MemoryInputBuffer() {}
+    
+protected:
+    virtual size_t read(uint8_t * buf, size_t len);
+    virtual bool close();
+    
+    std::string     _bytes;
+    size_t          _pos;
+    
+};
+
 EPUB3_XML_END_NAMESPACE
 
 #endif /* defined(__ePub3_xml_io__) */
@@ -0,0 +1,155 @@
+//
+//  parser_pool.cpp
+//  ePub3
+//
+//  Copyright (c) 2012-2013 The Readium Foundation and contributors.
+//
+//  The Readium SDK is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+
+#include "parser_pool.h"
+#include "dictionary.h"
+#include <libxml/HTMLparser.h>
+#include <libxml/SAX2.h>
+
+EPUB3_XML_BEGIN_NAMESPACE
+
+const size_t ParserContextPool::DefaultCapacity;
+
+// options such as XML_PARSE_NOBLANKS and XML_PARSE_SAX1 patch the context's SAX
+//  handler, and resetting the context doesn't undo that
+static void ResetXMLContext(xmlParserCtxtPtr ctxt)
+{
+    xmlCtxtReset(ctxt);
+    xmlSAXVersion(ctxt->sax, 2);
+}
+static void ResetHTMLContext(xmlParserCtxtPtr ctxt)
+{
+    htmlCtxtReset(ctxt);
+    xmlSAX2InitHtmlDefaultSAXHandler(ctxt->sax);
+}
+
+ParserContextPool::ParserContextPool(Creator creator, Resetter resetter, Destroyer destroyer, size_t capacity)
+    : _create(creator), _reset(resetter), _destroy(destroyer), _capacity(capacity), _initialOptions(0), _haveOptions(false), _idle()
+{
+    _idle.reserve(capacity);
+}
+ParserContextPool::~ParserContextPool()
+{
+    for ( xmlParserCtxtPtr ctxt : _idle )
+    {
+        _destroy(ctxt);
+    }
+}
+ParserContextPool& ParserContextPool::XMLContexts()
+{
+    static ParserContextPool pool(xmlNewParserCtxt, ResetXMLContext, xmlFreeParserCtxt);
+    return pool;
+}
+ParserContextPool& ParserContextPool::HTMLContexts()
+{
+    static ParserContextPool pool(htmlNewParserCtxt, ResetHTMLContext, htmlFreeParserCtxt);
+    return pool;
+}
+xmlParserCtxtPtr ParserContextPool::Acquire()
+{
+    {
+        std::lock_guard<std::mutex> _(_lock);
+        if ( !_idle.empty() )
+        {
+            xmlParserCtxtPtr ctxt = _idle.back();
+            _idle.pop_back();
+            return ctxt;
+        }
+    }
+    
+    xmlParserCtxtPtr ctxt = _create();
+    if ( ctxt == nullptr )
+        return nullptr;
+    
+    std::lock_guard<std::mutex> _(_lock);
+    if ( !_haveOptions )
+    {
+        _initialOptions = ctxt->options;
+        _haveOptions = true;
+    }
+    return ctxt;
+}
+void ParserContextPool::Relinquish(xmlParserCtxtPtr ctxt)
+{
+    if ( ctxt == nullptr )
+        return;
+    
+    // the reset happens outside our lock, but must happen under that of the context's
+    //  dictionary, which our caller holds
+    _reset(ctxt);
+    Dictionary::AttachToContext(ctxt, Dictionary::Vocabulary());
+    
+    {
+        std::lock_guard<std::mutex> _(_lock);
+        if ( _idle.size() < _capacity )
+        {
+            // older libxml2 versions' xmlCtxtUseOptions() only ever add to this
+            ctxt->options = _initialOptions;
+            _idle.push_back(ctxt);
+            return;
+        }
+    }
+    
+    _destroy(ctxt);
+}
+size_t ParserContextPool::Capacity() const
+{
+    std::lock_guard<std::mutex> _(_lock);
+    return _capacity;
+}
+void ParserContextPool::SetCapacity(size_t capacity)
+{
+    std::vector<xmlParserCtxtPtr> surplus;
+    {
+        std::lock_guard<std::mutex> _(_lock);
+        _capacity = capacity;
+        if ( _idle.size() > capacity )
+        {
+            surplus.assign(_idle.begin()+capacity, _idle.end());
+            _idle.resize(capacity);
+        }
+    }
+    
+    for ( xmlParserCtxtPtr ctxt : surplus )
+    {
+        _destroy(ctxt);
+    }
+}
+size_t ParserContextPool::IdleCount() const
+{
+    std::lock_guard<std::mutex> _(_lock);
+    return _idle.size();
+}
+void ParserContextPool::Drain()
+{
+    std::vector<xmlParserCtxtPtr> idle;
+    {
+        std::lock_guard<std::mutex> _(_lock);
+        idle.swap(_idle);
+    }
+    
+    for ( xmlParserCtxtPtr ctxt : idle )
+    {
+        _destroy(ctxt);
+    }
+}
+
+EPUB3_XML_END_NAMESPACE
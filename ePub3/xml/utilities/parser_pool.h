@@ -0,0 +1,157 @@
+//
+//  parser_pool.h
+//  ePub3
+//
+//  Copyright (c) 2012-2013 The Readium Foundation and contributors.
+//
+//  The Readium SDK is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+
+#ifndef __ePub3_xml_parser_pool__
+#define __ePub3_xml_parser_pool__
+
+#include <ePub3/xml/base.h>
+#include <libxml/parser.h>
+#include <mutex>
+#include <vector>
+
+EPUB3_XML_BEGIN_NAMESPACE
+
+/**
+ A pool of reusable libxml2 parser contexts.
+
+ Creating a parser context allocates its SAX handler, node and name stacks, and
+ several hash tables, and for small documents this setup can cost as much as the
+ parse itself. A ParserContextPool hands out contexts which have been reset after
+ an earlier parse, so that when many documents are read in succession the setup is
+ only paid once per thread.
+
+ There is one pool for XML contexts and one for HTML contexts; InputBuffer uses
+ these for all its DOM reads. A thread takes a context from the pool for the length
+ of one parse and then returns it, so the pool settles at one idle context for each
+ thread which parses concurrently, up to its Capacity().
+
+ Returned contexts are parked on Dictionary::Vocabulary(), so an idle context never
+ keeps a package's dictionary alive.
+
+ Contexts are not cached in thread-local storage: the `__thread` and
+ `__declspec(thread)` storage used by Trace can only hold plain values, which are
+ not destroyed when their thread exits, so every short-lived thread (such as a
+ Container's package loaders) would leak its context. A shared pool also keeps a
+ single bound on the number of idle contexts in the process.
+
+ @remarks All methods are thread-safe.
+
+ @ingroup xml-utils
+ */
+class ParserContextPool
+{
+public:
+    ///
+    /// The default number of idle contexts kept by each pool.
+    static const size_t     DefaultCapacity = 16;
+
+    typedef xmlParserCtxtPtr    (*Creator)();
+    typedef void                (*Resetter)(xmlParserCtxtPtr);
+    typedef void                (*Destroyer)(xmlParserCtxtPtr);
+
+    /**
+     Holds a context taken from a pool, and returns it when destroyed.
+
+     The lease must be destroyed while the lock of any Dictionary attached to the
+     context is still held, since resetting the context touches its dictionary.
+     */
+    class Lease
+    {
+    public:
+                            Lease(ParserContextPool& pool) : _pool(pool), _ctxt(pool.Acquire()) {}
+                            Lease(const Lease&)     = delete;
+                            Lease(Lease&&)          = delete;
+                            ~Lease()                { if ( _ctxt != nullptr ) _pool.Relinquish(_ctxt); }
+
+        xmlParserCtxtPtr    get()           const   { return _ctxt; }
+                            operator xmlParserCtxtPtr () const { return _ctxt; }
+
+    private:
+        ParserContextPool&  _pool;
+        xmlParserCtxtPtr    _ctxt;
+
+    };
+
+public:
+    /**
+     Creates an empty pool.
+     @param creator Allocates a new context.
+     @param resetter Returns a used context to its freshly-created state.
+     @param destroyer Frees a context.
+     @param capacity The maximum number of idle contexts to keep.
+     */
+                            ParserContextPool(Creator creator, Resetter resetter, Destroyer destroyer,
+                                              size_t capacity=DefaultCapacity);
+                            ParserContextPool(const ParserContextPool&)     = delete;
+                            ParserContextPool(ParserContextPool&&)          = delete;
+    virtual                 ~ParserContextPool();
+
+    ///
+    /// The shared pool of XML parser contexts.
+    static ParserContextPool&   XMLContexts();
+    ///
+    /// The shared pool of HTML parser contexts.
+    static ParserContextPool&   HTMLContexts();
+
+    /**
+     Takes an idle context from the pool, or creates a new one.
+     @result A parser context, or `nullptr` if one could not be allocated.
+     */
+    xmlParserCtxtPtr        Acquire();
+
+    /**
+     Resets a context and returns it to the pool.
+
+     If the pool is already at capacity, the context is freed instead.
+     @param ctxt A context obtained from Acquire() on this pool.
+     */
+    void                    Relinquish(xmlParserCtxtPtr ctxt);
+
+    ///
+    /// The maximum number of idle contexts the pool will keep.
+    size_t                  Capacity()          const;
+    ///
+    /// Changes the pool's capacity, freeing any idle contexts beyond the new limit.
+    void                    SetCapacity(size_t capacity);
+
+    ///
+    /// The number of contexts currently waiting in the pool.
+    size_t                  IdleCount()         const;
+
+    ///
+    /// Frees all idle contexts.
+    void                    Drain();
+
+protected:
+    Creator                         _create;
+    Resetter                        _reset;
+    Destroyer                       _destroy;
+    size_t                          _capacity;
+    int                             _initialOptions;    ///< The `options` of a new context, restored on reset.
+    bool                            _haveOptions;
+    std::vector<xmlParserCtxtPtr>   _idle;
+    mutable std::mutex              _lock;
+
+};
+
+EPUB3_XML_END_NAMESPACE
+
+#endif /* defined(__ePub3_xml_parser_pool__) */
@@ -0,0 +1,303 @@
+//
+//  push_parser.cpp
+//  ePub3
+//
+//  Copyright (c) 2012-2013 The Readium Foundation and contributors.
+//
+//  The Readium SDK is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+
+#include "push_parser.h"
+#include "dictionary.h"
+#include "entity_catalog.h"
+#include <libxml/HTMLparser.h>
+#include <libxml/parserInternals.h>
+#include <algorithm>
+#include <climits>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+EPUB3_XML_BEGIN_NAMESPACE
+
+// the number of chunks ParseConcurrently() lets the reader get ahead of the parser
+static const size_t kChunksInFlight = 4;
+
+const size_t PushParser::DefaultChunkSize;
+
+PushParser::PushParser(bool html, const char* url, const char* encoding, int options, xmlDictPtr dict)
+  : _ctxt(nullptr), _html(html), _finished(false), _container(nullptr), _lastChecked(nullptr), _readyCount(0)
+{
+    EntityCatalog::Install();
+    
+    // no initial chunk, so nothing is parsed until the dictionary is in place
+    if ( html )
+        _ctxt = htmlCreatePushParserCtxt(nullptr, nullptr, nullptr, 0, url, XML_CHAR_ENCODING_NONE);
+    else
+        _ctxt = xmlCreatePushParserCtxt(nullptr, nullptr, nullptr, 0, url);
+    if ( _ctxt == nullptr )
+        throw InternalError("Failed to create push parser context", xmlGetLastError());
+    
+    Dictionary::UseWithContext(_ctxt, dict);
+    
+    if ( html )
+        htmlCtxtUseOptions(_ctxt, options);
+    else
+        xmlCtxtUseOptions(_ctxt, options);
+    
+    if ( encoding != nullptr )
+    {
+        xmlCharEncodingHandlerPtr handler = xmlFindCharEncodingHandler(encoding);
+        if ( handler != nullptr )
+            xmlSwitchToEncoding(_ctxt, handler);
+    }
+}
+PushParser::~PushParser()
+{
+    if ( _ctxt == nullptr )
+        return;
+    
+    // an unfinished document is still ours
+    if ( _ctxt->myDoc != nullptr )
+    {
+        xmlFreeDoc(_ctxt->myDoc);
+        _ctxt->myDoc = nullptr;
+    }
+    
+    if ( _html )
+        htmlFreeParserCtxt(_ctxt);
+    else
+        xmlFreeParserCtxt(_ctxt);
+}
+bool PushParser::Feed(const void* bytes, size_t len)
+{
+    // once the parser has stopped building the tree, there's no point continuing
+    if ( _finished || _ctxt->disableSAX != 0 )
+        return false;
+    
+    const char* p = reinterpret_cast<const char*>(bytes);
+    while ( len != 0 )
+    {
+        // xmlParseChunk() takes an int
+        int n = static_cast<int>(std::min(len, size_t(INT_MAX)));
+        if ( _html )
+            htmlParseChunk(_ctxt, p, n, 0);
+        else
+            xmlParseChunk(_ctxt, p, n, 0);
+        p += n;
+        len -= n;
+    }
+    
+    UpdateProgress();
+    return (_ctxt->disableSAX == 0);
+}
+xmlDocPtr PushParser::Finish()
+{
+    if ( _finished )
+        return nullptr;
+    
+    if ( _html )
+        htmlParseChunk(_ctxt, nullptr, 0, 1);
+    else
+        xmlParseChunk(_ctxt, nullptr, 0, 1);
+    _finished = true;
+    
+    UpdateProgress();
+    
+    xmlDocPtr doc = _ctxt->myDoc;
+    _ctxt->myDoc = nullptr;
+    
+    // the same rule xmlCtxtReadIO() follows
+    if ( doc != nullptr && !_html && !_ctxt->wellFormed && !_ctxt->recovery )
+    {
+        xmlFreeDoc(doc);
+        doc = nullptr;
+    }
+    
+    _container = _lastChecked = nullptr;
+    return doc;
+}
+xmlDocPtr PushParser::ParseConcurrently(ReadFn read, size_t chunkSize)
+{
+    struct Chunk
+    {
+        std::unique_ptr<char[]> bytes;
+        size_t                  len;
+    };
+    
+    std::vector<Chunk> chunks(kChunksInFlight);
+    std::deque<Chunk*> empty, full;
+    for ( Chunk& chunk : chunks )
+    {
+        chunk.bytes.reset(new char[chunkSize]);
+        empty.push_back(&chunk);
+    }
+    
+    std::mutex lock;
+    std::condition_variable changed;
+    bool atEnd = false, readFailed = false, stop = false;
+    
+    std::thread reader([&]() {
+        std::unique_lock<std::mutex> _(lock);
+        while ( !atEnd )
+        {
+            changed.wait(_, [&]() { return stop || !empty.empty(); });
+            if ( stop )
+                break;
+            
+            Chunk* chunk = empty.front();
+            empty.pop_front();
+            
+            _.unlock();
+            ssize_t n = -1;
+            try
+            {
+                n = read(chunk->bytes.get(), chunkSize);
+            }
+            catch (...)
+            {
+            }
+            _.lock();
+            
+            if ( n > 0 )
+            {
+                chunk->len = static_cast<size_t>(n);
+                full.push_back(chunk);
+            }
+            else
+            {
+                empty.push_back(chunk);
+                readFailed = (n < 0);
+                atEnd = true;
+            }
+            changed.notify_all();
+        }
+    });
+    
+    std::exception_ptr failure;
+    try
+    {
+        std::unique_lock<std::mutex> _(lock);
+        while ( true )
+        {
+            changed.wait(_, [&]() { return atEnd || !full.empty(); });
+            if ( full.empty() )
+                break;      // atEnd, and everything has been parsed
+            
+            Chunk* chunk = full.front();
+            full.pop_front();
+            
+            _.unlock();
+            bool ok = Feed(chunk->bytes.get(), chunk->len);
+            _.lock();
+            
+            empty.push_back(chunk);
+            changed.notify_all();
+            
+            if ( !ok )
+                break;      // nothing more will be parsed, so don't bother reading it
+        }
+        
+        stop = true;
+        changed.notify_all();
+    }
+    catch (...)
+    {
+        // most likely thrown by the progress handler
+        failure = std::current_exception();
+        std::lock_guard<std::mutex> _(lock);
+        stop = true;
+        changed.notify_all();
+    }
+    
+    reader.join();
+    
+    if ( failure )
+        std::rethrow_exception(failure);
+    if ( readFailed )
+        return nullptr;
+    
+    return Finish();
+}
+void PushParser::UpdateProgress()
+{
+    xmlDocPtr doc = _ctxt->myDoc;
+    if ( doc == nullptr )
+        return;
+    
+    if ( _container == nullptr )
+    {
+        xmlNodePtr root = xmlDocGetRootElement(doc);
+        if ( root == nullptr )
+            return;
+        
+        if ( xmlStrcasecmp(root->name, BAD_CAST "html") != 0 )
+        {
+            _container = root;
+        }
+        else
+        {
+            for ( xmlNodePtr child = root->children; child != nullptr; child = child->next )
+            {
+                if ( child->type == XML_ELEMENT_NODE && xmlStrcasecmp(child->name, BAD_CAST "body") == 0 )
+                {
+                    _container = child;
+                    break;
+                }
+            }
+            
+            // wait for the body to turn up, unless there isn't going to be one
+            if ( _container == nullptr && !_finished && IsOpen(root) )
+                return;
+            if ( _container == nullptr )
+                _container = root;
+        }
+    }
+    
+    size_t readyCount = _readyCount;
+    xmlNodePtr next = (_lastChecked == nullptr ? _container->children : _lastChecked->next);
+    for ( ; next != nullptr; next = next->next )
+    {
+        if ( next->type == XML_ELEMENT_NODE )
+        {
+            if ( !_finished && IsOpen(next) )
+                break;
+            ++readyCount;
+        }
+        _lastChecked = next;
+    }
+    
+    if ( readyCount == _readyCount )
+        return;
+    
+    _readyCount = readyCount;
+    if ( _progress )
+        _progress(_container, _readyCount);
+}
+bool PushParser::IsOpen(xmlNodePtr node) const
+{
+    for ( xmlNodePtr n = _ctxt->node; n != nullptr; n = n->parent )
+    {
+        if ( n == node )
+            return true;
+    }
+    return false;
+}
+
+EPUB3_XML_END_NAMESPACE
@@ -0,0 +1,150 @@
+//
+//  push_parser.h
+//  ePub3
+//
+//  Copyright (c) 2012-2013 The Readium Foundation and contributors.
+//
+//  The Readium SDK is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+
+#ifndef __ePub3_xml_push_parser__
+#define __ePub3_xml_push_parser__
+
+#include <ePub3/xml/base.h>
+#include <libxml/parser.h>
+#include <functional>
+#include <sys/types.h>
+
+EPUB3_XML_BEGIN_NAMESPACE
+
+/**
+ Builds a document from data supplied a piece at a time.
+ 
+ A PushParser wraps a libxml2 push-parser context, so a document can be parsed as
+ its bytes arrive rather than only once all of them are in hand. As it goes, it
+ keeps track of how many of the document's top-level elements have been completely
+ parsed-- these are the children of the `body` element in (X)HTML documents, and of
+ the root element otherwise-- and reports each increase to a progress handler. Those
+ elements, and everything before them, will not change for the rest of the parse, so
+ a renderer can start work on the start of a long chapter while the rest of it is
+ still being read.
+ 
+ ParseConcurrently() reads the input on a separate thread while parsing what has
+ already been read, so that decompressing a resource and parsing it overlap.
+ 
+ @remarks A PushParser must only be used by one thread at a time. If a Dictionary is
+ used, its lock must be held from construction until the parser is destroyed.
+ 
+ @ingroup xml-utils
+ */
+class PushParser
+{
+public:
+    /**
+     Called whenever more top-level elements are complete.
+     @param container The element whose children are being counted. Its document is
+     still being built, so only the first `readyCount` element children and what
+     precedes them should be examined.
+     @param readyCount The number of its element children which are complete.
+     */
+    typedef std::function<void(xmlNodePtr container, size_t readyCount)>   ProgressFn;
+    
+    ///
+    /// Reads up to `len` bytes into `buf`, returning the number read, 0 at the end of
+    /// the input, or a negative value if an error occurred.
+    typedef std::function<ssize_t(void* buf, size_t len)>                  ReadFn;
+    
+    ///
+    /// The default size of each read made by ParseConcurrently().
+    static const size_t     DefaultChunkSize = 16 * 1024;
+    
+public:
+    /**
+     Creates a parser for a new document.
+     @param html Whether to use the HTML parser rather than the XML parser.
+     @param url The URL of the document, used to resolve relative references.
+     @param encoding The encoding of the input, or `nullptr` to detect it.
+     @param options The libxml2 parser options (`xmlParserOption` or `htmlParserOption`).
+     @param dict The dictionary in which to intern names, or `nullptr` to use a new one.
+     @throws InternalError if the parser context could not be created.
+     */
+                            PushParser(bool html, const char* url, const char* encoding, int options, xmlDictPtr dict=nullptr);
+                            PushParser(const PushParser&)   = delete;
+                            PushParser(PushParser&&)        = delete;
+    virtual                 ~PushParser();
+    
+    ///
+    /// Installs a function to be called as top-level elements are completed.
+    void                    SetProgressHandler(ProgressFn fn)       { _progress = fn; }
+    
+    /**
+     Parses some more of the document.
+     @param bytes The next bytes of the input.
+     @param len The number of bytes at `bytes`.
+     @result `false` if the parser has encountered an error from which it cannot
+     recover, in which case further input will be ignored.
+     */
+    bool                    Feed(const void* bytes, size_t len);
+    
+    /**
+     Completes the parse, once all input has been fed to the parser.
+     @result The finished document, which the caller now owns, or `nullptr` if it
+     was not well-formed and the parser was not asked to recover from errors.
+     */
+    xmlDocPtr               Finish();
+    
+    /**
+     Reads and parses an entire document.
+     
+     The input is read on a worker thread, a chunk at a time, and parsed on the
+     calling thread as each chunk arrives. Progress is reported on the calling thread.
+     @param read The function which supplies the input. It is called only from the
+     worker thread.
+     @param chunkSize The largest number of bytes to request from `read` at once.
+     @result The finished document, as from Finish(), or `nullptr` if `read` failed.
+     */
+    xmlDocPtr               ParseConcurrently(ReadFn read, size_t chunkSize=DefaultChunkSize);
+    
+    ///
+    /// The number of top-level elements which have been completely parsed so far.
+    size_t                  ReadyCount()                    const   { return _readyCount; }
+    
+    ///
+    /// The element whose children are counted, or `nullptr` if it hasn't been seen yet.
+    xmlNodePtr              Container()                     const   { return _container; }
+    
+protected:
+    xmlParserCtxtPtr        _ctxt;
+    bool                    _html;
+    bool                    _finished;
+    ProgressFn              _progress;
+    
+    xmlNodePtr              _container;     ///< The parent of the top-level elements.
+    xmlNodePtr              _lastChecked;   ///< The last of its children known to be complete.
+    size_t                  _readyCount;    ///< The number of complete element children.
+    
+    ///
+    /// Counts any newly-completed top-level elements, and reports them.
+    void                    UpdateProgress();
+    
+    ///
+    /// Whether `node` is still being parsed, i.e. it contains the parser's current node.
+    bool                    IsOpen(xmlNodePtr node)         const;
+    
+};
+
+EPUB3_XML_END_NAMESPACE
+
+#endif /* defined(__ePub3_xml_push_parser__) */
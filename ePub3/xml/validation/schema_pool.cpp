@@ -0,0 +1,177 @@
+//
+//  schema_pool.cpp
+//  ePub3
+//
+//  Copyright (c) 2012-2013 The Readium Foundation and contributors.
+//
+//  The Readium SDK is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+
+#include "schema_pool.h"
+#include <libxml/tree.h>
+
+EPUB3_XML_BEGIN_NAMESPACE
+
+#if LIBXML_VERSION >= 21200
+typedef const xmlError* ConstErrorPtr;
+#else
+typedef xmlErrorPtr ConstErrorPtr;
+#endif
+
+SchemaPool::EntryMap SchemaPool::gEntries;
+std::mutex SchemaPool::gEntriesLock;
+
+// keeps the first error reported, trimmed of its trailing newline
+static void RecordFirstError(void* ctx, ConstErrorPtr err)
+{
+    string* error = reinterpret_cast<string*>(ctx);
+    if ( error == nullptr || !error->empty() || err == nullptr || err->message == nullptr )
+        return;
+    
+    std::string message(err->message);
+    while ( !message.empty() && message.back() == '\n' )
+        message.pop_back();
+    
+    if ( err->line > 0 )
+        *error = _Str("line ", err->line, ": ", message);
+    else
+        *error = message;
+}
+
+void SchemaPool::RegisterSchemaFile(const string& namespaceURI, const string& path)
+{
+    Register(namespaceURI, path.stl_str(), true);
+}
+void SchemaPool::RegisterSchemaData(const string& namespaceURI, const std::string& data)
+{
+    Register(namespaceURI, data, false);
+}
+void SchemaPool::Register(const string& namespaceURI, const std::string& source, bool isFile)
+{
+    Shared<Entry> entry = std::make_shared<Entry>();
+    entry->source = source;
+    entry->isFile = isFile;
+    
+    std::lock_guard<std::mutex> _(gEntriesLock);
+    gEntries[namespaceURI] = entry;
+}
+void SchemaPool::UnregisterSchema(const string& namespaceURI)
+{
+    std::lock_guard<std::mutex> _(gEntriesLock);
+    gEntries.erase(namespaceURI);
+}
+bool SchemaPool::HasSchemaForNamespace(const string& namespaceURI)
+{
+    std::lock_guard<std::mutex> _(gEntriesLock);
+    return gEntries.find(namespaceURI) != gEntries.end();
+}
+SchemaPool::CompiledSchema SchemaPool::SchemaForNamespace(const string& namespaceURI)
+{
+    Shared<Entry> entry;
+    {
+        std::lock_guard<std::mutex> _(gEntriesLock);
+        auto found = gEntries.find(namespaceURI);
+        if ( found == gEntries.end() )
+            return nullptr;
+        entry = found->second;
+    }
+    
+    // compile outside the map lock; other namespaces shouldn't wait on this one
+    std::call_once(entry->compiled, &SchemaPool::Compile, entry.get());
+    if ( !entry->schema )
+        throw ParserError(_Str("Schema for ", namespaceURI, " could not be compiled: ", entry->error));
+    
+    return entry->schema;
+}
+void SchemaPool::Compile(Entry* entry)
+{
+    xmlSchemaParserCtxtPtr ctx = nullptr;
+    if ( entry->isFile )
+        ctx = xmlSchemaNewParserCtxt(entry->source.c_str());
+    else
+        ctx = xmlSchemaNewMemParserCtxt(entry->source.data(), static_cast<int>(entry->source.size()));
+    
+    if ( ctx == nullptr )
+    {
+        entry->error = "Failed to create schema parser";
+        return;
+    }
+    
+    xmlSchemaSetParserStructuredErrors(ctx, RecordFirstError, &entry->error);
+    xmlSchemaPtr schema = xmlSchemaParse(ctx);
+    xmlSchemaFreeParserCtxt(ctx);
+    
+    if ( schema != nullptr )
+        entry->schema = CompiledSchema(schema, xmlSchemaFree);
+    else if ( entry->error.empty() )
+        entry->error = "unknown error";
+}
+bool SchemaPool::ValidateDocument(xmlDocPtr doc, string* error)
+{
+    xmlNodePtr root = xmlDocGetRootElement(doc);
+    if ( root == nullptr )
+        return true;
+    
+    CompiledSchema schema = SchemaForNamespace(root->ns != nullptr ? string(root->ns->href) : string());
+    if ( !schema )
+        return true;
+    
+    xmlSchemaValidCtxtPtr vctxt = xmlSchemaNewValidCtxt(schema.get());
+    if ( vctxt == nullptr )
+        throw InternalError("Failed to create schema validation context");
+    
+    string message;
+    xmlSchemaSetValidStructuredErrors(vctxt, RecordFirstError, &message);
+    int result = xmlSchemaValidateDoc(vctxt, doc);
+    xmlSchemaFreeValidCtxt(vctxt);
+    
+    if ( result != 0 && error != nullptr )
+        *error = (message.empty() ? string("document is not valid") : message);
+    
+    return result == 0;
+}
+xmlSchemaValidCtxtPtr SchemaPool::ValidateReader(xmlTextReaderPtr reader, const CompiledSchema& schema, string* error)
+{
+    xmlSchemaValidCtxtPtr vctxt = xmlSchemaNewValidCtxt(schema.get());
+    if ( vctxt == nullptr )
+        return nullptr;
+    
+    xmlSchemaSetValidStructuredErrors(vctxt, RecordFirstError, error);
+    if ( xmlTextReaderSchemaValidateCtxt(reader, vctxt, 0) != 0 )
+    {
+        xmlSchemaFreeValidCtxt(vctxt);
+        return nullptr;
+    }
+    
+    return vctxt;
+}
+xmlSchemaValidCtxtPtr SchemaPool::ValidateParse(xmlParserCtxtPtr ctxt, const CompiledSchema& schema, string* error, xmlSchemaSAXPlugPtr* plug)
+{
+    xmlSchemaValidCtxtPtr vctxt = xmlSchemaNewValidCtxt(schema.get());
+    if ( vctxt == nullptr )
+        return nullptr;
+    
+    xmlSchemaSetValidStructuredErrors(vctxt, RecordFirstError, error);
+    *plug = xmlSchemaSAXPlug(vctxt, &ctxt->sax, &ctxt->userData);
+    if ( *plug == nullptr )
+    {
+        xmlSchemaFreeValidCtxt(vctxt);
+        return nullptr;
+    }
+    
+    return vctxt;
+}
+
+EPUB3_XML_END_NAMESPACE
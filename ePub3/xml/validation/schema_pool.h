@@ -0,0 +1,147 @@
+//
+//  schema_pool.h
+//  ePub3
+//
+//  Copyright (c) 2012-2013 The Readium Foundation and contributors.
+//
+//  The Readium SDK is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+
+#ifndef __ePub3_xml_schema_pool__
+#define __ePub3_xml_schema_pool__
+
+#include <ePub3/xml/base.h>
+#include <ePub3/utilities/utfstring.h>
+#include <libxml/xmlschemas.h>
+#include <libxml/xmlreader.h>
+#include <map>
+#include <mutex>
+
+EPUB3_XML_BEGIN_NAMESPACE
+
+/**
+ A process-wide set of compiled W3C XML Schemas, keyed by target namespace.
+
+ Schemas are registered by namespace URI, either as a file path or as in-memory
+ data, and each is compiled only once: the first time it is needed. The compiled
+ schema is read-only from then on, and is shared by every thread which validates
+ a document in that namespace; each validation uses its own lightweight validation
+ context.
+
+ No schemas are registered by default, so nothing is validated until an
+ application supplies (for instance) OPF, OCF container, and NCX schemas.
+
+ @remarks All methods are thread-safe.
+
+ @ingroup validation
+ */
+class SchemaPool
+{
+public:
+    ///
+    /// A compiled schema; this keeps it alive while in use, even if unregistered.
+    typedef Shared<_xmlSchema>  CompiledSchema;
+
+    /**
+     Registers the schema stored in a file.
+     @param namespaceURI The namespace of the root elements of documents to validate.
+     @param path The filesystem path of an XSD document. It is not read until needed.
+     */
+    static void             RegisterSchemaFile(const string& namespaceURI, const string& path);
+    /**
+     Registers a schema held in memory.
+     @param namespaceURI The namespace of the root elements of documents to validate.
+     @param data The content of an XSD document.
+     */
+    static void             RegisterSchemaData(const string& namespaceURI, const std::string& data);
+    ///
+    /// Removes any schema registered for a namespace.
+    static void             UnregisterSchema(const string& namespaceURI);
+
+    ///
+    /// Whether a schema has been registered for a namespace.
+    static bool             HasSchemaForNamespace(const string& namespaceURI);
+
+    /**
+     Obtains the compiled schema for a namespace, compiling it if necessary.
+     @result The compiled schema, or `nullptr` if none is registered.
+     @throws ParserError if the registered schema could not be compiled.
+     */
+    static CompiledSchema   SchemaForNamespace(const string& namespaceURI);
+
+    /**
+     Validates a complete document against the schema for its root element's namespace.
+     @param doc The document to validate.
+     @param error If non-null, receives a description of the first error found.
+     @result `true` if the document is valid, or if no schema is registered for it.
+     @throws ParserError if the registered schema could not be compiled.
+     */
+    static bool             ValidateDocument(xmlDocPtr doc, string* error=nullptr);
+
+    /**
+     Prepares a streaming reader to validate its input as it is read.
+
+     This must be called before the first call to `xmlTextReaderRead()`. Once all
+     input has been read, `xmlTextReaderIsValid()` reports the outcome.
+     @param reader The reader.
+     @param schema The schema to validate against.
+     @param error Receives a description of the first error found. It must remain
+     valid until the returned context is freed.
+     @result A validation context, which the caller must release using
+     `xmlSchemaFreeValidCtxt()` after the reader has been freed, or `nullptr` if
+     validation could not be set up.
+     */
+    static xmlSchemaValidCtxtPtr ValidateReader(xmlTextReaderPtr reader, const CompiledSchema& schema, string* error);
+    
+    /**
+     Prepares a parser context to validate its input while it builds a tree from it.
+     
+     The schema's SAX handlers are plugged in front of the context's own, so the
+     document is validated in the same pass which parses it. This must be called
+     before anything is parsed using the context. Once the parse is complete,
+     `xmlSchemaIsValid()` reports the outcome; the caller must then call
+     `xmlSchemaSAXUnplug()` on `*plug` before releasing the validation context
+     using `xmlSchemaFreeValidCtxt()`.
+     @param ctxt The parser context.
+     @param schema The schema to validate against.
+     @param error Receives a description of the first error found. It must remain
+     valid until the returned context is freed.
+     @param plug Receives the SAX plug to remove after parsing.
+     @result A validation context, or `nullptr` if validation could not be set up.
+     */
+    static xmlSchemaValidCtxtPtr ValidateParse(xmlParserCtxtPtr ctxt, const CompiledSchema& schema, string* error, xmlSchemaSAXPlugPtr* plug);
+
+protected:
+    struct Entry
+    {
+        std::string         source;             ///< A file path, or the schema's content.
+        bool                isFile;
+        std::once_flag      compiled;
+        CompiledSchema      schema;
+        string              error;              ///< Why compilation failed, if it did.
+    };
+    typedef std::map<string, Shared<Entry>>     EntryMap;
+
+    static EntryMap         gEntries;
+    static std::mutex       gEntriesLock;
+
+    static void             Register(const string& namespaceURI, const std::string& source, bool isFile);
+    static void             Compile(Entry* entry);
+
+};
+
+EPUB3_XML_END_NAMESPACE
+
+#endif /* defined(__ePub3_xml_schema_pool__) */